@@ -38,7 +38,6 @@
 #include <graphlab/util/generics/conditional_addition_wrapper.hpp>
 #include <graphlab/util/generics/test_function_or_functor_type.hpp>
 
-#include <graphlab/util/generics/any.hpp>
 #include <graphlab/util/timer.hpp>
 #include <graphlab/util/mutable_queue.hpp>
 #include <graphlab/logger/assertions.hpp>
@@ -74,7 +73,13 @@ namespace graphlab {
    * tick_synchronous() and tick_asynchronous() should not be used 
    * simultaneously within the same engine execution . For details on their 
    * usage, see their respective documentation.
-   * 
+   *
+   * Accumulators are reduced across machines along a tree rooted at
+   * machine 0, so no machine merges more than a few accumulators, and
+   * are serialized with their own type rather than through an any.
+   * Every aggregator gets an id when it is added; the asynchronous
+   * reduction refers to aggregators by id. Aggregators must therefore be
+   * added in the same order on all machines.
    */
   template<typename Graph, typename IContext>
   class distributed_aggregator {
@@ -116,19 +121,20 @@ namespace graphlab {
                  Returns false if it is over edges.*/
       virtual bool is_vertex_map() const = 0;      
       
-      /** \brief Returns the accumulator stored in an any. 
-                 (by some magic, any's can be serialized) */
-      virtual any get_accumulator() const = 0;
-      
-      /** \brief Combines accumulators using a second accumulator 
-                 stored in an any (as returned by get_accumulator).
-                 Must be thread safe.*/
-      virtual void add_accumulator_any(any& other) = 0;
+      /** \brief Serializes the accumulator */
+      virtual void save_accumulator(oarchive& oarc) const = 0;
+
+      /** \brief Combines the accumulator with one serialized by
+                 save_accumulator(). Must be thread safe.*/
+      virtual void merge_accumulator(iarchive& iarc) = 0;
 
-      /** \brief Sets the value of the accumulator
-                 from an any (as returned by get_accumulator).
-                 Must be thread safe.*/
-      virtual void set_accumulator_any(any& other) = 0;
+      /** \brief Sets the accumulator to one serialized by
+                 save_accumulator(). Must be thread safe.*/
+      virtual void load_accumulator(iarchive& iarc) = 0;
+
+      /** \brief Sums the accumulators of all machines along the
+                 reduction tree. Must be called on all machines. */
+      virtual void all_reduce(dc_dist_object<distributed_aggregator>& rmi) = 0;
 
       
       /** \brief Combines accumulators using a second accumulator 
@@ -239,26 +245,33 @@ namespace graphlab {
         return vertex_map;
       }
       
-      any get_accumulator() const {
-        return any(acc);
+      void save_accumulator(oarchive& oarc) const {
+        oarc << acc;
       }
-      
-      void add_accumulator_any(any& other) {
+
+      void merge_accumulator(iarchive& iarc) {
+        // deserialize outside of the lock
+        conditional_addition_wrapper<ReductionType> other;
+        iarc >> other;
         lock.lock();
-        acc += other.as<conditional_addition_wrapper<ReductionType> >();
+        acc += other;
         lock.unlock();
       }
 
-      void set_accumulator_any(any& other) {
+      void load_accumulator(iarchive& iarc) {
         lock.lock();
-        acc = other.as<conditional_addition_wrapper<ReductionType> >();
+        iarc >> acc;
         lock.unlock();
       }
 
+      void all_reduce(dc_dist_object<distributed_aggregator>& rmi) {
+        rmi.all_reduce(acc);
+      }
 
       void add_accumulator(imap_reduce_base* other) {
+        // clones of the same aggregator always have the same type
         lock.lock();
-        acc += dynamic_cast<map_reduce_type*>(other)->acc;
+        acc += static_cast<map_reduce_type*>(other)->acc;
         lock.unlock();
       }
 
@@ -289,28 +302,114 @@ namespace graphlab {
     std::map<std::string, imap_reduce_base*> aggregators;
     std::map<std::string, float> aggregate_period;
 
+    /// The id of every aggregator, in the order they were added
+    std::map<std::string, size_t> key_ids;
+    std::vector<std::string> key_names;
+    /// The aggregator of every id
+    std::vector<imap_reduce_base*> id_aggregators;
+    /// The period of every id, resolved by start(). Negative if the
+    /// aggregator is not periodic.
+    std::vector<float> id_periods;
+
     struct async_aggregator_state {
-      /// Performs reduction of all local threads. On machine 0, also
-      /// accumulates for all machines.
+      /// Performs reduction of all local threads and of the subtrees of
+      /// the children of this machine in the reduction tree.
       imap_reduce_base* root_reducer;
       /// Accumulator used for each thread
       std::vector<imap_reduce_base*> per_thread_aggregation;
-      /// Count down the completion of the local machine threads
-      atomic<int> local_count_down;
-      /// Count down the completion of machines. Used only on machine 0
-      atomic<int> distributed_count_down;
+      /// Count down the local threads and the children still reducing
+      atomic<int> reduce_count_down;
+      /// Count down this machine and the children still finalizing
+      atomic<int> finalize_count_down;
+      async_aggregator_state() : root_reducer(NULL) { }
     };
-    std::map<std::string, async_aggregator_state> async_state;
+    /// Indexed by aggregator id. Only periodic aggregators have a
+    /// root_reducer.
+    std::vector<async_aggregator_state> async_state;
 
     float start_time;
     
     /* annoyingly the mutable queue is a max heap when I need a min-heap
      * to track the next thing to activate. So we need to keep 
      *  negative priorities... */
-    mutable_queue<std::string, float> schedule;
+    mutable_queue<size_t, float> schedule;
     mutex schedule_lock;
     size_t ncpus;
 
+    /// The reduction tree is a binary heap over the machines
+    procid_t tree_parent() const { return (rmi.procid() - 1) / 2; }
+    procid_t tree_child(size_t i) const { return 2 * rmi.procid() + 1 + i; }
+    size_t tree_num_children() const {
+      size_t n = 0;
+      for (size_t i = 0; i < 2; ++i) n += tree_child(i) < rmi.numprocs();
+      return n;
+    }
+
+    /// Assigns an id to a new aggregator
+    void add_key(const std::string& key, imap_reduce_base* mr) {
+      aggregators[key] = mr;
+      key_ids[key] = key_names.size();
+      key_names.push_back(key);
+      id_aggregators.push_back(mr);
+    }
+
+    /// Checks that the aggregators were added in the same order everywhere
+    void check_key_ids() {
+      std::vector<std::vector<std::string> > all_names(rmi.numprocs());
+      all_names[rmi.procid()] = key_names;
+      rmi.all_gather(all_names);
+      for (procid_t i = 0; i < rmi.numprocs(); ++i) {
+        if (all_names[i] != key_names) {
+          logstream(LOG_FATAL) << "Aggregators must be added in the same "
+                               << "order on all machines" << std::endl;
+        }
+      }
+    }
+
+    /**
+     * Maps over the local data in parallel and sums the accumulators of
+     * all machines along the reduction tree.
+     */
+    void aggregate_now(size_t id) {
+      imap_reduce_base* mr = id_aggregators[id];
+      mr->clear_accumulator();
+      // ok. now we perform reduction on local data in parallel
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+      {
+        imap_reduce_base* localmr = mr->clone_empty();
+        if (localmr->is_vertex_map()) {
+#ifdef _OPENMP
+        #pragma omp for
+#endif
+          for (int i = 0; i < (int)graph.num_local_vertices(); ++i) {
+            local_vertex_type lvertex = graph.l_vertex(i);
+            if (lvertex.owner() == rmi.procid()) {
+              vertex_type vertex(lvertex);
+              localmr->perform_map_vertex(*context, vertex);
+            }
+          }
+        }
+        else {
+#ifdef _OPENMP
+        #pragma omp for
+#endif
+          for (int i = 0; i < (int)graph.num_local_vertices(); ++i) {
+            foreach(local_edge_type e, graph.l_vertex(i).in_edges()) {
+              edge_type edge(e);
+              localmr->perform_map_edge(*context, edge);
+            }
+          }
+        }
+        mr->add_accumulator(localmr);
+        delete localmr;
+      }
+      mr->all_reduce(rmi);
+      mr->finalize(*context);
+      mr->clear_accumulator();
+    }
+
     template <typename ReductionType, typename F>
     static void test_vertex_mapper_type(std::string key = "") {
       bool test_result = test_function_or_const_functor_2<F,
@@ -404,11 +503,11 @@ namespace graphlab {
           test_vertex_mapper_type<ReductionType, VertexMapperType>(key);
         }
         
-        aggregators[key] = new map_reduce_type<ReductionType,
+        add_key(key, new map_reduce_type<ReductionType,
                                                VertexMapperType,
                                                typename default_map_types<ReductionType>::edge_map_type,
                                                FinalizerType>(map_function, 
-                                                             finalize_function);
+                                                             finalize_function));
         return true;
       }
       else {
@@ -435,11 +534,11 @@ namespace graphlab {
       typedef decltype(map_function(*context, graph.vertex(0))) ReductionType;
       if (key.length() == 0) return false;
       if (aggregators.count(key) == 0) {
-        aggregators[key] = new map_reduce_type<ReductionType,
+        add_key(key, new map_reduce_type<ReductionType,
                                                VertexMapperType,
                                                typename default_map_types<ReductionType>::edge_map_type,
                                                FinalizerType>(map_function, 
-                                                             finalize_function);
+                                                             finalize_function));
         return true;
       }
       else {
@@ -464,12 +563,12 @@ namespace graphlab {
           // do a runtime type check
           test_edge_mapper_type<ReductionType, EdgeMapperType>(key);
         }
-        aggregators[key] = new map_reduce_type<ReductionType, 
+        add_key(key, new map_reduce_type<ReductionType, 
                                             typename default_map_types<ReductionType>::vertex_map_type,
                                             EdgeMapperType, 
                                             FinalizerType>(map_function, 
                                                            finalize_function, 
-                                                           true);
+                                                           true));
         return true;
       }
       else {
@@ -497,12 +596,12 @@ namespace graphlab {
       typedef decltype(map_function(*context, edge_type(graph.l_vertex(0).in_edges()[0]) )) ReductionType;
       if (key.length() == 0) return false;
       if (aggregators.count(key) == 0) {
-        aggregators[key] = new map_reduce_type<ReductionType, 
+        add_key(key, new map_reduce_type<ReductionType, 
                                             typename default_map_types<ReductionType>::vertex_map_type,
                                             EdgeMapperType, 
                                             FinalizerType>(map_function, 
                                                            finalize_function, 
-                                                           true);
+                                                           true));
         return true;
       }
       else {
@@ -521,70 +620,7 @@ namespace graphlab {
         ASSERT_MSG(false, "Requested aggregator %s not found", key.c_str());
         return false;
       }
-      
-      imap_reduce_base* mr = aggregators[key];
-      mr->clear_accumulator();
-      // ok. now we perform reduction on local data in parallel
-#ifdef _OPENMP
-#pragma omp parallel
-#endif
-      {
-        imap_reduce_base* localmr = mr->clone_empty();
-        if (localmr->is_vertex_map()) {
-#ifdef _OPENMP
-        #pragma omp for
-#endif
-          for (int i = 0; i < (int)graph.num_local_vertices(); ++i) {
-            local_vertex_type lvertex = graph.l_vertex(i);
-            if (lvertex.owner() == rmi.procid()) {
-              vertex_type vertex(lvertex);
-              localmr->perform_map_vertex(*context, vertex);
-            }
-          }
-        }
-        else {
-#ifdef _OPENMP
-        #pragma omp for
-#endif
-          for (int i = 0; i < (int)graph.num_local_vertices(); ++i) {
-            foreach(local_edge_type e, graph.l_vertex(i).in_edges()) {
-              edge_type edge(e);
-              localmr->perform_map_edge(*context, edge);
-            }
-          }
-        }
-#ifdef _OPENMP
-        #pragma omp critical
-#endif
-        {
-          mr->add_accumulator(localmr);
-        }
-        delete localmr;
-      }
-      
-      std::vector<any> gathervec(rmi.numprocs());
-      gathervec[rmi.procid()] = mr->get_accumulator();
-      
-      rmi.gather(gathervec, 0);
-      
-      if (rmi.procid() == 0) {
-        // machine 0 aggregates the accumulators
-        // sums them together and broadcasts it
-        for (procid_t i = 1; i < rmi.numprocs(); ++i) {
-          mr->add_accumulator_any(gathervec[i]);
-        }
-        any val = mr->get_accumulator();
-        rmi.broadcast(val, true);
-      }
-      else {
-        // all other machines wait for the broadcast value
-        any val;
-        rmi.broadcast(val, false);
-        mr->set_accumulator_any(val);
-      }
-      mr->finalize(*context);
-      mr->clear_accumulator();
-      gathervec.clear();
+      aggregate_now(key_ids[key]);
       return true;
     }
     
@@ -626,91 +662,92 @@ namespace graphlab {
      */
     void start(size_t ncpus = 0) {
       rmi.barrier();
+      check_key_ids();
       schedule.clear();
       start_time = timer::approx_time_seconds();
+      id_periods.assign(key_names.size(), -1);
       typename std::map<std::string, float>::iterator iter =
                                                     aggregate_period.begin();
       while (iter != aggregate_period.end()) {
+        size_t id = key_ids[iter->first];
+        id_periods[id] = iter->second;
         // schedule is a max heap. To treat it like a min heap
         // I need to insert negative keys
-        schedule.push(iter->first, -iter->second);
+        schedule.push(id, -iter->second);
         ++iter;
       }
       this->ncpus = ncpus;
 
       // now initialize the asyncronous reduction states
       if(ncpus > 0) {
-        iter = aggregate_period.begin();
-        while (iter != aggregate_period.end()) {
-          async_state[iter->first].local_count_down = (int)ncpus;
-          async_state[iter->first].distributed_count_down =
-                                                        (int)rmi.numprocs();
-          
-          async_state[iter->first].per_thread_aggregation.resize(ncpus);
+        async_state.resize(key_names.size());
+        for (size_t id = 0; id < id_periods.size(); ++id) {
+          if (id_periods[id] < 0) continue;
+          async_aggregator_state& state = async_state[id];
+          state.reduce_count_down = (int)(ncpus + tree_num_children());
+          state.finalize_count_down = (int)(1 + tree_num_children());
+          state.per_thread_aggregation.resize(ncpus);
           for (size_t i = 0; i < ncpus; ++i) {
-            async_state[iter->first].per_thread_aggregation[i] =
-                                    aggregators[iter->first]->clone_empty();
+            state.per_thread_aggregation[i] = id_aggregators[id]->clone_empty();
           }
-          async_state[iter->first].root_reducer =
-                                      aggregators[iter->first]->clone_empty();
-          ++iter;
+          state.root_reducer = id_aggregators[id]->clone_empty();
         }
+        // children may start reducing as soon as they return from start()
+        rmi.barrier();
       }
     }
     
+    /// An id returned by tick_asynchronous() when there is nothing to run
+    static const size_t NO_KEY = size_t(-1);
     
     /**
      * If asynchronous aggregation is desired, this function is
      * to be called periodically on each machine. This polls the schedule to
      * check if there is an aggregator which needs to be activated. If there
-     * is an aggregator to be started, this function will return a non empty
-     * string. This function is thread reentrant and each activated aggregator
-     * will only return a non empty string call to one call to
+     * is an aggregator to be started, this function will return its id,
+     * and NO_KEY otherwise. This function is thread reentrant and each
+     * activated aggregator will only be returned by one call to
      * tick_asynchronous() on each machine.
      * 
-     * If an empty is returned, the asynchronous engine
+     * If an id is returned, the asynchronous engine
      * must ensure that all threads (ncpus per machine) must eventually
-     * call tick_asynchronous_compute(cpuid, key) where key is the return string.
+     * call tick_asynchronous_compute(cpuid, id) where id is the returned id.
      */ 
-    std::string tick_asynchronous() {
+    size_t tick_asynchronous() {
       // if we fail to acquire the lock, go ahead
-      if (!schedule_lock.try_lock()) return "";
+      if (!schedule_lock.try_lock()) return NO_KEY;
       
       // see if there is a key to run
       float curtime = timer::approx_time_seconds() - start_time;
-      std::string key;
-      bool has_entry = false;
+      size_t id = NO_KEY;
       if (!schedule.empty() && -schedule.top().second <= curtime) {
-        key = schedule.top().first;
-        has_entry = true;
+        id = schedule.top().first;
         schedule.pop();
       }
       schedule_lock.unlock();
-
-      // no key to run. return false
-      if (has_entry == false) return "";
-      else return key;
-      // ok. we have a key to run, construct the local reducers
+      return id;
     }
 
     
     /**
-     * Once tick_asynchronous() returns a key, all threads in the engine
-     * should call tick_asynchronous_compute() with a matching key.
-     * This function will perform the computation for the key in question
-     * and send the accumulated result back to machine 0 when done
+     * Once tick_asynchronous() returns an id, all threads in the engine
+     * should call tick_asynchronous_compute() with a matching id.
+     * This function will perform the computation for the key in question.
+     * The accumulators of all machines are then merged along the
+     * reduction tree.
      */
-    void tick_asynchronous_compute(size_t cpuid, const std::string& key) {
-      // acquire and check the async_aggregator_state
-      typename std::map<std::string, async_aggregator_state>::iterator iter =
-                                                        async_state.find(key);
-      ASSERT_MSG(iter != async_state.end(), "Key %s not found", key.c_str());
-      ASSERT_GT(iter->second.per_thread_aggregation.size(), cpuid);
+    void tick_asynchronous_compute(size_t cpuid, size_t id) {
+      ASSERT_LT(id, async_state.size());
+      async_aggregator_state& state = async_state[id];
+      ASSERT_GT(state.per_thread_aggregation.size(), cpuid);
       
-      imap_reduce_base* localmr = iter->second.per_thread_aggregation[cpuid];
-      // perform the reduction using the local mr
+      imap_reduce_base* localmr = state.per_thread_aggregation[cpuid];
+      // every thread maps a contiguous range of the local vertices
+      const int nverts = (int)graph.num_local_vertices();
+      const int begin = (int)(size_t(nverts) * cpuid / ncpus);
+      const int end = (int)(size_t(nverts) * (cpuid + 1) / ncpus);
       if (localmr->is_vertex_map()) {
-        for (int i = cpuid;i < (int)graph.num_local_vertices(); i+=ncpus) {
+        for (int i = begin; i < end; ++i) {
           local_vertex_type lvertex = graph.l_vertex(i);
           if (lvertex.owner() == rmi.procid()) {
             vertex_type vertex(lvertex);
@@ -718,141 +755,114 @@ namespace graphlab {
           }
         }
       } else {
-        for (int i = cpuid;i < (int)graph.num_local_vertices(); i+=ncpus) {
+        for (int i = begin; i < end; ++i) {
           foreach(local_edge_type e, graph.l_vertex(i).in_edges()) {
             edge_type edge(e);
             localmr->perform_map_edge(*context, edge);
           }
         }
       }
-      iter->second.root_reducer->add_accumulator(localmr);
-      int countdown_val = iter->second.local_count_down.dec();
-
-      ASSERT_LT(countdown_val, ncpus);
-      ASSERT_GE(countdown_val, 0);
-      if (countdown_val == 0) {
-        // reset the async_state to pristine condition.
-        // - clear all thread reducers since we got all we need from them
-        // - clear all the local root reducer except for machine 0 (and after
-        //   we read the accumulator from them.
-        // - reset the counters
-        for (size_t i = 0;
-             i < iter->second.per_thread_aggregation.size(); ++i) {
-          iter->second.per_thread_aggregation[i]->clear_accumulator();
-        }
-        iter->second.local_count_down = ncpus;
-        
-        if (rmi.procid() != 0) {
-          // ok we need to signal back to the the root to perform finalization
-          // read the accumulator
-          any acc = iter->second.root_reducer->get_accumulator();
-          iter->second.root_reducer->clear_accumulator();
-          rmi.remote_call(0, &distributed_aggregator::rpc_key_merge,
-                          key, acc);
-        }
-        else {
-          decrement_distributed_counter(key);
-        }
-      }
+      state.root_reducer->add_accumulator(localmr);
+      localmr->clear_accumulator();
+      decrement_reduce_counter(id);
     }
 
     /**
-     * RPC Call called by other machines with their accumulator for the key.
-     * This function will merge the accumulator and perform finalization
-     * when all accumulators are received
+     * RPC Call called by the children of this machine in the reduction
+     * tree with the accumulator of their subtree.
      */
-    void rpc_key_merge(const std::string& key, any& acc) {
-      // acquire and check the async_aggregator_state 
-      typename std::map<std::string, async_aggregator_state>::iterator iter =
-                                                      async_state.find(key);
-      ASSERT_MSG(iter != async_state.end(), "Key %s not found", key.c_str());
-      iter->second.root_reducer->add_accumulator_any(acc);
-      decrement_distributed_counter(key);
+    void rpc_child_merge(size_t id, const std::string& acc) {
+      ASSERT_LT(id, async_state.size());
+      iarchive iarc(acc.c_str(), acc.length());
+      async_state[id].root_reducer->merge_accumulator(iarc);
+      decrement_reduce_counter(id);
     }
 
     /**
-     * Called whenever one machine finishes all of its local accumulation.
-     * When the counter determines that all machine's accumulators have been
-     * received, this function performs finalization and prepares and
-     * broadcasts the next scheduled time for the key.
+     * Called whenever a local thread or a child finishes its
+     * accumulation. When the whole subtree is done, its accumulator is
+     * sent to the parent. On machine 0 the reduction is complete, and
+     * finalization starts down the tree.
      */
-    void decrement_distributed_counter(const std::string& key) {
-      // must be master machine
-      ASSERT_EQ(rmi.procid(), 0);
-      // acquire and check the async_aggregator_state 
-      typename std::map<std::string, async_aggregator_state>::iterator iter =
-                                                      async_state.find(key);
-      ASSERT_MSG(iter != async_state.end(), "Key %s not found", key.c_str());
-      int countdown_val = iter->second.distributed_count_down.dec();
-      logstream(LOG_INFO) << "Distributed Aggregation of " << key << ". "
-                          << countdown_val << " remaining." << std::endl;
-
-      ASSERT_LE(countdown_val, rmi.numprocs());
+    void decrement_reduce_counter(size_t id) {
+      async_aggregator_state& state = async_state[id];
+      int countdown_val = state.reduce_count_down.dec();
       ASSERT_GE(countdown_val, 0);
-      if (countdown_val == 0) {
-        logstream(LOG_INFO) << "Aggregate completion of " << key << std::endl;
-        any acc_val = iter->second.root_reducer->get_accumulator();
-        // set distributed count down again for the second phase:
-        // waiting for everyone to finish finalization
-        iter->second.distributed_count_down = rmi.numprocs();
-        for (procid_t i = 1;i < rmi.numprocs(); ++i) {
-          rmi.remote_call(i, &distributed_aggregator::rpc_perform_finalize,
-                            key, acc_val);
-        }
-        iter->second.root_reducer->finalize(*context);
-        iter->second.root_reducer->clear_accumulator();
-        decrement_finalize_counter(key);
+      if (countdown_val > 0) return;
+      // reset the counter for the next round
+      state.reduce_count_down = (int)(ncpus + tree_num_children());
+      oarchive oarc;
+      state.root_reducer->save_accumulator(oarc);
+      std::string acc(oarc.buf, oarc.off);
+      free(oarc.buf);
+      if (rmi.procid() != 0) {
+        state.root_reducer->clear_accumulator();
+        rmi.remote_call(tree_parent(), &distributed_aggregator::rpc_child_merge,
+                        id, acc);
+      } else {
+        logstream(LOG_INFO) << "Aggregate completion of " << key_names[id]
+                            << std::endl;
+        rpc_perform_finalize(id, acc);
       }
     }
 
     /**
-     * Called from the root machine to all machines to perform finalization
-     * on the key
+     * Called down the reduction tree with the complete accumulator
+     * to perform finalization on the key
      */
-    void rpc_perform_finalize(const std::string& key, any& acc_val) {
-      ASSERT_NE(rmi.procid(), 0);
-      typename std::map<std::string, async_aggregator_state>::iterator iter =
-                                                  async_state.find(key);
-      ASSERT_MSG(iter != async_state.end(), "Key %s not found", key.c_str());
-      
-      iter->second.root_reducer->set_accumulator_any(acc_val);
-      iter->second.root_reducer->finalize(*context);
-      iter->second.root_reducer->clear_accumulator();
-      // reply to the root machine
-      rmi.remote_call(0, &distributed_aggregator::decrement_finalize_counter,
-                      key);
+    void rpc_perform_finalize(size_t id, const std::string& acc) {
+      for (size_t i = 0; i < tree_num_children(); ++i) {
+        rmi.remote_call(tree_child(i),
+                        &distributed_aggregator::rpc_perform_finalize,
+                        id, acc);
+      }
+      async_aggregator_state& state = async_state[id];
+      if (rmi.procid() != 0) {
+        iarchive iarc(acc.c_str(), acc.length());
+        state.root_reducer->load_accumulator(iarc);
+      }
+      state.root_reducer->finalize(*context);
+      state.root_reducer->clear_accumulator();
+      decrement_finalize_counter(id);
     }
 
-
-    void decrement_finalize_counter(const std::string& key) {
-      typename std::map<std::string, async_aggregator_state>::iterator iter =
-                                                      async_state.find(key);
-      ASSERT_MSG(iter != async_state.end(), "Key %s not found", key.c_str());
-      int countdown_val = iter->second.distributed_count_down.dec();
-      if (countdown_val == 0) {
+    /**
+     * Called when this machine or a child subtree has finalized. When the
+     * whole tree has, machine 0 schedules the next run of the key.
+     */
+    void decrement_finalize_counter(size_t id) {
+      async_aggregator_state& state = async_state[id];
+      int countdown_val = state.finalize_count_down.dec();
+      ASSERT_GE(countdown_val, 0);
+      if (countdown_val > 0) return;
+      state.finalize_count_down = (int)(1 + tree_num_children());
+      if (rmi.procid() != 0) {
+        rmi.remote_call(tree_parent(),
+                        &distributed_aggregator::decrement_finalize_counter,
+                        id);
+      } else {
         // done! all finalization is complete.
-        // reset the counter
-        iter->second.distributed_count_down = rmi.numprocs();
         // when is the next time we start. 
         // time is as an offset to start_time
         float next_time = timer::approx_time_seconds() + 
-                          aggregate_period[key] - start_time;
-        logstream(LOG_INFO) << rmi.procid() << "Reschedule of " << key
-                          << " at " << next_time << std::endl;
-        rpc_schedule_key(key, next_time);
-        for (procid_t i = 1;i < rmi.numprocs(); ++i) {
-          rmi.remote_call(i, &distributed_aggregator::rpc_schedule_key,
-                            key, next_time);
-        }
+                          id_periods[id] - start_time;
+        logstream(LOG_INFO) << "Reschedule of " << key_names[id]
+                            << " at " << next_time << std::endl;
+        rpc_schedule_key(id, next_time);
       }
     }
 
     /**
-     * Called to schedule the next trigger time for the key
+     * Called down the reduction tree to schedule the next trigger time
+     * for the key
      */
-    void rpc_schedule_key(const std::string& key, float next_time) {
+    void rpc_schedule_key(size_t id, float next_time) {
+      for (size_t i = 0; i < tree_num_children(); ++i) {
+        rmi.remote_call(tree_child(i), &distributed_aggregator::rpc_schedule_key,
+                        id, next_time);
+      }
       schedule_lock.lock();
-      schedule.push(key, -next_time);
+      schedule.push(id, -next_time);
       schedule_lock.unlock();
     }
 
@@ -871,17 +881,17 @@ namespace graphlab {
       // note that we do not call approx_time_seconds everytime
       // this ensures that each key will only be run at most once.
       // each time tick_synchronous is called.
-      std::vector<std::pair<std::string, float> > next_schedule;
+      std::vector<std::pair<size_t, float> > next_schedule;
       while(!schedule.empty() && -schedule.top().second <= curtime) {
-        std::string key = schedule.top().first;
-        aggregate_now(key);
+        size_t id = schedule.top().first;
+        aggregate_now(id);
         schedule.pop();
         // when is the next time we start. 
         // time is as an offset to start_time
         float next_time = (timer::approx_time_seconds() + 
-                           aggregate_period[key] - start_time);
+                           id_periods[id] - start_time);
         rmi.broadcast(next_time, rmi.procid() == 0);
-        next_schedule.push_back(std::make_pair(key, -next_time));
+        next_schedule.push_back(std::make_pair(id, -next_time));
       }
 
       for (size_t i = 0;i < next_schedule.size(); ++i) {
@@ -906,17 +916,13 @@ namespace graphlab {
       }
       // clear the asynchronous state
       {
-        typename std::map<std::string, async_aggregator_state>::iterator
-                                                  iter = async_state.begin();
-        while (iter != async_state.end()) {
-          delete iter->second.root_reducer;
-          for (size_t i = 0;
-               i < iter->second.per_thread_aggregation.size();
-               ++i) {
-            delete iter->second.per_thread_aggregation[i];
+        for (size_t i = 0; i < async_state.size(); ++i) {
+          delete async_state[i].root_reducer;
+          for (size_t j = 0;
+               j < async_state[i].per_thread_aggregation.size();
+               ++j) {
+            delete async_state[i].per_thread_aggregation[j];
           }
-          iter->second.per_thread_aggregation.clear();
-          ++iter;
         }
         async_state.clear();
       }
@@ -40,7 +40,9 @@
 #include <graphlab/options/graphlab_options.hpp>
 #include <graphlab/rpc/dc_dist_object.hpp>
 #include <graphlab/engine/distributed_chandy_misra.hpp>
+#include <graphlab/engine/distributed_ordered_locks.hpp>
 #include <graphlab/engine/message_array.hpp>
+#include <graphlab/engine/async_snapshot.hpp>
 
 #include <graphlab/util/tracepoint.hpp>
 #include <graphlab/util/memory_info.hpp>
@@ -51,6 +53,7 @@
 #include <graphlab/rpc/fiber_async_consensus.hpp>
 #include <graphlab/aggregation/distributed_aggregator.hpp>
 #include <graphlab/parallel/fiber_remote_request.hpp>
+#include <graphlab/util/lock_free_pool.hpp>
 #include <graphlab/macros_def.hpp>
 
 
@@ -199,7 +202,38 @@ namespace graphlab {
    * calls are guaranteed to be locally consistent. Can produce massive
    * increases in throughput at a consistency penalty.
    * \li \b nfibers (default: 10000) Number of fibers to use
-   * \li \b stacksize (default: 16384) Stacksize of each fiber.
+   * \li \b pin_fibers (default: true) If true, every fiber stays on the
+   * worker thread it was launched on. If false, idle worker threads may
+   * steal fibers from busy ones, which evens out the load when remote
+   * replies wake up fibers unevenly.
+   * \li \b stacksize (default: 16384) Stacksize of each fiber. Stacks are
+   * committed lazily, so a large value only costs memory for the depth
+   * actually used. The peak usage is logged at the end of the run.
+   * \li \b locking (default: chandy_misra) The distributed lock used when
+   * factorized is false. "ordered" selects a scheme whose local part is
+   * lock free and whose messages are batched per machine, which lowers
+   * locking latency but does not guarantee fairness.
+   * \sa distributed_ordered_locks
+   * \li \b remote_batch_size (default: 64) Number of gather/scatter
+   * requests to the same mirror machine which are coalesced into a single
+   * message. Partial batches are sent as soon as a worker runs out of
+   * fibers to run.
+   * \li \b snapshot_interval (default: 0) If positive, a consistent
+   * snapshot of the graph and of the pending messages is taken every
+   * snapshot_interval seconds while the engine runs, without stopping it.
+   * The first snapshot is a complete binary dump of the graph; later
+   * ones only hold the vertex and edge data which changed, and are
+   * written in the background. A snapshot in progress when the engine
+   * stops is completed before start() returns. The snapshot is only
+   * exact if factorized is false. \sa async_snapshot
+   * \li \b snapshot_path (default: "") The prefix of the snapshot files.
+   * Must be on a posix file system visible to the machine writing it.
+   * \li \b snapshot_resume (default: false) If true, the next call to
+   * start() resumes from the latest snapshot under snapshot_path. The
+   * graph must have been loaded with
+   * \ref graphlab::distributed_graph::load_binary "load_binary" from
+   * <tt>[snapshot_path]base_</tt> on the same number of machines. The
+   * gather cache and the aggregators are not restored.
    */
   template<typename VertexProgram>
   class async_consistent_engine: public iengine<VertexProgram> {
@@ -307,6 +341,28 @@ namespace graphlab {
     // context needs access to internal functions
     friend class context<async_consistent_engine>;
 
+    /**
+     * \internal
+     * The context of a task. Tags the signals of the task with its
+     * snapshot epoch.
+     */
+    class epoch_context : public context_type {
+      async_consistent_engine& engine;
+      size_t epoch;
+    public:
+      epoch_context(async_consistent_engine& engine, graph_type& graph,
+                    size_t epoch) :
+        context_type(engine, graph), engine(engine), epoch(epoch) { }
+      void signal(const vertex_type& vertex,
+                  const message_type& message = message_type()) {
+        engine.internal_signal(vertex, message, epoch);
+      }
+      void signal_vid(vertex_id_type vid,
+                      const message_type& message = message_type()) {
+        engine.internal_signal_gvid(vid, message, epoch);
+      }
+    };
+
     /// \internal \brief The type used to refer to vertices in the local graph
     typedef typename graph_type::local_vertex_type    local_vertex_type;
     /// \internal \brief The type used to refer to edges in the local graph
@@ -328,6 +384,12 @@ namespace graphlab {
     /// A pointer to the lock implementation
     distributed_chandy_misra<graph_type>* cmlocks;
 
+    /// The lock implementation used when locking is "ordered"
+    distributed_ordered_locks<graph_type>* ordered_locks;
+
+    /// engine option. The lock implementation: chandy_misra or ordered
+    std::string locking;
+
     /// Per vertex data locks
     std::vector<simple_spinlock> vertexlocks;
 
@@ -360,12 +422,23 @@ namespace graphlab {
     typedef typename iengine<VertexProgram>::aggregator_type aggregator_type;
     aggregator_type aggregator;
 
+    /// engine option. Seconds between snapshots. 0 disables them.
+    double snapshot_interval;
+    /// engine option. The prefix of the snapshot files
+    std::string snapshot_path;
+    /// engine option. Resume from the latest snapshot on the next start()
+    bool snapshot_resume;
+    typedef async_snapshot<graph_type, message_type> snapshot_type;
+    snapshot_type snapshot;
+
     /// Number of kernel threads
     size_t ncpus;
     /// Size of each fiber stack
     size_t stacksize;
     /// Number of fibers
     size_t nfibers;
+    /// If true, each fiber only runs on the worker it was launched on
+    bool pin_fibers;
     /// set to true if engine is started
     bool started;
 
@@ -384,6 +457,95 @@ namespace graphlab {
       size_t fiber_handle;
     };
     std::vector<vertex_fiber_cm_handle*> cm_handles;
+    /// At most one handle per fiber is in use, so the pool never runs out
+    lock_free_pool<vertex_fiber_cm_handle> cm_handle_pool;
+
+    /**
+     * Heap allocations made by the engine while running tasks. Counts
+     * cm handles allocated outside of the pool, growth of the request
+     * batches, of the reply buffers and of the compare buffers below,
+     * and the batches deserialized by mirrors.
+     */
+    atomic<uint64_t> task_allocations;
+
+    /**
+     * Two buffers per worker used to compare the serialized vertex
+     * program before and after apply. The buffers only grow.
+     */
+    std::vector<oarchive> vprog_oarc;
+
+    /**
+     * \internal
+     * A gather or scatter request for a mirror. Requests to the same
+     * machine are batched and sent together in one message.
+     */
+    struct remote_task {
+      /// true for a scatter, false for a gather
+      bool is_scatter;
+      /// false if the mirror should reuse the vertex program received
+      /// with the previous request for this vertex.
+      bool has_vprog;
+      vertex_id_type vid;
+      /// address of the remote_wait on the master
+      size_t handle;
+      /// the snapshot epoch of the task
+      size_t epoch;
+      vertex_program_type vprog;
+      /// the new vertex data. Only sent with a scatter.
+      vertex_data_type data;
+
+      void save(oarchive& oarc) const {
+        oarc << is_scatter << has_vprog << vid << handle;
+        serialize_varint(oarc, epoch);
+        if (has_vprog) oarc << vprog;
+        if (is_scatter) oarc << data;
+      }
+      void load(iarchive& iarc) {
+        iarc >> is_scatter >> has_vprog >> vid >> handle;
+        deserialize_varint(iarc, epoch);
+        if (has_vprog) iarc >> vprog;
+        if (is_scatter) iarc >> data;
+      }
+    };
+
+    /// \internal The reply to a remote_task.
+    struct remote_reply {
+      size_t handle;
+      conditional_gather_type accum;
+      void save(oarchive& oarc) const { oarc << handle << accum; }
+      void load(iarchive& iarc) { iarc >> handle >> accum; }
+    };
+
+    /**
+     * \internal
+     * Lives on the stack of the fiber running a vertex program while
+     * it waits for the replies of the mirrors.
+     */
+    struct remote_wait {
+      mutex lock;
+      size_t fiber_handle;
+      size_t remaining;
+      conditional_gather_type accum;
+      remote_wait(size_t remaining):
+          fiber_handle(fiber_control::get_tid()), remaining(remaining) { }
+    };
+
+    /// Requests waiting to be sent to each machine
+    std::vector<std::vector<remote_task> > remote_tasks;
+    /// A second buffer per machine, swapped in while a full batch is sent
+    std::vector<std::vector<remote_task> > spare_remote_tasks;
+    std::vector<padded_simple_spinlock> remote_tasks_lock;
+    size_t remote_batch_size;
+    /// The reply buffer for the batches of each machine, reused by mirrors
+    std::vector<std::vector<remote_reply> > spare_replies;
+    std::vector<padded_simple_spinlock> spare_replies_lock;
+
+    /**
+     * The vertex program received by this mirror with the last gather
+     * of each vertex. Scatters reuse it when the program did not change
+     * during apply.
+     */
+    std::vector<vertex_program_type> mirror_programs;
 
     dense_bitset program_running;
     dense_bitset hasnext;
@@ -413,7 +575,7 @@ namespace graphlab {
     execution_status::status_enum termination_reason;
 
     std::vector<mutex> aggregation_lock;
-    std::vector<std::deque<std::string> > aggregation_queue;
+    std::vector<std::deque<size_t> > aggregation_queue;
   public:
 
     /**
@@ -439,13 +601,21 @@ namespace graphlab {
                             graph_type& graph,
                             const graphlab_options& opts = graphlab_options()) :
         rmi(dc, this), graph(graph), scheduler_ptr(NULL),
-        aggregator(dc, graph, new context_type(*this, graph)), started(false),
+        aggregator(dc, graph, new context_type(*this, graph)),
+        snapshot(dc, graph, messages), started(false),
         engine_start_time(timer::approx_time_seconds()), force_stop(false) {
       rmi.barrier();
 
       nfibers = 10000;
+      pin_fibers = true;
       stacksize = 16384;
       use_cache = false;
+      remote_batch_size = 64;
+      snapshot_interval = 0;
+      snapshot_resume = false;
+      cmlocks = NULL;
+      ordered_locks = NULL;
+      locking = "chandy_misra";
       factorized_consistency = true;
       track_task_time = false;
       timed_termination = (size_t)(-1);
@@ -453,6 +623,8 @@ namespace graphlab {
       set_options(opts);
       init();
       total_completion_time.resize(fiber_control::get_instance().num_workers());
+      vprog_oarc.resize(2 * fiber_control::get_instance().num_workers());
+      cm_handle_pool.reset_pool(nfibers);
       init();
       rmi.barrier();
     }
@@ -488,6 +660,10 @@ namespace graphlab {
           opts.get_engine_args().get_option("nfibers", nfibers);
           if (rmi.procid() == 0)
             logstream(LOG_EMPH) << "Engine Option: nfibers = " << nfibers << std::endl;
+        } else if (opt == "pin_fibers") {
+          opts.get_engine_args().get_option("pin_fibers", pin_fibers);
+          if (rmi.procid() == 0)
+            logstream(LOG_EMPH) << "Engine Option: pin_fibers = " << pin_fibers << std::endl;
         } else if (opt == "track_task_time") {
           opts.get_engine_args().get_option("track_task_time", track_task_time);
           if (rmi.procid() == 0)
@@ -500,10 +676,44 @@ namespace graphlab {
           opts.get_engine_args().get_option("use_cache", use_cache);
           if (rmi.procid() == 0)
             logstream(LOG_EMPH) << "Engine Option: use_cache = " << use_cache << std::endl;
+        } else if (opt == "locking") {
+          opts.get_engine_args().get_option("locking", locking);
+          if (locking != "chandy_misra" && locking != "ordered") {
+            logstream(LOG_FATAL) << "Unknown locking: " << locking << std::endl;
+          }
+          if (rmi.procid() == 0)
+            logstream(LOG_EMPH) << "Engine Option: locking = " << locking << std::endl;
+        } else if (opt == "remote_batch_size") {
+          opts.get_engine_args().get_option("remote_batch_size", remote_batch_size);
+          ASSERT_GE(remote_batch_size, 1);
+          if (rmi.procid() == 0)
+            logstream(LOG_EMPH) << "Engine Option: remote_batch_size = " << remote_batch_size << std::endl;
+        } else if (opt == "snapshot_interval") {
+          opts.get_engine_args().get_option("snapshot_interval", snapshot_interval);
+          if (rmi.procid() == 0)
+            logstream(LOG_EMPH) << "Engine Option: snapshot_interval = " << snapshot_interval << std::endl;
+        } else if (opt == "snapshot_path") {
+          opts.get_engine_args().get_option("snapshot_path", snapshot_path);
+          if (rmi.procid() == 0)
+            logstream(LOG_EMPH) << "Engine Option: snapshot_path = " << snapshot_path << std::endl;
+        } else if (opt == "snapshot_resume") {
+          opts.get_engine_args().get_option("snapshot_resume", snapshot_resume);
+          if (rmi.procid() == 0)
+            logstream(LOG_EMPH) << "Engine Option: snapshot_resume = " << snapshot_resume << std::endl;
         } else {
           logstream(LOG_FATAL) << "Unexpected Engine Option: " << opt << std::endl;
         }
       }
+      if ((snapshot_interval > 0 || snapshot_resume) &&
+          !incremental_snapshot<graph_type>::valid_prefix(snapshot_path)) {
+        logstream(LOG_FATAL) << "snapshot_path must be set to a posix path "
+                             << "to take or resume snapshots" << std::endl;
+      }
+      if (snapshot_interval > 0 && factorized_consistency && rmi.procid() == 0) {
+        logstream(LOG_WARNING) << "Snapshots are only exact with factorized=false"
+                               << std::endl;
+      }
+      snapshot.set_options(snapshot_interval, snapshot_path);
       opts_copy = opts;
       // set a default scheduler if none
       if (opts_copy.get_scheduler_type() == "") {
@@ -517,14 +727,7 @@ namespace graphlab {
       rmi.barrier();
 
       // create initial fork arrangement based on the alternate vid mapping
-      if (factorized_consistency == false) {
-        cmlocks = new distributed_chandy_misra<graph_type>(rmi.dc(), graph,
-                                                    boost::bind(&engine_type::lock_ready, this, _1));
-                                                    
-      }
-      else {
-        cmlocks = NULL;
-      }
+      create_locks();
 
       // construct the termination consensus object
       consensus = new fiber_async_consensus(rmi.dc(), nfibers);
@@ -545,6 +748,12 @@ namespace graphlab {
       vertexlocks.resize(graph.num_local_vertices());
       program_running.resize(graph.num_local_vertices());
       hasnext.resize(graph.num_local_vertices());
+      mirror_programs.resize(graph.num_local_vertices());
+      remote_tasks.resize(rmi.numprocs());
+      spare_remote_tasks.resize(rmi.numprocs());
+      remote_tasks_lock.resize(rmi.numprocs());
+      spare_replies.resize(rmi.numprocs());
+      spare_replies_lock.resize(rmi.numprocs());
       if (use_cache) {
         gather_cache.resize(graph.num_local_vertices(), gather_type());
         has_cache.resize(graph.num_local_vertices());
@@ -560,8 +769,10 @@ namespace graphlab {
 
   public:
     ~async_consistent_engine() {
+      for (size_t i = 0;i < vprog_oarc.size(); ++i) free(vprog_oarc[i].buf);
       delete consensus;
       delete cmlocks;
+      delete ordered_locks;
       delete scheduler_ptr;
     }
 
@@ -573,6 +784,16 @@ namespace graphlab {
       return programs_executed.value;
     }
 
+    /**
+     * \brief Returns the number of heap allocations made by the engine
+     * while running tasks in the last call to start(), summed over all
+     * machines.
+     */
+    size_t num_task_allocations() const {
+      return task_allocations.value;
+    }
+
+
 
 
 
@@ -600,13 +821,17 @@ namespace graphlab {
      * This is used to receive a message forwarded from another machine
      */
     void rpc_signal(vertex_id_type vid,
-                            const message_type& message) {
-      if (force_stop) return;
-      const lvid_type local_vid = graph.local_vid(vid);
-      double priority;
-      messages.add(local_vid, message, &priority);
-      scheduler_ptr->schedule(local_vid, priority);
-      consensus->cancel();
+                    const message_type& message,
+                    size_t epoch) {
+      snapshot.observe(epoch);
+      if (!force_stop) {
+        const lvid_type local_vid = graph.local_vid(vid);
+        double priority;
+        snapshot.add_message(local_vid, message, epoch, &priority);
+        scheduler_ptr->schedule(local_vid, priority);
+        consensus->cancel();
+      }
+      snapshot.received(epoch);
     }
 
     /**
@@ -618,6 +843,17 @@ namespace graphlab {
      */
     void internal_signal(const vertex_type& vtx,
                          const message_type& message = message_type()) {
+      internal_signal(vtx, message, snapshot.current_epoch());
+    }
+
+    /**
+     * \internal
+     * Signals a vertex with a message sent by a task of the given
+     * snapshot epoch.
+     */
+    void internal_signal(const vertex_type& vtx,
+                         const message_type& message,
+                         size_t epoch) {
       if (force_stop) return;
       if (started) {
         const typename graph_type::vertex_record& rec = graph.l_get_vertex_record(vtx.local_id());
@@ -626,11 +862,12 @@ namespace graphlab {
           // fast signal. push to the remote machine immediately
           if (owner != rmi.procid()) {
             const vertex_id_type vid = rec.gvid;
-            rmi.remote_call(owner, &engine_type::rpc_signal, vid, message);
+            snapshot.sent(epoch);
+            rmi.remote_call(owner, &engine_type::rpc_signal, vid, message, epoch);
           }
           else {
             double priority;
-            messages.add(vtx.local_id(), message, &priority);
+            snapshot.add_message(vtx.local_id(), message, epoch, &priority);
             scheduler_ptr->schedule(vtx.local_id(), priority);
             consensus->cancel();
           }
@@ -638,14 +875,14 @@ namespace graphlab {
         else {
 
           double priority;
-          messages.add(vtx.local_id(), message, &priority);
+          snapshot.add_message(vtx.local_id(), message, epoch, &priority);
           scheduler_ptr->schedule(vtx.local_id(), priority);
           consensus->cancel();
         }
       }
       else {
         double priority;
-        messages.add(vtx.local_id(), message, &priority);
+        snapshot.add_message(vtx.local_id(), message, epoch, &priority);
         scheduler_ptr->schedule(vtx.local_id(), priority);
         consensus->cancel();
       }
@@ -661,15 +898,31 @@ namespace graphlab {
      */
     void internal_signal_gvid(vertex_id_type gvid,
                               const message_type& message = message_type()) {
+      internal_signal_gvid(gvid, message, snapshot.current_epoch());
+    }
+
+    void internal_signal_gvid(vertex_id_type gvid,
+                              const message_type& message,
+                              size_t epoch) {
       if (force_stop) return;
       if (graph.is_master(gvid)) {
-        internal_signal(graph.vertex(gvid), message);
+        internal_signal(graph.vertex(gvid), message, epoch);
       } else {
         procid_t proc = graph.master(gvid);
-        rmi.remote_call(proc, &async_consistent_engine::internal_signal_gvid,
-                             gvid, message);
+        snapshot.sent(epoch);
+        rmi.remote_call(proc, &async_consistent_engine::rpc_signal_gvid,
+                             gvid, message, epoch);
       }
-    } 
+    }
+
+    /// \internal Receives a signal sent with internal_signal_gvid()
+    void rpc_signal_gvid(vertex_id_type gvid,
+                         const message_type& message,
+                         size_t epoch) {
+      snapshot.observe(epoch);
+      internal_signal_gvid(gvid, message, epoch);
+      snapshot.received(epoch);
+    }
 
 
     void rpc_internal_stop() {
@@ -757,6 +1010,7 @@ namespace graphlab {
                     const message_type& message = message_type(),
                     const std::string& order = "shuffle") {
       logstream(LOG_DEBUG) << rmi.procid() << ": Schedule All" << std::endl;
+      resize_to_graph();
       // allocate a vector with all the local owned vertices
       // and schedule all of them.
       std::vector<vertex_id_type> vtxs;
@@ -781,20 +1035,73 @@ namespace graphlab {
       rmi.barrier();
     }
 
+    void signal_changed(edge_dir_type neighborhood = ALL_EDGES,
+                        const message_type& message = message_type()) {
+      vertex_set vset = graph.changed_vertices();
+      if (neighborhood != NO_EDGES) vset |= graph.neighbors(vset, neighborhood);
+      signal_vset(vset, message);
+    }
+
 
   private: 
 
+    /**
+     * \internal
+     * Reinitializes the per vertex datastructures if vertices were added
+     * to the graph since the engine was constructed.
+     */
+    void resize_to_graph() {
+      // init() is collective, so all machines must agree on the decision
+      size_t graph_grew = (messages.size() != graph.num_local_vertices());
+      rmi.all_reduce(graph_grew);
+      if (graph_grew == 0) return;
+      init();
+      create_locks();
+    }
+
+    /**
+     * \internal
+     * (Re)creates the distributed locks if consistency is not factorized.
+     */
+    void create_locks() {
+      delete cmlocks;
+      delete ordered_locks;
+      cmlocks = NULL;
+      ordered_locks = NULL;
+      if (factorized_consistency) return;
+      if (locking == "ordered") {
+        ordered_locks = new distributed_ordered_locks<graph_type>(rmi.dc(), graph,
+                                                    boost::bind(&engine_type::lock_ready, this, _1),
+                                                    remote_batch_size);
+      } else {
+        cmlocks = new distributed_chandy_misra<graph_type>(rmi.dc(), graph,
+                                                    boost::bind(&engine_type::lock_ready, this, _1));
+      }
+      // lock grants carry the snapshot epoch so that tasks with
+      // overlapping scopes are ordered by epoch
+      if (snapshot.enabled()) {
+        boost::function<size_t()> current =
+            boost::bind(&snapshot_type::current_epoch, &snapshot);
+        boost::function<void(size_t)> observe =
+            boost::bind(&snapshot_type::observe, &snapshot, _1);
+        if (ordered_locks != NULL) ordered_locks->set_epoch_clock(current, observe);
+        else cmlocks->set_epoch_clock(current, observe);
+      }
+    }
+
     /**
      * Gets a task from the scheduler and the associated message
      */
     sched_status::status_enum get_next_sched_task( size_t threadid,
                                                   lvid_type& lvid,
-                                                  message_type& msg) {
+                                                  message_type& msg,
+                                                  size_t& epoch) {
       while (1) {
         sched_status::status_enum stat = 
             scheduler_ptr->get_next(threadid % ncpus, lvid);
         if (stat == sched_status::NEW_TASK) {
-          if (messages.get(lvid, msg)) return stat;
+          // the epoch is provisional until the task holds its locks
+          if (snapshot.get_message(lvid, msg, epoch)) return stat;
           else continue;
         }
         return stat;
@@ -816,18 +1123,23 @@ namespace graphlab {
     bool try_to_quit(size_t threadid,
                      bool& has_sched_msg,
                      lvid_type& sched_lvid,
-                     message_type &msg) {
+                     message_type &msg,
+                     size_t& epoch) {
       if (timer::approx_time_seconds() - engine_start_time > timed_termination) {
         termination_reason = execution_status::TIMEOUT;
         force_stop = true;
       }
+      // nothing to run, so nothing else will fill up the partial batches
+      flush_remote_tasks();
       fiber_control::yield();
       logstream(LOG_DEBUG) << rmi.procid() << "-" << threadid << ": " << "Termination Attempt " << std::endl;
       has_sched_msg = false;
       consensus->begin_done_critical_section(threadid);
       sched_status::status_enum stat = 
-          get_next_sched_task(threadid, sched_lvid, msg);
+          get_next_sched_task(threadid, sched_lvid, msg, epoch);
       if (stat == sched_status::EMPTY || force_stop) {
+        // a task taken while stopping is dropped
+        if (stat != sched_status::EMPTY) snapshot.leave(epoch);
         logstream(LOG_DEBUG) << rmi.procid() << "-" << threadid <<  ": "
                              << "\tTermination Double Checked" << std::endl;
 
@@ -871,13 +1183,12 @@ namespace graphlab {
     }
 
 
-    conditional_gather_type perform_gather(vertex_id_type vid,
-                               vertex_program_type& vprog_) {
-      vertex_program_type vprog = vprog_;
-      lvid_type lvid = graph.local_vid(vid);
+    conditional_gather_type perform_gather(lvid_type lvid,
+                                           vertex_program_type& vprog,
+                                           size_t epoch) {
       local_vertex_type local_vertex(graph.l_vertex(lvid));
       vertex_type vertex(local_vertex);
-      context_type context(*this, graph);
+      epoch_context context(*this, graph, epoch);
       edge_dir_type gather_dir = vprog.gather_edges(context, vertex);
       conditional_gather_type accum;
 
@@ -893,6 +1204,7 @@ namespace graphlab {
           lvid_type a = edge.source().local_id(), b = edge.target().local_id();
           vertexlocks[std::min(a,b)].lock();
           vertexlocks[std::max(a,b)].lock();
+          snapshot.capture_edge(local_edge.id(), epoch);
           accum += vprog.gather(context, vertex, edge);
           vertexlocks[a].unlock();
           vertexlocks[b].unlock();
@@ -905,6 +1217,7 @@ namespace graphlab {
           lvid_type a = edge.source().local_id(), b = edge.target().local_id();
           vertexlocks[std::min(a,b)].lock();
           vertexlocks[std::max(a,b)].lock();
+          snapshot.capture_edge(local_edge.id(), epoch);
           accum += vprog.gather(context, vertex, edge);
           vertexlocks[a].unlock();
           vertexlocks[b].unlock();
@@ -918,10 +1231,11 @@ namespace graphlab {
 
 
     void perform_scatter_local(lvid_type lvid,
-                               vertex_program_type& vprog) {
+                               vertex_program_type& vprog,
+                               size_t epoch) {
       local_vertex_type local_vertex(graph.l_vertex(lvid));
       vertex_type vertex(local_vertex);
-      context_type context(*this, graph);
+      epoch_context context(*this, graph, epoch);
       edge_dir_type scatter_dir = vprog.scatter_edges(context, vertex);
       if(scatter_dir == IN_EDGES || scatter_dir == ALL_EDGES) {
         foreach(local_edge_type local_edge, local_vertex.in_edges()) {
@@ -929,6 +1243,7 @@ namespace graphlab {
           lvid_type a = edge.source().local_id(), b = edge.target().local_id();
           vertexlocks[std::min(a,b)].lock();
           vertexlocks[std::max(a,b)].lock();
+          snapshot.capture_edge(local_edge.id(), epoch);
           vprog.scatter(context, vertex, edge);
           vertexlocks[a].unlock();
           vertexlocks[b].unlock();
@@ -940,6 +1255,7 @@ namespace graphlab {
           lvid_type a = edge.source().local_id(), b = edge.target().local_id();
           vertexlocks[std::min(a,b)].lock();
           vertexlocks[std::max(a,b)].lock();
+          snapshot.capture_edge(local_edge.id(), epoch);
           vprog.scatter(context, vertex, edge);
           vertexlocks[a].unlock();
           vertexlocks[b].unlock();
@@ -947,21 +1263,182 @@ namespace graphlab {
       } 
 
       // release locks
-      if (!factorized_consistency) {
+      if (ordered_locks != NULL) {
+        ordered_locks->philosopher_stops_eating_per_replica(lvid);
+      } else if (!factorized_consistency) {
         cmlocks->philosopher_stops_eating_per_replica(lvid);
       }
     }
 
 
-    void perform_scatter(vertex_id_type vid,
-                    vertex_program_type& vprog_,
-                    const vertex_data_type& newdata) {
-      vertex_program_type vprog = vprog_;
-      lvid_type lvid = graph.local_vid(vid);
-      vertexlocks[lvid].lock();
-      graph.l_vertex(lvid).data() = newdata;
-      vertexlocks[lvid].unlock();
-      perform_scatter_local(lvid, vprog);
+    /**
+     * \internal
+     * Queues a request for a mirror, sending the batch for that machine
+     * if it is full. In endgame mode requests are sent right away.
+     */
+    void send_remote_task(procid_t target, const remote_task& task) {
+      std::vector<remote_task> outgoing;
+      remote_tasks_lock[target].lock();
+      std::vector<remote_task>& batch = remote_tasks[target];
+      const size_t capacity = batch.capacity();
+      batch.push_back(task);
+      if (batch.capacity() != capacity) task_allocations.inc();
+      if (batch.size() >= remote_batch_size || endgame_mode) {
+        take_batch_locked(target, outgoing);
+      }
+      remote_tasks_lock[target].unlock();
+      if (!outgoing.empty()) send_batch(target, outgoing);
+    }
+
+    /// \internal Sends all partially filled batches
+    void flush_remote_tasks() {
+      if (ordered_locks != NULL) ordered_locks->flush();
+      for (procid_t i = 0; i < remote_tasks.size(); ++i) {
+        if (remote_tasks[i].empty()) continue;
+        std::vector<remote_task> outgoing;
+        remote_tasks_lock[i].lock();
+        if (!remote_tasks[i].empty()) take_batch_locked(i, outgoing);
+        remote_tasks_lock[i].unlock();
+        if (!outgoing.empty()) send_batch(i, outgoing);
+      }
+    }
+
+    /**
+     * \internal
+     * Moves the batch for target into outgoing and replaces it with the
+     * spare buffer. The lock of target must be held.
+     */
+    void take_batch_locked(procid_t target, std::vector<remote_task>& outgoing) {
+      outgoing.swap(remote_tasks[target]);
+      remote_tasks[target].swap(spare_remote_tasks[target]);
+    }
+
+    /**
+     * \internal
+     * Sends a batch taken with take_batch_locked() without holding the lock
+     * of target, then returns its buffer as the spare so that it is reused.
+     */
+    void send_batch(procid_t target, std::vector<remote_task>& outgoing) {
+      rmi.remote_call(target, &engine_type::rpc_remote_tasks,
+                      rmi.procid(), outgoing);
+      outgoing.clear();
+      remote_tasks_lock[target].lock();
+      if (spare_remote_tasks[target].capacity() < outgoing.capacity()) {
+        spare_remote_tasks[target].swap(outgoing);
+      }
+      remote_tasks_lock[target].unlock();
+    }
+
+    /**
+     * \internal
+     * Returns true if the two programs serialize differently. Must not
+     * yield, since the buffers are shared by all fibers of the worker.
+     */
+    bool program_changed(const vertex_program_type& a,
+                         const vertex_program_type& b) {
+      const size_t wid = fiber_control::get_worker_id();
+      oarchive& oarc_a = vprog_oarc[2 * wid];
+      oarchive& oarc_b = vprog_oarc[2 * wid + 1];
+      const size_t len = oarc_a.len + oarc_b.len;
+      oarc_a.off = 0; oarc_b.off = 0;
+      oarc_a << a; oarc_b << b;
+      if (oarc_a.len + oarc_b.len != len) task_allocations.inc();
+      return oarc_a.off != oarc_b.off ||
+          memcmp(oarc_a.buf, oarc_b.buf, oarc_a.off) != 0;
+    }
+
+    /**
+     * \internal
+     * Must be called before a fiber goes to sleep. If no other fiber can
+     * run on this worker, nothing else will fill up the partial batches,
+     * so they are sent.
+     */
+    void flush_remote_tasks_if_idle() {
+      if (!fiber_control::worker_has_fibers_on_queue()) flush_remote_tasks();
+    }
+
+    /// \internal Takes a cm handle from the pool, counting pool misses
+    vertex_fiber_cm_handle* alloc_cm_handle() {
+      vertex_fiber_cm_handle* handle = cm_handle_pool.alloc();
+      const std::vector<vertex_fiber_cm_handle>& pool =
+          cm_handle_pool.unsafe_get_pool_ref();
+      if (pool.empty() || handle < &pool.front() || handle > &pool.back()) {
+        task_allocations.inc();
+      }
+      return handle;
+    }
+
+    /**
+     * \internal
+     * Runs a batch of gathers and scatters on the mirrors of this machine
+     * and sends all the replies back to the master in one message.
+     */
+    void rpc_remote_tasks(procid_t origin, std::vector<remote_task>& tasks) {
+      // the batch was deserialized into a new vector
+      if (tasks.capacity() > 0) task_allocations.inc();
+      std::vector<remote_reply> replies;
+      spare_replies_lock[origin].lock();
+      replies.swap(spare_replies[origin]);
+      spare_replies_lock[origin].unlock();
+      const size_t capacity = replies.capacity();
+      replies.clear();
+      replies.resize(tasks.size());
+      if (replies.capacity() != capacity) task_allocations.inc();
+      for (size_t i = 0; i < tasks.size(); ++i) {
+        remote_task& task = tasks[i];
+        snapshot.observe(task.epoch);
+        const lvid_type lvid = graph.local_vid(task.vid);
+        vertex_program_type& vprog = mirror_programs[lvid];
+        if (task.has_vprog) vprog = task.vprog;
+        replies[i].handle = task.handle;
+        if (task.is_scatter) {
+          vertexlocks[lvid].lock();
+          snapshot.capture_vertex(lvid, task.epoch);
+          graph.l_vertex(lvid).data() = task.data;
+          vertexlocks[lvid].unlock();
+          perform_scatter_local(lvid, vprog, task.epoch);
+        } else {
+          replies[i].accum = perform_gather(lvid, vprog, task.epoch);
+        }
+      }
+      rmi.remote_call(origin, &engine_type::rpc_remote_replies, replies);
+      // the replies are serialized, so the buffer can be reused
+      spare_replies_lock[origin].lock();
+      if (spare_replies[origin].capacity() < replies.capacity()) {
+        spare_replies[origin].swap(replies);
+      }
+      spare_replies_lock[origin].unlock();
+      // the scatters may have released locks
+      if (ordered_locks != NULL) ordered_locks->flush();
+    }
+
+    /// \internal Receives the replies of a batch of remote tasks
+    void rpc_remote_replies(std::vector<remote_reply>& replies) {
+      foreach(remote_reply& reply, replies) {
+        remote_wait* wait = reinterpret_cast<remote_wait*>(reply.handle);
+        wait->lock.lock();
+        wait->accum += reply.accum;
+        --wait->remaining;
+        if (wait->remaining == 0) fiber_control::schedule_tid(wait->fiber_handle);
+        wait->lock.unlock();
+      }
+    }
+
+    /**
+     * \internal
+     * Sleeps until all mirrors have replied. remaining is only read with
+     * the lock held: the last reply still holds the lock after waking
+     * this fiber, and the wait must not leave the stack before it lets go.
+     */
+    void wait_for_mirrors(remote_wait& wait, size_t nmirrors) {
+      if (nmirrors == 0) return;
+      flush_remote_tasks_if_idle();
+      wait.lock.lock();
+      while (wait.remaining > 0) {
+        fiber_control::deschedule_self(&wait.lock.m_mut);
+        wait.lock.lock();
+      }
+      wait.lock.unlock();
     }
 
 
@@ -969,13 +1446,15 @@ namespace graphlab {
     // if returns false, the message has been dropped into the message array.
     // quit
     bool get_exclusive_access_to_vertex(const lvid_type lvid,
-                                        const message_type& msg) {
+                                        const message_type& msg,
+                                        size_t& epoch) {
       vertexlocks[lvid].lock();
       bool someone_else_running = program_running.set_bit(lvid);
       if (someone_else_running) {
         // bad. someone else is here.
         // drop it into the message array
-        messages.add(lvid, msg);
+        snapshot.begin_task(lvid, msg, epoch);
+        snapshot.add_message(lvid, msg, epoch);
         hasnext.set_bit(lvid);
       } 
       vertexlocks[lvid].unlock();
@@ -1008,7 +1487,8 @@ namespace graphlab {
      * should be true. Otherwise it should be false.
      */
     void eval_sched_task(const lvid_type lvid,
-                         const message_type& msg) {
+                         const message_type& msg,
+                         size_t& epoch) {
       const typename graph_type::vertex_record& rec = graph.l_get_vertex_record(lvid);
       vertex_id_type vid = rec.gvid;
       char task_time_data[sizeof(timer)];
@@ -1020,22 +1500,26 @@ namespace graphlab {
       }
       // if this is another machine's forward it
       if (rec.owner != rmi.procid()) {
-        rmi.remote_call(rec.owner, &engine_type::rpc_signal, vid, msg);
+        snapshot.begin_task(lvid, msg, epoch);
+        snapshot.sent(epoch);
+        rmi.remote_call(rec.owner, &engine_type::rpc_signal, vid, msg, epoch);
         return;
       }
       // I have to run this myself
       
-      if (!get_exclusive_access_to_vertex(lvid, msg)) return;
+      if (!get_exclusive_access_to_vertex(lvid, msg, epoch)) return;
 
       /**************************************************************************/
       /*                             Acquire Locks                              */
       /**************************************************************************/
       if (!factorized_consistency) {
         // begin lock acquisition
-        cm_handles[lvid] = new vertex_fiber_cm_handle;
+        cm_handles[lvid] = alloc_cm_handle();
         cm_handles[lvid]->philosopher_ready = false;
         cm_handles[lvid]->fiber_handle = fiber_control::get_tid();
-        cmlocks->make_philosopher_hungry(lvid);
+        if (ordered_locks != NULL) ordered_locks->make_philosopher_hungry(lvid);
+        else cmlocks->make_philosopher_hungry(lvid);
+        flush_remote_tasks_if_idle();
         cm_handles[lvid]->lock.lock();
         while (!cm_handles[lvid]->philosopher_ready) {
           fiber_control::deschedule_self(&(cm_handles[lvid]->lock.m_mut));
@@ -1043,11 +1527,15 @@ namespace graphlab {
         }
         cm_handles[lvid]->lock.unlock();
       }
+      // The scope is held, so the epoch of the task can be fixed. Lock
+      // grants carry epochs, so a task which held the scope before us
+      // cannot be in a later epoch.
+      snapshot.begin_task(lvid, msg, epoch);
 
       /**************************************************************************/
       /*                             Begin Program                              */
       /**************************************************************************/
-      context_type context(*this, graph);
+      epoch_context context(*this, graph, epoch);
       vertex_program_type vprog = vertex_program_type();
       local_vertex_type local_vertex(graph.l_vertex(lvid));
       vertex_type vertex(local_vertex);
@@ -1060,26 +1548,30 @@ namespace graphlab {
       /**************************************************************************/
       /*                              Gather Phase                              */
       /**************************************************************************/
+      const size_t nmirrors = local_vertex.num_mirrors();
+      remote_task task;
+      task.vid = vid;
+      task.epoch = epoch;
       conditional_gather_type gather_result;
-      std::vector<request_future<conditional_gather_type> > gather_futures;
-      foreach(procid_t mirror, local_vertex.mirrors()) {
-        gather_futures.push_back(
-            object_fiber_remote_request(rmi, 
-                                        mirror, 
-                                        &async_consistent_engine::perform_gather, 
-                                        vid,
-                                        vprog));
-      }
-      gather_result += perform_gather(vid, vprog);
-
-      for(size_t i = 0;i < gather_futures.size(); ++i) {
-        gather_result += gather_futures[i]();
+      remote_wait gather_wait(nmirrors);
+      if (nmirrors > 0) {
+        task.is_scatter = false;
+        task.has_vprog = true;
+        task.handle = reinterpret_cast<size_t>(&gather_wait);
+        task.vprog = vprog;
+        foreach(procid_t mirror, local_vertex.mirrors()) {
+          send_remote_task(mirror, task);
+        }
       }
+      gather_result += perform_gather(lvid, vprog, epoch);
+      wait_for_mirrors(gather_wait, nmirrors);
+      gather_result += gather_wait.accum;
 
      /**************************************************************************/
      /*                              apply phase                               */
      /**************************************************************************/
      vertexlocks[lvid].lock();
+     snapshot.capture_vertex(lvid, epoch);
      vprog.apply(context, vertex, gather_result.value);      
      vertexlocks[lvid].unlock();
 
@@ -1091,26 +1583,24 @@ namespace graphlab {
      // should I wait for the scatter? nah... but in case you want to
      // the code is commented below
      /*foreach(procid_t mirror, local_vertex.mirrors()) {
-       rmi.remote_call(mirror, 
-                       &async_consistent_engine::perform_scatter, 
-                       vid,
-                       vprog,
-                       local_vertex.data());
+       send_remote_task(mirror, task);
      }*/
 
-     std::vector<request_future<void> > scatter_futures;
-     foreach(procid_t mirror, local_vertex.mirrors()) {
-       scatter_futures.push_back(
-           object_fiber_remote_request(rmi, 
-                                       mirror, 
-                                       &async_consistent_engine::perform_scatter, 
-                                       vid,
-                                       vprog,
-                                       local_vertex.data()));
+     // the mirrors still hold the program sent with the gather. It is
+     // only shipped again if apply changed it.
+     remote_wait scatter_wait(nmirrors);
+     if (nmirrors > 0) {
+       task.is_scatter = true;
+       task.has_vprog = program_changed(task.vprog, vprog);
+       task.handle = reinterpret_cast<size_t>(&scatter_wait);
+       if (task.has_vprog) task.vprog = vprog;
+       task.data = local_vertex.data();
+       foreach(procid_t mirror, local_vertex.mirrors()) {
+         send_remote_task(mirror, task);
+       }
      }
-     perform_scatter_local(lvid, vprog);
-     for(size_t i = 0;i < scatter_futures.size(); ++i) 
-       scatter_futures[i]();
+     perform_scatter_local(lvid, vprog, epoch);
+     wait_for_mirrors(scatter_wait, nmirrors);
 
       /************************************************************************/
       /*                           Release Locks                              */
@@ -1118,7 +1608,7 @@ namespace graphlab {
       // the scatter is used to release the chandy misra
       // here I cleanup
       if (!factorized_consistency) {
-        delete cm_handles[lvid];
+        cm_handle_pool.free(cm_handles[lvid]);
         cm_handles[lvid] = NULL;
       }
       release_exclusive_access_to_vertex(lvid);
@@ -1141,13 +1631,17 @@ namespace graphlab {
       lvid_type sched_lvid;
 
       message_type msg;
+      size_t epoch = 0;
       float last_aggregator_check = timer::approx_time_seconds();
       timer ti; ti.start();
       while(1) {
         if (timer::approx_time_seconds() != last_aggregator_check && !endgame_mode) {
           last_aggregator_check = timer::approx_time_seconds();
-          std::string key = aggregator.tick_asynchronous();
-          if (key != "") {
+          // do not hold partial batches of remote requests for long
+          flush_remote_tasks();
+          snapshot.tick();
+          size_t key = aggregator.tick_asynchronous();
+          if (key != aggregator_type::NO_KEY) {
             for (size_t i = 0;i < aggregation_lock.size(); ++i) {
               aggregation_lock[i].lock();
               aggregation_queue[i].push_back(key);
@@ -1161,26 +1655,28 @@ namespace graphlab {
           size_t wid = fiber_control::get_worker_id();
           ASSERT_LT(wid, ncpus);
           aggregation_lock[wid].lock();
-          std::string key = aggregation_queue[wid].front();
+          size_t key = aggregation_queue[wid].front();
           aggregation_queue[wid].pop_front();
           aggregation_lock[wid].unlock();
           aggregator.tick_asynchronous_compute(wid, key);
         }
 
-        sched_status::status_enum stat = get_next_sched_task(threadid, sched_lvid, msg);
+        sched_status::status_enum stat = get_next_sched_task(threadid, sched_lvid, msg, epoch);
 
 
         has_sched_msg = stat != sched_status::EMPTY;
         if (stat != sched_status::EMPTY) {
-          eval_sched_task(sched_lvid, msg);
+          eval_sched_task(sched_lvid, msg, epoch);
+          snapshot.leave(epoch);
           if (endgame_mode) rmi.dc().flush();
         }
-        else if (!try_to_quit(threadid, has_sched_msg, sched_lvid, msg)) {
+        else if (!try_to_quit(threadid, has_sched_msg, sched_lvid, msg, epoch)) {
           /*
            * We failed to obtain a task, try to quit
            */
           if (has_sched_msg) {
-            eval_sched_task(sched_lvid, msg);
+            eval_sched_task(sched_lvid, msg, epoch);
+            snapshot.leave(epoch);
           }
         } else { 
           break; 
@@ -1208,11 +1704,33 @@ namespace graphlab {
       * \return the reason for termination
       */
     execution_status::status_enum start() {
+      resize_to_graph();
+      graph.clear_changed_vertices();
       bool old_fasttrack = rmi.dc().set_fast_track_requests(false);
       logstream(LOG_INFO) << "Spawning " << nfibers << " threads" << std::endl;
       ASSERT_TRUE(scheduler_ptr != NULL);
       consensus->reset();
 
+      if (snapshot_resume) {
+        std::vector<std::pair<lvid_type, message_type> > msgs;
+        if (snapshot.restore(msgs)) {
+          for (size_t i = 0; i < msgs.size(); ++i) {
+            double priority;
+            messages.add(msgs[i].first, msgs[i].second, &priority);
+            scheduler_ptr->schedule(msgs[i].first, priority);
+          }
+          if (rmi.procid() == 0) {
+            logstream(LOG_EMPH) << "Resumed from snapshot " << snapshot_path
+                                << std::endl;
+          }
+        } else if (rmi.procid() == 0) {
+          logstream(LOG_WARNING) << "No snapshot to resume from in "
+                                 << snapshot_path << std::endl;
+        }
+        snapshot_resume = false;
+      }
+      snapshot.save_base();
+
       // now. It is of critical importance that we match the number of 
       // actual workers
      
@@ -1231,6 +1749,7 @@ namespace graphlab {
       force_stop = false;
       endgame_mode = false;
       programs_executed = 0;
+      task_allocations = 0;
       launch_timer.start();
 
       termination_reason = execution_status::RUNNING;
@@ -1240,11 +1759,20 @@ namespace graphlab {
       thrgroup.set_stacksize(stacksize);
         
       size_t effncpus = std::min(ncpus, fiber_control::get_instance().num_workers());
+      fiber_control::get_instance().reset_worker_stats();
+      // only unpinned fibers can be stolen
+      fiber_control::get_instance().set_work_stealing(!pin_fibers);
       for (size_t i = 0; i < nfibers ; ++i) {
-        thrgroup.launch(boost::bind(&engine_type::thread_start, this, i), 
-                        i % effncpus);
+        if (pin_fibers) {
+          thrgroup.launch(boost::bind(&engine_type::thread_start, this, i), 
+                          i % effncpus);
+        } else {
+          thrgroup.launch(boost::bind(&engine_type::thread_start, this, i));
+        }
       }
       thrgroup.join();
+      fiber_control::get_instance().set_work_stealing(false);
+      snapshot.finish();
       aggregator.stop();
       // if termination reason was not changed, then it must be depletion
       if (termination_reason == execution_status::RUNNING) {
@@ -1257,6 +1785,24 @@ namespace graphlab {
 
       rmi.cout() << "Completed Tasks: " << programs_executed.value << std::endl;
 
+      size_t nallocs = task_allocations.value;
+      rmi.all_reduce(nallocs);
+      task_allocations.value = nallocs;
+      rmi.cout() << "Task Heap Allocations: " << nallocs << " ("
+                 << double(nallocs) / std::max<size_t>(ctasks, 1)
+                 << " per update)" << std::endl;
+
+      fiber_stack_pool::stack_stats sstats =
+          fiber_control::get_instance().get_stack_stats();
+      logstream(LOG_INFO) << "Fiber stack peak usage: " << sstats.peak_usage
+                          << " of " << stacksize << " bytes" << std::endl;
+      std::vector<fiber_control::worker_stats> wstats =
+          fiber_control::get_instance().get_worker_stats();
+      for (size_t i = 0; i < wstats.size(); ++i) {
+        logstream(LOG_INFO) << "Fiber worker " << i << ": idle "
+                            << wstats[i].idle_time << "s, stole "
+                            << wstats[i].nsteals << " fibers" << std::endl;
+      }
 
       size_t numjoins = messages.num_joins();
       rmi.all_reduce(numjoins);
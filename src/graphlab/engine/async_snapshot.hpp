@@ -0,0 +1,567 @@
+/**
+ * Copyright (c) 2009 Carnegie Mellon University.
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+#ifndef GRAPHLAB_ASYNC_SNAPSHOT_HPP
+#define GRAPHLAB_ASYNC_SNAPSHOT_HPP
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <boost/bind.hpp>
+
+#include <graphlab/engine/incremental_snapshot.hpp>
+#include <graphlab/engine/message_array.hpp>
+#include <graphlab/rpc/dc.hpp>
+#include <graphlab/rpc/dc_dist_object.hpp>
+#include <graphlab/parallel/pthread_tools.hpp>
+#include <graphlab/parallel/atomic.hpp>
+#include <graphlab/util/dense_bitset.hpp>
+#include <graphlab/util/timer.hpp>
+#include <graphlab/logger/logger.hpp>
+#include <graphlab/macros_def.hpp>
+
+namespace graphlab {
+
+  /**
+   * \internal
+   * \brief Consistent snapshots of a running asynchronous engine.
+   *
+   * Snapshots are taken without stopping the engine, in the spirit of
+   * the Chandy-Lamport algorithm. Every task (the consumption of a
+   * message and the execution of the vertex program it starts) and
+   * every message sent between machines belongs to an epoch. Machine 0
+   * starts snapshot k by moving all machines to epoch k; a machine
+   * receiving a message of epoch k before the broadcast moves to it
+   * right away, which is the marker of the original algorithm. The
+   * snapshot is the state after every task of an earlier epoch and
+   * before every task of epoch k.
+   *
+   * The epoch of a task is fixed by begin_task() once the task holds the
+   * locks of its scope, not when its message is taken. Two tasks with
+   * overlapping scopes therefore get epochs in the order in which they
+   * hold the locks, provided the lock protocol carries epochs too: every
+   * message granting or releasing a lock must carry the epoch of its
+   * sender and be passed to observe() before the lock is handed over.
+   * Then:
+   *
+   * \li A task of epoch k captures the vertex and edge data it is about
+   *     to modify and the message it is about to consume or combine
+   *     with (copy on write). Captures are made by the
+   *     incremental_snapshot, so only data differing from the base is
+   *     kept.
+   * \li A message of an earlier epoch added to a vertex whose message
+   *     was already captured is logged; it was in flight when the
+   *     vertex was captured.
+   * \li Once machine 0 has seen, in two consecutive polls, that no task
+   *     of an earlier epoch runs anywhere and that all messages of
+   *     earlier epochs were received, the remaining data and messages
+   *     are captured and written in the background. The snapshot is
+   *     committed once every machine has written it.
+   *
+   * The engine starts tasks with get_message(), fixes their epoch with
+   * begin_task() and ends them with leave(). It reports messages with
+   * sent() and received() (only messages which are not part of a task,
+   * such as forwarded signals, need to be counted), and routes all
+   * additions of messages through add_message().
+   *
+   * The snapshot is consistent if the engine guarantees that a task
+   * only modifies data no concurrent task accesses, which is the case
+   * unless factorized consistency is used.
+   */
+  template <typename Graph, typename MessageType>
+  class async_snapshot {
+  public:
+    typedef Graph graph_type;
+    typedef MessageType message_type;
+    typedef std::pair<lvid_type, message_type> lvid_message_type;
+
+    async_snapshot(distributed_control& dc, graph_type& graph,
+                   message_array<message_type>& messages) :
+      rmi(dc, this), graph(graph), snapshot(dc, graph), messages(messages),
+      interval(0), epoch(0), capture_epoch(0), capturing(false),
+      stripes(NUM_STRIPES), logged(NUM_STRIPES) {
+      reset_coordinator();
+      rmi.barrier();
+    }
+
+    /**
+     * Sets the number of seconds between snapshots and the prefix of the
+     * snapshot files. Snapshots are disabled if interval is not positive.
+     */
+    void set_options(double seconds, const std::string& snapshot_prefix) {
+      interval = seconds;
+      prefix = snapshot_prefix;
+    }
+
+    /// Returns true if snapshots are taken.
+    bool enabled() const { return interval > 0; }
+
+    /**
+     * Restores the latest snapshot into a graph loaded from
+     * <tt>[prefix]base_</tt> and returns the pending messages in msgs.
+     * Returns false if there is no snapshot. Must be called on all
+     * machines before the engine runs.
+     */
+    bool restore(std::vector<lvid_message_type>& msgs) {
+      size_t saved_epoch;
+      std::string state;
+      if (!snapshot.restore(prefix, saved_epoch, state)) return false;
+      epoch = saved_epoch;
+      iarchive iarc(state.c_str(), state.length());
+      size_t nmsgs;
+      iarc >> nmsgs;
+      msgs.resize(nmsgs);
+      for (size_t i = 0; i < nmsgs; ++i) {
+        deserialize_varint(iarc, msgs[i].first);
+        iarc >> msgs[i].second;
+      }
+      return true;
+    }
+
+    /**
+     * Writes the base snapshot unless one was already written or
+     * restored. Must be called on all machines before the engine runs.
+     */
+    void save_base() {
+      if (!enabled()) return;
+      snapshot.save_base(prefix);
+      last_commit_time = timer::approx_time_seconds();
+    }
+
+    /**
+     * Completes a snapshot in progress once the engine stopped. Must be
+     * called on all machines after all tasks are done.
+     */
+    void finish() {
+      if (!enabled()) return;
+      if (rmi.procid() == 0) {
+        // no snapshot starts anymore. Wait until a snapshot being written
+        // was committed and acknowledged by every machine, and until no
+        // poll is outstanding.
+        coordinator_lock.lock();
+        while (state == WRITING || state == COMMITTING || polling) {
+          coordinator_cond.wait(coordinator_lock);
+        }
+        coordinator_lock.unlock();
+      }
+      // delivers any rpc_begin still in flight
+      rmi.full_barrier();
+      size_t ncapturing = capturing;
+      rmi.all_reduce(ncapturing);
+      ASSERT_TRUE(ncapturing == 0 || ncapturing == rmi.numprocs());
+      if (ncapturing > 0) {
+        // everything is quiescent, so the snapshot can be completed now
+        snapshot.start_write(capture_epoch,
+                             boost::bind(&async_snapshot::message_state, this),
+                             true);
+        size_t nok = snapshot.join_write();
+        rmi.all_reduce(nok);
+        complete(nok == rmi.numprocs());
+      }
+      reset_coordinator();
+      rmi.barrier();
+    }
+
+    /**
+     * Called by every worker about once a second. On machine 0 starts a
+     * snapshot when the interval has elapsed and drives the detection of
+     * the end of the earlier epochs.
+     */
+    void tick() {
+      if (!enabled() || rmi.procid() != 0) return;
+      if (!coordinator_lock.try_lock()) return;
+      if (state == IDLE) {
+        if (timer::approx_time_seconds() - last_commit_time >= interval) {
+          state = CAPTURING;
+          const size_t k = epoch + 1;
+          for (procid_t i = 0; i < rmi.numprocs(); ++i) {
+            rmi.remote_call(i, &async_snapshot::rpc_begin, k);
+          }
+        }
+      } else if (state == CAPTURING && !polling) {
+        if (quiescent) {
+          state = WRITING;
+          for (procid_t i = 0; i < rmi.numprocs(); ++i) {
+            rmi.remote_call(i, &async_snapshot::rpc_finalize, capture_epoch);
+          }
+        } else {
+          polling = true;
+          nreplies = 0;
+          nbegun = 0;
+          round = counts();
+          for (procid_t i = 0; i < rmi.numprocs(); ++i) {
+            rmi.remote_call(i, &async_snapshot::rpc_poll, capture_epoch);
+          }
+        }
+      }
+      coordinator_lock.unlock();
+    }
+
+    /// Returns the epoch new tasks and messages belong to.
+    size_t current_epoch() const { return epoch; }
+
+    /**
+     * Moves to the epoch of a message received from another machine if
+     * it is ahead.
+     */
+    void observe(size_t e) {
+      if (e > epoch) begin(e);
+    }
+
+    /// Counts a message of epoch e sent to another machine.
+    void sent(size_t e) {
+      if (enabled()) nsent[e % 2].inc();
+    }
+
+    /// Counts a message of epoch e received from another machine.
+    void received(size_t e) {
+      if (enabled()) nreceived[e % 2].inc();
+    }
+
+    /// Ends a task started by get_message().
+    void leave(size_t e) {
+      if (enabled()) running[e % 2].dec();
+    }
+
+    /// Returns true if a task of epoch e must capture data before writing.
+    bool post_cut(size_t e) const {
+      return capturing && e >= capture_epoch;
+    }
+
+    /// Captures a vertex about to be modified by a task of epoch e.
+    void capture_vertex(lvid_type lvid, size_t e) {
+      if (post_cut(e)) snapshot.capture_vertex(lvid);
+    }
+
+    /// Captures an edge about to be modified by a task of epoch e.
+    void capture_edge(edge_id_type eid, size_t e) {
+      if (post_cut(e)) snapshot.capture_edge(eid);
+    }
+
+    /// Adds a message of epoch e to a vertex.
+    void add_message(lvid_type lvid, const message_type& msg, size_t e,
+                     double* priority = NULL) {
+      if (!enabled()) {
+        messages.add(lvid, msg, priority);
+        return;
+      }
+      simple_spinlock& lock = stripes[lvid % NUM_STRIPES];
+      lock.lock();
+      if (capturing) {
+        if (e >= capture_epoch) {
+          capture_message(lvid);
+        } else if (message_saved.get(lvid)) {
+          logged[lvid % NUM_STRIPES].push_back(lvid_message_type(lvid, msg));
+        }
+      }
+      messages.add(lvid, msg, priority);
+      lock.unlock();
+    }
+
+    /**
+     * Takes the message of a vertex, starting a task. Returns false if
+     * there is no message. Otherwise e is a provisional epoch which
+     * keeps the snapshot from being written until begin_task() fixes the
+     * epoch of the task. The task must be ended with leave(e).
+     *
+     * If the provisional epoch is after the cut, the message is captured
+     * before it is taken. Otherwise the snapshot does not contain it
+     * yet, and begin_task() logs it if the task falls after the cut.
+     */
+    bool get_message(lvid_type lvid, message_type& msg, size_t& e) {
+      if (!enabled()) {
+        e = epoch;
+        return messages.get(lvid, msg);
+      }
+      simple_spinlock& lock = stripes[lvid % NUM_STRIPES];
+      lock.lock();
+      e = enter();
+      if (post_cut(e)) capture_message(lvid);
+      const bool ret = messages.get(lvid, msg);
+      lock.unlock();
+      if (!ret) leave(e);
+      return ret;
+    }
+
+    /**
+     * Fixes the epoch of a task started by get_message() with the message
+     * msg. Must be called once the task holds the locks of its scope, or
+     * before the message is forwarded or put back, and before anything
+     * is modified. e is updated to the epoch of the task.
+     */
+    void begin_task(lvid_type lvid, const message_type& msg, size_t& e) {
+      if (!enabled()) {
+        e = epoch;
+        return;
+      }
+      const size_t task_epoch = enter();
+      // The provisional epoch keeps the snapshot from completing, so
+      // capturing cannot change in between.
+      if (post_cut(task_epoch) && !post_cut(e)) {
+        // the message was pending at the cut but is not in the snapshot
+        simple_spinlock& lock = stripes[lvid % NUM_STRIPES];
+        lock.lock();
+        capture_message(lvid);
+        logged[lvid % NUM_STRIPES].push_back(lvid_message_type(lvid, msg));
+        lock.unlock();
+      }
+      leave(e);
+      e = task_epoch;
+    }
+
+  private:
+    dc_dist_object<async_snapshot> rmi;
+    graph_type& graph;
+    incremental_snapshot<graph_type> snapshot;
+    message_array<message_type>& messages;
+
+    double interval;
+    std::string prefix;
+
+    /// The epoch of new tasks
+    volatile size_t epoch;
+    /// The epoch of the snapshot being captured
+    volatile size_t capture_epoch;
+    /// True from the start of a snapshot until its commit
+    volatile bool capturing;
+    mutex begin_lock;
+
+    /// Tasks running, and messages sent and received, by epoch parity.
+    /// Only two epochs can be live at once.
+    atomic<size_t> running[2];
+    atomic<size_t> nsent[2];
+    atomic<size_t> nreceived[2];
+
+    /// Message capture. The message of a vertex is captured with the
+    /// lock of its stripe held, and logged messages are kept per stripe.
+    static const size_t NUM_STRIPES = 4096;
+    std::vector<simple_spinlock> stripes;
+    std::vector<std::vector<lvid_message_type> > logged;
+    dense_bitset message_saved;
+
+    /// Coordinator state. Only used on machine 0.
+    enum coordinator_state { IDLE, CAPTURING, WRITING, COMMITTING };
+    mutex coordinator_lock;
+    /// Signaled when a poll completes or the coordinator returns to IDLE
+    conditional coordinator_cond;
+    coordinator_state state;
+    double last_commit_time;
+    bool polling;
+    bool quiescent;
+    size_t nreplies, nbegun;
+    struct counts {
+      size_t running, sent, received;
+      counts() : running(0), sent(0), received(0) { }
+      bool operator==(const counts& other) const {
+        return running == other.running && sent == other.sent &&
+          received == other.received;
+      }
+    };
+    counts round, last_round;
+    size_t nwritten, nwritten_ok, nacks;
+
+    void reset_coordinator() {
+      state = IDLE;
+      last_commit_time = timer::approx_time_seconds();
+      polling = false;
+      quiescent = false;
+      nreplies = nbegun = 0;
+      round = last_round = counts();
+      // a poll can never match this
+      last_round.running = size_t(-1);
+      nwritten = nwritten_ok = nacks = 0;
+    }
+
+    size_t enter() {
+      while (1) {
+        const size_t e = epoch;
+        running[e % 2].inc();
+        if (e == epoch) return e;
+        running[e % 2].dec();
+      }
+    }
+
+    /// Moves this machine to epoch k and starts capturing.
+    void begin(size_t k) {
+      begin_lock.lock();
+      if (k > epoch) {
+        ASSERT_FALSE(capturing);
+        snapshot.begin_capture();
+        message_saved.resize(messages.size());
+        message_saved.clear();
+        for (size_t i = 0; i < logged.size(); ++i) logged[i].clear();
+        capture_epoch = k;
+        __sync_synchronize();
+        capturing = true;
+        __sync_synchronize();
+        epoch = k;
+      }
+      begin_lock.unlock();
+    }
+
+    /// Called with the lock of the stripe of lvid held.
+    void capture_message(lvid_type lvid) {
+      if (message_saved.get(lvid)) return;
+      message_type msg;
+      if (messages.peek(lvid, msg)) {
+        logged[lvid % NUM_STRIPES].push_back(lvid_message_type(lvid, msg));
+      }
+      message_saved.set_bit(lvid);
+    }
+
+    /**
+     * Captures the remaining messages and returns all messages of the
+     * snapshot, combined per vertex. Runs on the writer thread once no
+     * message of an earlier epoch can arrive.
+     */
+    std::string message_state() {
+      for (lvid_type lvid = 0; lvid < message_saved.size(); ++lvid) {
+        if (message_saved.get(lvid)) continue;
+        simple_spinlock& lock = stripes[lvid % NUM_STRIPES];
+        lock.lock();
+        capture_message(lvid);
+        lock.unlock();
+      }
+      std::vector<lvid_message_type> msgs;
+      for (size_t i = 0; i < logged.size(); ++i) {
+        stripes[i].lock();
+        msgs.insert(msgs.end(), logged[i].begin(), logged[i].end());
+        std::vector<lvid_message_type>().swap(logged[i]);
+        stripes[i].unlock();
+      }
+      std::stable_sort(msgs.begin(), msgs.end(), lvid_less);
+      size_t nmsgs = 0;
+      for (size_t i = 0; i < msgs.size(); ++i) {
+        if (nmsgs > 0 && msgs[nmsgs - 1].first == msgs[i].first) {
+          msgs[nmsgs - 1].second += msgs[i].second;
+        } else {
+          msgs[nmsgs++] = msgs[i];
+        }
+      }
+      oarchive oarc;
+      oarc << nmsgs;
+      for (size_t i = 0; i < nmsgs; ++i) {
+        serialize_varint(oarc, msgs[i].first);
+        oarc << msgs[i].second;
+      }
+      std::string ret(oarc.buf, oarc.off);
+      free(oarc.buf);
+      return ret;
+    }
+
+    static bool lvid_less(const lvid_message_type& a,
+                          const lvid_message_type& b) {
+      return a.first < b.first;
+    }
+
+    /// Commits or discards the written snapshot and stops capturing.
+    void complete(bool ok) {
+      if (ok) snapshot.commit();
+      else snapshot.discard();
+      capturing = false;
+      if (rmi.procid() == 0) {
+        if (ok) {
+          logstream(LOG_INFO) << "Snapshot " << capture_epoch
+                              << " committed" << std::endl;
+        } else {
+          logstream(LOG_ERROR) << "Snapshot " << capture_epoch
+                               << " failed. Keeping snapshot "
+                               << snapshot.latest_iteration() << std::endl;
+        }
+      }
+    }
+
+    void rpc_begin(size_t k) {
+      observe(k);
+    }
+
+    void rpc_poll(size_t k) {
+      const size_t p = (k - 1) % 2;
+      rmi.remote_call(0, &async_snapshot::rpc_poll_reply,
+                      size_t(epoch >= k), running[p].value, nsent[p].value,
+                      nreceived[p].value);
+    }
+
+    void rpc_poll_reply(size_t begun, size_t nrunning, size_t sent,
+                        size_t received) {
+      coordinator_lock.lock();
+      nbegun += begun;
+      round.running += nrunning;
+      round.sent += sent;
+      round.received += received;
+      if (++nreplies == rmi.numprocs()) {
+        // the counts of two consecutive polls must agree, so that no
+        // message was in flight while the first was collected
+        quiescent = nbegun == rmi.numprocs() && round.running == 0 &&
+          round.sent == round.received && round == last_round;
+        last_round = round;
+        polling = false;
+        coordinator_cond.signal();
+      }
+      coordinator_lock.unlock();
+    }
+
+    void rpc_finalize(size_t k) {
+      ASSERT_EQ(k, capture_epoch);
+      snapshot.start_write(k, boost::bind(&async_snapshot::message_state, this),
+                           true, boost::bind(&async_snapshot::written, this, _1));
+    }
+
+    /// Runs on the writer thread.
+    void written(bool ok) {
+      rmi.remote_call(0, &async_snapshot::rpc_written, ok);
+    }
+
+    void rpc_written(bool ok) {
+      coordinator_lock.lock();
+      nwritten_ok += ok;
+      if (++nwritten == rmi.numprocs()) {
+        state = COMMITTING;
+        const bool allok = nwritten_ok == rmi.numprocs();
+        for (procid_t i = 0; i < rmi.numprocs(); ++i) {
+          rmi.remote_call(i, &async_snapshot::rpc_commit, allok);
+        }
+      }
+      coordinator_lock.unlock();
+    }
+
+    void rpc_commit(bool ok) {
+      snapshot.join_write();
+      complete(ok);
+      rmi.remote_call(0, &async_snapshot::rpc_commit_ack);
+    }
+
+    void rpc_commit_ack() {
+      coordinator_lock.lock();
+      if (++nacks == rmi.numprocs()) {
+        reset_coordinator();
+        coordinator_cond.signal();
+      }
+      coordinator_lock.unlock();
+    }
+  }; // end of class async_snapshot
+
+} // end of namespace graphlab
+#include <graphlab/macros_undef.hpp>
+#endif
@@ -51,6 +51,17 @@ class distributed_chandy_misra {
 
   boost::function<void(lvid_type)> callback;
   boost::function<void(lvid_type)> hors_doeuvre_callback;
+  /*
+   * Optional epoch clock. The messages handing a lock to the master and
+   * from the master to the mirrors carry the epoch of their sender,
+   * which the receiver observes before the lock is handed over.
+   */
+  boost::function<size_t()> current_epoch;
+  boost::function<void(size_t)> observe_epoch;
+
+  inline size_t sender_epoch() {
+    return current_epoch != NULL ? current_epoch() : 0;
+  }
   /*
    * Each "fork" is one character.
    * bit 0: owner. if 0 is src. if 1 is target
@@ -527,7 +538,8 @@ class distributed_chandy_misra {
       if (hors_doeuvre_callback != NULL) hors_doeuvre_callback(p_id);
       rmi.remote_call(lvertex.owner(),
                       &dcm_type::rpc_signal_ready,
-                      lvertex.global_id(), philosopherset[p_id].lockid);
+                      lvertex.global_id(), philosopherset[p_id].lockid,
+                      sender_epoch());
       rmi.dc().set_sequentialization_key(pkey);
     }
   }
@@ -573,7 +585,8 @@ class distributed_chandy_misra {
       local_vertex_type lvertex(graph.l_vertex(lvid));
       unsigned char pkey = rmi.dc().set_sequentialization_key(lvertex.global_id() % 254 + 1);
       rmi.remote_call(lvertex.mirrors().begin(), lvertex.mirrors().end(),
-                      &dcm_type::rpc_set_eating, lvertex.global_id(), lockid);
+                      &dcm_type::rpc_set_eating, lvertex.global_id(), lockid,
+                      sender_epoch());
       set_eating(lvid, lockid);
       rmi.dc().set_sequentialization_key(pkey);
     }
@@ -583,7 +596,8 @@ class distributed_chandy_misra {
   }
 
 
-  void rpc_signal_ready(vertex_id_type gvid, bool lockid) {
+  void rpc_signal_ready(vertex_id_type gvid, bool lockid, size_t epoch) {
+    if (observe_epoch != NULL) observe_epoch(epoch);
     lvid_type lvid = graph.local_vid(gvid);
     signal_ready_unlocked(lvid, lockid);
   }
@@ -608,7 +622,8 @@ class distributed_chandy_misra {
     }
   }
 
-  void rpc_set_eating(vertex_id_type gvid, bool lockid) {
+  void rpc_set_eating(vertex_id_type gvid, bool lockid, size_t epoch) {
+    if (observe_epoch != NULL) observe_epoch(epoch);
 
     logstream(LOG_DEBUG) << rmi.procid() <<
             ": Receive Set EATING " << gvid << std::endl;
@@ -759,6 +774,16 @@ class distributed_chandy_misra {
     rmi.barrier();
   }
 
+  /**
+   * Sets the functions returning the epoch of this machine and moving it
+   * to the epoch of a received message.
+   */
+  void set_epoch_clock(boost::function<size_t()> current,
+                       boost::function<void(size_t)> observe) {
+    current_epoch = current;
+    observe_epoch = observe;
+  }
+
   size_t num_clean_forks() const {
     return clean_fork_count.value;
   }
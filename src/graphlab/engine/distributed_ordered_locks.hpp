@@ -0,0 +1,469 @@
+/*
+ * Copyright (c) 2009 Carnegie Mellon University.
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+
+#ifndef GRAPHLAB_DISTRIBUTED_ORDERED_LOCKS_HPP
+#define GRAPHLAB_DISTRIBUTED_ORDERED_LOCKS_HPP
+#include <vector>
+#include <boost/function.hpp>
+#include <graphlab/rpc/dc_dist_object.hpp>
+#include <graphlab/logger/assertions.hpp>
+#include <graphlab/parallel/pthread_tools.hpp>
+#include <graphlab/parallel/atomic_ops.hpp>
+#include <graphlab/graph/graph_basic_types.hpp>
+#include <graphlab/serialization/is_pod.hpp>
+#include <graphlab/macros_def.hpp>
+namespace graphlab {
+
+/**
+ * \internal
+ *
+ * A distributed edge consistency lock, used by the asynchronous engine
+ * in place of distributed_chandy_misra when the "locking" engine option
+ * is set to "ordered".
+ *
+ * Local part: every replica of a vertex has one 32-bit lock word. A
+ * vertex acquires a replica by setting the writer bit on its own word and
+ * adding a reader to the word of every neighbor with an edge on that
+ * machine, all with compare-and-swap. Two adjacent vertices therefore
+ * never hold the same machine at the same time. An acquisition first
+ * checks all the words without modifying them, so it only leaves
+ * transient state behind when it races with another acquisition. Nothing
+ * on the local path takes a lock.
+ *
+ * Remote part: the master first tries all replicas at once. If some fail,
+ * it keeps the replicas with a lower machine id than the first failure,
+ * gives back the others, and waits on the first failure. Once that one is
+ * granted, it tries the rest again. Since a vertex only waits on a
+ * machine while holding machines with lower ids, there is no deadlock. A
+ * waiting vertex is retried when a neighbor releases on that machine.
+ * Unlike Chandy-Misra, this scheme does not guarantee fairness.
+ *
+ * Requests, grants and releases to the same machine are batched. Batches
+ * are sent when full, after every incoming batch, and when flush() is
+ * called.
+ *
+ * The protocol does not rely on any ordering of the messages. Batches
+ * from one machine may be handled concurrently, and a mirror releases
+ * its replica itself, without a message from the master. Correctness
+ * only relies on causality: the master sends the next round of an
+ * acquisition after all replies of the current round arrived. A TRY
+ * which finds the replica still held by the previous acquisition of the
+ * same vertex is denied, and a WAIT which finds it is retried by the
+ * release (see unlock()).
+ *
+ * If set_epoch_clock() was called, every batch carries the epoch of its
+ * sender, which the receiver observes before handling the batch. This is
+ * what orders the tasks of an asynchronous snapshot (see async_snapshot).
+ */
+template <typename GraphType>
+class distributed_ordered_locks {
+ public:
+  typedef typename GraphType::local_vertex_type local_vertex_type;
+  typedef typename GraphType::local_edge_type local_edge_type;
+  typedef typename GraphType::vertex_id_type vertex_id_type;
+  typedef typename GraphType::lvid_type lvid_type;
+  typedef typename GraphType::mirror_type mirror_type;
+
+  typedef distributed_ordered_locks<GraphType> dol_type;
+
+ private:
+  dc_dist_object<dol_type> rmi;
+  GraphType& graph;
+  boost::function<void(lvid_type)> callback;
+  boost::function<size_t()> current_epoch;
+  boost::function<void(size_t)> observe_epoch;
+
+  enum { WRITER = 0x80000000u };
+  /// Writer bit and reader count of each replica
+  std::vector<uint32_t> lockword;
+
+  /*
+   * Possible values of the waiting state of a replica
+   */
+  enum {
+    IDLE = 0,
+    WAITING = 1,        // waiting to be retried
+    ATTEMPTING = 2,     // a thread is trying to acquire it
+    RETRY = 3           // attempting, and a neighbor released meanwhile
+  };
+  std::vector<unsigned char> pending;
+
+  /// Progress of an acquisition on the master
+  struct acquisition {
+    simple_spinlock lock;
+    procid_t outstanding;
+    procid_t first_fail;
+    mirror_type held;
+  };
+  std::vector<acquisition> acquisitions;
+
+  enum { TRY, WAIT, RELEASE, GRANTED, DENIED };
+  struct lock_message: public IS_POD_TYPE {
+    vertex_id_type gvid;
+    unsigned char type;
+    lock_message() { }
+    lock_message(vertex_id_type gvid, unsigned char type):
+        gvid(gvid), type(type) { }
+  };
+  std::vector<std::vector<lock_message> > outbox;
+  std::vector<padded_simple_spinlock> outbox_lock;
+  /**
+   * Held while a batch is sent to the machine. Protects sending[i], the
+   * buffer the outbox is swapped into, which is reused by every send.
+   * The batches do leave in order, but they are not necessarily handled
+   * in order, and the protocol does not depend on it.
+   */
+  std::vector<mutex> send_lock;
+  std::vector<std::vector<lock_message> > sending;
+  size_t batch_size;
+
+  /// vertices to retry once the current operation completes
+  typedef std::vector<lvid_type> work_type;
+
+  inline uint32_t load(lvid_type v) const {
+    return *reinterpret_cast<const volatile uint32_t*>(&lockword[v]);
+  }
+
+  /// Checks without side effects whether v could be acquired
+  bool is_free(lvid_type v) {
+    if (load(v) != 0) return false;
+    local_vertex_type lvertex(graph.l_vertex(v));
+    foreach(local_edge_type edge, lvertex.in_edges()) {
+      if (load(edge.source().id()) & WRITER) return false;
+    }
+    foreach(local_edge_type edge, lvertex.out_edges()) {
+      if (load(edge.target().id()) & WRITER) return false;
+    }
+    return true;
+  }
+
+  bool read_lock(lvid_type u, lvid_type v) {
+    if (u == v) return true;
+    while(1) {
+      const uint32_t w = load(u);
+      if (w & WRITER) return false;
+      if (atomic_compare_and_swap(lockword[u], w, w + 1)) return true;
+    }
+  }
+
+  /// Releases the writer bit of v and the first "count" reader locks
+  void release_first(lvid_type v, size_t count) {
+    local_vertex_type lvertex(graph.l_vertex(v));
+    foreach(local_edge_type edge, lvertex.in_edges()) {
+      if (count == 0) break;
+      lvid_type u = edge.source().id();
+      if (u != v) __sync_fetch_and_sub(&lockword[u], 1);
+      --count;
+    }
+    foreach(local_edge_type edge, lvertex.out_edges()) {
+      if (count == 0) break;
+      lvid_type u = edge.target().id();
+      if (u != v) __sync_fetch_and_sub(&lockword[u], 1);
+      --count;
+    }
+    __sync_fetch_and_and(&lockword[v], ~uint32_t(WRITER));
+  }
+
+  /// Queues the waiting neighbors of v for a retry
+  void wake_neighbors(lvid_type v, work_type& work) {
+    local_vertex_type lvertex(graph.l_vertex(v));
+    foreach(local_edge_type edge, lvertex.in_edges()) {
+      if (pending[edge.source().id()] != IDLE) work.push_back(edge.source().id());
+    }
+    foreach(local_edge_type edge, lvertex.out_edges()) {
+      if (pending[edge.target().id()] != IDLE) work.push_back(edge.target().id());
+    }
+  }
+
+  /**
+   * Tries to acquire the local replica of v. If the attempt lost a race
+   * and had to roll back, the neighbors it may have blocked are queued
+   * for a retry.
+   */
+  bool try_lock(lvid_type v, work_type& work) {
+    if (!is_free(v)) return false;
+    if (!atomic_compare_and_swap(lockword[v], uint32_t(0), uint32_t(WRITER))) {
+      return false;
+    }
+    local_vertex_type lvertex(graph.l_vertex(v));
+    size_t taken = 0;
+    bool success = true;
+    foreach(local_edge_type edge, lvertex.in_edges()) {
+      if (!read_lock(edge.source().id(), v)) { success = false; break; }
+      ++taken;
+    }
+    if (success) {
+      foreach(local_edge_type edge, lvertex.out_edges()) {
+        if (!read_lock(edge.target().id(), v)) { success = false; break; }
+        ++taken;
+      }
+    }
+    if (success) return true;
+    release_first(v, taken);
+    wake_neighbors(v, work);
+    return false;
+  }
+
+  void unlock(lvid_type v, work_type& work) {
+    local_vertex_type lvertex(graph.l_vertex(v));
+    release_first(v, lvertex.num_in_edges() + lvertex.num_out_edges());
+    wake_neighbors(v, work);
+    // Nothing orders this release against the messages of the next
+    // acquisition of v, so its WAIT may have been handled while v still
+    // held this replica. Retry it now.
+    if (pending[v] != IDLE) work.push_back(v);
+  }
+
+  /// Acquires the local replica of v now or once a neighbor releases
+  void wait_lock(lvid_type v, work_type& work) {
+    ASSERT_EQ((int)pending[v], (int)IDLE);
+    pending[v] = WAITING;
+    __sync_synchronize();
+    retry(v, work);
+  }
+
+  void retry(lvid_type v, work_type& work) {
+    while(1) {
+      const unsigned char state = pending[v];
+      if (state == IDLE || state == RETRY) return;
+      if (state == WAITING) {
+        if (atomic_compare_and_swap(pending[v], (unsigned char)WAITING,
+                                    (unsigned char)ATTEMPTING)) break;
+      } else if (atomic_compare_and_swap(pending[v], (unsigned char)ATTEMPTING,
+                                         (unsigned char)RETRY)) {
+        // the thread attempting will try again
+        return;
+      }
+    }
+    // I own the attempt
+    while(1) {
+      if (try_lock(v, work)) {
+        pending[v] = IDLE;
+        __sync_synchronize();
+        send(graph.l_vertex(v).owner(),
+             lock_message(graph.global_vid(v), GRANTED), work);
+        return;
+      }
+      if (atomic_compare_and_swap(pending[v], (unsigned char)ATTEMPTING,
+                                  (unsigned char)WAITING)) return;
+      // a neighbor released while I was trying
+      pending[v] = ATTEMPTING;
+    }
+  }
+
+  void process_work(work_type& work) {
+    while(!work.empty()) {
+      lvid_type v = work.back();
+      work.pop_back();
+      retry(v, work);
+    }
+  }
+
+  /// Replicas of v, including the master
+  mirror_type replicas(lvid_type lvid) {
+    local_vertex_type lvertex(graph.l_vertex(lvid));
+    mirror_type ret = lvertex.mirrors();
+    ret.set_bit(lvertex.owner());
+    return ret;
+  }
+
+  /**
+   * Called on the master with the answer of one replica. When the current
+   * round completes, either all replicas are held, or the master waits on
+   * the first replica which failed, or it tries the remaining replicas.
+   */
+  void receive_reply(lvid_type lvid, procid_t proc, bool granted,
+                     work_type& work) {
+    acquisition& acq = acquisitions[lvid];
+    const mirror_type all = replicas(lvid);
+    mirror_type to_release, to_send;
+    unsigned char type = TRY;
+    acq.lock.lock();
+    if (granted) acq.held.set_bit(proc);
+    else acq.first_fail = std::min(acq.first_fail, proc);
+    --acq.outstanding;
+    if (acq.outstanding > 0) {
+      acq.lock.unlock();
+      return;
+    }
+    if (acq.first_fail != procid_t(-1)) {
+      // keep the replicas below the first failure, wait on it and give
+      // back the others
+      foreach(size_t p, acq.held) {
+        if (p > acq.first_fail) to_release.set_bit(p);
+      }
+      foreach(size_t p, to_release) acq.held.clear_bit(p);
+      to_send.set_bit(acq.first_fail);
+      type = WAIT;
+    } else {
+      foreach(size_t p, all) {
+        if (!acq.held.get(p)) to_send.set_bit(p);
+      }
+    }
+    acq.outstanding = to_send.popcount();
+    acq.first_fail = procid_t(-1);
+    acq.lock.unlock();
+
+    const vertex_id_type gvid = graph.global_vid(lvid);
+    foreach(size_t p, to_release) send(p, lock_message(gvid, RELEASE), work);
+    if (to_send.empty()) {
+      callback(lvid);
+    } else {
+      foreach(size_t p, to_send) send(p, lock_message(gvid, type), work);
+    }
+  }
+
+  void handle(procid_t source, const lock_message& msg, work_type& work) {
+    const lvid_type lvid = graph.local_vid(msg.gvid);
+    switch(msg.type) {
+     case TRY: {
+       const bool granted = try_lock(lvid, work);
+       send(source, lock_message(msg.gvid, granted ? GRANTED : DENIED), work);
+       break;
+     }
+     case WAIT:
+       wait_lock(lvid, work);
+       break;
+     case RELEASE:
+       unlock(lvid, work);
+       break;
+     case GRANTED:
+       receive_reply(lvid, source, true, work);
+       break;
+     case DENIED:
+       receive_reply(lvid, source, false, work);
+       break;
+    }
+  }
+
+  /// Sends a message. Messages to this machine are handled right away.
+  void send(procid_t target, const lock_message& msg, work_type& work) {
+    if (target == rmi.procid()) {
+      handle(target, msg, work);
+      return;
+    }
+    outbox_lock[target].lock();
+    outbox[target].push_back(msg);
+    const bool full = outbox[target].size() >= batch_size;
+    outbox_lock[target].unlock();
+    if (full) send_outbox(target);
+  }
+
+  /**
+   * Sends the messages queued for target. The batch is swapped out under
+   * the outbox lock and sent after the lock is released.
+   */
+  void send_outbox(procid_t target) {
+    send_lock[target].lock();
+    std::vector<lock_message>& batch = sending[target];
+    outbox_lock[target].lock();
+    batch.swap(outbox[target]);
+    outbox_lock[target].unlock();
+    if (!batch.empty()) {
+      const size_t epoch = current_epoch != NULL ? current_epoch() : 0;
+      rmi.remote_call(target, &dol_type::rpc_handle_batch,
+                      rmi.procid(), epoch, batch);
+      batch.clear();
+    }
+    send_lock[target].unlock();
+  }
+
+  void rpc_handle_batch(procid_t source, size_t epoch,
+                        std::vector<lock_message>& msgs) {
+    if (observe_epoch != NULL) observe_epoch(epoch);
+    work_type work;
+    foreach(const lock_message& msg, msgs) handle(source, msg, work);
+    process_work(work);
+    flush();
+  }
+
+ public:
+  inline distributed_ordered_locks(distributed_control &dc,
+                                   GraphType &graph,
+                                   boost::function<void(lvid_type)> callback,
+                                   size_t batch_size = 64):
+      rmi(dc, this), graph(graph), callback(callback),
+      batch_size(batch_size) {
+    lockword.resize(graph.num_local_vertices(), 0);
+    pending.resize(graph.num_local_vertices(), IDLE);
+    acquisitions.resize(graph.num_local_vertices());
+    outbox.resize(rmi.numprocs());
+    outbox_lock.resize(rmi.numprocs());
+    send_lock.resize(rmi.numprocs());
+    sending.resize(rmi.numprocs());
+    rmi.barrier();
+  }
+
+  /**
+   * Sets the functions returning the epoch of this machine and moving it
+   * to the epoch of a received batch.
+   */
+  void set_epoch_clock(boost::function<size_t()> current,
+                       boost::function<void(size_t)> observe) {
+    current_epoch = current;
+    observe_epoch = observe;
+  }
+
+  /**
+   * Starts acquiring the master vertex p_id. The callback is issued once
+   * all of its replicas are held.
+   */
+  void make_philosopher_hungry(lvid_type p_id) {
+    const mirror_type all = replicas(p_id);
+    acquisition& acq = acquisitions[p_id];
+    acq.lock.lock();
+    acq.held.clear();
+    acq.first_fail = procid_t(-1);
+    acq.outstanding = all.popcount();
+    acq.lock.unlock();
+    const vertex_id_type gvid = graph.global_vid(p_id);
+    work_type work;
+    foreach(size_t p, all) send(p, lock_message(gvid, TRY), work);
+    process_work(work);
+  }
+
+  /// Releases the replica of p_id on this machine
+  void philosopher_stops_eating_per_replica(lvid_type p_id) {
+    work_type work;
+    unlock(p_id, work);
+    process_work(work);
+  }
+
+  /// Sends all partially filled batches
+  void flush() {
+    for (procid_t i = 0; i < outbox.size(); ++i) {
+      if (!outbox[i].empty()) send_outbox(i);
+    }
+  }
+
+  void no_locks_consistency_check() {
+    for (size_t i = 0;i < lockword.size(); ++i) ASSERT_EQ(lockword[i], 0);
+    for (size_t i = 0;i < pending.size(); ++i) ASSERT_EQ((int)pending[i], (int)IDLE);
+  }
+};
+
+}
+
+#include <graphlab/macros_undef.hpp>
+#endif
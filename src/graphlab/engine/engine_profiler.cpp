@@ -0,0 +1,236 @@
+/*  
+ * Copyright (c) 2009 Carnegie Mellon University. 
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <graphlab/engine/engine_profiler.hpp>
+#include <graphlab/ui/metrics_server.hpp>
+#include <graphlab/logger/logger.hpp>
+#include <graphlab/logger/assertions.hpp>
+#include <graphlab/macros_def.hpp>
+
+namespace graphlab {
+
+static const char* phase_names[engine_profiler::NUM_PHASES] = {
+  "exchange", "receive", "gather", "apply", "scatter", "aggregate"
+};
+
+// The profiler shown on the metrics server: the most recently created one
+static mutex active_profiler_lock;
+static engine_profiler* active_profiler = NULL;
+
+static std::pair<std::string, std::string>
+engine_profile_json(std::map<std::string, std::string>& vars) {
+  size_t nlast = engine_profiler::DEFAULT_LAST;
+  if (vars.count("last")) nlast = atol(vars["last"].c_str());
+  std::string json = "[]";
+  active_profiler_lock.lock();
+  if (active_profiler != NULL) json = active_profiler->to_json(nlast);
+  active_profiler_lock.unlock();
+  return std::make_pair(std::string("text/plain"), json);
+}
+
+
+engine_profiler::superstep_record::superstep_record() :
+  iteration(0), active_vertices(0), start_time(0), wall_time(0) {
+  memset(phases, 0, sizeof(phases));
+}
+
+void engine_profiler::superstep_record::save(oarchive& oarc) const {
+  oarc << iteration << active_vertices << start_time << wall_time;
+  oarc.write(reinterpret_cast<const char*>(phases), sizeof(phases));
+  oarc << thread_barrier_wait;
+}
+
+void engine_profiler::superstep_record::load(iarchive& iarc) {
+  iarc >> iteration >> active_vertices >> start_time >> wall_time;
+  iarc.read(reinterpret_cast<char*>(phases), sizeof(phases));
+  iarc >> thread_barrier_wait;
+}
+
+
+engine_profiler::engine_profiler(distributed_control& dc, size_t ncpus) :
+  rmi(dc, this), enabled(true), history(DEFAULT_HISTORY), thread_wait(ncpus),
+  records(dc.numprocs()) {
+  reset();
+  if (rmi.procid() == 0) {
+    active_profiler_lock.lock();
+    active_profiler = this;
+    active_profiler_lock.unlock();
+    add_metric_server_callback("engine_profile.json", engine_profile_json);
+  }
+  rmi.barrier();
+}
+
+engine_profiler::~engine_profiler() {
+  active_profiler_lock.lock();
+  if (active_profiler == this) active_profiler = NULL;
+  active_profiler_lock.unlock();
+}
+
+void engine_profiler::reset() {
+  records_lock.lock();
+  for (size_t i = 0; i < records.size(); ++i) records[i].clear();
+  records_lock.unlock();
+  ti.start();
+}
+
+void engine_profiler::begin_superstep(size_t iteration) {
+  if (!enabled) return;
+  current = superstep_record();
+  current.iteration = iteration;
+  current.thread_barrier_wait.assign(NUM_PHASES * thread_wait.size(), 0);
+  current.start_time = ti.current_time();
+}
+
+void engine_profiler::end_superstep() {
+  if (!enabled) return;
+  current.wall_time = ti.current_time() - current.start_time;
+  if (rmi.procid() == 0) {
+    add_record(0, current);
+  } else {
+    rmi.remote_call(0, &engine_profiler::rpc_add_record,
+                    rmi.procid(), current);
+  }
+}
+
+void engine_profiler::begin_phase(phase_type phase) {
+  if (!enabled) return;
+  for (size_t i = 0; i < thread_wait.size(); ++i) thread_wait[i].value = 0;
+  queue_length = 0;
+  phase_bytes_sent = rmi.dc().bytes_sent();
+  phase_bytes_received = rmi.dc().bytes_received();
+  phase_start = barrier_start = ti.current_time();
+}
+
+void engine_profiler::begin_machine_barrier() {
+  if (!enabled) return;
+  barrier_start = ti.current_time();
+}
+
+void engine_profiler::end_phase(phase_type phase) {
+  if (!enabled) return;
+  ASSERT_LT(phase, NUM_PHASES);
+  const double now = ti.current_time();
+  phase_record& rec = current.phases[phase];
+  rec.wall_time += now - phase_start;
+  if (barrier_start > phase_start) {
+    rec.machine_barrier_wait += now - barrier_start;
+  }
+  double max_wait = 0;
+  const size_t nthreads = thread_wait.size();
+  for (size_t i = 0; i < nthreads; ++i) {
+    max_wait = std::max(max_wait, thread_wait[i].value);
+    rec.total_thread_barrier_wait += thread_wait[i].value;
+    current.thread_barrier_wait[phase * nthreads + i] += thread_wait[i].value;
+  }
+  rec.max_thread_barrier_wait = std::max(rec.max_thread_barrier_wait,
+                                         max_wait);
+  rec.bytes_sent += rmi.dc().bytes_sent() - phase_bytes_sent;
+  rec.bytes_received += rmi.dc().bytes_received() - phase_bytes_received;
+  rec.queue_length = std::max<uint64_t>(rec.queue_length, queue_length);
+}
+
+void engine_profiler::rpc_add_record(procid_t procid,
+                                     const superstep_record& record) {
+  add_record(procid, record);
+}
+
+void engine_profiler::add_record(procid_t procid,
+                                 const superstep_record& record) {
+  records_lock.lock();
+  records[procid].push_back(record);
+  while (records[procid].size() > history) records[procid].pop_front();
+  records_lock.unlock();
+}
+
+void engine_profiler::flush() {
+  rmi.full_barrier();
+}
+
+std::string engine_profiler::to_json(size_t nlast) {
+  std::stringstream strm;
+  records_lock.lock();
+  strm << "[\n";
+  for (size_t p = 0; p < records.size(); ++p) {
+    const std::deque<superstep_record>& machine = records[p];
+    const size_t begin = machine.size() > nlast ? machine.size() - nlast : 0;
+    strm << "  {\n"
+         << "    \"procid\": " << p << ",\n"
+         << "    \"supersteps\": [";
+    for (size_t i = begin; i < machine.size(); ++i) {
+      const superstep_record& rec = machine[i];
+      strm << (i == begin ? "\n" : ",\n")
+           << "      {\"iteration\": " << rec.iteration
+           << ", \"start_time\": " << rec.start_time
+           << ", \"wall_time\": " << rec.wall_time
+           << ", \"active_vertices\": " << rec.active_vertices
+           << ", \"phases\": {";
+      const size_t nthreads = rec.thread_barrier_wait.size() / NUM_PHASES;
+      for (size_t ph = 0; ph < NUM_PHASES; ++ph) {
+        const phase_record& phase = rec.phases[ph];
+        strm << (ph == 0 ? "\n" : ",\n")
+             << "        \"" << phase_names[ph] << "\": {"
+             << "\"wall_time\": " << phase.wall_time
+             << ", \"machine_barrier_wait\": " << phase.machine_barrier_wait
+             << ", \"max_thread_barrier_wait\": "
+             << phase.max_thread_barrier_wait
+             << ", \"total_thread_barrier_wait\": "
+             << phase.total_thread_barrier_wait
+             << ", \"bytes_sent\": " << phase.bytes_sent
+             << ", \"bytes_received\": " << phase.bytes_received
+             << ", \"queue_length\": " << phase.queue_length
+             << ", \"thread_barrier_wait\": [";
+        for (size_t i = 0; i < nthreads; ++i) {
+          strm << (i == 0 ? "" : ", ")
+               << rec.thread_barrier_wait[ph * nthreads + i];
+        }
+        strm << "]}";
+      }
+      strm << "}}";
+    }
+    strm << "\n    ]\n"
+         << "  }" << (p + 1 < records.size() ? ",\n" : "\n");
+  }
+  strm << "]\n";
+  records_lock.unlock();
+  return strm.str();
+}
+
+bool engine_profiler::save_json(const std::string& fname) {
+  if (rmi.procid() != 0) return true;
+  std::ofstream fout(fname.c_str());
+  if (!fout.good()) {
+    logstream(LOG_ERROR) << "Unable to open " << fname
+                         << " to write the engine profile" << std::endl;
+    return false;
+  }
+  fout << to_json();
+  return fout.good();
+}
+
+} // namespace graphlab
+#include <graphlab/macros_undef.hpp>
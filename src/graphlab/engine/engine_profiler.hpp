@@ -0,0 +1,199 @@
+/*  
+ * Copyright (c) 2009 Carnegie Mellon University. 
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+#ifndef GRAPHLAB_ENGINE_PROFILER_HPP
+#define GRAPHLAB_ENGINE_PROFILER_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <graphlab/rpc/dc.hpp>
+#include <graphlab/rpc/dc_dist_object.hpp>
+#include <graphlab/parallel/pthread_tools.hpp>
+#include <graphlab/serialization/oarchive.hpp>
+#include <graphlab/serialization/iarchive.hpp>
+#include <graphlab/util/timer.hpp>
+
+namespace graphlab {
+
+  /**
+   * \ingroup engine
+   * \brief Records per superstep and per phase statistics of an engine.
+   *
+   * For every superstep and every phase of the superstep the profiler
+   * records, on every machine:
+   * \li the wall time of the phase,
+   * \li the time spent in the machine barrier ending the phase, which
+   *     is the time this machine waited for the slowest one,
+   * \li the time each engine thread waited in thread barriers, and the
+   *     largest and the total of these waits,
+   * \li the bytes sent and received during the phase,
+   * \li the length of the exchange receive queue when the threads
+   *     finished computing,
+   * and the number of vertices active in the superstep.
+   *
+   * The records of every machine are sent to machine 0 at the end of
+   * every superstep, which keeps the last set_history() supersteps of
+   * each machine. Machine 0 serves the most recent supersteps as JSON
+   * on the metrics server page <tt>engine_profile.json</tt> (see
+   * launch_metric_server()), and save_json() writes all kept supersteps
+   * to a file. The page accepts the optional GET variable \c last, the
+   * number of most recent supersteps to return, which defaults to
+   * DEFAULT_LAST.
+   *
+   * The cost is a few clock reads per phase per thread, and one small
+   * message per superstep per machine.
+   */
+  class engine_profiler {
+  public:
+    enum phase_type {
+      EXCHANGE, RECEIVE, GATHER, APPLY, SCATTER, AGGREGATE, NUM_PHASES
+    };
+
+    struct phase_record {
+      double wall_time;
+      double machine_barrier_wait;
+      double max_thread_barrier_wait;
+      double total_thread_barrier_wait;
+      uint64_t bytes_sent;
+      uint64_t bytes_received;
+      uint64_t queue_length;
+    };
+
+    /// Supersteps kept per machine unless set_history() is called
+    static const size_t DEFAULT_HISTORY = 500;
+    /// Supersteps returned by the metrics server page by default
+    static const size_t DEFAULT_LAST = 100;
+
+    struct superstep_record {
+      uint64_t iteration;
+      uint64_t active_vertices;
+      double start_time;
+      double wall_time;
+      phase_record phases[NUM_PHASES];
+      /// The barrier wait of thread i in phase p is at
+      /// [p * nthreads + i]
+      std::vector<double> thread_barrier_wait;
+
+      superstep_record();
+      void save(oarchive& oarc) const;
+      void load(iarchive& iarc);
+    };
+
+    /**
+     * Creates a profiler for an engine with ncpus threads. Must be
+     * called on all machines simultaneously.
+     */
+    engine_profiler(distributed_control& dc, size_t ncpus);
+
+    ~engine_profiler();
+
+    /// Enables or disables recording. Enabled by default.
+    void set_enabled(bool enabled) { this->enabled = enabled; }
+
+    bool is_enabled() const { return enabled; }
+
+    /// Sets the number of supersteps kept per machine. Defaults to
+    /// DEFAULT_HISTORY.
+    void set_history(size_t history) { this->history = history; }
+
+    /// Clears the records of all machines and restarts the clock
+    void reset();
+
+    /// Called by the engine before the phases of a superstep
+    void begin_superstep(size_t iteration);
+
+    /// Called by the engine once all phases of the superstep are done
+    void end_superstep();
+
+    /// Called by the engine before the threads start a phase
+    void begin_phase(phase_type phase);
+
+    /// Called by the engine before the machine barrier ending a phase
+    void begin_machine_barrier();
+
+    /**
+     * Called by the engine after a phase. Phases run more than once in
+     * a superstep accumulate.
+     */
+    void end_phase(phase_type phase);
+
+    /// Adds time engine thread thread_id spent in a thread barrier
+    void add_thread_barrier_wait(size_t thread_id, double seconds) {
+      thread_wait[thread_id].value += seconds;
+    }
+
+    /// Records the length of an exchange queue. The largest is kept.
+    void sample_queue_length(size_t length) {
+      if (length > queue_length) queue_length = length;
+    }
+
+    /// Adds to the number of vertices active in the current superstep
+    void add_active_vertices(size_t n) { current.active_vertices += n; }
+
+    /**
+     * Waits for the records of all machines to reach machine 0. Must be
+     * called on all machines simultaneously.
+     */
+    void flush();
+
+    /**
+     * Returns the last nlast supersteps of every machine as JSON. Only
+     * meaningful on machine 0.
+     */
+    std::string to_json(size_t nlast = size_t(-1));
+
+    /**
+     * Writes to_json() to a file. Only does something on machine 0.
+     * Returns false on failure.
+     */
+    bool save_json(const std::string& fname);
+
+  private:
+    dc_dist_object<engine_profiler> rmi;
+    bool enabled;
+    size_t history;
+    timer ti;
+
+    superstep_record current;
+    double phase_start, barrier_start;
+    uint64_t phase_bytes_sent, phase_bytes_received;
+    size_t queue_length;
+
+    struct padded_double {
+      double value;
+      char padding[64 - sizeof(double)];
+      padded_double() : value(0) { }
+    };
+    std::vector<padded_double> thread_wait;
+
+    /// Machine 0 only: the records received from every machine
+    mutex records_lock;
+    std::vector<std::deque<superstep_record> > records;
+
+    void rpc_add_record(procid_t procid, const superstep_record& record);
+    void add_record(procid_t procid, const superstep_record& record);
+  }; // end of class engine_profiler
+
+} // namespace graphlab
+#endif
@@ -341,6 +341,37 @@ namespace graphlab {
                              const message_type& message = message_type(),
                              const std::string& order = "shuffle") = 0;
 
+    /**
+     * \brief Signal the vertices changed by graph updates since the last
+     * call to start(), together with their neighborhood.
+     *
+     * After edges or vertices are added to a dynamic graph and the graph
+     * is finalized again, only the vertices touched by the update (see
+     * distributed_graph::changed_vertices()) and their neighbors along
+     * the given edge direction need to be recomputed. This allows a
+     * computation to be resumed at a cost proportional to the size of the
+     * update rather than the size of the graph:
+     *
+     * \code
+     * engine.signal_all();
+     * engine.start();
+     * graph.load_format(delta_path, format); // add more edges
+     * graph.finalize();
+     * engine.signal_changed(graphlab::OUT_EDGES);
+     * engine.start();
+     * \endcode
+     *
+     * The signal_changed function must be invoked on all machines
+     * simultaneously.
+     *
+     * @param [in] neighborhood The edges along which neighbors of changed
+     * vertices are also signaled. NO_EDGES signals only the changed
+     * vertices.
+     * @param [in] message the message to send to all signaled vertices.
+     */
+    virtual void signal_changed(edge_dir_type neighborhood = ALL_EDGES,
+                                const message_type& message = message_type()) = 0;
+
 
      /** 
      * \brief Creates a vertex aggregator. Returns true on success.
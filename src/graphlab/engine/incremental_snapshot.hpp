@@ -0,0 +1,584 @@
+/**
+ * Copyright (c) 2009 Carnegie Mellon University.
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+#ifndef GRAPHLAB_INCREMENTAL_SNAPSHOT_HPP
+#define GRAPHLAB_INCREMENTAL_SNAPSHOT_HPP
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+
+#include <graphlab/rpc/dc.hpp>
+#include <graphlab/rpc/dc_dist_object.hpp>
+#include <graphlab/parallel/pthread_tools.hpp>
+#include <graphlab/parallel/atomic.hpp>
+#include <graphlab/serialization/serialization_includes.hpp>
+#include <graphlab/util/dense_bitset.hpp>
+#include <graphlab/util/timer.hpp>
+#include <graphlab/logger/logger.hpp>
+#include <graphlab/macros_def.hpp>
+
+namespace graphlab {
+
+  /**
+   * \internal
+   * \brief Incremental, asynchronous snapshots of a distributed graph and
+   * of the state of an engine.
+   *
+   * The first snapshot (the base) is a complete binary dump of the graph
+   * written with distributed_graph::save_binary() to
+   * <tt>[prefix]base_[procid].bin</tt>. Every later snapshot (a delta)
+   * only holds the vertex and edge data which differ from the base,
+   * together with an opaque engine state string, and is written to
+   * <tt>[prefix]delta[iteration]_[procid].bin</tt>.
+   *
+   * Changed data is detected by comparing a 64 bit hash of the serialized
+   * data of every local vertex and edge with its hash in the base, so no
+   * cooperation from the vertex program is needed. A delta is collected
+   * by begin_capture(), followed by capture_vertex() and capture_edge()
+   * calls made before an element is modified (copy on write), and by
+   * capture_all() which captures the remaining elements. Capturing
+   * serializes the changed data into memory; compressing and writing it
+   * is done by a background thread while the engine continues. The
+   * writer can also run capture_all() itself, in which case the engine
+   * keeps capturing the elements it modifies until the delta is
+   * committed (see save_delta()). A delta
+   * becomes the latest snapshot once it has been written on all
+   * machines. Each machine then records its iteration in
+   * <tt>[prefix]latest_[procid]</tt>, and the delta before the previous
+   * one is deleted.
+   *
+   * A snapshot is restored by loading the base with
+   * distributed_graph::load_binary() and calling restore(), which applies
+   * the latest delta written by all machines. Snapshots are written with
+   * posix file operations, so prefix must not be an hdfs path.
+   *
+   * save_base(), save_delta(), poll(), wait() and restore() must be
+   * called simultaneously on all machines. The remaining functions are
+   * local; an engine using them coordinates the commit itself.
+   */
+  template <typename Graph>
+  class incremental_snapshot {
+  public:
+    typedef Graph graph_type;
+    typedef typename graph_type::local_graph_type local_graph_type;
+
+    /// Returns the engine state stored with a delta
+    typedef boost::function<std::string (void)> state_function_type;
+    /// Called on the writer thread with the result of the write
+    typedef boost::function<void (bool)> written_function_type;
+
+    incremental_snapshot(distributed_control& dc, graph_type& graph) :
+      rmi(dc, this), graph(graph), has_base(false), pending(false),
+      last_iteration(size_t(-1)), prev_iteration(size_t(-1)) {
+      rmi.barrier();
+    }
+
+    ~incremental_snapshot() {
+      if (pending) writer.join();
+      vertices.free_chunks();
+      edges.free_chunks();
+    }
+
+    /// Returns true if prefix may be used for snapshots.
+    static bool valid_prefix(const std::string& prefix) {
+      return !prefix.empty() && !boost::starts_with(prefix, "hdfs://");
+    }
+
+    /**
+     * Writes the base snapshot and remembers the hashes of all data.
+     * Does nothing if the base was already written or restored and the
+     * graph has not grown since.
+     */
+    void save_base(const std::string& prefix) {
+      wait();
+      const local_graph_type& lgraph = graph.get_local_graph();
+      if (has_base && prefix == snapshot_prefix &&
+          vertices.hashes.size() == lgraph.num_vertices() &&
+          edges.hashes.size() == lgraph.num_edges()) {
+        return;
+      }
+      snapshot_prefix = prefix;
+      graph.save_binary(prefix + "base_");
+      compute_hashes();
+      has_base = true;
+      last_iteration = prev_iteration = size_t(-1);
+    }
+
+    /**
+     * Starts writing a delta holding all vertex and edge data which
+     * differ from the base and the engine state. Waits for the previous
+     * delta to be written first. The data is serialized and written by
+     * the background writer, so until the delta is committed (while
+     * writing() is true) the engine must call capture_vertex() or
+     * capture_edge() before it modifies an element.
+     */
+    void save_delta(size_t iteration, const std::string& engine_state) {
+      wait();
+      begin_capture();
+      pending_state = engine_state;
+      start_write(iteration, state_function_type(), true);
+    }
+
+    /**
+     * Commits the pending delta if it has been written on all machines.
+     * Returns immediately otherwise.
+     */
+    void poll() {
+      if (!pending) return;
+      size_t ndone = write_done.value;
+      rmi.all_reduce(ndone);
+      if (ndone == rmi.numprocs()) finish();
+    }
+
+    /// Waits for the pending delta to be written and commits it.
+    void wait() {
+      if (!pending) return;
+      finish();
+    }
+
+    /**
+     * Prepares the collection of a new delta without capturing anything.
+     * Must not be called while a delta is being written.
+     */
+    void begin_capture() {
+      ASSERT_TRUE(has_base);
+      ASSERT_FALSE(pending);
+      const local_graph_type& lgraph = graph.get_local_graph();
+      vertices.reset(lgraph.num_vertices());
+      edges.reset(lgraph.num_edges());
+    }
+
+    /**
+     * Captures the current data of a local vertex unless it was captured
+     * since begin_capture(). Thread safe.
+     */
+    void capture_vertex(lvid_type lvid) {
+      vertices.capture(vertex_accessor(graph.get_local_graph()), lvid);
+    }
+
+    /**
+     * Captures the current data of a local edge unless it was captured
+     * since begin_capture(). Thread safe.
+     */
+    void capture_edge(edge_id_type eid) {
+      edges.capture(edge_accessor(graph.get_local_graph()), eid);
+    }
+
+    /// Captures all vertices and edges not captured yet.
+    void capture_all() {
+      local_graph_type& lgraph = graph.get_local_graph();
+      vertices.capture_all(vertex_accessor(lgraph));
+      edges.capture_all(edge_accessor(lgraph));
+    }
+
+    /**
+     * Writes the captured delta in the background. If capture_remaining
+     * is true the writer first calls capture_all(). The engine state is
+     * then obtained from state_fn, or is the string passed to
+     * save_delta() if state_fn is empty. on_written, if set, is called on
+     * the writer thread once the file is complete.
+     */
+    void start_write(size_t iteration, const state_function_type& state_fn,
+                     bool capture_remaining,
+                     const written_function_type& on_written =
+                     written_function_type()) {
+      ASSERT_FALSE(pending);
+      pending_iteration = iteration;
+      pending_fname = delta_fname(iteration, rmi.procid());
+      pending_state_fn = state_fn;
+      pending_capture = capture_remaining;
+      pending_on_written = on_written;
+      write_ok = false;
+      write_done = 0;
+      pending = true;
+      writer.launch(boost::bind(&incremental_snapshot::write_delta, this));
+    }
+
+    /// Returns true from start_write() until commit() or discard().
+    bool writing() const { return pending; }
+
+    /**
+     * Waits for the writer and returns true if the delta was written.
+     * The delta must then be passed to commit() or discard().
+     */
+    bool join_write() {
+      join_lock.lock();
+      writer.join();
+      // a thread object can only be launched once
+      writer = thread();
+      join_lock.unlock();
+      return write_ok;
+    }
+
+    /// Makes the written delta the latest snapshot of this machine.
+    void commit() {
+      ASSERT_TRUE(pending);
+      pending = false;
+      // replace the latest file atomically
+      const std::string tmp = latest_fname() + ".tmp";
+      {
+        std::ofstream fout(tmp.c_str());
+        fout << pending_iteration << std::endl;
+      }
+      std::rename(tmp.c_str(), latest_fname().c_str());
+      // keep the previous delta in case a peer has not committed this one
+      if (prev_iteration != size_t(-1) && prev_iteration != pending_iteration) {
+        std::remove(delta_fname(prev_iteration, rmi.procid()).c_str());
+      }
+      prev_iteration = last_iteration;
+      last_iteration = pending_iteration;
+    }
+
+    /// Discards the written delta.
+    void discard() {
+      ASSERT_TRUE(pending);
+      pending = false;
+      std::remove(pending_fname.c_str());
+    }
+
+    /// Returns the iteration of the latest committed delta, or -1.
+    size_t latest_iteration() const { return last_iteration; }
+
+    /**
+     * Applies the latest delta written by all machines to a graph loaded
+     * from the base. Returns false, leaving the graph unchanged, if no
+     * delta was written; the next save_base() then writes a new base.
+     * Otherwise sets iteration and engine_state to the values passed to
+     * save_delta().
+     */
+    bool restore(const std::string& prefix, size_t& iteration,
+                 std::string& engine_state) {
+      wait();
+      snapshot_prefix = prefix;
+      last_iteration = prev_iteration = size_t(-1);
+
+      std::vector<size_t> latest(rmi.numprocs());
+      latest[rmi.procid()] = read_latest();
+      rmi.all_gather(latest);
+      // a machine may have failed after committing and before its peers
+      // did, in which case they still hold the previous delta
+      iteration = *std::min_element(latest.begin(), latest.end());
+      // with nothing to restore the graph need not be the base
+      if (iteration == size_t(-1)) return false;
+      compute_hashes();
+      has_base = true;
+
+      const std::string fname = delta_fname(iteration, rmi.procid());
+      std::ifstream in_file(fname.c_str(),
+                            std::ios_base::in | std::ios_base::binary);
+      if (!in_file.good()) {
+        logstream(LOG_FATAL) << "Unable to open snapshot " << fname
+                             << std::endl;
+      }
+      boost::iostreams::filtering_stream<boost::iostreams::input> fin;
+      fin.push(boost::iostreams::gzip_decompressor());
+      fin.push(in_file);
+      iarchive iarc(fin);
+      size_t saved_iteration, nverts, nedges;
+      iarc >> saved_iteration >> nverts >> nedges;
+      local_graph_type& lgraph = graph.get_local_graph();
+      if (saved_iteration != iteration || nverts != lgraph.num_vertices() ||
+          nedges != lgraph.num_edges()) {
+        logstream(LOG_FATAL) << "Snapshot " << fname << " does not match "
+                             << "the graph. The graph must be loaded from "
+                             << prefix << "base_ with the same number of "
+                             << "machines." << std::endl;
+      }
+      size_t nchanged;
+      iarc >> nchanged;
+      for (size_t i = 0; i < nchanged; ++i) {
+        lvid_type lvid;
+        deserialize_varint(iarc, lvid);
+        iarc >> lgraph.vertex_data(lvid);
+      }
+      iarc >> nchanged;
+      for (size_t i = 0; i < nchanged; ++i) {
+        edge_id_type eid;
+        deserialize_varint(iarc, eid);
+        iarc >> lgraph.edge_data(eid);
+      }
+      iarc >> engine_state;
+      fin.pop();
+      fin.pop();
+      last_iteration = iteration;
+      logstream(LOG_INFO) << "Restored snapshot " << fname << std::endl;
+      rmi.barrier();
+      return true;
+    }
+
+  private:
+    dc_dist_object<incremental_snapshot> rmi;
+    graph_type& graph;
+    std::string snapshot_prefix;
+    bool has_base;
+
+    static const size_t CHUNK_SIZE = 65536;
+
+    /// The serialized changes of a block of CHUNK_SIZE elements
+    struct chunk {
+      oarchive out;
+      /// holds the data of one element while it is compared to the base
+      oarchive scratch;
+      size_t nchanged;
+      chunk() : nchanged(0) { }
+    };
+
+    /// The vertices or the edges of a delta
+    struct capture_set {
+      /// Hashes of the serialized data of every element in the base
+      std::vector<uint64_t> hashes;
+      /// Elements captured since begin_capture()
+      dense_bitset saved;
+      std::vector<chunk> chunks;
+      std::vector<simple_spinlock> locks;
+
+      void free_chunks() {
+        for (size_t i = 0; i < chunks.size(); ++i) {
+          free(chunks[i].out.buf);
+          free(chunks[i].scratch.buf);
+        }
+        std::vector<chunk>().swap(chunks);
+      }
+
+      void reset(size_t n) {
+        ASSERT_EQ(n, hashes.size());
+        free_chunks();
+        const size_t nchunks = (n + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        chunks.resize(nchunks);
+        locks.resize(nchunks);
+        saved.resize(n);
+        saved.clear();
+      }
+
+      size_t nchanged() const {
+        size_t ret = 0;
+        for (size_t i = 0; i < chunks.size(); ++i) ret += chunks[i].nchanged;
+        return ret;
+      }
+
+      /// Called with the lock of the chunk of element i held.
+      template <typename Accessor>
+      void save(const Accessor& acc, size_t i, chunk& c) {
+        c.scratch.off = 0;
+        acc.save(c.scratch, i);
+        if (hash_bytes(c.scratch.buf, c.scratch.off) != hashes[i]) {
+          serialize_varint(c.out, i);
+          c.out.write(c.scratch.buf, c.scratch.off);
+          ++c.nchanged;
+        }
+        saved.set_bit(i);
+      }
+
+      template <typename Accessor>
+      void capture(const Accessor& acc, size_t i) {
+        if (saved.get(i)) return;
+        const size_t c = i / CHUNK_SIZE;
+        locks[c].lock();
+        if (!saved.get(i)) save(acc, i, chunks[c]);
+        locks[c].unlock();
+      }
+
+      template <typename Accessor>
+      void capture_all(const Accessor& acc) {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+        for (size_t c = 0; c < chunks.size(); ++c) {
+          locks[c].lock();
+          const size_t end = std::min(hashes.size(), (c + 1) * CHUNK_SIZE);
+          for (size_t i = c * CHUNK_SIZE; i < end; ++i) {
+            if (!saved.get(i)) save(acc, i, chunks[c]);
+          }
+          locks[c].unlock();
+        }
+      }
+    };
+    capture_set vertices;
+    capture_set edges;
+
+    std::string pending_state;
+    state_function_type pending_state_fn;
+    written_function_type pending_on_written;
+    bool pending_capture;
+    std::string pending_fname;
+    size_t pending_iteration;
+
+    /// true between start_write() and the commit or discard of the delta
+    bool pending;
+    thread writer;
+    mutex join_lock;
+    bool write_ok;
+    atomic<size_t> write_done;
+
+    /// Iterations of the two most recently committed deltas
+    size_t last_iteration, prev_iteration;
+
+    struct vertex_accessor {
+      local_graph_type& lgraph;
+      vertex_accessor(local_graph_type& lgraph) : lgraph(lgraph) { }
+      size_t size() const { return lgraph.num_vertices(); }
+      void save(oarchive& oarc, size_t i) const {
+        oarc << lgraph.vertex_data(lvid_type(i));
+      }
+    };
+
+    struct edge_accessor {
+      local_graph_type& lgraph;
+      edge_accessor(local_graph_type& lgraph) : lgraph(lgraph) { }
+      size_t size() const { return lgraph.num_edges(); }
+      void save(oarchive& oarc, size_t i) const {
+        oarc << lgraph.edge_data(edge_id_type(i));
+      }
+    };
+
+    static uint64_t hash_bytes(const char* c, size_t len) {
+      // FNV-1a
+      uint64_t h = 14695981039346656037ULL;
+      for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)c[i];
+        h *= 1099511628211ULL;
+      }
+      return h;
+    }
+
+    template <typename Accessor>
+    static void hash_all(const Accessor& acc, std::vector<uint64_t>& hashes) {
+      hashes.resize(acc.size());
+      const size_t nchunks = (hashes.size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+      for (size_t c = 0; c < nchunks; ++c) {
+        oarchive scratch;
+        const size_t end = std::min(hashes.size(), (c + 1) * CHUNK_SIZE);
+        for (size_t i = c * CHUNK_SIZE; i < end; ++i) {
+          scratch.off = 0;
+          acc.save(scratch, i);
+          hashes[i] = hash_bytes(scratch.buf, scratch.off);
+        }
+        free(scratch.buf);
+      }
+    }
+
+    void compute_hashes() {
+      local_graph_type& lgraph = graph.get_local_graph();
+      hash_all(vertex_accessor(lgraph), vertices.hashes);
+      hash_all(edge_accessor(lgraph), edges.hashes);
+    }
+
+    std::string delta_fname(size_t iteration, procid_t procid) const {
+      return snapshot_prefix + "delta" + tostr(iteration) + "_" +
+        tostr(procid) + ".bin";
+    }
+
+    std::string latest_fname() const {
+      return snapshot_prefix + "latest_" + tostr(rmi.procid());
+    }
+
+    /// Returns the iteration of the latest committed delta, or -1.
+    size_t read_latest() const {
+      std::ifstream fin(latest_fname().c_str());
+      size_t iteration = size_t(-1);
+      if (fin.good()) fin >> iteration;
+      return fin.fail() ? size_t(-1) : iteration;
+    }
+
+    /// Runs on the writer thread.
+    void write_delta() {
+      if (pending_capture) capture_all();
+      if (pending_state_fn) pending_state = pending_state_fn();
+      const size_t nverts_changed = vertices.nchanged();
+      const size_t nedges_changed = edges.nchanged();
+      logstream(LOG_INFO) << "Snapshot " << pending_iteration << ": "
+                          << nverts_changed << " of "
+                          << vertices.hashes.size() << " vertices and "
+                          << nedges_changed << " of " << edges.hashes.size()
+                          << " edges changed" << std::endl;
+      std::ofstream out_file(pending_fname.c_str(),
+                             std::ios_base::out | std::ios_base::binary);
+      if (out_file.good()) {
+        boost::iostreams::filtering_stream<boost::iostreams::output> fout;
+        fout.push(boost::iostreams::gzip_compressor());
+        fout.push(out_file);
+        oarchive oarc(fout);
+        oarc << pending_iteration << vertices.hashes.size()
+             << edges.hashes.size();
+        oarc << nverts_changed;
+        for (size_t i = 0; i < vertices.chunks.size(); ++i) {
+          oarc.write(vertices.chunks[i].out.buf, vertices.chunks[i].out.off);
+        }
+        oarc << nedges_changed;
+        for (size_t i = 0; i < edges.chunks.size(); ++i) {
+          oarc.write(edges.chunks[i].out.buf, edges.chunks[i].out.off);
+        }
+        oarc << pending_state;
+        fout.pop();
+        fout.pop();
+        out_file.close();
+        write_ok = !out_file.fail();
+      }
+      if (!write_ok) {
+        logstream(LOG_ERROR) << "Unable to write snapshot " << pending_fname
+                             << std::endl;
+      }
+      // every element is captured, so the chunks are no longer used
+      vertices.free_chunks();
+      edges.free_chunks();
+      std::string().swap(pending_state);
+      write_done.inc();
+      if (pending_on_written) pending_on_written(write_ok);
+    }
+
+    /// Joins the writer and, if all machines succeeded, commits the delta.
+    void finish() {
+      size_t nok = join_write();
+      rmi.all_reduce(nok);
+      if (nok != rmi.numprocs()) {
+        if (rmi.procid() == 0) {
+          logstream(LOG_ERROR) << "Snapshot " << pending_iteration
+                               << " failed. Keeping snapshot "
+                               << last_iteration << std::endl;
+        }
+        discard();
+        return;
+      }
+      commit();
+      if (rmi.procid() == 0) {
+        logstream(LOG_INFO) << "Snapshot " << pending_iteration
+                            << " committed" << std::endl;
+      }
+    }
+  }; // end of class incremental_snapshot
+
+} // end of namespace graphlab
+#include <graphlab/macros_undef.hpp>
+#endif
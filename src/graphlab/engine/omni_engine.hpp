@@ -226,6 +226,10 @@ namespace graphlab {
                      const std::string& order = "shuffle") {
       engine_ptr->signal_vset(vset, message, order);
     }
+    void signal_changed(edge_dir_type neighborhood = ALL_EDGES,
+                        const message_type& message = message_type()) {
+      engine_ptr->signal_changed(neighborhood, message);
+    }
 
 
     aggregator_type* get_aggregator() { return engine_ptr->get_aggregator(); }
@@ -26,6 +26,10 @@
 #define GRAPHLAB_SYNCHRONOUS_ENGINE_HPP
 
 #include <deque>
+#include <sstream>
+#include <algorithm>
+#include <map>
+#include <set>
 #include <boost/bind.hpp>
 
 #include <graphlab/engine/iengine.hpp>
@@ -35,6 +39,8 @@
 #include <graphlab/vertex_program/context.hpp>
 
 #include <graphlab/engine/execution_status.hpp>
+#include <graphlab/engine/incremental_snapshot.hpp>
+#include <graphlab/engine/engine_profiler.hpp>
 #include <graphlab/options/graphlab_options.hpp>
 
 
@@ -44,6 +50,7 @@
 #include <graphlab/parallel/fiber_barrier.hpp>
 #include <graphlab/util/tracepoint.hpp>
 #include <graphlab/util/memory_info.hpp>
+#include <graphlab/util/generics/conditional_addition_wrapper.hpp>
 
 #include <graphlab/rpc/dc_dist_object.hpp>
 #include <graphlab/rpc/distributed_event_log.hpp>
@@ -188,16 +195,57 @@ namespace graphlab {
    * or update (\ref icontext::post_delta) the cache values of
    * neighboring vertices during the scatter phase.
    *
-   * \li \b snapshot_interval If set to a positive value, a snapshot
-   * is taken every this number of iterations. If set to 0, a snapshot
-   * is taken before the first iteration. If set to a negative value,
-   * no snapshots are taken. Defaults to -1. A snapshot is a binary
-   * dump of the graph.
+   * \li \b snapshot_interval If set to a value >= 0, a binary dump of
+   * the graph (the base snapshot) is saved with
+   * distributed_graph::save_binary() to <tt>[snapshot_path]base_</tt>
+   * before the first iteration. If set to a positive value, an
+   * incremental snapshot is also taken every this number of iterations.
+   * It holds the vertex and edge data which differ from the base, the
+   * iteration counter and the pending messages. Only the engine state
+   * is serialized between iterations; the graph data is serialized and
+   * written in the background while the next iterations run, which
+   * capture a vertex or an edge before they modify it. If set to a negative
+   * value, no snapshots are taken. Defaults to -1.
    *
    * \li \b snapshot_path If snapshot_interval is set to a value >=0,
    * this option must be specified and should contain a target basename
    * for the snapshot. The path including folder and file prefix in
-   * which the snapshots should be saved.
+   * which the snapshots should be saved. Must not be an hdfs path.
+   *
+   * \li \b snapshot_resume (default: false) If set to true, start()
+   * resumes from the latest incremental snapshot in snapshot_path,
+   * restoring the vertex and edge data, the iteration counter and the
+   * pending messages. The graph must have been loaded with
+   * <tt>graph.load_binary(snapshot_path + "base_")</tt> on the same
+   * number of machines. Aggregators are not restored. If there is no
+   * snapshot the engine starts normally.
+   *
+   * \li \b profile (default: true) Records the wall time, barrier
+   * waits, bytes sent and received and exchange queue lengths of every
+   * phase of every super-step on every machine, and the active
+   * vertices of every super-step. See graphlab::engine_profiler. The
+   * records are served by the metrics server (see
+   * graphlab::launch_metric_server()) on the page
+   * <tt>engine_profile.json</tt>.
+   *
+   * \li \b profile_file If set, machine 0 writes the profile as JSON to
+   * this file when the engine finishes.
+   *
+   * \li \b profile_history (default: 500) The number of most recent
+   * super-steps of each machine kept by the profiler.
+   *
+   * \li \b staleness (default: 0) If set to k > 0 the engine runs in
+   * stale-synchronous (SSP) mode: each machine may run up to k
+   * super-steps ahead of the slowest machine instead of waiting at a
+   * barrier after every minor-step. Super-step clocks are piggybacked on
+   * the per-super-step batch each machine sends every other machine.
+   * Each vertex still performs init, gather, apply and scatter in order,
+   * but mirrors may gather and scatter with stale neighbor data and
+   * messages may be delivered a few super-steps late. This suits
+   * programs which tolerate staleness (e.g. SGD, ALS) on clusters with
+   * stragglers. Periodic aggregators are not run in this mode and
+   * it cannot be combined with a positive \b snapshot_interval,
+   * \b snapshot_resume or \b sched_allv.
    *
    * \see graphlab::omni_engine
    * \see graphlab::async_consistent_engine
@@ -383,6 +431,9 @@ namespace graphlab {
     /// \brief The target base name the snapshot is saved in.
     std::string snapshot_path;
 
+    /// \brief If true start() resumes from the latest snapshot
+    bool snapshot_resume;
+
     /**
      * \brief A counter that tracks the current iteration number since
      * start was last invoked.
@@ -404,6 +455,12 @@ namespace graphlab {
      */
     bool sched_allv;
 
+    /**
+     * \brief The number of super-steps a machine may run ahead of the
+     * slowest machine. 0 runs the usual bulk synchronous schedule.
+     */
+    size_t staleness;
+
     /**
      * \brief Used to stop the engine prematurely
      */
@@ -515,6 +572,13 @@ namespace graphlab {
      */
     atomic<size_t> shared_lvid_counter;
 
+    /**
+     * \brief The next block of each NUMA range of the graph, used
+     * instead of shared_lvid_counter when the graph is split across
+     * NUMA nodes.
+     */
+    std::vector<atomic<size_t> > numa_lvid_counter;
+
 
     /**
      * \brief The pair type used to synchronize vertex programs across machines.
@@ -580,6 +644,140 @@ namespace graphlab {
      */
     message_exchange_type message_exchange;
 
+    // Stale-synchronous state ================================================
+    /**
+     * \brief A gather partial which may be empty. Mirrors always reply
+     * to a gather request so that the master can count the replies.
+     */
+    typedef conditional_addition_wrapper<gather_type> conditional_gather_type;
+    typedef std::pair<vertex_id_type, conditional_gather_type>
+                                                        vid_partial_pair_type;
+
+    /**
+     * \internal
+     * \brief Everything one machine sends to another during one
+     * super-step in stale-synchronous mode.
+     *
+     * Exactly one batch is sent to every other machine per super-step,
+     * so the number of batches received from a machine is its clock.
+     */
+    struct ssp_batch {
+      /// the super-step of the sender which produced this batch
+      size_t step;
+      /// true if the sender had no work left, had received all batches
+      /// of earlier super-steps and sent nothing in this one
+      bool quiet;
+      /// execution_status::RUNNING unless the sender is stopping
+      int status;
+      /// messages from mirrors (or remote signals) to masters
+      std::vector<vid_message_pair_type> messages;
+      /// master vertex programs for which the mirror should gather
+      std::vector<vid_prog_pair_type> gather_requests;
+      /// mirror partial gathers replying to the gather requests
+      std::vector<vid_partial_pair_type> partials;
+      /// vertex data of masters that completed an apply
+      std::vector<vid_vdata_pair_type> vdata;
+      /// master vertex programs for which the mirror should scatter
+      std::vector<vid_prog_pair_type> scatters;
+
+      ssp_batch() : step(0), quiet(false), status(execution_status::RUNNING) { }
+
+      bool empty() const {
+        return messages.empty() && gather_requests.empty() &&
+          partials.empty() && vdata.empty() && scatters.empty();
+      }
+
+      void clear() {
+        messages.clear(); gather_requests.clear(); partials.clear();
+        vdata.clear(); scatters.clear();
+      }
+
+      void append(const ssp_batch& other) {
+        messages.insert(messages.end(),
+                        other.messages.begin(), other.messages.end());
+        gather_requests.insert(gather_requests.end(),
+                               other.gather_requests.begin(),
+                               other.gather_requests.end());
+        partials.insert(partials.end(),
+                        other.partials.begin(), other.partials.end());
+        vdata.insert(vdata.end(), other.vdata.begin(), other.vdata.end());
+        scatters.insert(scatters.end(),
+                        other.scatters.begin(), other.scatters.end());
+      }
+
+      void save(oarchive& oarc) const {
+        oarc << step << quiet << status << messages << gather_requests
+             << partials << vdata << scatters;
+      }
+      void load(iarchive& iarc) {
+        iarc >> step >> quiet >> status >> messages >> gather_requests
+             >> partials >> vdata >> scatters;
+      }
+    };
+
+    /**
+     * \brief Outgoing batches indexed by [thread][target machine]
+     */
+    std::vector<std::vector<ssp_batch> > ssp_outbox;
+
+    /**
+     * \brief Messages of remote signals (icontext::signal_vid) waiting
+     * for the next batch, indexed by target machine. Protected by
+     * ssp_lock.
+     */
+    std::vector<std::vector<vid_message_pair_type> > ssp_signal_outbox;
+
+    /**
+     * \brief Protects the batch inbox and the clocks below.
+     */
+    mutex ssp_lock;
+    conditional ssp_cond;
+
+    /**
+     * \brief Batches received but not yet processed.
+     */
+    std::vector<std::pair<procid_t, ssp_batch> > ssp_inbox;
+
+    /**
+     * \brief For each machine, the number of consecutive super-steps
+     * (starting from 0) for which its batch has been received.
+     */
+    std::vector<size_t> ssp_clock;
+
+    /**
+     * \brief Super-steps received from each machine ahead of its clock.
+     */
+    std::vector<std::set<size_t> > ssp_early;
+
+    /**
+     * \brief Number of quiet batches received for each super-step.
+     */
+    std::map<size_t, size_t> ssp_quiet;
+
+    /**
+     * \brief Set to the reason if another machine is stopping.
+     */
+    int ssp_status;
+
+    /**
+     * \brief The number of mirror partials a gathering master is still
+     * waiting for.
+     */
+    std::vector<procid_t> ssp_pending;
+
+    /**
+     * \brief Masters waiting for mirror partials. A master does not
+     * consume new messages until its current gather completes.
+     */
+    dense_bitset ssp_gathering;
+    atomic<size_t> ssp_num_gathering;
+
+    /**
+     * \brief Gather requests received at the beginning of the
+     * super-step. Installed after the pending mirror scatters ran.
+     */
+    std::vector<vid_prog_pair_type> ssp_gather_requests;
+
 
     /**
      * \brief The distributed aggregator used to manage background
@@ -587,6 +785,19 @@ namespace graphlab {
      */
     aggregator_type aggregator;
 
+    /**
+     * \brief Writes the snapshots of the graph and the engine state.
+     */
+    incremental_snapshot<graph_type> snapshot;
+
+    /**
+     * \brief Records the per super-step, per phase statistics.
+     */
+    engine_profiler profiler;
+
+    /// \brief If set, the profile is written to this file by start()
+    std::string profile_file;
+
     DECLARE_EVENT(EVENT_APPLIES);
     DECLARE_EVENT(EVENT_GATHERS);
     DECLARE_EVENT(EVENT_SCATTERS);
@@ -656,6 +867,10 @@ namespace graphlab {
                     const message_type& message = message_type(),
                     const std::string& order = "shuffle");
 
+    // documentation inherited from iengine
+    void signal_changed(edge_dir_type neighborhood = ALL_EDGES,
+                        const message_type& message = message_type());
+
 
     // documentation inherited from iengine
     float elapsed_seconds() const;
@@ -794,7 +1009,57 @@ namespace graphlab {
      */
     template<typename MemberFunction>
     void run_synchronous(MemberFunction member_fun) {
+      run_local(member_fun);
+      rmi.barrier();
+    } // end of run_synchronous
+
+    /**
+     * \brief Same as run_synchronous but records the phase in the
+     * profiler.
+     */
+    template<typename MemberFunction>
+    void run_synchronous(engine_profiler::phase_type phase,
+                         MemberFunction member_fun) {
+      profiler.begin_phase(phase);
+      run_local(member_fun);
+      profiler.begin_machine_barrier();
+      rmi.barrier();
+      profiler.end_phase(phase);
+    } // end of run_synchronous
+
+    /**
+     * \brief Same as run_local but records the phase in the profiler.
+     */
+    template<typename MemberFunction>
+    void run_local(engine_profiler::phase_type phase,
+                   MemberFunction member_fun) {
+      profiler.begin_phase(phase);
+      run_local(member_fun);
+      profiler.end_phase(phase);
+    } // end of run_local
+
+    /**
+     * \brief Waits for the other engine threads, recording the wait in
+     * the profiler.
+     */
+    void wait_thread_barrier(size_t thread_id) {
+      timer ti;
+      thread_barrier.wait();
+      profiler.add_thread_barrier_wait(thread_id, ti.current_time());
+    }
+
+    /**
+     * \brief Same as run_synchronous but without the rmi barrier, so
+     * the other machines do not participate.
+     */
+    template<typename MemberFunction>
+    void run_local(MemberFunction member_fun) {
       shared_lvid_counter = 0;
+      const std::vector<lvid_type>& numa_ranges = graph.numa_ranges();
+      numa_lvid_counter.resize(numa_ranges.size());
+      for (size_t i = 0; i < numa_ranges.size(); ++i) {
+        numa_lvid_counter[i] = numa_ranges[i];
+      }
       if (ncpus <= 1) {
         INCREMENT_EVENT(EVENT_ACTIVE_CPUS, 1);
       }
@@ -810,11 +1075,10 @@ namespace graphlab {
       }
       // Wait for all threads to finish
       threads.join();
-      rmi.barrier();
       if (ncpus <= 1) {
         DECREMENT_EVENT(EVENT_ACTIVE_CPUS, 1);
       }
-    } // end of run_synchronous
+    } // end of run_local
 
     // /**
     //  * \brief Initialize all vertex programs by invoking
@@ -825,6 +1089,17 @@ namespace graphlab {
     //  */
     // void initialize_vertex_programs(size_t thread_id);
 
+    /**
+     * \brief Claims the next block of 64 local vertices for a thread.
+     *
+     * If the graph is split across NUMA nodes the thread first drains the
+     * range of the node it runs on, and then helps with the ranges of the
+     * other nodes.
+     *
+     * @return false once all vertices have been claimed
+     */
+    bool next_lvid_block(size_t thread_id, lvid_type& lvid_block_start);
+
     /**
      * \brief Synchronize all message data.
      *
@@ -876,6 +1151,23 @@ namespace graphlab {
      */
     void execute_scatters(size_t thread_id);
 
+    /**
+     * \brief Compute the local contribution to the gather of a vertex
+     * using the given vertex program, reading from and updating the
+     * gather cache if caching is enabled.
+     *
+     * @return true if accum was set.
+     */
+    bool compute_local_gather(context_type& context, lvid_type lvid,
+                              const vertex_program_type& vprog,
+                              gather_type& accum);
+
+    /**
+     * \brief Run the scatter of the vertex program stored for lvid on
+     * the local edges and clear the vertex program.
+     */
+    void scatter_vertex(context_type& context, lvid_type lvid);
+
     // Data Synchronization ===================================================
     /**
      * \brief Send the vertex program for the local vertex id to all
@@ -951,6 +1243,103 @@ namespace graphlab {
      */
     void recv_messages();
 
+    // Stale-synchronous execution ============================================
+    /**
+     * \brief The main loop used when staleness > 0.
+     *
+     * Each super-step consists of:
+     * \li processing all batches received so far (messages, gather
+     * requests and partials, vertex data and scatter requests),
+     * \li running the scatters and then the gathers requested by remote
+     * masters on local mirrors,
+     * \li receiving messages on masters which are not gathering, running
+     * init and the local part of the gather, and requesting the
+     * remaining partials from the mirrors,
+     * \li running apply and the local scatter on masters whose gather
+     * is complete, and forwarding the vertex data (and vertex program
+     * if a scatter is required) to the mirrors,
+     * \li sending one batch to every other machine and waiting until
+     * every machine has completed super-step (current - staleness).
+     *
+     * The engine terminates once every machine reports a quiet batch
+     * for the same super-step.
+     */
+    execution_status::status_enum run_stale_synchronous();
+
+    /**
+     * \brief Clear the clocks and per-vertex state of the
+     * stale-synchronous mode. Must be called on all machines before a
+     * barrier preceding the first super-step.
+     */
+    void ssp_reset();
+
+    /**
+     * \brief Process all batches received so far.
+     *
+     * @return true if all batches of earlier super-steps had been
+     * received.
+     */
+    bool ssp_recv_batches();
+
+    /**
+     * \brief Run the gathers requested by remote masters and reply
+     * with the partials.
+     */
+    void ssp_execute_mirror_gathers(size_t thread_id);
+
+    /**
+     * \brief Forward mirror messages to the masters and start the
+     * gather of every master with messages that is not gathering.
+     */
+    void ssp_receive_messages(size_t thread_id);
+
+    /**
+     * \brief Apply every master whose gather is complete.
+     */
+    void ssp_execute_applys(size_t thread_id);
+
+    /**
+     * \brief Send one batch to every other machine.
+     *
+     * @param [in] status execution_status::RUNNING or the reason
+     * this machine stops.
+     * @param [in] idle_and_drained true if this machine has no work
+     * left and processed every batch of the earlier super-steps.
+     *
+     * @return true if the batches were quiet.
+     */
+    bool ssp_send_batches(int status, bool idle_and_drained);
+
+    /**
+     * \brief Block until every other machine completed at least
+     * nsteps super-steps or is stopping.
+     */
+    void ssp_wait(size_t nsteps);
+
+    /**
+     * \brief Called after the final full barrier: applies the vertex
+     * data still sitting in the inbox so mirrors are consistent, keeps
+     * the messages for the next start() and drops incomplete gathers.
+     */
+    void ssp_finish();
+
+    /**
+     * \brief Serializes the state restored by snapshot_resume: the
+     * iteration counter, the pending messages and the gather cache.
+     * Only valid between iterations.
+     */
+    std::string save_engine_state() const;
+
+    /**
+     * \brief Restores the state saved by save_engine_state().
+     */
+    void load_engine_state(const std::string& state);
+
+    /**
+     * \brief Receives a batch from another machine.
+     */
+    void rpc_ssp_batch(procid_t src, const ssp_batch& batch);
+
 
   }; // end of class synchronous engine
 
@@ -1006,13 +1395,16 @@ namespace graphlab {
     ncpus(opts.get_ncpus()),
     threads(2*1024*1024 /* 2MB stack per fiber*/),
     thread_barrier(opts.get_ncpus()),
-    max_iterations(-1), snapshot_interval(-1), iteration_counter(0),
-    timeout(0), sched_allv(false),
+    max_iterations(-1), snapshot_interval(-1), snapshot_resume(false),
+    iteration_counter(0),
+    timeout(0), sched_allv(false), staleness(0),
     vprog_exchange(dc),
     vdata_exchange(dc),
     gather_exchange(dc),
     message_exchange(dc),
-    aggregator(dc, graph, new context_type(*this, graph)) {
+    aggregator(dc, graph, new context_type(*this, graph)),
+    snapshot(dc, graph),
+    profiler(dc, opts.get_ncpus()) {
     // Process any additional options
     std::vector<std::string> keys = opts.get_engine_args().get_option_keys();
     per_thread_compute_time.resize(opts.get_ncpus());
@@ -1043,11 +1435,40 @@ namespace graphlab {
         if (rmi.procid() == 0)
           logstream(LOG_EMPH) << "Engine Option: snapshot_path = "
             << snapshot_path << std::endl;
+      } else if (opt == "snapshot_resume") {
+        opts.get_engine_args().get_option("snapshot_resume", snapshot_resume);
+        if (rmi.procid() == 0)
+          logstream(LOG_EMPH) << "Engine Option: snapshot_resume = "
+            << snapshot_resume << std::endl;
       } else if (opt == "sched_allv") {
         opts.get_engine_args().get_option("sched_allv", sched_allv);
         if (rmi.procid() == 0)
           logstream(LOG_EMPH) << "Engine Option: sched_allv = "
             << sched_allv << std::endl;
+      } else if (opt == "profile") {
+        bool profile = true;
+        opts.get_engine_args().get_option("profile", profile);
+        profiler.set_enabled(profile);
+        if (rmi.procid() == 0)
+          logstream(LOG_EMPH) << "Engine Option: profile = "
+            << profile << std::endl;
+      } else if (opt == "profile_history") {
+        size_t profile_history = engine_profiler::DEFAULT_HISTORY;
+        opts.get_engine_args().get_option("profile_history", profile_history);
+        profiler.set_history(profile_history);
+        if (rmi.procid() == 0)
+          logstream(LOG_EMPH) << "Engine Option: profile_history = "
+            << profile_history << std::endl;
+      } else if (opt == "profile_file") {
+        opts.get_engine_args().get_option("profile_file", profile_file);
+        if (rmi.procid() == 0)
+          logstream(LOG_EMPH) << "Engine Option: profile_file = "
+            << profile_file << std::endl;
+      } else if (opt == "staleness") {
+        opts.get_engine_args().get_option("staleness", staleness);
+        if (rmi.procid() == 0)
+          logstream(LOG_EMPH) << "Engine Option: staleness = "
+            << staleness << std::endl;
       } else {
         logstream(LOG_FATAL) << "Unexpected Engine Option: " << opt << std::endl;
       }
@@ -1057,6 +1478,18 @@ namespace graphlab {
       logstream(LOG_FATAL)
         << "Snapshot interval specified, but no snapshot path" << std::endl;
     }
+    if ((snapshot_interval >= 0 || snapshot_resume) &&
+        !snapshot.valid_prefix(snapshot_path)) {
+      logstream(LOG_FATAL)
+        << "snapshot_path must be a non-empty posix path" << std::endl;
+    }
+    if (staleness > 0 && (snapshot_interval > 0 || snapshot_resume ||
+                          sched_allv)) {
+      logstream(LOG_FATAL)
+        << "staleness cannot be combined with snapshot_interval, "
+        << "snapshot_resume or sched_allv" << std::endl;
+    }
+    ssp_signal_outbox.resize(rmi.numprocs());
     INITIALIZE_EVENT_LOG(dc);
     ADD_CUMULATIVE_EVENT(EVENT_APPLIES, "Applies", "Calls");
     ADD_CUMULATIVE_EVENT(EVENT_GATHERS , "Gathers", "Calls");
@@ -1170,6 +1603,15 @@ namespace graphlab {
   } // end of signal all
 
 
+  template<typename VertexProgram>
+  void synchronous_engine<VertexProgram>::
+  signal_changed(edge_dir_type neighborhood, const message_type& message) {
+    vertex_set vset = graph.changed_vertices();
+    if (neighborhood != NO_EDGES) vset |= graph.neighbors(vset, neighborhood);
+    signal_vset(vset, message);
+  } // end of signal changed
+
+
   template<typename VertexProgram>
   void synchronous_engine<VertexProgram>::
   internal_signal(const vertex_type& vertex,
@@ -1191,6 +1633,13 @@ namespace graphlab {
   internal_signal_gvid(vertex_id_type gvid, const message_type& message) {
     procid_t proc = graph.master(gvid);
     if(proc == rmi.procid()) internal_signal_rpc(gvid, message);
+    else if (staleness > 0) {
+      // the signal must travel with the batches so that it is seen by
+      // the termination detection
+      ssp_lock.lock();
+      ssp_signal_outbox[proc].push_back(std::make_pair(gvid, message));
+      ssp_lock.unlock();
+    }
     else rmi.remote_call(proc, 
                          &synchronous_engine<VertexProgram>::internal_signal_rpc,
                          gvid, message);
@@ -1271,6 +1720,7 @@ namespace graphlab {
   synchronous_engine<VertexProgram>::start() {
     if (vlocks.size() != graph.num_local_vertices())
       resize();
+    graph.clear_changed_vertices();
     completed_applys = 0;
     rmi.barrier();
 
@@ -1287,11 +1737,23 @@ namespace graphlab {
     //   // Initialize all vertex programs
     //   run_synchronous( &synchronous_engine::initialize_vertex_programs );
     // }
+    if (staleness > 0) ssp_reset();
     aggregator.start();
     rmi.barrier();
 
-    if (snapshot_interval == 0) {
-      graph.save_binary(snapshot_path);
+    if (snapshot_resume) {
+      std::string engine_state;
+      size_t resume_iteration;
+      if (snapshot.restore(snapshot_path, resume_iteration, engine_state)) {
+        load_engine_state(engine_state);
+        if (rmi.procid() == 0) {
+          logstream(LOG_EMPH) << "Resuming from iteration "
+                              << iteration_counter << std::endl;
+        }
+      }
+    }
+    if (snapshot_interval >= 0) {
+      snapshot.save_base(snapshot_path);
     }
 
     float last_print = -5;
@@ -1300,7 +1762,9 @@ namespace graphlab {
                         << std::endl;
     }
     // Program Main loop ====================================================
-    while(iteration_counter < max_iterations && !force_abort ) {
+    if (staleness > 0) termination_reason = run_stale_synchronous();
+    while(staleness == 0 &&
+          iteration_counter < max_iterations && !force_abort ) {
 
       // Check first to see if we are out of time
       if(timeout != 0 && timeout < elapsed_seconds()) {
@@ -1322,11 +1786,13 @@ namespace graphlab {
       active_superstep.clear(); active_minorstep.clear();
       has_gather_accum.clear();
       rmi.barrier();
+      profiler.begin_superstep(iteration_counter);
 
       // Exchange Messages --------------------------------------------------
       // Exchange any messages in the local message vectors
       // if (rmi.procid() == 0) std::cout << "Exchange messages..." << std::endl;
-      run_synchronous( &synchronous_engine::exchange_messages );
+      run_synchronous( engine_profiler::EXCHANGE,
+                       &synchronous_engine::exchange_messages );
       /**
        * Post conditions:
        *   1) only master vertices have messages
@@ -1339,7 +1805,8 @@ namespace graphlab {
 
       // if (rmi.procid() == 0) std::cout << "Receive messages..." << std::endl;
       num_active_vertices = 0;
-      run_synchronous( &synchronous_engine::receive_messages );
+      run_synchronous( engine_profiler::RECEIVE,
+                       &synchronous_engine::receive_messages );
       if (sched_allv) {
         active_minorstep.fill();
       }
@@ -1356,6 +1823,7 @@ namespace graphlab {
        *      received messages.
        */
 
+      profiler.add_active_vertices(num_active_vertices);
       // Check termination condition  ---------------------------------------
       size_t total_active_vertices = num_active_vertices;
       rmi.all_reduce(total_active_vertices);
@@ -1364,6 +1832,8 @@ namespace graphlab {
           << "\tActive vertices: " << total_active_vertices << std::endl;
       if(total_active_vertices == 0 ) {
         termination_reason = execution_status::TASK_DEPLETION;
+        // record the exchange of the final superstep too
+        profiler.end_superstep();
         break;
       }
 
@@ -1372,7 +1842,8 @@ namespace graphlab {
       // Execute the gather operation for all vertices that are active
       // in this minor-step (active-minorstep bit set).
       // if (rmi.procid() == 0) std::cout << "Gathering..." << std::endl;
-      run_synchronous( &synchronous_engine::execute_gathers );
+      run_synchronous( engine_profiler::GATHER,
+                       &synchronous_engine::execute_gathers );
       // Clear the minor step bit since only super-step vertices
       // (only master vertices are required to participate in the
       // apply step)
@@ -1388,7 +1859,8 @@ namespace graphlab {
       // Execute Apply Operations -------------------------------------------
       // Run the apply function on all active vertices
       // if (rmi.procid() == 0) std::cout << "Applying..." << std::endl;
-      run_synchronous( &synchronous_engine::execute_applys );
+      run_synchronous( engine_profiler::APPLY,
+                       &synchronous_engine::execute_applys );
       /**
        * Post conditions:
        *   1) any changes to the vertex data have been synchronized
@@ -1403,7 +1875,8 @@ namespace graphlab {
 
       // Execute Scatter Operations -----------------------------------------
       // Execute each of the scatters on all minor-step active vertices.
-      run_synchronous( &synchronous_engine::execute_scatters );
+      run_synchronous( engine_profiler::SCATTER,
+                       &synchronous_engine::execute_scatters );
       /**
        * Post conditions:
        *   1) NONE
@@ -1411,14 +1884,21 @@ namespace graphlab {
       if(rmi.procid() == 0 && print_this_round)
         logstream(LOG_EMPH) << "\t Running Aggregators" << std::endl;
       // probe the aggregator
+      profiler.begin_phase(engine_profiler::AGGREGATE);
       aggregator.tick_synchronous();
+      profiler.end_phase(engine_profiler::AGGREGATE);
+      profiler.end_superstep();
 
       ++iteration_counter;
 
       if (snapshot_interval > 0 && iteration_counter % snapshot_interval == 0) {
-        graph.save_binary(snapshot_path);
+        snapshot.save_delta(iteration_counter, save_engine_state());
+      } else {
+        snapshot.poll();
       }
     }
+    // make sure the last snapshot is complete before returning
+    snapshot.wait();
 
     if (rmi.procid() == 0) {
       logstream(LOG_EMPH) << iteration_counter
@@ -1445,6 +1925,11 @@ namespace graphlab {
       logstream(LOG_INFO) << std::endl;
     }
     rmi.full_barrier();
+    if (staleness > 0) ssp_finish();
+    if (profiler.is_enabled()) {
+      profiler.flush();
+      if (!profile_file.empty()) profiler.save_json(profile_file);
+    }
     // Stop the aggregator
     aggregator.stop();
     // return the final reason for termination
@@ -1453,6 +1938,89 @@ namespace graphlab {
 
 
 
+  template<typename VertexProgram>
+  std::string synchronous_engine<VertexProgram>::save_engine_state() const {
+    std::stringstream strm;
+    oarchive oarc(strm);
+    oarc << iteration_counter << size_t(has_message.popcount());
+    foreach(size_t lvid, has_message) {
+      serialize_varint(oarc, lvid);
+      oarc << messages[lvid];
+    }
+    const bool caching_enabled = !gather_cache.empty();
+    oarc << caching_enabled;
+    if (caching_enabled) {
+      oarc << size_t(has_cache.popcount());
+      foreach(size_t lvid, has_cache) {
+        serialize_varint(oarc, lvid);
+        oarc << gather_cache[lvid];
+      }
+    }
+    strm.flush();
+    return strm.str();
+  } // end of save_engine_state
+
+
+  template<typename VertexProgram>
+  void synchronous_engine<VertexProgram>::
+  load_engine_state(const std::string& state) {
+    std::stringstream strm(state);
+    iarchive iarc(strm);
+    size_t nmessages;
+    iarc >> iteration_counter >> nmessages;
+    has_message.clear();
+    for (size_t i = 0; i < nmessages; ++i) {
+      lvid_type lvid;
+      deserialize_varint(iarc, lvid);
+      iarc >> messages[lvid];
+      has_message.set_bit(lvid);
+    }
+    bool caching_enabled;
+    iarc >> caching_enabled;
+    if (caching_enabled != !gather_cache.empty()) {
+      logstream(LOG_FATAL) << "The snapshot was taken with use_cache = "
+                           << caching_enabled << std::endl;
+    }
+    if (caching_enabled) {
+      size_t ncached;
+      iarc >> ncached;
+      has_cache.clear();
+      for (size_t i = 0; i < ncached; ++i) {
+        lvid_type lvid;
+        deserialize_varint(iarc, lvid);
+        iarc >> gather_cache[lvid];
+        has_cache.set_bit(lvid);
+      }
+    }
+  } // end of load_engine_state
+
+
+
+  template<typename VertexProgram>
+  bool synchronous_engine<VertexProgram>::
+  next_lvid_block(const size_t thread_id, lvid_type& lvid_block_start) {
+    const std::vector<lvid_type>& numa_ranges = graph.numa_ranges();
+    if (numa_ranges.empty()) {
+      lvid_block_start = shared_lvid_counter.inc_ret_last(8 * sizeof(size_t));
+      return lvid_block_start < graph.num_local_vertices();
+    }
+    fiber_control& fc = fiber_control::get_instance();
+    const size_t nnodes = numa_ranges.size() - 1;
+    const size_t home = fc.worker_numa_node(thread_id % fc.num_workers());
+    for (size_t i = 0; i < nnodes; ++i) {
+      const size_t node = (home + i) % nnodes;
+      const size_t end = numa_ranges[node + 1];
+      if (numa_lvid_counter[node].value >= end) continue;
+      const size_t start = numa_lvid_counter[node].inc_ret_last(8 * sizeof(size_t));
+      if (start < end) {
+        lvid_block_start = start;
+        return true;
+      }
+    }
+    return false;
+  } // end of next_lvid_block
+
+
   template<typename VertexProgram>
   void synchronous_engine<VertexProgram>::
   exchange_messages(const size_t thread_id) {
@@ -1462,9 +2030,8 @@ namespace graphlab {
     fixed_dense_bitset<8 * sizeof(size_t)> local_bitset; // a word-size = 64 bit
     while (1) {
       // increment by a word at a time
-      lvid_type lvid_block_start =
-                  shared_lvid_counter.inc_ret_last(8 * sizeof(size_t));
-      if (lvid_block_start >= graph.num_local_vertices()) break;
+      lvid_type lvid_block_start;
+      if (!next_lvid_block(thread_id, lvid_block_start)) break;
       // get the bit field from has_message
       size_t lvid_bit_block = has_message.containing_word(lvid_block_start);
       if (lvid_bit_block == 0) continue;
@@ -1486,10 +2053,11 @@ namespace graphlab {
       }
     } // end of loop over vertices to send messages
     message_exchange.partial_flush();
+    if (thread_id == 0) profiler.sample_queue_length(message_exchange.size());
     // Finish sending and receiving all messages
-    thread_barrier.wait();
+    wait_thread_barrier(thread_id);
     if(thread_id == 0) message_exchange.flush();
-    thread_barrier.wait();
+    wait_thread_barrier(thread_id);
     recv_messages();
   } // end of exchange_messages
 
@@ -1506,9 +2074,8 @@ namespace graphlab {
 
     while (1) {
       // increment by a word at a time
-      lvid_type lvid_block_start =
-                  shared_lvid_counter.inc_ret_last(8 * sizeof(size_t));
-      if (lvid_block_start >= graph.num_local_vertices()) break;
+      lvid_type lvid_block_start;
+      if (!next_lvid_block(thread_id, lvid_block_start)) break;
       // get the bit field from has_message
       size_t lvid_bit_block = has_message.containing_word(lvid_block_start);
       if (lvid_bit_block == 0) continue;
@@ -1546,13 +2113,14 @@ namespace graphlab {
 
     num_active_vertices += nactive_inc;
     vprog_exchange.partial_flush();
+    if (thread_id == 0) profiler.sample_queue_length(vprog_exchange.size());
     // Flush the buffer and finish receiving any remaining vertex
     // programs.
-    thread_barrier.wait();
+    wait_thread_barrier(thread_id);
     if(thread_id == 0) {
       vprog_exchange.flush();
     }
-    thread_barrier.wait();
+    wait_thread_barrier(thread_id);
 
     recv_vertex_programs();
 
@@ -1565,16 +2133,14 @@ namespace graphlab {
     context_type context(*this, graph);
     const size_t TRY_RECV_MOD = 1000;
     size_t vcount = 0;
-    const bool caching_enabled = !gather_cache.empty();
     timer ti;
 
     fixed_dense_bitset<8 * sizeof(size_t)> local_bitset; // a word-size = 64 bit
 
     while (1) {
       // increment by a word at a time
-      lvid_type lvid_block_start =
-                  shared_lvid_counter.inc_ret_last(8 * sizeof(size_t));
-      if (lvid_block_start >= graph.num_local_vertices()) break;
+      lvid_type lvid_block_start;
+      if (!next_lvid_block(thread_id, lvid_block_start)) break;
       // get the bit field from has_message
       size_t lvid_bit_block = active_minorstep.containing_word(lvid_block_start);
       if (lvid_bit_block == 0) continue;
@@ -1586,61 +2152,9 @@ namespace graphlab {
         lvid_type lvid = lvid_block_start + lvid_block_offset;
         if (lvid >= graph.num_local_vertices()) break;
 
-        bool accum_is_set = false;
         gather_type accum = gather_type();
-        // if caching is enabled and we have a cache entry then use
-        // that as the accum
-        if( caching_enabled && has_cache.get(lvid) ) {
-          accum = gather_cache[lvid];
-          accum_is_set = true;
-        } else {
-          // recompute the local contribution to the gather
-          const vertex_program_type& vprog = vertex_programs[lvid];
-          local_vertex_type local_vertex = graph.l_vertex(lvid);
-          const vertex_type vertex(local_vertex);
-          const edge_dir_type gather_dir = vprog.gather_edges(context, vertex);
-          // Loop over in edges
-          size_t edges_touched = 0;
-          vprog.pre_local_gather(accum);
-          if(gather_dir == IN_EDGES || gather_dir == ALL_EDGES) {
-            foreach(local_edge_type local_edge, local_vertex.in_edges()) {
-              edge_type edge(local_edge);
-              // elocks[local_edge.id()].lock();
-              if(accum_is_set) { // \todo hint likely
-                accum += vprog.gather(context, vertex, edge);
-              } else {
-                accum = vprog.gather(context, vertex, edge);
-                accum_is_set = true;
-              }
-              ++edges_touched;
-              // elocks[local_edge.id()].unlock();
-            }
-          } // end of if in_edges/all_edges
-            // Loop over out edges
-          if(gather_dir == OUT_EDGES || gather_dir == ALL_EDGES) {
-            foreach(local_edge_type local_edge, local_vertex.out_edges()) {
-              edge_type edge(local_edge);
-              // elocks[local_edge.id()].lock();
-              if(accum_is_set) { // \todo hint likely
-                accum += vprog.gather(context, vertex, edge);
-              } else {
-                accum = vprog.gather(context, vertex, edge);
-                accum_is_set = true;
-              }
-              // elocks[local_edge.id()].unlock();
-              ++edges_touched;
-            }
-            INCREMENT_EVENT(EVENT_GATHERS, edges_touched);
-          } // end of if out_edges/all_edges
-          vprog.post_local_gather(accum);
-          // If caching is enabled then save the accumulator to the
-          // cache for future iterations.  Note that it is possible
-          // that the accumulator was never set in which case we are
-          // effectively "zeroing out" the cache.
-          if(caching_enabled && accum_is_set) {
-            gather_cache[lvid] = accum; has_cache.set_bit(lvid);
-          } // end of if caching enabled
-        }
+        const bool accum_is_set =
+          compute_local_gather(context, lvid, vertex_programs[lvid], accum);
         // If the accum contains a value for the local gather we put
         // that estimate in the gather exchange.
         if(accum_is_set) sync_gather(lvid, accum, thread_id);
@@ -1655,14 +2169,78 @@ namespace graphlab {
     } // end of loop over vertices to compute gather accumulators
     per_thread_compute_time[thread_id] += ti.current_time();
     gather_exchange.partial_flush();
+    if (thread_id == 0) profiler.sample_queue_length(gather_exchange.size());
       // Finish sending and receiving all gather operations
-    thread_barrier.wait();
+    wait_thread_barrier(thread_id);
     if(thread_id == 0) gather_exchange.flush();
-    thread_barrier.wait();
+    wait_thread_barrier(thread_id);
     recv_gathers();
   } // end of execute_gathers
 
 
+  template<typename VertexProgram>
+  bool synchronous_engine<VertexProgram>::
+  compute_local_gather(context_type& context, lvid_type lvid,
+                       const vertex_program_type& vprog,
+                       gather_type& accum) {
+    const bool caching_enabled = !gather_cache.empty();
+    bool accum_is_set = false;
+    // if caching is enabled and we have a cache entry then use
+    // that as the accum
+    if( caching_enabled && has_cache.get(lvid) ) {
+      accum = gather_cache[lvid];
+      accum_is_set = true;
+    } else {
+      // recompute the local contribution to the gather
+      local_vertex_type local_vertex = graph.l_vertex(lvid);
+      const vertex_type vertex(local_vertex);
+      const edge_dir_type gather_dir = vprog.gather_edges(context, vertex);
+      // Loop over in edges
+      size_t edges_touched = 0;
+      vprog.pre_local_gather(accum);
+      if(gather_dir == IN_EDGES || gather_dir == ALL_EDGES) {
+        foreach(local_edge_type local_edge, local_vertex.in_edges()) {
+          edge_type edge(local_edge);
+          // elocks[local_edge.id()].lock();
+          if(accum_is_set) { // \todo hint likely
+            accum += vprog.gather(context, vertex, edge);
+          } else {
+            accum = vprog.gather(context, vertex, edge);
+            accum_is_set = true;
+          }
+          ++edges_touched;
+          // elocks[local_edge.id()].unlock();
+        }
+      } // end of if in_edges/all_edges
+      // Loop over out edges
+      if(gather_dir == OUT_EDGES || gather_dir == ALL_EDGES) {
+        foreach(local_edge_type local_edge, local_vertex.out_edges()) {
+          edge_type edge(local_edge);
+          // elocks[local_edge.id()].lock();
+          if(accum_is_set) { // \todo hint likely
+            accum += vprog.gather(context, vertex, edge);
+          } else {
+            accum = vprog.gather(context, vertex, edge);
+            accum_is_set = true;
+          }
+          // elocks[local_edge.id()].unlock();
+          ++edges_touched;
+        }
+        INCREMENT_EVENT(EVENT_GATHERS, edges_touched);
+      } // end of if out_edges/all_edges
+      vprog.post_local_gather(accum);
+      // If caching is enabled then save the accumulator to the
+      // cache for future iterations.  Note that it is possible
+      // that the accumulator was never set in which case we are
+      // effectively "zeroing out" the cache.
+      if(caching_enabled && accum_is_set) {
+        gather_cache[lvid] = accum; has_cache.set_bit(lvid);
+      } // end of if caching enabled
+    }
+    return accum_is_set;
+  } // end of compute_local_gather
+
+
   template<typename VertexProgram>
   void synchronous_engine<VertexProgram>::
   execute_applys(const size_t thread_id) {
@@ -1674,9 +2252,8 @@ namespace graphlab {
     fixed_dense_bitset<8 * sizeof(size_t)> local_bitset;  // allocate a word size = 64bits
     while (1) {
       // increment by a word at a time
-      lvid_type lvid_block_start =
-                  shared_lvid_counter.inc_ret_last(8 * sizeof(size_t));
-      if (lvid_block_start >= graph.num_local_vertices()) break;
+      lvid_type lvid_block_start;
+      if (!next_lvid_block(thread_id, lvid_block_start)) break;
       // get the bit field from has_message
       size_t lvid_bit_block = active_superstep.containing_word(lvid_block_start);
       if (lvid_bit_block == 0) continue;
@@ -1694,6 +2271,8 @@ namespace graphlab {
         // the gather_accum was not set during the gather.
         const gather_type& accum = gather_accum[lvid];
         INCREMENT_EVENT(EVENT_APPLIES, 1);
+        // the snapshot being written must see the value before apply
+        if (snapshot.writing()) snapshot.capture_vertex(lvid);
         vertex_programs[lvid].apply(context, vertex, accum);
         // record an apply as a completed task
         ++completed_applys;
@@ -1722,12 +2301,16 @@ namespace graphlab {
     per_thread_compute_time[thread_id] += ti.current_time();
     vprog_exchange.partial_flush();
     vdata_exchange.partial_flush();
+    if (thread_id == 0) {
+      profiler.sample_queue_length(vprog_exchange.size() +
+                                   vdata_exchange.size());
+    }
       // Finish sending and receiving all changes due to apply operations
-    thread_barrier.wait();
+    wait_thread_barrier(thread_id);
     if(thread_id == 0) { 
       vprog_exchange.flush(); vdata_exchange.flush(); 
     }
-    thread_barrier.wait();
+    wait_thread_barrier(thread_id);
     recv_vertex_programs();
     recv_vertex_data();
   } // end of execute_applys
@@ -1743,9 +2326,8 @@ namespace graphlab {
     fixed_dense_bitset<8 * sizeof(size_t)> local_bitset; // allocate a word size = 64 bits
     while (1) {
       // increment by a word at a time
-      lvid_type lvid_block_start =
-                  shared_lvid_counter.inc_ret_last(8 * sizeof(size_t));
-      if (lvid_block_start >= graph.num_local_vertices()) break;
+      lvid_type lvid_block_start;
+      if (!next_lvid_block(thread_id, lvid_block_start)) break;
       // get the bit field from has_message
       size_t lvid_bit_block = active_minorstep.containing_word(lvid_block_start);
       if (lvid_bit_block == 0) continue;
@@ -1756,34 +2338,7 @@ namespace graphlab {
         lvid_type lvid = lvid_block_start + lvid_block_offset;
         if (lvid >= graph.num_local_vertices()) break;
 
-        const vertex_program_type& vprog = vertex_programs[lvid];
-        local_vertex_type local_vertex = graph.l_vertex(lvid);
-        const vertex_type vertex(local_vertex);
-        const edge_dir_type scatter_dir = vprog.scatter_edges(context, vertex);
-				size_t edges_touched = 0;
-        // Loop over in edges
-        if(scatter_dir == IN_EDGES || scatter_dir == ALL_EDGES) {
-          foreach(local_edge_type local_edge, local_vertex.in_edges()) {
-            edge_type edge(local_edge);
-            // elocks[local_edge.id()].lock();
-            vprog.scatter(context, vertex, edge);
-            // elocks[local_edge.id()].unlock();
-          }
-					++edges_touched;
-        } // end of if in_edges/all_edges
-        // Loop over out edges
-        if(scatter_dir == OUT_EDGES || scatter_dir == ALL_EDGES) {
-          foreach(local_edge_type local_edge, local_vertex.out_edges()) {
-            edge_type edge(local_edge);
-            // elocks[local_edge.id()].lock();
-            vprog.scatter(context, vertex, edge);
-            // elocks[local_edge.id()].unlock();
-          }
-					++edges_touched;
-        } // end of if out_edges/all_edges
-				INCREMENT_EVENT(EVENT_SCATTERS, edges_touched);
-        // Clear the vertex program
-        vertex_programs[lvid] = vertex_program_type();
+        scatter_vertex(context, lvid);
       } // end of if active on this minor step
     } // end of loop over vertices to complete scatter operation
 
@@ -1792,6 +2347,45 @@ namespace graphlab {
 
 
 
+  template<typename VertexProgram>
+  void synchronous_engine<VertexProgram>::
+  scatter_vertex(context_type& context, lvid_type lvid) {
+    const vertex_program_type& vprog = vertex_programs[lvid];
+    local_vertex_type local_vertex = graph.l_vertex(lvid);
+    const vertex_type vertex(local_vertex);
+    const edge_dir_type scatter_dir = vprog.scatter_edges(context, vertex);
+    size_t edges_touched = 0;
+    // the snapshot being written must see the edges before the scatter
+    const bool capture = snapshot.writing();
+    // Loop over in edges
+    if(scatter_dir == IN_EDGES || scatter_dir == ALL_EDGES) {
+      foreach(local_edge_type local_edge, local_vertex.in_edges()) {
+        edge_type edge(local_edge);
+        if (capture) snapshot.capture_edge(local_edge.id());
+        // elocks[local_edge.id()].lock();
+        vprog.scatter(context, vertex, edge);
+        // elocks[local_edge.id()].unlock();
+      }
+      ++edges_touched;
+    } // end of if in_edges/all_edges
+    // Loop over out edges
+    if(scatter_dir == OUT_EDGES || scatter_dir == ALL_EDGES) {
+      foreach(local_edge_type local_edge, local_vertex.out_edges()) {
+        edge_type edge(local_edge);
+        if (capture) snapshot.capture_edge(local_edge.id());
+        // elocks[local_edge.id()].lock();
+        vprog.scatter(context, vertex, edge);
+        // elocks[local_edge.id()].unlock();
+      }
+      ++edges_touched;
+    } // end of if out_edges/all_edges
+    INCREMENT_EVENT(EVENT_SCATTERS, edges_touched);
+    // Clear the vertex program
+    vertex_programs[lvid] = vertex_program_type();
+  } // end of scatter_vertex
+
+
+
   // Data Synchronization ===================================================
   template<typename VertexProgram>
   void synchronous_engine<VertexProgram>::
@@ -1850,6 +2444,7 @@ namespace graphlab {
         foreach(const vid_vdata_pair_type& pair, buffer) {
           const lvid_type lvid = graph.local_vid(pair.first);
           ASSERT_FALSE(graph.l_is_master(lvid));
+          if (snapshot.writing()) snapshot.capture_vertex(lvid);
           graph.l_vertex(lvid).data() = pair.second;
         }
       }
@@ -1937,6 +2532,449 @@ namespace graphlab {
   } // end of recv_messages
 
 
+  // Stale-synchronous execution ============================================
+  template<typename VertexProgram> execution_status::status_enum
+  synchronous_engine<VertexProgram>::run_stale_synchronous() {
+    float last_print = -5;
+    while(iteration_counter < max_iterations) {
+      // Stop if this machine timed out or was aborted (telling the other
+      // machines) or if another machine is stopping.
+      int status = execution_status::RUNNING;
+      if (force_abort) {
+        status = execution_status::FORCED_ABORT;
+      } else if (timeout != 0 && timeout < elapsed_seconds()) {
+        status = execution_status::TIMEOUT;
+      }
+      if (status != execution_status::RUNNING) {
+        ssp_send_batches(status, false);
+        return execution_status::status_enum(status);
+      }
+      ssp_lock.lock();
+      status = ssp_status;
+      ssp_lock.unlock();
+      if (status != execution_status::RUNNING) {
+        return execution_status::status_enum(status);
+      }
+
+      bool print_this_round = (elapsed_seconds() - last_print) >= 5;
+      if(rmi.procid() == 0 && print_this_round) {
+        logstream(LOG_EMPH)
+          << rmi.procid() << ": Starting iteration: " << iteration_counter
+          << std::endl;
+        last_print = elapsed_seconds();
+      }
+
+      profiler.begin_superstep(iteration_counter);
+      // Receive batches ----------------------------------------------------
+      profiler.begin_phase(engine_profiler::EXCHANGE);
+      const bool drained = ssp_recv_batches();
+      profiler.end_phase(engine_profiler::EXCHANGE);
+
+      // Mirrors ------------------------------------------------------------
+      // Complete the scatters requested by remote masters before
+      // installing the vertex programs of their next gather.
+      run_local( engine_profiler::SCATTER, &synchronous_engine::execute_scatters );
+      active_minorstep.clear();
+      foreach(const vid_prog_pair_type& pair, ssp_gather_requests) {
+        const lvid_type lvid = graph.local_vid(pair.first);
+        vertex_programs[lvid] = pair.second;
+        active_minorstep.set_bit(lvid);
+      }
+      ssp_gather_requests.clear();
+      run_local( engine_profiler::GATHER,
+                 &synchronous_engine::ssp_execute_mirror_gathers );
+      active_minorstep.clear();
+
+      // Masters ------------------------------------------------------------
+      num_active_vertices = 0;
+      run_local( engine_profiler::RECEIVE,
+                 &synchronous_engine::ssp_receive_messages );
+      profiler.add_active_vertices(num_active_vertices);
+      run_local( engine_profiler::APPLY, &synchronous_engine::ssp_execute_applys );
+      active_superstep.clear();
+      run_local( engine_profiler::SCATTER, &synchronous_engine::execute_scatters );
+      active_minorstep.clear();
+      if (rmi.procid() == 0 && print_this_round)
+        logstream(LOG_EMPH)
+          << "\tActive vertices: " << num_active_vertices.value << std::endl;
+
+      // Send batches and advance the clock ---------------------------------
+      profiler.begin_phase(engine_profiler::EXCHANGE);
+      const bool idle = has_message.empty() && ssp_num_gathering.value == 0;
+      const bool quiet =
+        ssp_send_batches(execution_status::RUNNING, idle && drained);
+      const size_t step = iteration_counter++;
+      // waiting for the slower machines is recorded as the barrier wait
+      profiler.begin_machine_barrier();
+      bool all_quiet = false;
+      if (idle) {
+        // Nothing can happen until data arrives, so wait for the
+        // super-step to complete everywhere and test for quiescence.
+        ssp_wait(step + 1);
+        ssp_lock.lock();
+        all_quiet = quiet && ssp_quiet[step] + 1 == rmi.numprocs();
+        ssp_quiet.erase(ssp_quiet.begin(), ssp_quiet.upper_bound(step));
+        ssp_lock.unlock();
+      } else if (iteration_counter > staleness) {
+        ssp_wait(iteration_counter - staleness);
+      }
+      profiler.end_phase(engine_profiler::EXCHANGE);
+      profiler.end_superstep();
+      if (all_quiet) return execution_status::TASK_DEPLETION;
+    }
+    return execution_status::UNSET;
+  } // end of run_stale_synchronous
+
+
+  template<typename VertexProgram>
+  void synchronous_engine<VertexProgram>::ssp_reset() {
+    ssp_outbox.assign(ncpus, std::vector<ssp_batch>(rmi.numprocs()));
+    ssp_lock.lock();
+    ssp_inbox.clear();
+    ssp_clock.assign(rmi.numprocs(), 0);
+    ssp_early.assign(rmi.numprocs(), std::set<size_t>());
+    ssp_quiet.clear();
+    ssp_status = execution_status::RUNNING;
+    ssp_lock.unlock();
+    ssp_pending.assign(graph.num_local_vertices(), 0);
+    ssp_gathering.resize(graph.num_local_vertices());
+    ssp_gathering.clear();
+    ssp_num_gathering = 0;
+    ssp_gather_requests.clear();
+    active_superstep.clear();
+    active_minorstep.clear();
+    has_gather_accum.clear();
+  } // end of ssp_reset
+
+
+  template<typename VertexProgram>
+  bool synchronous_engine<VertexProgram>::ssp_recv_batches() {
+    std::vector<std::pair<procid_t, ssp_batch> > inbox;
+    bool drained = true;
+    ssp_lock.lock();
+    inbox.swap(ssp_inbox);
+    for (procid_t i = 0; i < rmi.numprocs(); ++i) {
+      if (i != rmi.procid() && ssp_clock[i] < iteration_counter) {
+        drained = false;
+      }
+    }
+    ssp_lock.unlock();
+    // The batches of a machine must be processed in the order in which
+    // they were produced.
+    std::vector<std::pair<size_t, size_t> > order(inbox.size());
+    for (size_t i = 0; i < inbox.size(); ++i) {
+      order[i] = std::make_pair(inbox[i].second.step, i);
+    }
+    std::sort(order.begin(), order.end());
+
+    context_type context(*this, graph);
+    for (size_t i = 0; i < order.size(); ++i) {
+      const ssp_batch& batch = inbox[order[i].second].second;
+      foreach(const vid_message_pair_type& pair, batch.messages) {
+        internal_signal_rpc(pair.first, pair.second);
+      }
+      foreach(const vid_partial_pair_type& pair, batch.partials) {
+        const lvid_type lvid = graph.local_vid(pair.first);
+        ASSERT_TRUE(ssp_gathering.get(lvid));
+        if (pair.second.not_empty()) {
+          if (has_gather_accum.get(lvid)) {
+            gather_accum[lvid] += pair.second.value;
+          } else {
+            gather_accum[lvid] = pair.second.value;
+            has_gather_accum.set_bit(lvid);
+          }
+        }
+        // the last partial makes the vertex ready to apply
+        if (--ssp_pending[lvid] == 0) {
+          ssp_gathering.clear_bit(lvid);
+          ssp_num_gathering.dec();
+          active_superstep.set_bit(lvid);
+        }
+      }
+      foreach(const vid_vdata_pair_type& pair, batch.vdata) {
+        const lvid_type lvid = graph.local_vid(pair.first);
+        ASSERT_FALSE(graph.l_is_master(lvid));
+        graph.l_vertex(lvid).data() = pair.second;
+      }
+      foreach(const vid_prog_pair_type& pair, batch.scatters) {
+        const lvid_type lvid = graph.local_vid(pair.first);
+        // The scatter of an earlier round of this vertex arrived in the
+        // same step. Run it now before its vertex program is replaced.
+        if (active_minorstep.get(lvid)) scatter_vertex(context, lvid);
+        vertex_programs[lvid] = pair.second;
+        active_minorstep.set_bit(lvid);
+      }
+      ssp_gather_requests.insert(ssp_gather_requests.end(),
+                                 batch.gather_requests.begin(),
+                                 batch.gather_requests.end());
+    }
+    return drained;
+  } // end of ssp_recv_batches
+
+
+  template<typename VertexProgram>
+  void synchronous_engine<VertexProgram>::
+  ssp_execute_mirror_gathers(const size_t thread_id) {
+    context_type context(*this, graph);
+    timer ti;
+    fixed_dense_bitset<8 * sizeof(size_t)> local_bitset; // a word-size = 64 bit
+    while (1) {
+      // increment by a word at a time
+      lvid_type lvid_block_start;
+      if (!next_lvid_block(thread_id, lvid_block_start)) break;
+      size_t lvid_bit_block = active_minorstep.containing_word(lvid_block_start);
+      if (lvid_bit_block == 0) continue;
+      // initialize a word sized bitfield
+      local_bitset.clear();
+      local_bitset.initialize_from_mem(&lvid_bit_block, sizeof(size_t));
+      foreach(size_t lvid_block_offset, local_bitset) {
+        lvid_type lvid = lvid_block_start + lvid_block_offset;
+        if (lvid >= graph.num_local_vertices()) break;
+        // Reply even if there is nothing to contribute so that the
+        // master can count the partials.
+        gather_type accum = gather_type();
+        conditional_gather_type partial;
+        if (compute_local_gather(context, lvid, vertex_programs[lvid], accum)) {
+          partial.swap(accum);
+        }
+        ssp_outbox[thread_id][graph.l_master(lvid)].partials.push_back(
+            std::make_pair(graph.global_vid(lvid), partial));
+        vertex_programs[lvid] = vertex_program_type();
+      }
+    }
+    per_thread_compute_time[thread_id] += ti.current_time();
+  } // end of ssp_execute_mirror_gathers
+
+
+  template<typename VertexProgram>
+  void synchronous_engine<VertexProgram>::
+  ssp_receive_messages(const size_t thread_id) {
+    context_type context(*this, graph);
+    timer ti;
+    size_t nactive_inc = 0;
+    fixed_dense_bitset<8 * sizeof(size_t)> local_bitset; // a word-size = 64 bit
+    while (1) {
+      // increment by a word at a time
+      lvid_type lvid_block_start;
+      if (!next_lvid_block(thread_id, lvid_block_start)) break;
+      // get the bit field from has_message
+      size_t lvid_bit_block = has_message.containing_word(lvid_block_start);
+      if (lvid_bit_block == 0) continue;
+      // initialize a word sized bitfield
+      local_bitset.clear();
+      local_bitset.initialize_from_mem(&lvid_bit_block, sizeof(size_t));
+      foreach(size_t lvid_block_offset, local_bitset) {
+        lvid_type lvid = lvid_block_start + lvid_block_offset;
+        if (lvid >= graph.num_local_vertices()) break;
+        // Messages on mirrors are forwarded to the master
+        if (!graph.l_is_master(lvid)) {
+          vlocks[lvid].lock();
+          ssp_outbox[thread_id][graph.l_master(lvid)].messages.push_back(
+              std::make_pair(graph.global_vid(lvid), messages[lvid]));
+          messages[lvid] = message_type();
+          has_message.clear_bit(lvid);
+          vlocks[lvid].unlock();
+          continue;
+        }
+        // A master which is still gathering, or whose last partial
+        // arrived in this step and is waiting to apply, keeps its
+        // messages until the current round completes.
+        if (ssp_gathering.get(lvid) || active_superstep.get(lvid)) continue;
+        vlocks[lvid].lock();
+        const message_type message = messages[lvid];
+        messages[lvid] = message_type();
+        has_message.clear_bit(lvid);
+        vlocks[lvid].unlock();
+
+        ++nactive_inc;
+        vertex_type vertex(graph.l_vertex(lvid));
+        vertex_programs[lvid].init(context, vertex, message);
+        const vertex_program_type& const_vprog = vertex_programs[lvid];
+        const vertex_type const_vertex = vertex;
+        if(const_vprog.gather_edges(context, const_vertex) !=
+           graphlab::NO_EDGES) {
+          gather_type accum = gather_type();
+          if (compute_local_gather(context, lvid, const_vprog, accum)) {
+            gather_accum[lvid] = accum;
+            has_gather_accum.set_bit(lvid);
+          }
+          local_vertex_type local_vertex = graph.l_vertex(lvid);
+          if (local_vertex.num_mirrors() > 0) {
+            // request the remaining partials from the mirrors
+            ssp_pending[lvid] = local_vertex.num_mirrors();
+            ssp_gathering.set_bit(lvid);
+            ssp_num_gathering.inc();
+            const vertex_id_type vid = graph.global_vid(lvid);
+            foreach(const procid_t& mirror, local_vertex.mirrors()) {
+              ssp_outbox[thread_id][mirror].gather_requests.push_back(
+                  std::make_pair(vid, const_vprog));
+            }
+            continue;
+          }
+        }
+        active_superstep.set_bit(lvid);
+      }
+    }
+    num_active_vertices += nactive_inc;
+    per_thread_compute_time[thread_id] += ti.current_time();
+  } // end of ssp_receive_messages
+
+
+  template<typename VertexProgram>
+  void synchronous_engine<VertexProgram>::
+  ssp_execute_applys(const size_t thread_id) {
+    context_type context(*this, graph);
+    timer ti;
+    fixed_dense_bitset<8 * sizeof(size_t)> local_bitset; // a word-size = 64 bit
+    while (1) {
+      // increment by a word at a time
+      lvid_type lvid_block_start;
+      if (!next_lvid_block(thread_id, lvid_block_start)) break;
+      size_t lvid_bit_block = active_superstep.containing_word(lvid_block_start);
+      if (lvid_bit_block == 0) continue;
+      // initialize a word sized bitfield
+      local_bitset.clear();
+      local_bitset.initialize_from_mem(&lvid_bit_block, sizeof(size_t));
+      foreach(size_t lvid_block_offset, local_bitset) {
+        lvid_type lvid = lvid_block_start + lvid_block_offset;
+        if (lvid >= graph.num_local_vertices()) break;
+        ASSERT_TRUE(graph.l_is_master(lvid));
+        vertex_type vertex(graph.l_vertex(lvid));
+        INCREMENT_EVENT(EVENT_APPLIES, 1);
+        vertex_programs[lvid].apply(context, vertex, gather_accum[lvid]);
+        ++completed_applys;
+        gather_accum[lvid] = gather_type();
+        has_gather_accum.clear_bit(lvid);
+        // forward the vertex data, and the vertex program if a scatter
+        // is needed, to the mirrors
+        const vertex_program_type& const_vprog = vertex_programs[lvid];
+        const vertex_type const_vertex = vertex;
+        const bool needs_scatter =
+          const_vprog.scatter_edges(context, const_vertex) != graphlab::NO_EDGES;
+        local_vertex_type local_vertex = graph.l_vertex(lvid);
+        const vertex_id_type vid = graph.global_vid(lvid);
+        foreach(const procid_t& mirror, local_vertex.mirrors()) {
+          ssp_batch& batch = ssp_outbox[thread_id][mirror];
+          batch.vdata.push_back(std::make_pair(vid, local_vertex.data()));
+          if (needs_scatter) {
+            batch.scatters.push_back(std::make_pair(vid, const_vprog));
+          }
+        }
+        if (needs_scatter) {
+          active_minorstep.set_bit(lvid);
+        } else {
+          vertex_programs[lvid] = vertex_program_type();
+        }
+      }
+    }
+    per_thread_compute_time[thread_id] += ti.current_time();
+  } // end of ssp_execute_applys
+
+
+  template<typename VertexProgram>
+  bool synchronous_engine<VertexProgram>::
+  ssp_send_batches(int status, bool idle_and_drained) {
+    std::vector<ssp_batch> batches(rmi.numprocs());
+    for (size_t i = 0; i < ssp_outbox.size(); ++i) {
+      for (procid_t p = 0; p < rmi.numprocs(); ++p) {
+        batches[p].append(ssp_outbox[i][p]);
+        ssp_outbox[i][p].clear();
+      }
+    }
+    ssp_lock.lock();
+    for (procid_t p = 0; p < rmi.numprocs(); ++p) {
+      batches[p].messages.insert(batches[p].messages.end(),
+                                 ssp_signal_outbox[p].begin(),
+                                 ssp_signal_outbox[p].end());
+      ssp_signal_outbox[p].clear();
+    }
+    ssp_lock.unlock();
+    bool quiet = idle_and_drained;
+    for (procid_t p = 0; p < rmi.numprocs(); ++p) {
+      if (!batches[p].empty()) quiet = false;
+    }
+    for (procid_t p = 0; p < rmi.numprocs(); ++p) {
+      if (p == rmi.procid()) continue;
+      batches[p].step = iteration_counter;
+      batches[p].quiet = quiet;
+      batches[p].status = status;
+      rmi.remote_call(p, &synchronous_engine::rpc_ssp_batch,
+                      rmi.procid(), batches[p]);
+    }
+    rmi.dc().flush();
+    return quiet;
+  } // end of ssp_send_batches
+
+
+  template<typename VertexProgram>
+  void synchronous_engine<VertexProgram>::ssp_wait(size_t nsteps) {
+    ssp_lock.lock();
+    while(ssp_status == execution_status::RUNNING) {
+      bool ready = true;
+      for (procid_t i = 0; i < rmi.numprocs(); ++i) {
+        if (i != rmi.procid() && ssp_clock[i] < nsteps) {
+          ready = false;
+          break;
+        }
+      }
+      if (ready) break;
+      ssp_cond.wait(ssp_lock);
+    }
+    ssp_lock.unlock();
+  } // end of ssp_wait
+
+
+  template<typename VertexProgram>
+  void synchronous_engine<VertexProgram>::ssp_finish() {
+    std::vector<std::pair<procid_t, ssp_batch> > inbox;
+    ssp_lock.lock();
+    inbox.swap(ssp_inbox);
+    ssp_lock.unlock();
+    std::vector<std::pair<size_t, size_t> > order(inbox.size());
+    for (size_t i = 0; i < inbox.size(); ++i) {
+      order[i] = std::make_pair(inbox[i].second.step, i);
+    }
+    std::sort(order.begin(), order.end());
+    for (size_t i = 0; i < order.size(); ++i) {
+      const ssp_batch& batch = inbox[order[i].second].second;
+      foreach(const vid_message_pair_type& pair, batch.messages) {
+        internal_signal_rpc(pair.first, pair.second);
+      }
+      foreach(const vid_vdata_pair_type& pair, batch.vdata) {
+        graph.l_vertex(graph.local_vid(pair.first)).data() = pair.second;
+      }
+    }
+    // drop the gathers which did not complete
+    foreach(size_t lvid, ssp_gathering) {
+      vertex_programs[lvid] = vertex_program_type();
+      gather_accum[lvid] = gather_type();
+    }
+    ssp_gathering.clear();
+    ssp_num_gathering = 0;
+    ssp_gather_requests.clear();
+    has_gather_accum.clear();
+  } // end of ssp_finish
+
+
+  template<typename VertexProgram>
+  void synchronous_engine<VertexProgram>::
+  rpc_ssp_batch(procid_t src, const ssp_batch& batch) {
+    ssp_lock.lock();
+    ssp_inbox.push_back(std::make_pair(src, batch));
+    if (batch.step == ssp_clock[src]) {
+      ++ssp_clock[src];
+      while(ssp_early[src].erase(ssp_clock[src])) ++ssp_clock[src];
+    } else {
+      ssp_early[src].insert(batch.step);
+    }
+    if (batch.quiet) ++ssp_quiet[batch.step];
+    if (batch.status != execution_status::RUNNING) ssp_status = batch.status;
+    ssp_cond.broadcast();
+    ssp_lock.unlock();
+  } // end of rpc_ssp_batch
+
+
+
 
 
 
@@ -38,6 +38,8 @@
 #include <graphlab/rpc/dc_dist_object.hpp>
 #include <graphlab/engine/distributed_chandy_misra.hpp>
 #include <graphlab/engine/message_array.hpp>
+#include <graphlab/engine/async_snapshot.hpp>
+#include <graphlab/engine/warp_snapshot_task.hpp>
 #include <graphlab/serialization/serialize_to_from_string.hpp>
 #include <graphlab/util/tracepoint.hpp>
 #include <graphlab/util/memory_info.hpp>
@@ -171,6 +173,18 @@ namespace warp {
    * increases in throughput at a consistency penalty.
    * \li \b nfibers (default: 10000) Number of fibers to use
    * \li \b stacksize (default: 16384) Stacksize of each fiber.
+   * \li \b snapshot_interval (default: 0) If positive, a consistent
+   * snapshot of the graph and of the pending messages is taken every
+   * snapshot_interval seconds while the engine runs, as in the
+   * \ref graphlab::async_consistent_engine "async_consistent_engine".
+   * The warp functions capture the data they touch on every machine.
+   * The snapshot is only exact if factorized is false.
+   * \li \b snapshot_path (default: "") The prefix of the snapshot files.
+   * \li \b snapshot_resume (default: false) If true, the next call to
+   * start() resumes from the latest snapshot under snapshot_path. The
+   * graph must have been loaded with
+   * \ref graphlab::distributed_graph::load_binary "load_binary" from
+   * <tt>[snapshot_path]base_</tt> on the same number of machines.
    */
   template <typename GraphType, typename MessageType = graphlab::empty>
   class warp_engine {
@@ -243,13 +257,16 @@ namespace warp {
       std::string original_value;
       vertex_type vtx;
       bool vtx_set;
+      /// the snapshot epoch of the task, if vtx_set
+      size_t epoch;
 
       context(warp_engine& engine, graph_type& graph, 
-              vertex_type vtx):
+              vertex_type vtx, size_t epoch):
           engine(engine), 
           graph(graph), 
           vtx(vtx),
-          vtx_set(true) { 
+          vtx_set(true),
+          epoch(epoch) { 
             set_synchronized();
         }
       
@@ -258,7 +275,8 @@ namespace warp {
           engine(engine), 
           graph(graph), 
           vtx(graph, 0),
-          vtx_set(false) { 
+          vtx_set(false),
+          epoch(0) { 
         }
       
       /**
@@ -386,7 +404,8 @@ namespace warp {
        */
       void signal(const vertex_type& vertex, 
                   const message_type& message = message_type()) {
-        engine.internal_signal(vertex, message);
+        if (vtx_set) engine.internal_signal(vertex, message, epoch);
+        else engine.internal_signal(vertex, message);
       }
 
 
@@ -411,7 +430,8 @@ namespace warp {
        */
       void signal(vertex_id_type gvid, 
                   const message_type& message = message_type()) {
-        engine.internal_signal_gvid(gvid, message);
+        if (vtx_set) engine.internal_signal_gvid(gvid, message, epoch);
+        else engine.internal_signal_gvid(gvid, message);
       }
 
 
@@ -438,7 +458,7 @@ namespace warp {
           std::string new_value = serialize_to_string(vtx.data());
           if (original_value != new_value) {
             // synchronize this vertex's value
-            engine.synchronize_one_vertex_wait(vtx);
+            engine.synchronize_one_vertex_wait(vtx, epoch);
           }
           std::swap(original_value, new_value);
         }
@@ -502,6 +522,15 @@ namespace warp {
     typedef distributed_aggregator<graph_type, context_type>  aggregator_type;
     aggregator_type aggregator;
 
+    /// engine option. Seconds between snapshots. 0 disables them.
+    double snapshot_interval;
+    /// engine option. The prefix of the snapshot files
+    std::string snapshot_path;
+    /// engine option. Resume from the latest snapshot on the next start()
+    bool snapshot_resume;
+    typedef async_snapshot<graph_type, message_type> snapshot_type;
+    snapshot_type snapshot;
+
     /// Number of kernel threads
     size_t ncpus;
     /// Size of each fiber stack
@@ -553,7 +582,7 @@ namespace warp {
     execution_status::status_enum termination_reason;
 
     std::vector<mutex> aggregation_lock;
-    std::vector<std::deque<std::string> > aggregation_queue;
+    std::vector<std::deque<size_t> > aggregation_queue;
 
     update_function_type update_fn;
   public:
@@ -581,13 +610,16 @@ namespace warp {
                             graph_type& graph,
                             const graphlab_options& opts = graphlab_options()) :
         rmi(dc, this), graph(graph), scheduler_ptr(NULL),
-        aggregator(dc, graph, new context_type(*this, graph)), started(false),
+        aggregator(dc, graph, new context_type(*this, graph)),
+        snapshot(dc, graph, messages), started(false),
         engine_start_time(timer::approx_time_seconds()), force_stop(false) {
       rmi.barrier();
 
       nfibers = 10000;
       stacksize = 16384;
       factorized_consistency = true;
+      snapshot_interval = 0;
+      snapshot_resume = false;
       update_fn = NULL;
       timed_termination = (size_t)(-1);
       termination_reason = execution_status::UNSET;
@@ -638,10 +670,32 @@ namespace warp {
           opts.get_engine_args().get_option("stacksize", stacksize);
           if (rmi.procid() == 0)
             logstream(LOG_EMPH) << "Engine Option: stacksize= " << stacksize << std::endl;
+        } else if (opt == "snapshot_interval") {
+          opts.get_engine_args().get_option("snapshot_interval", snapshot_interval);
+          if (rmi.procid() == 0)
+            logstream(LOG_EMPH) << "Engine Option: snapshot_interval = " << snapshot_interval << std::endl;
+        } else if (opt == "snapshot_path") {
+          opts.get_engine_args().get_option("snapshot_path", snapshot_path);
+          if (rmi.procid() == 0)
+            logstream(LOG_EMPH) << "Engine Option: snapshot_path = " << snapshot_path << std::endl;
+        } else if (opt == "snapshot_resume") {
+          opts.get_engine_args().get_option("snapshot_resume", snapshot_resume);
+          if (rmi.procid() == 0)
+            logstream(LOG_EMPH) << "Engine Option: snapshot_resume = " << snapshot_resume << std::endl;
         } else {
           logstream(LOG_FATAL) << "Unexpected Engine Option: " << opt << std::endl;
         }
       }
+      if ((snapshot_interval > 0 || snapshot_resume) &&
+          !incremental_snapshot<graph_type>::valid_prefix(snapshot_path)) {
+        logstream(LOG_FATAL) << "snapshot_path must be set to a posix path "
+                             << "to take or resume snapshots" << std::endl;
+      }
+      if (snapshot_interval > 0 && factorized_consistency && rmi.procid() == 0) {
+        logstream(LOG_WARNING) << "Snapshots are only exact with factorized=false"
+                               << std::endl;
+      }
+      snapshot.set_options(snapshot_interval, snapshot_path);
       opts_copy = opts;
       // set a default scheduler if none
       if (opts_copy.get_scheduler_type() == "") {
@@ -658,7 +712,13 @@ namespace warp {
       if (factorized_consistency == false) {
         cmlocks = new distributed_chandy_misra<graph_type>(rmi.dc(), graph,
                                                     boost::bind(&engine_type::lock_ready, this, _1));
-                                                    
+        // lock grants carry the snapshot epoch so that tasks with
+        // overlapping scopes are ordered by epoch
+        if (snapshot.enabled()) {
+          cmlocks->set_epoch_clock(
+              boost::bind(&snapshot_type::current_epoch, &snapshot),
+              boost::bind(&snapshot_type::observe, &snapshot, _1));
+        }
       }
       else {
         cmlocks = NULL;
@@ -753,13 +813,17 @@ namespace warp {
      * This is used to receive a message forwarded from another machine
      */
     void rpc_signal(vertex_id_type vid,
-                            const message_type& message) {
-      if (force_stop) return;
-      const lvid_type local_vid = graph.local_vid(vid);
-      double priority;
-      messages.add(local_vid, message, &priority);
-      scheduler_ptr->schedule(local_vid, priority);
-      consensus->cancel();
+                    const message_type& message,
+                    size_t epoch) {
+      snapshot.observe(epoch);
+      if (!force_stop) {
+        const lvid_type local_vid = graph.local_vid(vid);
+        double priority;
+        snapshot.add_message(local_vid, message, epoch, &priority);
+        scheduler_ptr->schedule(local_vid, priority);
+        consensus->cancel();
+      }
+      snapshot.received(epoch);
     }
 
     /**
@@ -771,6 +835,17 @@ namespace warp {
      */
     void internal_signal(const vertex_type& vtx,
                          const message_type& message = message_type()) {
+      internal_signal(vtx, message, snapshot.current_epoch());
+    }
+
+    /**
+     * \internal
+     * Signals a vertex with a message sent by a task of the given
+     * snapshot epoch.
+     */
+    void internal_signal(const vertex_type& vtx,
+                         const message_type& message,
+                         size_t epoch) {
       if (force_stop) return;
       if (started) {
         const typename graph_type::vertex_record& rec = graph.l_get_vertex_record(vtx.local_id());
@@ -779,11 +854,12 @@ namespace warp {
           // fast signal. push to the remote machine immediately
           if (owner != rmi.procid()) {
             const vertex_id_type vid = rec.gvid;
-            rmi.remote_call(owner, &engine_type::rpc_signal, vid, message);
+            snapshot.sent(epoch);
+            rmi.remote_call(owner, &engine_type::rpc_signal, vid, message, epoch);
           }
           else {
             double priority;
-            messages.add(vtx.local_id(), message, &priority);
+            snapshot.add_message(vtx.local_id(), message, epoch, &priority);
             scheduler_ptr->schedule(vtx.local_id(), priority);
             consensus->cancel();
           }
@@ -791,14 +867,14 @@ namespace warp {
         else {
 
           double priority;
-          messages.add(vtx.local_id(), message, &priority);
+          snapshot.add_message(vtx.local_id(), message, epoch, &priority);
           scheduler_ptr->schedule(vtx.local_id(), priority);
           consensus->cancel();
         }
       }
       else {
         double priority;
-        messages.add(vtx.local_id(), message, &priority);
+        snapshot.add_message(vtx.local_id(), message, epoch, &priority);
         scheduler_ptr->schedule(vtx.local_id(), priority);
         consensus->cancel();
       }
@@ -814,16 +890,32 @@ namespace warp {
      */
     void internal_signal_gvid(vertex_id_type gvid,
                               const message_type& message = message_type()) {
+      internal_signal_gvid(gvid, message, snapshot.current_epoch());
+    }
+
+    void internal_signal_gvid(vertex_id_type gvid,
+                              const message_type& message,
+                              size_t epoch) {
       if (force_stop) return;
       if (graph.is_master(gvid)) {
-        internal_signal(graph.vertex(gvid), message);
+        internal_signal(graph.vertex(gvid), message, epoch);
       } else {
         procid_t proc = graph.master(gvid);
-        rmi.remote_call(proc, &warp_engine::internal_signal,
-                        gvid, message);
+        snapshot.sent(epoch);
+        rmi.remote_call(proc, &warp_engine::rpc_signal_gvid,
+                        gvid, message, epoch);
       }
     } 
 
+    /// \internal Receives a signal sent with internal_signal_gvid()
+    void rpc_signal_gvid(vertex_id_type gvid,
+                         const message_type& message,
+                         size_t epoch) {
+      snapshot.observe(epoch);
+      internal_signal_gvid(gvid, message, epoch);
+      snapshot.received(epoch);
+    }
+
 
 
     void rpc_internal_stop() {
@@ -1000,12 +1092,14 @@ namespace warp {
      */
     sched_status::status_enum get_next_sched_task(size_t threadid,
                                                   lvid_type& lvid,
-                                                  message_type& msg) {
+                                                  message_type& msg,
+                                                  size_t& epoch) {
       while (1) {
         sched_status::status_enum stat = 
             scheduler_ptr->get_next(threadid % ncpus, lvid);
         if (stat == sched_status::NEW_TASK) {
-          if (messages.get(lvid, msg)) return stat;
+          // the epoch is provisional until the task holds its locks
+          if (snapshot.get_message(lvid, msg, epoch)) return stat;
           else continue;
         }
         return stat;
@@ -1027,7 +1121,8 @@ namespace warp {
     bool try_to_quit(size_t threadid,
                      bool& has_sched_msg,
                      lvid_type& sched_lvid,
-                     message_type &msg) {
+                     message_type &msg,
+                     size_t& epoch) {
       if (timer::approx_time_seconds() - engine_start_time > timed_termination) {
         termination_reason = execution_status::TIMEOUT;
         force_stop = true;
@@ -1037,8 +1132,10 @@ namespace warp {
       fiber_control::yield();
       consensus->begin_done_critical_section(threadid);
       sched_status::status_enum stat = 
-          get_next_sched_task(threadid, sched_lvid, msg);
+          get_next_sched_task(threadid, sched_lvid, msg, epoch);
       if (stat == sched_status::EMPTY || force_stop) {
+        // a task taken while stopping is dropped
+        if (stat != sched_status::EMPTY) snapshot.leave(epoch);
         logstream(LOG_DEBUG) << rmi.procid() << "-" << threadid <<  ": "
                              << "\tTermination Double Checked" << std::endl;
 
@@ -1086,13 +1183,15 @@ namespace warp {
     // if returns false, the message has been dropped into the message array.
     // quit
     bool get_exclusive_access_to_vertex(const lvid_type lvid,
-                                        const message_type& msg) {
+                                        const message_type& msg,
+                                        size_t& epoch) {
       vertexlocks[lvid].lock();
       bool someone_else_running = program_running.set_bit(lvid);
       if (someone_else_running) {
         // bad. someone else is here.
         // drop it into the message array
-        messages.add(lvid, msg);
+        snapshot.begin_task(lvid, msg, epoch);
+        snapshot.add_message(lvid, msg, epoch);
         hasnext.set_bit(lvid);
       } 
       vertexlocks[lvid].unlock();
@@ -1118,20 +1217,24 @@ namespace warp {
     }
 
     void update_vertex_value(vertex_id_type vid,
-                             vertex_data_type& vdata) {
-      local_vertex_type lvtx(graph.l_vertex(graph.local_vid(vid)));
+                             vertex_data_type& vdata,
+                             size_t epoch) {
+      snapshot.observe(epoch);
+      const lvid_type lvid = graph.local_vid(vid);
+      local_vertex_type lvtx(graph.l_vertex(lvid));
+      snapshot.capture_vertex(lvid, epoch);
       lvtx.data() = vdata;
     }
 
-    void synchronize_one_vertex(vertex_type vtx) {
+    void synchronize_one_vertex(vertex_type vtx, size_t epoch) {
       local_vertex_type lvtx(vtx);
       foreach(procid_t mirror, lvtx.mirrors()) {
-        rmi.remote_call(mirror, &warp_engine::update_vertex_value, vtx.id(), vtx.data());
+        rmi.remote_call(mirror, &warp_engine::update_vertex_value, vtx.id(), vtx.data(), epoch);
       }
     }
 
 
-    void synchronize_one_vertex_wait(vertex_type vtx) {
+    void synchronize_one_vertex_wait(vertex_type vtx, size_t epoch) {
       local_vertex_type lvtx(vtx);
       std::vector<request_future<void> > futures;
       foreach(procid_t mirror, lvtx.mirrors()) {
@@ -1139,13 +1242,51 @@ namespace warp {
                                                       mirror, 
                                                       &warp_engine::update_vertex_value, 
                                                       vtx.id(), 
-                                                      vtx.data()));
+                                                      vtx.data(),
+                                                      epoch));
       }
       for (size_t i = 0;i < futures.size(); ++i) {
         futures[i]();
       }
     }
 
+    /**
+     * \internal
+     * Returns the snapshot_task of a task of the given epoch. The warp
+     * functions send it to the mirrors, which reach their instance of
+     * the engine through the static functions below.
+     */
+    warp_impl::snapshot_task make_snapshot_task(size_t epoch) {
+      warp_impl::snapshot_task task;
+      if (snapshot.enabled()) {
+        task.engine_objid = rmi.get_obj_id();
+        task.epoch = epoch;
+        task.observe_fn = &engine_type::snapshot_observe;
+        task.capture_vertex_fn = &engine_type::snapshot_capture_vertex;
+        task.capture_edge_fn = &engine_type::snapshot_capture_edge;
+      }
+      return task;
+    }
+
+    static engine_type& engine_from_objid(size_t objid) {
+      return *reinterpret_cast<engine_type*>(
+          distributed_control::get_instance()->get_registered_object(objid));
+    }
+
+    static void snapshot_observe(size_t objid, size_t epoch) {
+      engine_from_objid(objid).snapshot.observe(epoch);
+    }
+
+    static void snapshot_capture_vertex(size_t objid, size_t epoch,
+                                        lvid_type lvid) {
+      engine_from_objid(objid).snapshot.capture_vertex(lvid, epoch);
+    }
+
+    static void snapshot_capture_edge(size_t objid, size_t epoch,
+                                      edge_id_type eid) {
+      engine_from_objid(objid).snapshot.capture_edge(eid, epoch);
+    }
+
     /**
      * \internal
      * Called when the scheduler returns a vertex to run.
@@ -1153,17 +1294,20 @@ namespace warp {
      * should be true. Otherwise it should be false.
      */
     void eval_sched_task(const lvid_type lvid,
-                         const message_type& msg) {
+                         const message_type& msg,
+                         size_t& epoch) {
       const typename graph_type::vertex_record& rec = graph.l_get_vertex_record(lvid);
       vertex_id_type vid = rec.gvid;
       // if this is another machine's forward it
       if (rec.owner != rmi.procid()) {
-        rmi.remote_call(rec.owner, &engine_type::rpc_signal, vid, msg);
+        snapshot.begin_task(lvid, msg, epoch);
+        snapshot.sent(epoch);
+        rmi.remote_call(rec.owner, &engine_type::rpc_signal, vid, msg, epoch);
         return;
       }
       // I have to run this myself
       
-      if (!get_exclusive_access_to_vertex(lvid, msg)) return;
+      if (!get_exclusive_access_to_vertex(lvid, msg, epoch)) return;
 
       /**************************************************************************/
       /*                             Acquire Locks                              */
@@ -1181,15 +1325,22 @@ namespace warp {
         }
         cm_handles[lvid]->lock.unlock();
       }
-
-      
+      // The scope is held, so the epoch of the task can be fixed. Lock
+      // grants carry epochs, so a task which held the scope before us
+      // cannot be in a later epoch.
+      snapshot.begin_task(lvid, msg, epoch);
 
       local_vertex_type l_vtx(graph.l_vertex(lvid));
       local_vertex_type vtx(l_vtx);
 
-
-      context ctx(*this, graph, vtx);
+      // the warp functions called by the update function find the epoch
+      // of the task in the fiber local storage
+      warp_impl::snapshot_task task = make_snapshot_task(epoch);
+      snapshot.capture_vertex(lvid, epoch);
+      context ctx(*this, graph, vtx, epoch);
+      fiber_control::set_tls(&task);
       update_fn(ctx, vtx);
+      fiber_control::set_tls(NULL);
       ctx.synchronize();
       /************************************************************************/
       /*                           Release Locks                              */
@@ -1215,13 +1366,15 @@ namespace warp {
       lvid_type sched_lvid;
 
       message_type msg;
+      size_t epoch = 0;
       float last_aggregator_check = timer::approx_time_seconds();
       timer ti; ti.start();
       while(1) {
         if (timer::approx_time_seconds() != last_aggregator_check && !endgame_mode) {
           last_aggregator_check = timer::approx_time_seconds();
-          std::string key = aggregator.tick_asynchronous();
-          if (key != "") {
+          snapshot.tick();
+          size_t key = aggregator.tick_asynchronous();
+          if (key != aggregator_type::NO_KEY) {
             for (size_t i = 0;i < aggregation_lock.size(); ++i) {
               aggregation_lock[i].lock();
               aggregation_queue[i].push_back(key);
@@ -1235,26 +1388,28 @@ namespace warp {
           size_t wid = fiber_control::get_worker_id();
           ASSERT_LT(wid, ncpus);
           aggregation_lock[wid].lock();
-          std::string key = aggregation_queue[wid].front();
+          size_t key = aggregation_queue[wid].front();
           aggregation_queue[wid].pop_front();
           aggregation_lock[wid].unlock();
           aggregator.tick_asynchronous_compute(wid, key);
         }
 
-        sched_status::status_enum stat = get_next_sched_task(threadid, sched_lvid, msg);
+        sched_status::status_enum stat = get_next_sched_task(threadid, sched_lvid, msg, epoch);
 
 
         has_sched_msg = stat != sched_status::EMPTY;
         if (stat != sched_status::EMPTY) {
-          eval_sched_task(sched_lvid, msg);
+          eval_sched_task(sched_lvid, msg, epoch);
+          snapshot.leave(epoch);
           if (endgame_mode) rmi.dc().flush();
         }
-        else if (!try_to_quit(threadid, has_sched_msg, sched_lvid, msg)) {
+        else if (!try_to_quit(threadid, has_sched_msg, sched_lvid, msg, epoch)) {
           /*
            * We failed to obtain a task, try to quit
            */
           if (has_sched_msg) {
-            eval_sched_task(sched_lvid, msg);
+            eval_sched_task(sched_lvid, msg, epoch);
+            snapshot.leave(epoch);
           }
         } else { 
           break; 
@@ -1284,6 +1439,26 @@ namespace warp {
       ASSERT_TRUE(scheduler_ptr != NULL);
       consensus->reset();
 
+      if (snapshot_resume) {
+        std::vector<std::pair<lvid_type, message_type> > msgs;
+        if (snapshot.restore(msgs)) {
+          for (size_t i = 0; i < msgs.size(); ++i) {
+            double priority;
+            messages.add(msgs[i].first, msgs[i].second, &priority);
+            scheduler_ptr->schedule(msgs[i].first, priority);
+          }
+          if (rmi.procid() == 0) {
+            logstream(LOG_EMPH) << "Resumed from snapshot " << snapshot_path
+                                << std::endl;
+          }
+        } else if (rmi.procid() == 0) {
+          logstream(LOG_WARNING) << "No snapshot to resume from in "
+                                 << snapshot_path << std::endl;
+        }
+        snapshot_resume = false;
+      }
+      snapshot.save_base();
+
       // now. It is of critical importance that we match the number of 
       // actual workers
      
@@ -1320,6 +1495,7 @@ namespace warp {
         thrgroup.launch(boost::bind(&engine_type::thread_start, this, i));
       }
       thrgroup.join();
+      snapshot.finish();
       aggregator.stop();
       // if termination reason was not changed, then it must be depletion
       if (termination_reason == execution_status::RUNNING) {
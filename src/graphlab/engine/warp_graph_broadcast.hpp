@@ -31,6 +31,7 @@
 #include <graphlab/parallel/fiber_remote_request.hpp>
 #include <graphlab/logger/assertions.hpp>
 #include <graphlab/rpc/dc.hpp>
+#include <graphlab/engine/warp_snapshot_task.hpp>
 #include <graphlab/macros_def.hpp>
 namespace graphlab {
 
@@ -65,7 +66,8 @@ struct broadcast_neighborhood_impl {
                                                  void(*broadcast_fn)(context_type& context,
                                                                      edge_type edge,
                                                                      vertex_type other),
-                                                 vertex_id_type vid) {
+                                                 vertex_id_type vid,
+                                                 const snapshot_task& task) {
     GraphType& graph(context.graph);
     lvid_type lvid = graph.local_vid(vid);
     local_vertex_type local_vertex(context.graph.l_vertex(lvid));
@@ -77,6 +79,7 @@ struct broadcast_neighborhood_impl {
         lvid_type a = edge.source().local_id(), b = edge.target().local_id();
         graph.get_lock_manager()[std::min(a,b)].lock();
         graph.get_lock_manager()[std::max(a,b)].lock();
+        task.capture_edge(local_edge.id());
         broadcast_fn(context, edge, other);
         graph.get_lock_manager()[a].unlock();
         graph.get_lock_manager()[b].unlock();
@@ -90,6 +93,7 @@ struct broadcast_neighborhood_impl {
         lvid_type a = edge.source().local_id(), b = edge.target().local_id();
         graph.get_lock_manager()[std::min(a,b)].lock();
         graph.get_lock_manager()[std::max(a,b)].lock();
+        task.capture_edge(local_edge.id());
         broadcast_fn(context, edge, other);
         graph.get_lock_manager()[a].unlock();
         graph.get_lock_manager()[b].unlock();
@@ -102,11 +106,14 @@ struct broadcast_neighborhood_impl {
                                                              edge_dir_type edge_direction,
                                                              size_t broadcast_ptr,
                                                              vertex_id_type vid,
-                                                             vertex_data_type& vdata) {
+                                                             vertex_data_type& vdata,
+                                                             const snapshot_task& task) {
+    task.observe();
     EngineType* engine = reinterpret_cast<EngineType*>(distributed_control::get_instance()->get_registered_object(objid.first));
     GraphType* graph = reinterpret_cast<GraphType*>(distributed_control::get_instance()->get_registered_object(objid.second));
     vertex_type vertex(graph->l_vertex(graph->local_vid(vid)));
-    context_type context(*engine, *graph, vertex);
+    context_type context(*engine, *graph, vertex, task.epoch);
+    task.capture_vertex(vertex.local_id());
     vertex.data() = vdata;
     // cast the mappers and combiners back into their pointer types
     void(*broadcast_fn)(context_type&, edge_type edge, vertex_type other) = 
@@ -115,7 +122,8 @@ struct broadcast_neighborhood_impl {
         context,
         edge_direction,
         broadcast_fn,
-        vid);
+        vid,
+        task);
   }
 
   static void basic_broadcast_neighborhood(context_type& context,
@@ -130,6 +138,7 @@ struct broadcast_neighborhood_impl {
 
     // make sure we are running on a master vertex
     ASSERT_EQ(vrecord.owner, distributed_control::get_instance_procid());
+    const snapshot_task task = snapshot_task::current();
     
     // create num-mirrors worth of requests
     std::vector<request_future<void > > requests(vrecord.num_mirrors());
@@ -143,14 +152,16 @@ struct broadcast_neighborhood_impl {
                                              edge_direction,
                                              reinterpret_cast<size_t>(broadcast_fn),
                                              current.id(),
-                                             current.data());
+                                             current.data(),
+                                             task);
         ++ctr;
     }
     // compute the local tasks
     basic_local_broadcast_neighborhood(context,
                                        edge_direction, 
                                        broadcast_fn, 
-                                       current.id());
+                                       current.id(),
+                                       task);
     // now, wait for everyone
     for (size_t i = 0;i < requests.size(); ++i) {
       requests[i]();
@@ -190,7 +201,8 @@ struct broadcast_neighborhood_impl2 {
                                                      vertex_type other,
                                                      const ExtraArg extra),
                                  vertex_id_type vid,
-                                 const ExtraArg extra) {
+                                 const ExtraArg extra,
+                                 const snapshot_task& task) {
     GraphType& graph(context.graph);
     lvid_type lvid = graph.local_vid(vid);
     local_vertex_type local_vertex(graph.l_vertex(lvid));
@@ -202,6 +214,7 @@ struct broadcast_neighborhood_impl2 {
         lvid_type a = edge.source().local_id(), b = edge.target().local_id();
         graph.get_lock_manager()[std::min(a,b)].lock();
         graph.get_lock_manager()[std::max(a,b)].lock();
+        task.capture_edge(local_edge.id());
         broadcast_fn(context, edge, other, extra);
         graph.get_lock_manager()[a].unlock();
         graph.get_lock_manager()[b].unlock();
@@ -215,6 +228,7 @@ struct broadcast_neighborhood_impl2 {
         lvid_type a = edge.source().local_id(), b = edge.target().local_id();
         graph.get_lock_manager()[std::min(a,b)].lock();
         graph.get_lock_manager()[std::max(a,b)].lock();
+        task.capture_edge(local_edge.id());
         broadcast_fn(context, edge, other, extra);
         graph.get_lock_manager()[a].unlock();
         graph.get_lock_manager()[b].unlock();
@@ -228,12 +242,17 @@ struct broadcast_neighborhood_impl2 {
                                                                 size_t broadcast_ptr,
                                                                 vertex_id_type vid,
                                                                 vertex_data_type& vdata,
-                                                                const ExtraArg extra) {
-
+                                                                const std::pair<ExtraArg, snapshot_task> extra_task) {
+    // the extra argument and the task travel together, since requests
+    // take at most 6 arguments
+    const ExtraArg& extra = extra_task.first;
+    const snapshot_task& task = extra_task.second;
+    task.observe();
     EngineType* engine = reinterpret_cast<EngineType*>(distributed_control::get_instance()->get_registered_object(objid.first));
     GraphType* graph = reinterpret_cast<GraphType*>(distributed_control::get_instance()->get_registered_object(objid.second));
     vertex_type vertex(graph->l_vertex(graph->local_vid(vid)));
-    context_type context(*engine, *graph, vertex);
+    context_type context(*engine, *graph, vertex, task.epoch);
+    task.capture_vertex(vertex.local_id());
     vertex.data() = vdata;
     // cast the mappers and combiners back into their pointer types
     void(*broadcast_fn)(context_type&, edge_type edge, vertex_type other, const ExtraArg) = 
@@ -243,7 +262,8 @@ struct broadcast_neighborhood_impl2 {
         edge_direction,
         broadcast_fn,
         vid,
-        extra);
+        extra,
+        task);
   }
 
   static void extended_broadcast_neighborhood(context_type& context,
@@ -259,6 +279,7 @@ struct broadcast_neighborhood_impl2 {
 
     // make sure we are running on a master vertex
     ASSERT_EQ(vrecord.owner, distributed_control::get_instance_procid());
+    const snapshot_task task = snapshot_task::current();
     
     // create num-mirrors worth of requests
     std::vector<request_future<void> > requests(vrecord.num_mirrors());
@@ -273,7 +294,7 @@ struct broadcast_neighborhood_impl2 {
                                              reinterpret_cast<size_t>(broadcast_fn),
                                              current.id(),
                                              current.data(),
-                                             extra);
+                                             std::make_pair(extra, task));
         ++ctr;
     }
     // compute the local tasks
@@ -281,7 +302,8 @@ struct broadcast_neighborhood_impl2 {
                                           edge_direction, 
                                           broadcast_fn, 
                                           current.id(),
-                                          extra);
+                                          extra,
+                                          task);
     // now, wait for everyone
     for (size_t i = 0;i < requests.size(); ++i) {
       requests[i]();
@@ -31,6 +31,7 @@
 #include <graphlab/parallel/fiber_remote_request.hpp>
 #include <graphlab/logger/assertions.hpp>
 #include <graphlab/rpc/dc.hpp>
+#include <graphlab/engine/warp_snapshot_task.hpp>
 #include <graphlab/macros_def.hpp>
 namespace graphlab {
 
@@ -82,7 +83,8 @@ struct map_reduce_neighborhood_impl {
                                                            edge_dir_type edge_direction,
                                                            RetType (*mapper)(edge_type edge, vertex_type other),
                                                            void (*combiner)(RetType&, const RetType&),
-                                                           vertex_id_type vid) {
+                                                           vertex_id_type vid,
+                                                           const snapshot_task& task) {
     lvid_type lvid = graph.local_vid(vid);
     local_vertex_type local_vertex(graph.l_vertex(lvid));
     
@@ -94,6 +96,7 @@ struct map_reduce_neighborhood_impl {
         lvid_type a = edge.source().local_id(), b = edge.target().local_id();
         graph.get_lock_manager()[std::min(a,b)].lock();
         graph.get_lock_manager()[std::max(a,b)].lock();
+        task.capture_edge(local_edge.id());
         accum += mapper(edge, other);
         graph.get_lock_manager()[a].unlock();
         graph.get_lock_manager()[b].unlock();
@@ -107,6 +110,7 @@ struct map_reduce_neighborhood_impl {
         lvid_type a = edge.source().local_id(), b = edge.target().local_id();
         graph.get_lock_manager()[std::min(a,b)].lock();
         graph.get_lock_manager()[std::max(a,b)].lock();
+        task.capture_edge(local_edge.id());
         accum += mapper(edge, other);
         graph.get_lock_manager()[a].unlock();
         graph.get_lock_manager()[b].unlock();
@@ -120,7 +124,9 @@ struct map_reduce_neighborhood_impl {
                                                            edge_dir_type edge_direction,
                                                            size_t mapper_ptr,
                                                            size_t combiner_ptr,
-                                                           vertex_id_type vid) {
+                                                           vertex_id_type vid,
+                                                           const snapshot_task& task) {
+    task.observe();
     // cast the mappers and combiners back into their pointer types
     RetType (*mapper)(edge_type edge, vertex_type other) = 
         reinterpret_cast<RetType(*)(edge_type, vertex_type)>(mapper_ptr);
@@ -131,7 +137,8 @@ struct map_reduce_neighborhood_impl {
         edge_direction,
         mapper,
         combiner,
-        vid);
+        vid,
+        task);
   }
 
   static RetType basic_map_reduce_neighborhood(typename GraphType::vertex_type current,
@@ -148,33 +155,38 @@ struct map_reduce_neighborhood_impl {
 
     // make sure we are running on a master vertex
     ASSERT_EQ(vrecord.owner, distributed_control::get_instance_procid());
+    const snapshot_task task = snapshot_task::current();
     
-    // create num-mirrors worth of requests
-    std::vector<request_future<conditional_combiner_wrapper<RetType> > > requests(vrecord.num_mirrors());
-    
-    size_t ctr = 0;
+    // issue all the requests. The replies are combined as they arrive.
+    // The combiner is wrapped explicitly: a raw function pointer converts
+    // to bool, and would pick the (value, has_value) constructor if
+    // RetType is bool.
+    fiber_reply_combiner<conditional_combiner_wrapper<RetType> > 
+        remote(vrecord.num_mirrors(), 
+               conditional_combiner_wrapper<RetType>(
+                   boost::function<void(RetType&, const RetType&)>(combiner)));
     foreach(procid_t proc, vrecord.mirrors()) {
       // issue the communication
-        requests[ctr] = fiber_remote_request(proc, 
-                                             map_reduce_neighborhood_impl<RetType, GraphType>::basic_local_mapper_from_remote,
-                                             objid,
-                                             edge_direction,
-                                             reinterpret_cast<size_t>(mapper),
-                                             reinterpret_cast<size_t>(combiner),
-                                             current.id());
-        ++ctr;
+        continuation_remote_request(proc, 
+                                    remote.callback(),
+                                    map_reduce_neighborhood_impl<RetType, GraphType>::basic_local_mapper_from_remote,
+                                    objid,
+                                    edge_direction,
+                                    reinterpret_cast<size_t>(mapper),
+                                    reinterpret_cast<size_t>(combiner),
+                                    current.id(),
+                                    task);
     }
     // compute the local tasks
     conditional_combiner_wrapper<RetType> accum = basic_local_mapper(graph, 
                                                                      edge_direction, 
                                                                      mapper, 
                                                                      combiner,
-                                                                     current.id());
+                                                                     current.id(),
+                                                                     task);
     accum.set_combiner(combiner);
     // now, wait for everyone
-    for (size_t i = 0;i < requests.size(); ++i) {
-      accum += requests[i]();
-    }
+    accum += remote.wait();
     return accum.value;
   }
 
@@ -206,7 +218,8 @@ struct map_reduce_neighborhood_impl2 {
                                                               RetType (*mapper)(edge_type edge, vertex_type other, const ExtraArg),
                                                               void (*combiner)(RetType&, const RetType&, const ExtraArg),
                                                               vertex_id_type vid,
-                                                              const ExtraArg extra) {
+                                                              const ExtraArg extra,
+                                                              const snapshot_task& task) {
 
     lvid_type lvid = graph.local_vid(vid);
     local_vertex_type local_vertex(graph.l_vertex(lvid));
@@ -220,6 +233,7 @@ struct map_reduce_neighborhood_impl2 {
 
         graph.get_lock_manager()[std::min(a,b)].lock();
         graph.get_lock_manager()[std::max(a,b)].lock();
+        task.capture_edge(local_edge.id());
         accum += mapper(edge, other, extra);
         graph.get_lock_manager()[a].unlock();
         graph.get_lock_manager()[b].unlock();
@@ -234,6 +248,7 @@ struct map_reduce_neighborhood_impl2 {
 
         graph.get_lock_manager()[std::min(a,b)].lock();
         graph.get_lock_manager()[std::max(a,b)].lock();
+        task.capture_edge(local_edge.id());
         accum += mapper(edge, other, extra);
         graph.get_lock_manager()[a].unlock();
         graph.get_lock_manager()[b].unlock();
@@ -247,7 +262,12 @@ struct map_reduce_neighborhood_impl2 {
                                                               size_t mapper_ptr,
                                                               size_t combiner_ptr,
                                                               vertex_id_type vid,
-                                                              const ExtraArg extra) {
+                                                              const std::pair<ExtraArg, snapshot_task> extra_task) {
+    // the extra argument and the task travel together, since requests
+    // take at most 6 arguments
+    const ExtraArg& extra = extra_task.first;
+    const snapshot_task& task = extra_task.second;
+    task.observe();
     // cast the mappers and combiners back into their pointer types
     RetType (*mapper)(edge_type edge, vertex_type other, const ExtraArg) = 
         reinterpret_cast<RetType(*)(edge_type, vertex_type, const ExtraArg)>(mapper_ptr);
@@ -259,7 +279,8 @@ struct map_reduce_neighborhood_impl2 {
         mapper,
         combiner,
         vid,
-        extra);
+        extra,
+        task);
   }
 
   static RetType extended_map_reduce_neighborhood(typename GraphType::vertex_type current,
@@ -278,33 +299,33 @@ struct map_reduce_neighborhood_impl2 {
 
     // make sure we are running on a master vertex
     ASSERT_EQ(vrecord.owner, distributed_control::get_instance_procid());
+    const snapshot_task task = snapshot_task::current();
     
-    // create num-mirrors worth of requests
-    std::vector<request_future<conditional_combiner_wrapper<RetType> > > requests(vrecord.num_mirrors());
-    
-    size_t ctr = 0;
+    // issue all the requests. The replies are combined as they arrive
+    fiber_reply_combiner<conditional_combiner_wrapper<RetType> > 
+        remote(vrecord.num_mirrors(), 
+               conditional_combiner_wrapper<RetType>(
+                   boost::bind(combiner, _1, _2, boost::ref(extra))));
     foreach(procid_t proc, vrecord.mirrors()) {
       // issue the communication
-      requests[ctr] = fiber_remote_request(proc, 
-                                           map_reduce_neighborhood_impl2::extended_local_mapper_from_remote,
-                                           objid,
-                                           edge_direction,
-                                           reinterpret_cast<size_t>(mapper),
-                                           reinterpret_cast<size_t>(combiner),
-                                           current.id(),
-                                           extra);
-        ++ctr;
+      continuation_remote_request(proc, 
+                                  remote.callback(),
+                                  map_reduce_neighborhood_impl2::extended_local_mapper_from_remote,
+                                  objid,
+                                  edge_direction,
+                                  reinterpret_cast<size_t>(mapper),
+                                  reinterpret_cast<size_t>(combiner),
+                                  current.id(),
+                                  std::make_pair(extra, task));
     }
     // compute the local tasks
     conditional_combiner_wrapper<RetType> accum = 
         extended_local_mapper(graph, edge_direction, mapper, 
-                              combiner, current.id(), extra);
+                              combiner, current.id(), extra, task);
 
     accum.set_combiner(boost::bind(combiner, _1, _2, boost::ref(extra)));
     // now, wait for everyone
-    for (size_t i = 0;i < requests.size(); ++i) {
-      accum += requests[i]();
-    }
+    accum += remote.wait();
     return accum.value;
   }
 
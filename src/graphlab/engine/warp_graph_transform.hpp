@@ -31,6 +31,7 @@
 #include <graphlab/parallel/fiber_remote_request.hpp>
 #include <graphlab/logger/assertions.hpp>
 #include <graphlab/rpc/dc.hpp>
+#include <graphlab/engine/warp_snapshot_task.hpp>
 #include <graphlab/macros_def.hpp>
 namespace graphlab {
 
@@ -62,7 +63,8 @@ struct transform_neighborhood_impl {
                                                  edge_dir_type edge_direction,
                                                  void(*transform_fn)(edge_type edge,
                                                                      vertex_type other),
-                                                 vertex_id_type vid) {
+                                                 vertex_id_type vid,
+                                                 const snapshot_task& task) {
     lvid_type lvid = graph.local_vid(vid);
     local_vertex_type local_vertex(graph.l_vertex(lvid));
     
@@ -73,6 +75,7 @@ struct transform_neighborhood_impl {
         lvid_type a = edge.source().local_id(), b = edge.target().local_id();
         graph.get_lock_manager()[std::min(a,b)].lock();
         graph.get_lock_manager()[std::max(a,b)].lock();
+        task.capture_edge(local_edge.id());
         transform_fn(edge, other);
         graph.get_lock_manager()[a].unlock();
         graph.get_lock_manager()[b].unlock();
@@ -86,6 +89,7 @@ struct transform_neighborhood_impl {
         lvid_type a = edge.source().local_id(), b = edge.target().local_id();
         graph.get_lock_manager()[std::min(a,b)].lock();
         graph.get_lock_manager()[std::max(a,b)].lock();
+        task.capture_edge(local_edge.id());
         transform_fn(edge, other);
         graph.get_lock_manager()[a].unlock();
         graph.get_lock_manager()[b].unlock();
@@ -97,7 +101,9 @@ struct transform_neighborhood_impl {
   static void basic_local_transform_neighborhood_from_remote(size_t objid,
                                                              edge_dir_type edge_direction,
                                                              size_t transform_ptr,
-                                                             vertex_id_type vid) {
+                                                             vertex_id_type vid,
+                                                             const snapshot_task& task) {
+    task.observe();
     // cast the mappers and combiners back into their pointer types
     void(*transform_fn)(edge_type edge, vertex_type other) = 
         reinterpret_cast<void(*)(edge_type, vertex_type)>(transform_ptr);
@@ -105,7 +111,8 @@ struct transform_neighborhood_impl {
         *reinterpret_cast<GraphType*>(distributed_control::get_instance()->get_registered_object(objid)),
         edge_direction,
         transform_fn,
-        vid);
+        vid,
+        task);
   }
 
   static void basic_transform_neighborhood(typename GraphType::vertex_type current,
@@ -119,6 +126,7 @@ struct transform_neighborhood_impl {
 
     // make sure we are running on a master vertex
     ASSERT_EQ(vrecord.owner, distributed_control::get_instance_procid());
+    const snapshot_task task = snapshot_task::current();
     
     // create num-mirrors worth of requests
     std::vector<request_future<void > > requests(vrecord.num_mirrors());
@@ -131,14 +139,16 @@ struct transform_neighborhood_impl {
                                              objid,
                                              edge_direction,
                                              reinterpret_cast<size_t>(transform_fn),
-                                             current.id());
+                                             current.id(),
+                                             task);
         ++ctr;
     }
     // compute the local tasks
     basic_local_transform_neighborhood(graph, 
                                        edge_direction, 
                                        transform_fn, 
-                                       current.id());
+                                       current.id(),
+                                       task);
     // now, wait for everyone
     for (size_t i = 0;i < requests.size(); ++i) {
       requests[i]();
@@ -175,7 +185,8 @@ struct transform_neighborhood_impl2 {
                                                      vertex_type other,
                                                      const ExtraArg extra),
                                  vertex_id_type vid,
-                                 const ExtraArg extra) {
+                                 const ExtraArg extra,
+                                 const snapshot_task& task) {
     lvid_type lvid = graph.local_vid(vid);
     local_vertex_type local_vertex(graph.l_vertex(lvid));
     
@@ -186,6 +197,7 @@ struct transform_neighborhood_impl2 {
         lvid_type a = edge.source().local_id(), b = edge.target().local_id();
         graph.get_lock_manager()[std::min(a,b)].lock();
         graph.get_lock_manager()[std::max(a,b)].lock();
+        task.capture_edge(local_edge.id());
         transform_fn(edge, other, extra);
         graph.get_lock_manager()[a].unlock();
         graph.get_lock_manager()[b].unlock();
@@ -199,6 +211,7 @@ struct transform_neighborhood_impl2 {
         lvid_type a = edge.source().local_id(), b = edge.target().local_id();
         graph.get_lock_manager()[std::min(a,b)].lock();
         graph.get_lock_manager()[std::max(a,b)].lock();
+        task.capture_edge(local_edge.id());
         transform_fn(edge, other, extra);
         graph.get_lock_manager()[a].unlock();
         graph.get_lock_manager()[b].unlock();
@@ -211,7 +224,9 @@ struct transform_neighborhood_impl2 {
                                                                 edge_dir_type edge_direction,
                                                                 size_t transform_ptr,
                                                                 vertex_id_type vid,
-                                                                const ExtraArg extra) {
+                                                                const ExtraArg extra,
+                                                                const snapshot_task& task) {
+    task.observe();
     // cast the mappers and combiners back into their pointer types
     void(*transform_fn)(edge_type edge, vertex_type other, const ExtraArg) = 
         reinterpret_cast<void(*)(edge_type, vertex_type, const ExtraArg)>(transform_ptr);
@@ -220,7 +235,8 @@ struct transform_neighborhood_impl2 {
         edge_direction,
         transform_fn,
         vid,
-        extra);
+        extra,
+        task);
   }
 
   static void extended_transform_neighborhood(typename GraphType::vertex_type current,
@@ -235,6 +251,7 @@ struct transform_neighborhood_impl2 {
 
     // make sure we are running on a master vertex
     ASSERT_EQ(vrecord.owner, distributed_control::get_instance_procid());
+    const snapshot_task task = snapshot_task::current();
     
     // create num-mirrors worth of requests
     std::vector<request_future<void> > requests(vrecord.num_mirrors());
@@ -248,7 +265,8 @@ struct transform_neighborhood_impl2 {
                                              edge_direction,
                                              reinterpret_cast<size_t>(transform_fn),
                                              current.id(),
-                                             extra);
+                                             extra,
+                                             task);
         ++ctr;
     }
     // compute the local tasks
@@ -256,7 +274,8 @@ struct transform_neighborhood_impl2 {
                                           edge_direction, 
                                           transform_fn, 
                                           current.id(),
-                                          extra);
+                                          extra,
+                                          task);
     // now, wait for everyone
     for (size_t i = 0;i < requests.size(); ++i) {
       requests[i]();
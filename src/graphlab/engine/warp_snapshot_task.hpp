@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2009 Carnegie Mellon University.
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+#ifndef GRAPHLAB_WARP_SNAPSHOT_TASK_HPP
+#define GRAPHLAB_WARP_SNAPSHOT_TASK_HPP
+
+#include <cstddef>
+#include <graphlab/graph/graph_basic_types.hpp>
+#include <graphlab/parallel/fiber_control.hpp>
+#include <graphlab/serialization/is_pod.hpp>
+
+namespace graphlab {
+
+namespace warp {
+
+namespace warp_impl {
+
+/**
+ * \internal
+ * The snapshot epoch of the warp_engine task running in the current
+ * fiber. While an update function runs, the engine keeps a pointer to it
+ * in the fiber local storage. The warp functions send it along with
+ * their requests, so that every machine moves to the epoch of the task
+ * and captures the edges and vertices it is about to touch (see
+ * async_snapshot).
+ *
+ * The functions are static members of the engine, which find the engine
+ * on every machine through its rpc object id, in the same way as the
+ * mapper and combiner pointers of the warp functions.
+ */
+struct snapshot_task: public IS_POD_TYPE {
+  size_t engine_objid;
+  size_t epoch;
+  void (*observe_fn)(size_t engine_objid, size_t epoch);
+  void (*capture_vertex_fn)(size_t engine_objid, size_t epoch, lvid_type lvid);
+  void (*capture_edge_fn)(size_t engine_objid, size_t epoch, edge_id_type eid);
+
+  snapshot_task(): engine_objid(0), epoch(0), observe_fn(NULL),
+                   capture_vertex_fn(NULL), capture_edge_fn(NULL) { }
+
+  /**
+   * Returns the task of the current fiber, or a task doing nothing if the
+   * warp function is not called from a warp_engine update function.
+   */
+  static snapshot_task current() {
+    if (fiber_control::get_tid() == 0) return snapshot_task();
+    const snapshot_task* task =
+        static_cast<const snapshot_task*>(fiber_control::get_tls());
+    return task != NULL ? *task : snapshot_task();
+  }
+
+  /// Moves this machine to the epoch of the task. Called on the mirrors.
+  void observe() const {
+    if (observe_fn != NULL) observe_fn(engine_objid, epoch);
+  }
+
+  /// Captures a local vertex before the task writes it
+  void capture_vertex(lvid_type lvid) const {
+    if (capture_vertex_fn != NULL) capture_vertex_fn(engine_objid, epoch, lvid);
+  }
+
+  /// Captures a local edge before the task accesses it
+  void capture_edge(edge_id_type eid) const {
+    if (capture_edge_fn != NULL) capture_edge_fn(engine_objid, epoch, eid);
+  }
+};
+
+} // namespace warp::warp_impl
+
+} // namespace warp
+
+} // namespace graphlab
+
+#endif
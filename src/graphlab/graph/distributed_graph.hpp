@@ -34,6 +34,7 @@
 #include <vector>
 #include <set>
 #include <map>
+#include <unistd.h>
 #include <graphlab/util/dense_bitset.hpp>
 
 #include <queue>
@@ -53,6 +54,7 @@
 #include <boost/iostreams/filter/gzip.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/concept/requires.hpp>
+#include <boost/lexical_cast.hpp>
 
 #include <graphlab/logger/logger.hpp>
 #include <graphlab/logger/assertions.hpp>
@@ -60,9 +62,14 @@
 #include <graphlab/rpc/dc.hpp>
 #include <graphlab/rpc/dc_dist_object.hpp>
 #include <graphlab/rpc/buffered_exchange.hpp>
+#include <graphlab/parallel/fiber_control.hpp>
+#include <graphlab/parallel/numa.hpp>
 #include <graphlab/util/random.hpp>
 #include <graphlab/util/branch_hints.hpp>
 #include <graphlab/util/generics/conditional_addition_wrapper.hpp>
+#if defined(__cplusplus) && __cplusplus >= 201103L
+#include <graphlab/util/generics/reductions.hpp>
+#endif
 
 #include <graphlab/options/graphlab_options.hpp>
 #include <graphlab/serialization/serialization_includes.hpp>
@@ -75,6 +82,7 @@
 #include <graphlab/graph/ingress/distributed_ingress_base.hpp>
 #include <graphlab/graph/ingress/distributed_oblivious_ingress.hpp>
 #include <graphlab/graph/ingress/distributed_hdrf_ingress.hpp>
+#include <graphlab/graph/ingress/distributed_hybrid_ingress.hpp>
 #include <graphlab/graph/ingress/distributed_random_ingress.hpp>
 #include <graphlab/graph/ingress/distributed_identity_ingress.hpp>
 
@@ -82,8 +90,10 @@
 #include <graphlab/graph/ingress/distributed_constrained_random_ingress.hpp>
 
 #include <graphlab/graph/graph_hash.hpp>
+#include <graphlab/graph/vid2lvid_index.hpp>
 
 #include <graphlab/util/hopscotch_map.hpp>
+#include <graphlab/util/mmap_allocator.hpp>
 
 #include <graphlab/util/fs_util.hpp>
 #include <graphlab/util/hdfs.hpp>
@@ -199,6 +209,12 @@ namespace graphlab
    *                perfect difference set.  This obtains the highest quality partition,
    *                reducing runtime memory consumption significantly, without load-time penalty.
    *                Currently only works with p^2+p+1 number of machines (p prime).
+   *
+   * \li \c "hybrid" Places all in-edges of a low-degree vertex on the machine
+   *                owning that vertex and only cuts vertices whose in-degree
+   *                exceeds \c threshold. Removes most mirrors of low-degree
+   *                vertices on power-law graphs at the cost of an extra
+   *                shuffle of the edges during finalize.
    *	
    * \li \c "hdrf" Runs at roughly the speed of oblivious.
    *	            HDRF provides the smallest average replication factor with close to optimal load balance.
@@ -404,6 +420,7 @@ public:
   friend class distributed_identity_ingress<VertexData, EdgeData>;
   friend class distributed_oblivious_ingress<VertexData, EdgeData>;
   friend class distributed_hdrf_ingress<VertexData, EdgeData>;
+  friend class distributed_hybrid_ingress<VertexData, EdgeData>;
   friend class distributed_constrained_random_ingress<VertexData, EdgeData>;
 
   typedef graphlab::vertex_id_type vertex_id_type;
@@ -612,6 +629,37 @@ public:
      *                Defaults to 50,000. Increasing this number will
      *                decrease partitioning time with a penalty to partitioning
      *                quality.
+     * \li \c threshold The in-degree above which the "hybrid" ingress
+     *                method cuts a vertex. Defaults to 100.
+     * \li \c spill_dir If set, enables out-of-core ingress: received edges
+     *                are written to sorted run files in this local directory
+     *                and merged into the local graph during finalize, instead
+     *                of being buffered in memory.
+     * \li \c spill_budget The amount of edge data (in MB) held in memory
+     *                per machine. Each run written to spill_dir holds half
+     *                of it. Defaults to 1024.
+     * \li \c numa If set, finalize() splits the local vertices into one
+     *                contiguous range per NUMA node, balanced by degree and
+     *                by the number of fiber workers on each node, and
+     *                moves the vertex, edge and adjacency data of each range
+     *                to its node. The synchronous engine then processes
+     *                each range on the workers of its node first.
+     *                Defaults to 0.
+     * \li \c alloc How the large arrays of the graph (vertex and edge
+     *                data, adjacency, vid2lvid and the vertex records) are
+     *                allocated. "malloc" (default), "hugepage" for
+     *                transparent 2MB pages, "hugetlb" for pages from the
+     *                hugetlbfs pool, or "file" for memory mapped files in
+     *                alloc_dir which the OS may page out, so the graph can
+     *                exceed physical memory. The setting is process wide.
+     * \li \c alloc_dir The directory of the backing files of
+     *                alloc=file. Defaults to /tmp.
+     * \li \c vid2lvid The representation of the map from global to local
+     *                vertex ids after finalize. "hash" (default) keeps the
+     *                hash table. "dense" uses an array over the range of
+     *                local vertex ids, "sorted" sorted arrays with a radix
+     *                table, and "auto" picks "dense" if the ids are dense
+     *                and "sorted" otherwise. See vid2lvid_index.
      *
      * \param [in] dc Distributed controller to associate with
      * \param [in] opts A graphlab::graphlab_options object specifying engine
@@ -627,7 +675,8 @@ public:
 #else
                                                                          vertex_exchange(dc),
 #endif
-                                                                         vset_exchange(dc), parallel_ingress(true)
+                                                                         vset_exchange(dc), parallel_ingress(true),
+                                                                         use_numa(false)
   {
     rpc.barrier();
     set_options(opts);
@@ -650,7 +699,12 @@ private:
     size_t bufsize = 50000;
     bool usehash = false;
     bool userecent = false;
+    size_t threshold = 100;
+    std::string spill_dir = "";
+    size_t spill_budget = 1024;
     std::string ingress_method = "";
+    std::string alloc = "";
+    std::string alloc_dir = "";
     std::vector<std::string> keys = opts.get_graph_args().get_option_keys();
     foreach (std::string opt, keys)
     {
@@ -692,12 +746,79 @@ private:
           logstream(LOG_EMPH) << "Graph Option: userecent = "
                               << userecent << std::endl;
       }
+      else if (opt == "spill_dir")
+      {
+        opts.get_graph_args().get_option("spill_dir", spill_dir);
+        if (rpc.procid() == 0)
+          logstream(LOG_EMPH) << "Graph Option: spill_dir = "
+                              << spill_dir << std::endl;
+      }
+      else if (opt == "spill_budget")
+      {
+        opts.get_graph_args().get_option("spill_budget", spill_budget);
+        if (rpc.procid() == 0)
+          logstream(LOG_EMPH) << "Graph Option: spill_budget = "
+                              << spill_budget << "MB" << std::endl;
+      }
+      else if (opt == "threshold")
+      {
+        opts.get_graph_args().get_option("threshold", threshold);
+        if (rpc.procid() == 0)
+          logstream(LOG_EMPH) << "Graph Option: threshold = "
+                              << threshold << std::endl;
+      }
+      else if (opt == "numa")
+      {
+        opts.get_graph_args().get_option("numa", use_numa);
+        if (rpc.procid() == 0)
+          logstream(LOG_EMPH) << "Graph Option: numa = "
+                              << use_numa << std::endl;
+      }
+      else if (opt == "alloc")
+      {
+        opts.get_graph_args().get_option("alloc", alloc);
+        if (rpc.procid() == 0)
+          logstream(LOG_EMPH) << "Graph Option: alloc = "
+                              << alloc << std::endl;
+      }
+      else if (opt == "alloc_dir")
+      {
+        opts.get_graph_args().get_option("alloc_dir", alloc_dir);
+        if (rpc.procid() == 0)
+          logstream(LOG_EMPH) << "Graph Option: alloc_dir = "
+                              << alloc_dir << std::endl;
+      }
+      else if (opt == "vid2lvid")
+      {
+        std::string index_mode;
+        opts.get_graph_args().get_option("vid2lvid", index_mode);
+        if (!vid2lvid.set_mode(index_mode))
+          logstream(LOG_FATAL) << "Unknown vid2lvid index " << index_mode
+                               << std::endl;
+        if (rpc.procid() == 0)
+          logstream(LOG_EMPH) << "Graph Option: vid2lvid = "
+                              << index_mode << std::endl;
+      }
       else
       {
         logstream(LOG_ERROR) << "Unexpected Graph Option: " << opt << std::endl;
       }
     }
-    set_ingress_method(ingress_method, bufsize, usehash, userecent);
+    if (!alloc.empty() && !mmap_alloc::set_mode(alloc, alloc_dir))
+    {
+      logstream(LOG_FATAL) << "Unknown graph allocation mode " << alloc
+                           << std::endl;
+    }
+    set_ingress_method(ingress_method, bufsize, usehash, userecent, threshold);
+    if (!spill_dir.empty())
+    {
+      // Include the pid so that concurrent jobs sharing spill_dir do not
+      // overwrite each other's runs.
+      const std::string prefix = spill_dir + "/graphlab_ingress_" +
+                                 boost::lexical_cast<std::string>(getpid()) + "_" +
+                                 boost::lexical_cast<std::string>(rpc.procid());
+      ingress_ptr->enable_edge_spill(prefix, spill_budget * 1024 * 1024);
+    }
   }
 
 public:
@@ -725,18 +846,65 @@ public:
     ASSERT_NE(ingress_ptr, NULL);
     logstream(LOG_INFO) << "Distributed graph: enter finalize" << std::endl;
     ingress_ptr->finalize();
+    rebuild_owned_lvids();
     lock_manager.resize(num_local_vertices());
+    if (use_numa)
+      place_on_numa_nodes();
     rpc.barrier();
 
     finalized = true;
   }
 
+  /**
+   * \brief Returns the NUMA ranges of the local vertices.
+   *
+   * If the \c numa graph option is set, the local vertices
+   * [ranges[i], ranges[i+1]) are stored on NUMA node i. The boundaries
+   * are multiples of 64 so that ranges never share a word of a dense
+   * bitset. Empty if the option is not set.
+   */
+  const std::vector<lvid_type> &numa_ranges() const
+  {
+    return numa_bounds;
+  }
+
   /// \brief Returns true if the graph is finalized.
   bool is_finalized()
   {
     return finalized;
   }
 
+  /**
+     * \brief Returns the set of vertices whose adjacency or data was
+     * changed by calls to finalize() since the set was last cleared.
+     *
+     * After the first finalize this is the complete set. On a dynamic
+     * graph, subsequent finalizes only renegotiate the vertices touched by
+     * the newly added edges and vertices, and this set can be used to
+     * resume an engine on just the affected part of the graph. The engines
+     * clear the set when they start, so it always holds the changes since
+     * the last call to start():
+     *
+     * \code
+     * graph.add_edge(...);
+     * graph.finalize();
+     * engine.signal_changed(graphlab::ALL_EDGES);
+     * engine.start();
+     * \endcode
+     */
+  const vertex_set& changed_vertices() const
+  {
+    return changed_vset;
+  }
+
+  /**
+     * \brief Empties the set returned by changed_vertices().
+     */
+  void clear_changed_vertices()
+  {
+    changed_vset = empty_set();
+  }
+
   /** \brief Get the number of vertices */
   size_t num_vertices() const { return nverts; }
 
@@ -1013,20 +1181,20 @@ public:
 #ifdef _OPENMP
 #pragma omp for
 #endif
-      for (int i = 0; i < (int)local_graph.num_vertices(); ++i)
+      for (int i = 0; i < (int)owned_lvids.size(); ++i)
       {
-        if (lvid2record[i].owner == rpc.procid() &&
-            vset.l_contains((lvid_type)i))
+        const lvid_type lvid = owned_lvids[i];
+        if (vset.l_contains(lvid))
         {
           if (!result_set)
           {
-            const vertex_type vtx(l_vertex(i));
+            const vertex_type vtx(l_vertex(lvid));
             result = mapfunction(vtx);
             result_set = true;
           }
           else if (result_set)
           {
-            const vertex_type vtx(l_vertex(i));
+            const vertex_type vtx(l_vertex(lvid));
             const ReductionType tmp = mapfunction(vtx);
             result += tmp;
           }
@@ -1217,6 +1385,307 @@ public:
     return wrapper.value;
   } // end of map_reduce_edges
 
+#if defined(__cplusplus) && __cplusplus >= 201103L
+  /**
+    * \brief Performs several map-reduce operations on each vertex in
+    * one pass over the graph.
+    *
+    * map_reduce_vertices_fused() calls every map function on every
+    * vertex in vset and returns the sums of their results in a
+    * graphlab::reduction_tuple. Only a single pass over the owned
+    * vertices and a single all-reduce are performed, instead of one of
+    * each per map function. For instance:
+    * \code
+    * graphlab::reduction<graphlab::sum_op<double> >
+    * vertex_delta(const graph_type::vertex_type& vertex) {
+    *   return std::fabs(vertex.data().delta);
+    * }
+    * graphlab::reduction<graphlab::max_op<double> >
+    * vertex_max_delta(const graph_type::vertex_type& vertex) {
+    *   return std::fabs(vertex.data().delta);
+    * }
+    * graphlab::reduction<graphlab::count_op>
+    * vertex_active(const graph_type::vertex_type& vertex) {
+    *   return vertex.data().active;
+    * }
+    * auto result = graph.map_reduce_vertices_fused(graph.complete_set(),
+    *                                               vertex_delta,
+    *                                               vertex_max_delta,
+    *                                               vertex_active);
+    * double total = result.get<0>().value;
+    * \endcode
+    * Must be called on all machines simultaneously. This function is
+    * available only if the compiler has C++11 support.
+    *
+    * \param vset The set of vertices to map reduce over.
+    * \param mapfunctions The map functions. Each must take a
+    *                    \ref vertex_type, or a reference to a
+    *                    \ref vertex_type, and return a type with
+    *                    operator+= which is \ref sec_serializable.
+    */
+  template <typename... MapFunctionTypes>
+  reduction_tuple<typename map_result_type<MapFunctionTypes,
+                                           const vertex_type &>::type...>
+  map_reduce_vertices_fused(const vertex_set &vset,
+                            MapFunctionTypes... mapfunctions)
+  {
+    typedef reduction_tuple<typename map_result_type<
+        MapFunctionTypes, const vertex_type &>::type...>
+        result_type;
+    if (!finalized)
+    {
+      logstream(LOG_FATAL)
+          << "\n\tAttempting to run graph.map_reduce_vertices_fused(...) "
+          << "\n\tbefore calling graph.finalize()."
+          << std::endl;
+    }
+
+    rpc.barrier();
+    conditional_addition_wrapper<result_type> global_result;
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+      conditional_addition_wrapper<result_type> result;
+#ifdef _OPENMP
+#pragma omp for
+#endif
+      for (int i = 0; i < (int)owned_lvids.size(); ++i)
+      {
+        const lvid_type lvid = owned_lvids[i];
+        if (vset.l_contains(lvid))
+        {
+          const vertex_type vtx(l_vertex(lvid));
+          result += result_type(mapfunctions(vtx)...);
+        }
+      }
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+      global_result += result;
+    }
+    rpc.all_reduce(global_result);
+    return global_result.value;
+  } // end of map_reduce_vertices_fused
+
+  /**
+    * \brief Performs several map-reduce operations on each edge in
+    * one pass over the graph.
+    *
+    * The edge counterpart of map_reduce_vertices_fused(). vset and edir
+    * select the edges as in map_reduce_edges(). Must be called on all
+    * machines simultaneously. This function is available only if the
+    * compiler has C++11 support.
+    *
+    * \param vset A set of vertices. Combines with edir to identify the
+    *             set of edges.
+    * \param edir An edge direction. Combines with vset to identify the
+    *             set of edges.
+    * \param mapfunctions The map functions. Each must take an
+    *                    \ref edge_type, or a reference to an
+    *                    \ref edge_type, and return a type with
+    *                    operator+= which is \ref sec_serializable.
+    */
+  template <typename... MapFunctionTypes>
+  reduction_tuple<typename map_result_type<MapFunctionTypes,
+                                           const edge_type &>::type...>
+  map_reduce_edges_fused(const vertex_set &vset, edge_dir_type edir,
+                         MapFunctionTypes... mapfunctions)
+  {
+    typedef reduction_tuple<typename map_result_type<
+        MapFunctionTypes, const edge_type &>::type...>
+        result_type;
+    if (!finalized)
+    {
+      logstream(LOG_FATAL)
+          << "\n\tAttempting to run graph.map_reduce_edges_fused(...) "
+          << "\n\tbefore calling graph.finalize()."
+          << std::endl;
+    }
+
+    rpc.barrier();
+    conditional_addition_wrapper<result_type> global_result;
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+      conditional_addition_wrapper<result_type> result;
+#ifdef _OPENMP
+#pragma omp for
+#endif
+      for (int i = 0; i < (int)local_graph.num_vertices(); ++i)
+      {
+        if (vset.l_contains((lvid_type)i))
+        {
+          if (edir == IN_EDGES || edir == ALL_EDGES)
+          {
+            foreach (const local_edge_type &e, l_vertex(i).in_edges())
+            {
+              const edge_type edge(e);
+              result += result_type(mapfunctions(edge)...);
+            }
+          }
+          if (edir == OUT_EDGES || edir == ALL_EDGES)
+          {
+            foreach (const local_edge_type &e, l_vertex(i).out_edges())
+            {
+              const edge_type edge(e);
+              result += result_type(mapfunctions(edge)...);
+            }
+          }
+        }
+      }
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+      global_result += result;
+    }
+    rpc.all_reduce(global_result);
+    return global_result.value;
+  } // end of map_reduce_edges_fused
+
+  /**
+    * \brief Reduces a value computed from the data of each vertex with
+    * one of the built-in POD reductions.
+    *
+    * datafunction is called directly on the vertex data of every owned
+    * vertex in vset, and its results are combined with Op, which is one
+    * of graphlab::sum_op, graphlab::min_op, graphlab::max_op or
+    * graphlab::count_op. No vertex_type is constructed and the
+    * accumulator is a plain value, so the loop can be vectorized by the
+    * compiler. For instance:
+    * \code
+    * double max_rank = graph.reduce_vertex_data<graphlab::max_op<double> >(
+    *     [](const vertex_data_type& vdata) { return vdata.rank; });
+    * \endcode
+    * Must be called on all machines simultaneously. This function is
+    * available only if the compiler has C++11 support.
+    *
+    * \tparam Op The reduction operation.
+    * \param datafunction Takes a const reference to a vertex_data_type
+    *                     and returns a value convertible to
+    *                     Op::value_type.
+    * \param vset The set of vertices to reduce over. Optional. Defaults
+    *             to complete_set()
+    */
+  template <typename Op, typename DataFunctionType>
+  typename Op::value_type reduce_vertex_data(DataFunctionType datafunction,
+                                             const vertex_set &vset =
+                                                 complete_set())
+  {
+    typedef typename Op::value_type value_type;
+    if (!finalized)
+    {
+      logstream(LOG_FATAL)
+          << "\n\tAttempting to run graph.reduce_vertex_data(...) "
+          << "\n\tbefore calling graph.finalize()."
+          << std::endl;
+    }
+
+    rpc.barrier();
+    const bool all_vertices = vset.lazy && vset.is_complete_set;
+    const lvid_type *lvids = owned_lvids.empty() ? NULL : &owned_lvids[0];
+    const int nlvids = (int)owned_lvids.size();
+    reduction<Op> global_result;
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+      value_type result = Op::identity();
+      if (all_vertices)
+      {
+#ifdef _OPENMP
+#pragma omp for nowait
+#endif
+        for (int i = 0; i < nlvids; ++i)
+        {
+          result = Op::combine(result,
+              datafunction(local_graph.vertex_data(lvids[i])));
+        }
+      }
+      else
+      {
+#ifdef _OPENMP
+#pragma omp for nowait
+#endif
+        for (int i = 0; i < nlvids; ++i)
+        {
+          if (vset.l_contains(lvids[i]))
+          {
+            result = Op::combine(result,
+                datafunction(local_graph.vertex_data(lvids[i])));
+          }
+        }
+      }
+      // result is already a partial result, not the value of an element
+      reduction<Op> partial;
+      partial.value = result;
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+      global_result += partial;
+    }
+    rpc.all_reduce(global_result);
+    return global_result.value;
+  } // end of reduce_vertex_data
+
+  /**
+    * \brief Reduces a value computed from the data of each edge with
+    * one of the built-in POD reductions.
+    *
+    * The edge counterpart of reduce_vertex_data(). Every edge is stored
+    * on exactly one machine, so datafunction is called once on the
+    * data of every edge in the graph, walking the local edge data
+    * array in order. Must be called on all machines simultaneously.
+    * This function is available only if the compiler has C++11 support.
+    *
+    * \tparam Op The reduction operation.
+    * \param datafunction Takes a const reference to an edge_data_type
+    *                     and returns a value convertible to
+    *                     Op::value_type.
+    */
+  template <typename Op, typename DataFunctionType>
+  typename Op::value_type reduce_edge_data(DataFunctionType datafunction)
+  {
+    typedef typename Op::value_type value_type;
+    if (!finalized)
+    {
+      logstream(LOG_FATAL)
+          << "\n\tAttempting to run graph.reduce_edge_data(...) "
+          << "\n\tbefore calling graph.finalize()."
+          << std::endl;
+    }
+
+    rpc.barrier();
+    const int nedges = (int)local_graph.num_edges();
+    const edge_data_type *edata =
+        nedges == 0 ? NULL : &local_graph.edge_data(0);
+    reduction<Op> global_result;
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+      value_type result = Op::identity();
+#ifdef _OPENMP
+#pragma omp for nowait
+#endif
+      for (int i = 0; i < nedges; ++i)
+      {
+        result = Op::combine(result, datafunction(edata[i]));
+      }
+      // result is already a partial result, not the value of an element
+      reduction<Op> partial;
+      partial.value = result;
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+      global_result += partial;
+    }
+    rpc.all_reduce(global_result);
+    return global_result.value;
+  } // end of reduce_edge_data
+#endif
+
   /**
     * \brief Performs a fold operation on each vertex in the
     * graph returning the result.
@@ -1310,12 +1779,12 @@ public:
 #ifdef _OPENMP
 #pragma omp for
 #endif
-      for (int i = 0; i < (int)local_graph.num_vertices(); ++i)
+      for (int i = 0; i < (int)owned_lvids.size(); ++i)
       {
-        if (lvid2record[i].owner == rpc.procid() &&
-            vset.l_contains((lvid_type)i))
+        const lvid_type lvid = owned_lvids[i];
+        if (vset.l_contains(lvid))
         {
-          const vertex_type vtx(l_vertex(i));
+          const vertex_type vtx(l_vertex(lvid));
           foldfunction(vtx, result);
         }
       }
@@ -1544,12 +2013,12 @@ public:
 #ifdef _OPENMP
 #pragma omp parallel for
 #endif
-    for (int i = 0; i < (int)local_graph.num_vertices(); ++i)
+    for (int i = 0; i < (int)owned_lvids.size(); ++i)
     {
-      if (lvid2record[i].owner == rpc.procid() &&
-          vset.l_contains((lvid_type)i))
+      const lvid_type lvid = owned_lvids[i];
+      if (vset.l_contains(lvid))
       {
-        vertex_type vtx(l_vertex(i));
+        vertex_type vtx(l_vertex(lvid));
         transform_functor(vtx);
       }
     }
@@ -1729,6 +2198,7 @@ public:
   {
     // read the vertices
     arc >> nverts >> nedges >> local_own_nverts >> nreplicas >> vid2lvid >> lvid2record >> local_graph;
+    rebuild_owned_lvids();
     finalized = true;
     // check the graph condition
   } // end of load
@@ -1760,10 +2230,12 @@ public:
     foreach (vertex_record &vrec, lvid2record)
       vrec.clear();
     lvid2record.clear();
+    std::vector<lvid_type>().swap(owned_lvids);
     vid2lvid.clear();
     local_graph.clear();
     finalized = false;
     nverts = nedges = local_own_nverts = nreplicas = 0;
+    clear_changed_vertices();
   }
 
   /** \brief Load a distributed graph from a native binary format
@@ -2731,10 +3203,9 @@ public:
   size_t vertex_set_size(const vertex_set &vset)
   {
     size_t count = 0;
-    for (int i = 0; i < (int)local_graph.num_vertices(); ++i)
+    for (size_t i = 0; i < owned_lvids.size(); ++i)
     {
-      count += (lvid2record[i].owner == rpc.procid() &&
-                vset.l_contains((lvid_type)i));
+      count += vset.l_contains(owned_lvids[i]);
     }
     rpc.all_reduce(count);
     return count;
@@ -2840,13 +3311,17 @@ public:
      *\brief Get the number of vertices owned by this proc */
   size_t num_local_own_vertices() const { return local_own_nverts; }
 
+  /** \internal
+     *\brief Get the lvids of the vertices owned by this proc */
+  const std::vector<lvid_type> &l_owned_vertices() const { return owned_lvids; }
+
   /** \internal
      *\brief Convert a global vid to a local vid */
   lvid_type local_vid(const vertex_id_type vid) const
   {
     // typename boost::unordered_map<vertex_id_type, lvid_type>::
     //   const_iterator iter = vid2lvid.find(vid);
-    typename hopscotch_map_type::const_iterator iter = vid2lvid.find(vid);
+    typename vid2lvid_map_type::const_iterator iter = vid2lvid.find(vid);
     return iter->second;
   } // end of local_vertex_id
 
@@ -2936,7 +3411,7 @@ public:
   {
     // typename boost::unordered_map<vertex_id_type, lvid_type>::
     //   const_iterator iter = vid2lvid.find(vid);
-    typename hopscotch_map_type::const_iterator iter = vid2lvid.find(vid);
+    typename vid2lvid_map_type::const_iterator iter = vid2lvid.find(vid);
     ASSERT_TRUE(iter != vid2lvid.end());
     return lvid2record[iter->second];
   }
@@ -3325,14 +3800,14 @@ private:
   local_graph_type local_graph;
 
   /** The map from global vertex ids to vertex records */
-  std::vector<vertex_record> lvid2record;
+  std::vector<vertex_record, mmap_allocator<vertex_record> > lvid2record;
 
   // boost::unordered_map<vertex_id_type, lvid_type> vid2lvid;
   /** The map from global vertex ids back to local vertex ids */
-  typedef hopscotch_map<vertex_id_type, lvid_type> hopscotch_map_type;
-  typedef hopscotch_map_type vid2lvid_map_type;
+  typedef vid2lvid_index::hash_map_type hopscotch_map_type;
+  typedef vid2lvid_index vid2lvid_map_type;
 
-  hopscotch_map_type vid2lvid;
+  vid2lvid_map_type vid2lvid;
 
   /** The global number of vertices and edges */
   size_t nverts, nedges;
@@ -3340,9 +3815,101 @@ private:
   /** The number of vertices owned by this proc */
   size_t local_own_nverts;
 
+  /** The lvids of the vertices owned by this proc, in increasing order */
+  std::vector<lvid_type> owned_lvids;
+
+  void rebuild_owned_lvids()
+  {
+    owned_lvids.clear();
+    owned_lvids.reserve(local_own_nverts);
+    for (size_t i = 0; i < lvid2record.size(); ++i)
+    {
+      if (lvid2record[i].owner == rpc.procid())
+        owned_lvids.push_back((lvid_type)i);
+    }
+  }
+
   /** The global number of vertex replica */
   size_t nreplicas;
 
+  /** The vertices changed by finalize since the last clear */
+  vertex_set changed_vset;
+
+  /**
+   * Splits the local vertices into one range per NUMA node and moves
+   * the data of each range to its node. The cost of a vertex is one
+   * plus its degree, and every node receives a share of the cost
+   * proportional to the number of fiber workers running on it.
+   */
+  void place_on_numa_nodes()
+  {
+    fiber_control &fc = fiber_control::get_instance();
+    std::vector<size_t> node_workers;
+    for (size_t i = 0; i < fc.num_workers(); ++i)
+    {
+      const size_t node = fc.worker_numa_node(i);
+      if (node >= node_workers.size())
+        node_workers.resize(node + 1, 0);
+      ++node_workers[node];
+    }
+    const size_t nnodes = node_workers.size();
+    const lvid_type nlocal = num_local_vertices();
+    numa_bounds.assign(nnodes + 1, nlocal);
+    numa_bounds[0] = 0;
+    double total_cost = 0;
+    for (lvid_type lvid = 0; lvid < nlocal; ++lvid)
+    {
+      total_cost += 1 + local_graph.num_in_edges(lvid) +
+                    local_graph.num_out_edges(lvid);
+    }
+    // walk the vertices, closing a range whenever the accumulated cost
+    // passes the share of the nodes seen so far
+    double cost = 0;
+    size_t workers_seen = 0;
+    size_t node = 0;
+    for (lvid_type lvid = 0; lvid < nlocal && node + 1 < nnodes; ++lvid)
+    {
+      cost += 1 + local_graph.num_in_edges(lvid) +
+              local_graph.num_out_edges(lvid);
+      while (node + 1 < nnodes &&
+             cost >= total_cost * (workers_seen + node_workers[node]) /
+                         fc.num_workers())
+      {
+        // nodes without workers get an empty range
+        const lvid_type end =
+            node_workers[node] == 0
+                ? numa_bounds[node]
+                : std::min<lvid_type>(nlocal, (lvid + 64) & ~lvid_type(63));
+        workers_seen += node_workers[node];
+        ++node;
+        numa_bounds[node] = end;
+      }
+    }
+    for (size_t i = 1; i < nnodes; ++i)
+      numa_bounds[i] = std::max(numa_bounds[i], numa_bounds[i - 1]);
+    for (size_t i = 0; i < nnodes; ++i)
+    {
+      if (numa_bounds[i] == numa_bounds[i + 1])
+        continue;
+      local_graph.place_on_numa_node(numa_bounds[i], numa_bounds[i + 1], i);
+      numa::place(lvid2record, numa_bounds[i], numa_bounds[i + 1], i);
+    }
+    logstream(LOG_INFO) << "Placed " << nlocal << " local vertices on "
+                        << nnodes << " NUMA nodes" << std::endl;
+  }
+
+  /** Adds the vertices changed by a finalize to changed_vset */
+  void add_changed_vertices(const vertex_set& vset)
+  {
+    // sets from earlier finalizes may cover fewer local vertices
+    if (!changed_vset.lazy)
+      changed_vset.localvset.resize(num_local_vertices());
+    vertex_set other(vset);
+    if (!other.lazy)
+      other.localvset.resize(num_local_vertices());
+    changed_vset |= other;
+  }
+
   /** pointer to the distributed ingress object*/
   distributed_ingress_base<VertexData, EdgeData> *ingress_ptr;
 
@@ -3355,10 +3922,17 @@ private:
   /** Command option to disable parallel ingress. Used for simulating single node ingress */
   bool parallel_ingress;
 
+  /** Whether the local graph is split across NUMA nodes */
+  bool use_numa;
+
+  /** The boundaries of the NUMA ranges. See numa_ranges() */
+  std::vector<lvid_type> numa_bounds;
+
   lock_manager_type lock_manager;
 
   void set_ingress_method(const std::string &method,
-                          size_t bufsize = 50000, bool usehash = false, bool userecent = false)
+                          size_t bufsize = 50000, bool usehash = false, bool userecent = false,
+                          size_t threshold = 100)
   {
     if (ingress_ptr != NULL)
     {
@@ -3379,6 +3953,13 @@ private:
                             << ", userecent: " << userecent << std::endl;
       ingress_ptr = new distributed_hdrf_ingress<VertexData, EdgeData>(rpc.dc(), *this, usehash, userecent);
     }
+    else if (method == "hybrid")
+    {
+      if (rpc.procid() == 0)
+        logstream(LOG_EMPH) << "Use hybrid ingress, threshold: " << threshold
+                            << std::endl;
+      ingress_ptr = new distributed_hybrid_ingress<VertexData, EdgeData>(rpc.dc(), *this, threshold);
+    }
     else if (method == "random")
     {
       if (rpc.procid() == 0)
@@ -53,6 +53,7 @@
 #include <graphlab/util/generics/counting_sort.hpp>
 #include <graphlab/util/generics/dynamic_csr_storage.hpp>
 #include <graphlab/parallel/atomic.hpp>
+#include <graphlab/parallel/numa.hpp>
 
 #include <graphlab/logger/logger.hpp>
 #include <graphlab/logger/assertions.hpp>
@@ -192,6 +193,26 @@ namespace graphlab {
       return 0;
     } // End of add edge
 
+    /**
+     * \brief Grows the edge buffer by n edges which must then be filled in
+     * with set_edge(). Returns the position of the first new edge. 
+     * Should not be called after finalization.
+     */
+    size_t extend_edge_buffer(size_t n) {
+      return edge_buffer.extend(n);
+    }
+
+    /**
+     * \brief Fills in an edge reserved by extend_edge_buffer(). Concurrent
+     * calls on distinct positions are safe. Unlike add_edge() this does not
+     * grow the vertex set, so resize() must be called before finalize().
+     */
+    void set_edge(size_t pos, lvid_type source, lvid_type target, 
+                  const EdgeData& edata) {
+      ASSERT_MSG(source != target, "Attempting to add self edge!");
+      edge_buffer.set_edge(pos, source, target, edata);
+    }
+
     /**
      * \brief Add edges in block.
      */
@@ -298,7 +319,6 @@ namespace graphlab {
       // fast path with first time insertion.
       if (edges.size() == 0) {
         edges.swap(edge_buffer.data);
-        edge_buffer.clear();
         // warp into csr csc storage.
         _csr_storage.wrap(src_counting_prefix_sum, csr_values);
         _csc_storage.wrap(dest_counting_prefix_sum, csc_values);
@@ -307,29 +327,21 @@ namespace graphlab {
         edges.reserve(edges.size() + edge_buffer.size());
         edges.insert(edges.end(), edge_buffer.data.begin(), edge_buffer.data.end());
         std::vector<EdgeData>().swap(edge_buffer.data);
-        edge_buffer.clear();
-        size_t begin, end;
-        for (size_t i = 0; i < src_counting_prefix_sum.size(); ++i) {
-          begin = src_counting_prefix_sum[i];
-          end = (i==src_counting_prefix_sum.size()-1)
-              ? csr_values.size()
-              : src_counting_prefix_sum[i+1];
-          if (end > begin) {
-            _csr_storage.insert(i, csr_values.begin()+begin, csr_values.begin()+end);
-          }
-        }
-        for (size_t i = 0; i < dest_counting_prefix_sum.size(); ++i) {
-          begin = dest_counting_prefix_sum[i];
-          end = (i==dest_counting_prefix_sum.size()-1)
-              ? csc_values.size()
-              : dest_counting_prefix_sum[i+1];
-          if (end > begin) {
-            _csc_storage.insert(i, csc_values.begin()+begin, csc_values.begin()+end);
-          }
-        }
-        _csr_storage.repack();
-        _csc_storage.repack();
+        // Only the vertices touched by the new edges are visited, so the
+        // cost of the insertion is proportional to the size of the delta.
+        std::vector<lvid_type> csr_keys, csc_keys;
+        insert_sorted_runs(_csr_storage, csr_values, edge_buffer.source_arr,
+                           dest_permute, csr_keys);
+        insert_sorted_runs(_csc_storage, csc_values, edge_buffer.target_arr,
+                           src_permute, csc_keys);
+        _csr_storage.repack(csr_keys);
+        _csc_storage.repack(csc_keys);
+        logstream(LOG_INFO) << "Inserted " << csr_values.size() 
+                            << " edges touching " << csr_keys.size() 
+                            << " sources and " << csc_keys.size() 
+                            << " targets" << std::endl;
       }
+      edge_buffer.clear();
       ASSERT_EQ(_csr_storage.num_values(), _csc_storage.num_values());
       ASSERT_EQ(_csr_storage.num_values(), edges.size());
 
@@ -475,6 +487,16 @@ namespace graphlab {
       return edges[eid];
     }
 
+    /**
+     * \internal
+     * \brief Moves the vertex data of the vertices [begin, end) to a NUMA
+     * node. The edges are stored in blocks which are not ordered by
+     * vertex and are left where they are.
+     */
+    void place_on_numa_node(lvid_type begin, lvid_type end, size_t node) {
+      numa::place(vertices, begin, end, node);
+    }
+
     /**
      * \internal
      * \brief Returns the estimated memory footprint of the local_graph. */
@@ -513,6 +535,27 @@ namespace graphlab {
 
     typedef typename csr_type::iterator csr_edge_iterator;
 
+    /**
+     * \internal
+     * Inserts values sorted by key into the storage, one batch per key,
+     * and records the keys that received new values.
+     */
+    static void insert_sorted_runs(csr_type& storage,
+                                   const std::vector< std::pair<lvid_type, edge_id_type> >& values,
+                                   const std::vector<lvid_type>& key_arr,
+                                   const std::vector<edge_id_type>& permute,
+                                   std::vector<lvid_type>& touched_keys) {
+      size_t begin = 0;
+      while (begin < values.size()) {
+        const lvid_type key = key_arr[permute[begin]];
+        size_t end = begin + 1;
+        while (end < values.size() && key_arr[permute[end]] == key) ++end;
+        storage.insert(key, values.begin() + begin, values.begin() + end);
+        touched_keys.push_back(key);
+        begin = end;
+      }
+    }
+
     // PRIVATE DATA MEMBERS ===================================================>
     //
     /** The vertex data is simply a vector of vertex data */
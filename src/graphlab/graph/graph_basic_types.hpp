@@ -38,12 +38,24 @@ namespace graphlab {
   typedef uint64_t vertex_id_type;
 #endif
 
-  /// Identifier type of a vertex which is only locally consistent. Guaranteed to be integral
+  /**
+   * Identifier type of a vertex which is only locally consistent. Guaranteed
+   * to be integral. With USE_LVID32 it is 32 bits wide regardless of the
+   * width of vertex_id_type, so that the local graph structures of a
+   * machine holding fewer than 2^32 vertex replicas (and edges) stay
+   * compact while global ids are 64 bits. edge_id_type shrinks with it,
+   * so each machine is then also limited to 2^32 - 1 local edges.
+   */
+#if defined(USE_VID32) || defined(USE_LVID32)
+  typedef uint32_t lvid_type;
+#else
   typedef vertex_id_type lvid_type;
+#endif
 
   /**
    * Identifier type of an edge which is only locally
-   * consistent. Guaranteed to be integral and consecutive.
+   * consistent. Guaranteed to be integral and consecutive. Same width as
+   * lvid_type, hence 32 bit with USE_LVID32.
    */
   typedef lvid_type edge_id_type;
 
@@ -0,0 +1,178 @@
+/**
+ * Copyright (c) 2009 Carnegie Mellon University.
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+#ifndef GRAPHLAB_DISTRIBUTED_HYBRID_INGRESS_HPP
+#define GRAPHLAB_DISTRIBUTED_HYBRID_INGRESS_HPP
+
+#include <graphlab/graph/graph_basic_types.hpp>
+#include <graphlab/graph/graph_hash.hpp>
+#include <graphlab/graph/ingress/distributed_ingress_base.hpp>
+#include <graphlab/graph/distributed_graph.hpp>
+#include <graphlab/rpc/buffered_exchange.hpp>
+#include <graphlab/util/hopscotch_map.hpp>
+#include <graphlab/macros_def.hpp>
+namespace graphlab {
+  template<typename VertexData, typename EdgeData>
+    class distributed_graph;
+
+  /**
+   * \brief Ingress object implementing degree-aware hybrid partitioning.
+   *
+   * Low-degree vertices are partitioned with an edge-cut: all of their
+   * in-edges are placed on the machine owning the target vertex, so
+   * gathering over the in-edges of such a vertex never touches a mirror.
+   * High-degree vertices are partitioned with a vertex-cut: their
+   * in-edges are spread out by hashing the source vertex.
+   *
+   * Ingress proceeds in two passes. In the first pass every edge is
+   * shipped to the owner of its target, which therefore observes the
+   * complete in-degree of every vertex it owns. In the second pass
+   * (during finalize) edges whose target exceeds the degree threshold are
+   * re-shipped to the owner of their source, while the remaining edges stay
+   * on the current machine.
+   *
+   * On a dynamic graph the in-degree also counts the in-edges added by
+   * earlier finalizes, which the owner finds in the vertex record. A
+   * vertex that crosses the threshold therefore has the in-edges of
+   * later finalizes cut, while the edges placed before stay where they
+   * are.
+   */
+  template<typename VertexData, typename EdgeData>
+  class distributed_hybrid_ingress:
+    public distributed_ingress_base<VertexData, EdgeData> {
+  public:
+    typedef distributed_graph<VertexData, EdgeData> graph_type;
+    /// The type of the vertex data stored in the graph
+    typedef VertexData vertex_data_type;
+    /// The type of the edge data stored in the graph
+    typedef EdgeData   edge_data_type;
+
+    typedef distributed_ingress_base<VertexData, EdgeData> base_type;
+    typedef typename base_type::edge_buffer_record edge_buffer_record;
+
+    /** Type of the in-degree table: a map from vertex id to its in-degree. */
+    typedef hopscotch_map<vertex_id_type, size_t> degree_table_type;
+
+    /** Edges shipped to the owner of the target in the first pass. */
+    buffered_exchange<edge_buffer_record> hybrid_edge_exchange;
+
+    /** Vertices with in-degree larger than this are cut. */
+    size_t threshold;
+
+  public:
+    distributed_hybrid_ingress(distributed_control& dc, graph_type& graph,
+                               size_t threshold = 100) :
+      base_type(dc, graph),
+#ifdef _OPENMP
+      hybrid_edge_exchange(dc, omp_get_max_threads()),
+#else
+      hybrid_edge_exchange(dc),
+#endif
+      threshold(threshold) {
+    } // end of constructor
+
+    ~distributed_hybrid_ingress() { }
+
+    /** Add an edge to the ingress object, routing it to the target owner. */
+    void add_edge(vertex_id_type source, vertex_id_type target,
+                  const EdgeData& edata) {
+      const procid_t owning_proc =
+        graph_hash::hash_vertex(target) % base_type::rpc.numprocs();
+      const edge_buffer_record record(source, target, edata);
+#ifdef _OPENMP
+      hybrid_edge_exchange.send(owning_proc, record, omp_get_thread_num());
+#else
+      hybrid_edge_exchange.send(owning_proc, record);
+#endif
+    } // end of add edge
+
+    /** In-degree of vid from the previous finalizes, 0 if it is new. */
+    size_t previous_in_degree(vertex_id_type vid) const {
+      const graph_type& graph = base_type::graph;
+      if (!graph.contains_vertex(vid)) return 0;
+      return graph.get_vertex_record(vid).num_in_edges;
+    }
+
+    virtual void finalize() {
+      typedef typename buffered_exchange<edge_buffer_record>::buffer_type
+        edge_buffer_type;
+
+      hybrid_edge_exchange.flush();
+
+      // Pass 1: all new in-edges of the vertices owned by this machine
+      // have arrived, and the owner knows their previous in-degree, so
+      // the in-degree counts are exact.
+      std::vector<edge_buffer_record> local_edges;
+      local_edges.reserve(hybrid_edge_exchange.size());
+      degree_table_type in_degree;
+      {
+        edge_buffer_type edge_buffer;
+        procid_t proc;
+        while(hybrid_edge_exchange.recv(proc, edge_buffer)) {
+          foreach(const edge_buffer_record& rec, edge_buffer) {
+            size_t& degree = in_degree[rec.target];
+            if (degree == 0) degree = previous_in_degree(rec.target);
+            ++degree;
+            local_edges.push_back(rec);
+          }
+        }
+        hybrid_edge_exchange.clear();
+      }
+
+      // Pass 2: keep the in-edges of low-degree vertices and re-assign the
+      // in-edges of high-degree vertices by hashing their source.
+      size_t num_high_degree = 0;
+      foreach(const typename degree_table_type::value_type& pair, in_degree) {
+        if (pair.second > threshold) ++num_high_degree;
+      }
+      size_t num_cut_edges = 0;
+      const procid_t self = base_type::rpc.procid();
+      foreach(const edge_buffer_record& rec, local_edges) {
+        procid_t owning_proc = self;
+        if (in_degree[rec.target] > threshold) {
+          owning_proc =
+            graph_hash::hash_vertex(rec.source) % base_type::rpc.numprocs();
+          ++num_cut_edges;
+        }
+        base_type::edge_exchange.send(owning_proc, rec);
+      }
+      std::vector<edge_buffer_record>().swap(local_edges);
+      in_degree.clear();
+
+      base_type::rpc.all_reduce(num_high_degree);
+      base_type::rpc.all_reduce(num_cut_edges);
+      if (base_type::rpc.procid() == 0) {
+        logstream(LOG_EMPH) << "Hybrid ingress: threshold " << threshold
+                            << ", high-degree vertices " << num_high_degree
+                            << ", cut edges " << num_cut_edges << std::endl;
+      }
+
+      distributed_ingress_base<VertexData, EdgeData>::finalize();
+    }
+
+  }; // end of distributed_hybrid_ingress
+
+}; // end of namespace graphlab
+#include <graphlab/macros_undef.hpp>
+
+
+#endif
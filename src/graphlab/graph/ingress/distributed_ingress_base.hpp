@@ -26,9 +26,13 @@
 #include <graphlab/graph/graph_basic_types.hpp>
 #include <graphlab/graph/graph_hash.hpp>
 #include <graphlab/graph/ingress/ingress_edge_decision.hpp>
+#include <graphlab/graph/ingress/ingress_edge_spill.hpp>
 #include <graphlab/graph/graph_gather_apply.hpp>
 #include <graphlab/util/memory_info.hpp>
 #include <graphlab/util/hopscotch_map.hpp>
+#include <graphlab/util/timer.hpp>
+#include <graphlab/parallel/atomic.hpp>
+#include <graphlab/parallel/pthread_tools.hpp>
 #include <graphlab/rpc/buffered_exchange.hpp>
 #include <graphlab/macros_def.hpp>
 namespace graphlab {
@@ -64,8 +68,8 @@ namespace graphlab {
       vertex_buffer_record(vertex_id_type vid = -1,
                            vertex_data_type vdata = vertex_data_type()) :
         vid(vid), vdata(vdata) { }
-      void load(iarchive& arc) { arc >> vid >> vdata; }
-      void save(oarchive& arc) const { arc << vid << vdata; }
+      void load(iarchive& arc) { deserialize_varint(arc, vid); arc >> vdata; }
+      void save(oarchive& arc) const { serialize_varint(arc, vid); arc << vdata; }
     }; 
     buffered_exchange<vertex_buffer_record> vertex_exchange;
 
@@ -77,8 +81,18 @@ namespace graphlab {
                          const vertex_id_type& target = vertex_id_type(-1), 
                          const edge_data_type& edata = edge_data_type()) :
         source(source), target(target), edata(edata) { }
-      void load(iarchive& arc) { arc >> source >> target >> edata; }
-      void save(oarchive& arc) const { arc << source << target << edata; }
+      // vertex ids are sent with the variable length encoding, so ids
+      // below 2^28 take at most 4 bytes even if vertex_id_type is 64 bit
+      void load(iarchive& arc) {
+        deserialize_varint(arc, source);
+        deserialize_varint(arc, target);
+        arc >> edata;
+      }
+      void save(oarchive& arc) const {
+        serialize_varint(arc, source);
+        serialize_varint(arc, target);
+        arc << edata;
+      }
     };
     buffered_exchange<edge_buffer_record> edge_exchange;
 
@@ -111,6 +125,9 @@ namespace graphlab {
     /// Ingress decision object for computing the edge destination. 
     ingress_edge_decision<VertexData, EdgeData> edge_decision;
 
+    /// Sorted run files holding the received edges in out-of-core mode.
+    ingress_edge_spill<edge_buffer_record>* edge_spill;
+
   public:
     distributed_ingress_base(distributed_control& dc, graph_type& graph) :
       rpc(dc, this), graph(graph), 
@@ -120,11 +137,14 @@ namespace graphlab {
 #else
       vertex_exchange(dc), edge_exchange(dc),
 #endif
-      edge_decision(dc) {
+      edge_decision(dc), edge_spill(NULL) {
       rpc.barrier();
     } // end of constructor
 
-    virtual ~distributed_ingress_base() { }
+    virtual ~distributed_ingress_base() { 
+      delete edge_spill;
+      edge_spill = NULL;
+    }
 
     /** \brief Add an edge to the ingress object. */
     virtual void add_edge(vertex_id_type source, vertex_id_type target,
@@ -152,6 +172,46 @@ namespace graphlab {
     } // end of add vertex
 
 
+    /**
+     * \brief Enables out-of-core ingress.
+     *
+     * Received edges are moved out of the edge exchange as soon as they
+     * arrive and are written to sorted run files named prefix.run.[i] by
+     * a background thread, holding at most budget_bytes of edges in
+     * memory. finalize() then builds the local
+     * graph by merging the runs instead of buffering all edges in the
+     * local_edge_buffer. Only supported for the first finalize of a static
+     * graph.
+     */
+    void enable_edge_spill(const std::string& prefix, size_t budget_bytes) {
+#ifdef USE_DYNAMIC_LOCAL_GRAPH
+      logstream(LOG_WARNING) << "Out-of-core ingress is not supported with "
+                             << "dynamic graphs. Ignoring." << std::endl;
+#else
+      delete edge_spill;
+      edge_spill = new ingress_edge_spill<edge_buffer_record>(prefix, 
+                                                              budget_bytes);
+      // Drain on the receive path so that the budget also holds on
+      // machines which receive edges without adding any.
+      edge_exchange.set_recv_callback(
+          boost::bind(&distributed_ingress_base::spill_received_edges,
+                      this, true));
+#endif
+    }
+
+    /**
+     * \brief Moves the edges received so far into the spill runs. 
+     * Does nothing unless out-of-core ingress is enabled.
+     */
+    void spill_received_edges(bool try_lock = true) {
+      if (edge_spill == NULL || edge_exchange.empty()) return;
+      typename buffered_exchange<edge_buffer_record>::buffer_type edge_buffer;
+      procid_t proc;
+      while(edge_exchange.recv(proc, edge_buffer, try_lock)) {
+        edge_spill->add(edge_buffer);
+      }
+    }
+
     void set_duplicate_vertex_strategy(
         boost::function<void(vertex_data_type&,
                              const vertex_data_type&)> combine_strategy) {
@@ -181,17 +241,17 @@ namespace graphlab {
     virtual void finalize() {
 
       rpc.full_barrier();
+      graphlab::timer finalize_timer, stage_timer;
+      finalize_timer.start();
 
       bool first_time_finalize = false;
       /**
        * Fast pass for first time finalization. 
        */
-      if (graph.is_dynamic()) {
+      {
         size_t nverts = graph.num_local_vertices();
         rpc.all_reduce(nverts);
         first_time_finalize = (nverts == 0);
-      } else {
-        first_time_finalize = false;
       }
 
 
@@ -234,11 +294,21 @@ namespace graphlab {
       /**************************************************************************/
       edge_exchange.flush(); vertex_exchange.flush();     
 
+      const bool use_spill = (edge_spill != NULL && graph.vid2lvid.size() == 0);
+      if (edge_spill != NULL) {
+        edge_exchange.set_recv_callback(boost::function<void()>());
+      }
+      if (use_spill) {
+        spill_received_edges(false);
+        edge_spill->finish();
+      }
+
       /**
        * Fast pass for redundant finalization with no graph changes. 
        */
       {
         size_t changed_size = edge_exchange.size() + vertex_exchange.size();
+        if (use_spill) changed_size += edge_spill->size();
         rpc.all_reduce(changed_size);
         if (changed_size == 0) {
           logstream(LOG_INFO) << "Skipping Graph Finalization because no changes happened..." << std::endl;
@@ -248,6 +318,7 @@ namespace graphlab {
 
       if(rpc.procid() == 0)       
         memory_info::log_usage("Post Flush");
+      log_stage_time("flush", stage_timer);
 
      
       /**************************************************************************/
@@ -255,45 +326,52 @@ namespace graphlab {
       /*                         Construct local graph                          */
       /*                                                                        */
       /**************************************************************************/
-      { // Add all the edges to the local graph
+      if (use_spill) {
+        construct_local_graph_from_spill(vid2lvid_buffer);
+      } else { // Add all the edges to the local graph
         logstream(LOG_INFO) << "Graph Finalize: constructing local graph" << std::endl;
-        const size_t nedges = edge_exchange.size()+1;
-        graph.local_graph.reserve_edge_space(nedges + 1);      
-        edge_buffer_type edge_buffer;
-        procid_t proc;
-        while(edge_exchange.recv(proc, edge_buffer)) {
-          foreach(const edge_buffer_record& rec, edge_buffer) {
-            // Get the source_vlid;
-            lvid_type source_lvid(-1);
-            if(graph.vid2lvid.find(rec.source) == graph.vid2lvid.end()) {
-              if (vid2lvid_buffer.find(rec.source) == vid2lvid_buffer.end()) {
-                source_lvid = lvid_start + vid2lvid_buffer.size();
-                vid2lvid_buffer[rec.source] = source_lvid;
-              } else {
-                source_lvid = vid2lvid_buffer[rec.source];
-              }
-            } else {
-              source_lvid = graph.vid2lvid[rec.source];
-              updated_lvids.set_bit(source_lvid);
-            }
-            // Get the target_lvid;
-            lvid_type target_lvid(-1);
-            if(graph.vid2lvid.find(rec.target) == graph.vid2lvid.end()) {
-              if (vid2lvid_buffer.find(rec.target) == vid2lvid_buffer.end()) {
-                target_lvid = lvid_start + vid2lvid_buffer.size();
-                vid2lvid_buffer[rec.target] = target_lvid;
-              } else {
-                target_lvid = vid2lvid_buffer[rec.target];
-              }
-            } else {
-              target_lvid = graph.vid2lvid[rec.target];
-              updated_lvids.set_bit(target_lvid);
-            }
-            graph.local_graph.add_edge(source_lvid, target_lvid, rec.edata);
-            // std::cout << "add edge " << rec.source << "\t" << rec.target << std::endl;
-          } // end of loop over add edges
-        } // end for loop over buffers
+        // Collect the received buffers so that they can be processed in
+        // parallel, each writing to its own range of the edge buffer.
+        std::vector<edge_buffer_type> edge_buffers;
+        std::vector<size_t> edge_offsets(1, 0);
+        {
+          edge_buffer_type edge_buffer;
+          procid_t proc;
+          while(edge_exchange.recv(proc, edge_buffer)) {
+            edge_offsets.push_back(edge_offsets.back() + edge_buffer.size());
+            edge_buffers.push_back(edge_buffer_type());
+            edge_buffers.back().swap(edge_buffer);
+          }
+        }
         edge_exchange.clear();
+        check_local_id_range(lvid_start, 
+                             graph.local_graph.num_edges() + edge_offsets.back());
+        const size_t edge_begin = 
+          graph.local_graph.extend_edge_buffer(edge_offsets.back());
+        concurrent_vid2lvid new_vids(lvid_start);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+        for (ssize_t i = 0; i < ssize_t(edge_buffers.size()); ++i) {
+          size_t pos = edge_begin + edge_offsets[i];
+          foreach(const edge_buffer_record& rec, edge_buffers[i]) {
+            const lvid_type source_lvid = 
+              translate_vid(rec.source, new_vids, updated_lvids);
+            const lvid_type target_lvid = 
+              translate_vid(rec.target, new_vids, updated_lvids);
+            graph.local_graph.set_edge(pos++, source_lvid, target_lvid, rec.edata);
+          }
+          edge_buffer_type().swap(edge_buffers[i]);
+        } // end for loop over buffers
+        new_vids.merge_into(vid2lvid_buffer);
+        check_local_id_range(graph.vid2lvid.size() + vid2lvid_buffer.size(),
+                             graph.local_graph.num_edges() + edge_offsets.back());
+        graph.local_graph.resize(lvid_start + vid2lvid_buffer.size());
+        logstream(LOG_INFO) << "Graph Finalize: translated " 
+                            << edge_offsets.back() << " edges in "
+                            << stage_timer.current_time() << " secs" 
+                            << std::endl;
+        std::vector<edge_buffer_type>().swap(edge_buffers);
 
         ASSERT_EQ(graph.vid2lvid.size()  + vid2lvid_buffer.size(), graph.local_graph.num_vertices());
         if(rpc.procid() == 0)  {
@@ -316,6 +394,7 @@ namespace graphlab {
           // std::cout << graph.local_graph << std::endl;
         }
       }
+      log_stage_time("construct local graph", stage_timer);
 
       /**************************************************************************/
       /*                                                                        */
@@ -347,9 +426,12 @@ namespace graphlab {
           }
         }
         vertex_exchange.clear();
+        check_local_id_range(graph.vid2lvid.size() + vid2lvid_buffer.size(),
+                             graph.local_graph.num_edges());
         if(rpc.procid() == 0)         
           memory_info::log_usage("Finished adding vertex data");
       } // end of loop to populate vrecmap
+      log_stage_time("add vertex data", stage_timer);
 
 
 
@@ -373,6 +455,7 @@ namespace graphlab {
         if(rpc.procid() == 0)       
           memory_info::log_usage("Finihsed allocating lvid2record");
       }
+      log_stage_time("allocate lvid2record", stage_timer);
 
       /**************************************************************************/
       /*                                                                        */
@@ -449,6 +532,7 @@ namespace graphlab {
           // std::cout << "proc " << rpc.procid() << " recevies flying vertex " << gvid << std::endl;
         }
       } // end of master handshake
+      log_stage_time("master handshake", stage_timer);
 
       /**************************************************************************/
       /*                                                                        */
@@ -456,17 +540,14 @@ namespace graphlab {
       /*                                                                        */
       /**************************************************************************/
       {
-        if (graph.vid2lvid.size() == 0) {
-          graph.vid2lvid.swap(vid2lvid_buffer);
-        } else {
-          graph.vid2lvid.rehash(graph.vid2lvid.size() + vid2lvid_buffer.size());
-          foreach (const typename vid2lvid_map_type::value_type& pair, vid2lvid_buffer) {
-            graph.vid2lvid.insert(pair);
-          }
-          vid2lvid_buffer.clear();
-          // vid2lvid_buffer.swap(vid2lvid_map_type(-1));
-        }
+        graph.vid2lvid.merge(vid2lvid_buffer);
+        graph.vid2lvid.compact();
+        logstream(LOG_INFO) << "Graph Finalize: vid2lvid index holds "
+                            << graph.vid2lvid.size() << " vertices in "
+                            << graph.vid2lvid.memory_bytes() << " bytes"
+                            << std::endl;
       }
+      log_stage_time("merge vid2lvid", stage_timer);
 
 
       /**************************************************************************/
@@ -480,9 +561,10 @@ namespace graphlab {
         // Fast pass for first time finalize;
         vertex_set changed_vset(true);
 
-        // Compute the vertices that needs synchronization 
+        // Compute the vertices that needs synchronization. Only vertices
+        // touched by the new edges and vertices are renegotiated.
         if (!first_time_finalize) {
-          vertex_set changed_vset = vertex_set(false);
+          changed_vset = vertex_set(false);
           changed_vset.make_explicit(graph);
           updated_lvids.resize(graph.num_local_vertices());
           for (lvid_type i = lvid_start; i <  graph.num_local_vertices(); ++i) {
@@ -500,12 +582,20 @@ namespace graphlab {
                              boost::bind(&distributed_ingress_base::finalize_gather, this, _1, _2), 
                              boost::bind(&distributed_ingress_base::finalize_apply, this, _1, _2, _3));
         vrecord_sync_gas.exec(changed_vset);
+        graph.add_changed_vertices(changed_vset);
 
         if(rpc.procid() == 0)       
           memory_info::log_usage("Finished synchronizing vertex (meta)data");
       }
+      log_stage_time("synchronize vertex records", stage_timer);
 
       exchange_global_info();
+      log_stage_time("exchange global info", stage_timer);
+      if (rpc.procid() == 0) {
+        logstream(LOG_EMPH) << "Graph finalized in " 
+                            << finalize_timer.current_time() << " secs" 
+                            << std::endl;
+      }
     } // end of finalize
 
 
@@ -513,9 +603,15 @@ namespace graphlab {
      * global statistics for the distributed graph. */
     void exchange_global_info () {
       // Count the number of vertices owned locally
-      graph.local_own_nverts = 0;
-      foreach(const vertex_record& record, graph.lvid2record)
-        if(record.owner == rpc.procid()) ++graph.local_own_nverts;
+      size_t local_own_nverts = 0;
+      const procid_t procid = rpc.procid();
+#ifdef _OPENMP
+#pragma omp parallel for reduction(+:local_own_nverts)
+#endif
+      for (ssize_t i = 0; i < ssize_t(graph.lvid2record.size()); ++i) {
+        if (graph.lvid2record[i].owner == procid) ++local_own_nverts;
+      }
+      graph.local_own_nverts = local_own_nverts;
 
       // Finalize global graph statistics. 
       logstream(LOG_INFO)
@@ -556,6 +652,188 @@ namespace graphlab {
   private:
     boost::function<void(vertex_data_type&, const vertex_data_type&)> vertex_combine_strategy;
 
+    typedef typename graph_type::hopscotch_map_type vid2lvid_map_type;
+
+    /** Logs the time spent in a finalize stage and restarts the timer. */
+    void log_stage_time(const char* stage, graphlab::timer& stage_timer) {
+      logstream(LOG_INFO) << "Graph Finalize: " << stage << " took "
+                          << stage_timer.current_time() << " secs" 
+                          << std::endl;
+      stage_timer.start();
+    }
+
+    /**
+     * \brief Sharded vid to lvid map used to assign lvids to new vertices
+     * from several threads at once.
+     *
+     * Lvids are handed out from a shared counter, so the assignment
+     * depends on thread interleaving but is always dense starting from
+     * lvid_start.
+     */
+    class concurrent_vid2lvid {
+    public:
+      concurrent_vid2lvid(lvid_type lvid_start) :
+        shards(nshards), locks(nshards), lvid_start(lvid_start), 
+        next_lvid(0) { }
+
+      lvid_type get_or_insert(vertex_id_type vid) {
+        const size_t shard = (graph_hash::hash_vertex(vid) >> 16) % nshards;
+        locks[shard].lock();
+        typename vid2lvid_map_type::iterator it = shards[shard].find(vid);
+        lvid_type lvid;
+        if (it == shards[shard].end()) {
+          lvid = lvid_start + next_lvid.inc_ret_last();
+          shards[shard][vid] = lvid;
+        } else {
+          lvid = it->second;
+        }
+        locks[shard].unlock();
+        return lvid;
+      }
+
+      size_t size() const { return next_lvid.value; }
+
+      /** Moves all entries into a single map. Not thread safe. */
+      void merge_into(vid2lvid_map_type& vid2lvid_buffer) {
+        vid2lvid_buffer.rehash(vid2lvid_buffer.size() + size());
+        for (size_t i = 0; i < nshards; ++i) {
+          foreach(const typename vid2lvid_map_type::value_type& pair, 
+                  shards[i]) {
+            vid2lvid_buffer.insert(pair);
+          }
+          vid2lvid_map_type().swap(shards[i]);
+        }
+      }
+
+    private:
+      enum { nshards = 256 };
+      std::vector<vid2lvid_map_type> shards;
+      std::vector<simple_spinlock> locks;
+      lvid_type lvid_start;
+      // wider than lvid_type, so size() still counts past an overflow
+      atomic<size_t> next_lvid;
+    };
+
+    /**
+     * Fails if the local graph would have more vertices or edges than
+     * lvid_type and edge_id_type can index. Both are 32 bit when compiled
+     * with USE_LVID32. Called before the local graph is finalized, and for
+     * the edges before any lvid is assigned.
+     */
+    void check_local_id_range(size_t nverts, size_t nedges) {
+      if (nverts >= size_t(lvid_type(-1)) ||
+          nedges >= size_t(edge_id_type(-1))) {
+        logstream(LOG_FATAL) << "The local graph has " << nverts
+                             << " vertices and " << nedges << " edges, too "
+                             << "many for a " << 8 * sizeof(lvid_type)
+                             << " bit lvid_type and edge_id_type. Use more "
+                             << "machines or build without LVID32."
+                             << std::endl;
+      }
+    }
+
+    /**
+     * Translates a global vid to its lvid. Existing vertices are marked as
+     * updated; unseen vertices get a new lvid. Thread safe.
+     */
+    lvid_type translate_vid(vertex_id_type vid, concurrent_vid2lvid& new_vids,
+                            dense_bitset& updated_lvids) {
+      const typename graph_type::vid2lvid_map_type& vid2lvid = graph.vid2lvid;
+      typename graph_type::vid2lvid_map_type::const_iterator it =
+        vid2lvid.find(vid);
+      if (it != vid2lvid.end()) {
+        updated_lvids.set_bit(it->second);
+        return it->second;
+      }
+      return new_vids.get_or_insert(vid);
+    }
+
+    /**
+     * \brief Builds the local graph from the spilled edge runs. 
+     *
+     * The first merge pass assigns lvids and counts degrees, the second
+     * streams the edges into their final CSR/CSC position. Neither pass
+     * holds more than one edge per run in memory.
+     */
+    void construct_local_graph_from_spill(vid2lvid_map_type& vid2lvid_buffer) {
+#ifndef USE_DYNAMIC_LOCAL_GRAPH
+      logstream(LOG_INFO) << "Graph Finalize: constructing local graph from " 
+                          << edge_spill->num_runs() << " spilled runs" 
+                          << std::endl;
+      std::vector<edge_id_type> out_degree, in_degree;
+      check_local_id_range(0, edge_spill->size());
+      edge_spill->merge(boost::bind(&distributed_ingress_base::spill_count_edge,
+                                    this, _1, boost::ref(vid2lvid_buffer),
+                                    boost::ref(out_degree), 
+                                    boost::ref(in_degree)));
+      check_local_id_range(vid2lvid_buffer.size(), edge_spill->size());
+      graph.local_graph.resize(vid2lvid_buffer.size());
+      if(rpc.procid() == 0)  {
+        memory_info::log_usage("Finished counting spilled edges.");
+      }
+      graph.local_graph.finalize_streaming(
+          out_degree, in_degree, 
+          boost::bind(&distributed_ingress_base::spill_stream_edges,
+                      this, _1, boost::ref(vid2lvid_buffer)));
+      // Later finalizes go through the in-memory path.
+      delete edge_spill;
+      edge_spill = NULL;
+      logstream(LOG_INFO) << "Local graph info: " << std::endl
+                          << "\t nverts: " << graph.local_graph.num_vertices()
+                          << std::endl
+                          << "\t nedges: " << graph.local_graph.num_edges()
+                          << std::endl;
+      if(rpc.procid() == 0) {
+        memory_info::log_usage("Finished finalizing local graph."); 
+      }
+#endif
+    }
+
+    /** Returns the lvid of a vertex, assigning a new one if unseen. */
+    static lvid_type spill_lvid(vid2lvid_map_type& vid2lvid_buffer, 
+                                vertex_id_type vid,
+                                std::vector<edge_id_type>& out_degree,
+                                std::vector<edge_id_type>& in_degree) {
+      typename vid2lvid_map_type::iterator it = vid2lvid_buffer.find(vid);
+      if (it != vid2lvid_buffer.end()) return it->second;
+      const lvid_type lvid = vid2lvid_buffer.size();
+      vid2lvid_buffer[vid] = lvid;
+      out_degree.push_back(0);
+      in_degree.push_back(0);
+      return lvid;
+    }
+
+    void spill_count_edge(const edge_buffer_record& rec, 
+                          vid2lvid_map_type& vid2lvid_buffer,
+                          std::vector<edge_id_type>& out_degree,
+                          std::vector<edge_id_type>& in_degree) {
+      const lvid_type source_lvid = 
+        spill_lvid(vid2lvid_buffer, rec.source, out_degree, in_degree);
+      const lvid_type target_lvid = 
+        spill_lvid(vid2lvid_buffer, rec.target, out_degree, in_degree);
+      ++out_degree[source_lvid];
+      ++in_degree[target_lvid];
+    }
+
+#ifndef USE_DYNAMIC_LOCAL_GRAPH
+    typedef typename graph_type::local_graph_type::edge_callback_type 
+      edge_callback_type;
+
+    void spill_stream_edges(const edge_callback_type& callback,
+                            vid2lvid_map_type& vid2lvid_buffer) {
+      edge_spill->merge(boost::bind(&distributed_ingress_base::spill_place_edge,
+                                    this, _1, boost::cref(callback), 
+                                    boost::ref(vid2lvid_buffer)));
+    }
+
+    void spill_place_edge(const edge_buffer_record& rec, 
+                          const edge_callback_type& callback,
+                          vid2lvid_map_type& vid2lvid_buffer) {
+      callback(vid2lvid_buffer[rec.source], vid2lvid_buffer[rec.target], 
+               rec.edata);
+    }
+#endif
+
     /**
      * \brief Gather the vertex distributed meta data.
      */
@@ -0,0 +1,339 @@
+/**
+ * Copyright (c) 2009 Carnegie Mellon University.
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+#ifndef GRAPHLAB_INGRESS_EDGE_SPILL_HPP
+#define GRAPHLAB_INGRESS_EDGE_SPILL_HPP
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <graphlab/logger/logger.hpp>
+#include <graphlab/logger/assertions.hpp>
+#include <graphlab/parallel/pthread_tools.hpp>
+#include <graphlab/serialization/iarchive.hpp>
+#include <graphlab/serialization/oarchive.hpp>
+#include <graphlab/macros_def.hpp>
+
+namespace graphlab {
+
+  /**
+   * \brief Spills ingress edge records to sorted run files on local disk.
+   *
+   * Records are accumulated in memory until half of the configured budget
+   * is used. The full buffer is then handed to a background writer thread
+   * which sorts it by (source, target) and writes it out as a run file,
+   * while new records go to a fresh buffer. If the writer falls behind,
+   * add() waits for it, so at most two buffers are held at any time and
+   * the callers (typically the rpc receive path) never sort or write.
+   *
+   * merge() streams all records back in sorted order through a k-way
+   * merge of the runs, holding one record per run in memory. If there are
+   * more than max_fanin runs, groups of max_fanin runs are first merged
+   * into longer runs, so that no more than max_fanin files are open at
+   * once.
+   *
+   * RecordType must expose \c source and \c target members and be
+   * serializable.
+   */
+  template<typename RecordType>
+  class ingress_edge_spill {
+  public:
+    typedef RecordType record_type;
+
+    /**
+     * \param prefix Path prefix of the run files. Each run is written to
+     *               prefix.run.[i].
+     * \param budget_bytes Memory used by buffered records. A run holds
+     *                     half of it.
+     * \param max_fanin Maximum number of runs merged at once.
+     */
+    ingress_edge_spill(const std::string& prefix, size_t budget_bytes,
+                       size_t max_fanin = 64) :
+      prefix(prefix),
+      max_buffered(std::max<size_t>(1, budget_bytes / 2 / sizeof(RecordType))),
+      max_fanin(std::max<size_t>(2, max_fanin)),
+      nrecords(0), next_run_id(0), writing(false), done(false) {
+      writer.launch(boost::bind(&ingress_edge_spill::writer_loop, this));
+    }
+
+    ~ingress_edge_spill() {
+      clear();
+      lock.lock();
+      done = true;
+      cond.broadcast();
+      lock.unlock();
+      writer.join();
+    }
+
+    /** Adds a record, handing off the buffer if it is full. Thread safe. */
+    void add(const RecordType& rec) {
+      lock.lock();
+      buffer.push_back(rec);
+      ++nrecords;
+      if (buffer.size() >= max_buffered) hand_off();
+      lock.unlock();
+    }
+
+    /** Adds a batch of records. Thread safe. */
+    void add(const std::vector<RecordType>& recs) {
+      lock.lock();
+      foreach(const RecordType& rec, recs) {
+        buffer.push_back(rec);
+        if (buffer.size() >= max_buffered) hand_off();
+      }
+      nrecords += recs.size();
+      lock.unlock();
+    }
+
+    /** Writes out the remaining buffered records and waits for the writer. */
+    void finish() {
+      lock.lock();
+      if (!buffer.empty()) hand_off();
+      while (!pending.empty() || writing) cond.wait(lock);
+      lock.unlock();
+    }
+
+    /** Returns the total number of records added. */
+    size_t size() const { return nrecords; }
+
+    /** Returns the number of runs written to disk. */
+    size_t num_runs() const { return run_files.size(); }
+
+    /**
+     * Calls fn(record) on every record in (source, target) order.
+     * finish() must be called first.
+     */
+    template<typename Fn>
+    void merge(Fn fn) {
+      ASSERT_TRUE(buffer.empty());
+      while (run_files.size() > max_fanin) merge_pass();
+      merge_runs(run_files, fn);
+    }
+
+    /** Removes all run files and buffered records. */
+    void clear() {
+      lock.lock();
+      // the run being written would be left behind
+      while (writing) cond.wait(lock);
+      std::vector<RecordType>().swap(buffer);
+      std::vector<RecordType>().swap(pending);
+      cond.broadcast();
+      foreach(const std::string& fname, run_files) {
+        std::remove(fname.c_str());
+      }
+      run_files.clear();
+      nrecords = 0;
+      lock.unlock();
+    }
+
+  private:
+    std::string prefix;
+    size_t max_buffered;
+    size_t max_fanin;
+    size_t nrecords;
+    size_t next_run_id;
+    /// records being added
+    std::vector<RecordType> buffer;
+    /// a full buffer waiting for the writer
+    std::vector<RecordType> pending;
+    std::vector<std::string> run_files;
+    /// true while the writer sorts and writes a run
+    bool writing;
+    bool done;
+    mutex lock;
+    conditional cond;
+    thread writer;
+
+    static bool record_less(const RecordType& a, const RecordType& b) {
+      return a.source < b.source ||
+        (a.source == b.source && a.target < b.target);
+    }
+
+    /**
+     * Passes the full buffer to the writer, waiting for the previous one
+     * to be taken. Lock must be held.
+     */
+    void hand_off() {
+      while (!pending.empty()) cond.wait(lock);
+      pending.swap(buffer);
+      cond.broadcast();
+      buffer.reserve(std::min<size_t>(max_buffered, 1 << 20));
+    }
+
+    /** Returns the name of a new run file. Lock must be held. */
+    std::string new_run_name() {
+      return prefix + ".run." + boost::lexical_cast<std::string>(next_run_id++);
+    }
+
+    /** Sorts and writes the buffers handed off by add(). */
+    void writer_loop() {
+      std::vector<RecordType> run;
+      lock.lock();
+      while (true) {
+        while (pending.empty() && !done) cond.wait(lock);
+        if (pending.empty()) break;
+        run.swap(pending);
+        writing = true;
+        const std::string fname = new_run_name();
+        // the next buffer can be handed off while this one is written
+        cond.broadcast();
+        lock.unlock();
+
+        std::sort(run.begin(), run.end(), record_less);
+        std::ofstream fout(fname.c_str(), std::ios::binary);
+        if (!fout.good()) {
+          logstream(LOG_FATAL) << "Unable to open spill file " << fname
+                               << std::endl;
+        }
+        oarchive oarc(fout);
+        oarc << run.size();
+        foreach(const RecordType& rec, run) oarc << rec;
+        fout.close();
+        if (fout.fail()) {
+          logstream(LOG_FATAL) << "Failed writing spill file " << fname
+                               << std::endl;
+        }
+        logstream(LOG_INFO) << "Spilled " << run.size()
+                            << " edges to " << fname << std::endl;
+        std::vector<RecordType>().swap(run);
+
+        lock.lock();
+        run_files.push_back(fname);
+        writing = false;
+        cond.broadcast();
+      }
+      lock.unlock();
+    }
+
+    /** Merges groups of max_fanin runs into single runs. */
+    void merge_pass() {
+      std::vector<std::string> merged_files;
+      for (size_t first = 0; first < run_files.size(); first += max_fanin) {
+        const size_t last = std::min(first + max_fanin, run_files.size());
+        std::vector<std::string> group(run_files.begin() + first,
+                                       run_files.begin() + last);
+        if (group.size() == 1) {
+          merged_files.push_back(group[0]);
+          continue;
+        }
+        size_t total = 0;
+        foreach(const std::string& fname, group) {
+          run_reader reader(fname);
+          total += reader.remaining;
+        }
+        const std::string fname = new_run_name();
+        std::ofstream fout(fname.c_str(), std::ios::binary);
+        if (!fout.good()) {
+          logstream(LOG_FATAL) << "Unable to open spill file " << fname
+                               << std::endl;
+        }
+        oarchive oarc(fout);
+        oarc << total;
+        run_writer out(oarc);
+        merge_runs(group, out);
+        fout.close();
+        if (fout.fail()) {
+          logstream(LOG_FATAL) << "Failed writing spill file " << fname
+                               << std::endl;
+        }
+        foreach(const std::string& old, group) std::remove(old.c_str());
+        merged_files.push_back(fname);
+      }
+      logstream(LOG_INFO) << "Merged " << run_files.size() << " spilled runs into "
+                          << merged_files.size() << std::endl;
+      run_files.swap(merged_files);
+    }
+
+    /** Calls fn(record) on every record of the runs in sorted order. */
+    template<typename Fn>
+    static void merge_runs(const std::vector<std::string>& files, Fn& fn) {
+      std::vector<run_reader*> readers;
+      std::vector<size_t> heap;
+      for (size_t i = 0; i < files.size(); ++i) {
+        readers.push_back(new run_reader(files[i]));
+        if (readers[i]->next()) heap.push_back(i);
+      }
+      reader_greater cmp(readers);
+      std::make_heap(heap.begin(), heap.end(), cmp);
+      while(!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), cmp);
+        const size_t i = heap.back();
+        fn(readers[i]->current);
+        if (readers[i]->next()) {
+          std::push_heap(heap.begin(), heap.end(), cmp);
+        } else {
+          heap.pop_back();
+        }
+      }
+      foreach(run_reader* reader, readers) delete reader;
+    }
+
+    /** Appends the merged records to a run file. */
+    struct run_writer {
+      oarchive& oarc;
+      run_writer(oarchive& oarc) : oarc(oarc) { }
+      void operator()(const RecordType& rec) { oarc << rec; }
+    };
+
+    /** Streams the records of one run file. */
+    struct run_reader {
+      std::ifstream fin;
+      iarchive iarc;
+      size_t remaining;
+      RecordType current;
+      run_reader(const std::string& fname) :
+        fin(fname.c_str(), std::ios::binary), iarc(fin), remaining(0) {
+        if (!fin.good()) {
+          logstream(LOG_FATAL) << "Unable to open spill file " << fname
+                               << std::endl;
+        }
+        iarc >> remaining;
+      }
+      bool next() {
+        if (remaining == 0) return false;
+        iarc >> current;
+        --remaining;
+        return true;
+      }
+    };
+
+    /** Heap ordering so that the smallest current record is on top. */
+    struct reader_greater {
+      const std::vector<run_reader*>& readers;
+      reader_greater(const std::vector<run_reader*>& readers) :
+        readers(readers) { }
+      bool operator()(size_t a, size_t b) const {
+        return record_less(readers[b]->current, readers[a]->current);
+      }
+    };
+  }; // end of class ingress_edge_spill
+
+} // end of namespace graphlab
+#include <graphlab/macros_undef.hpp>
+
+#endif
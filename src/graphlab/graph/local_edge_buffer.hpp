@@ -29,13 +29,20 @@
 
 namespace graphlab {    
 
-    template<typename VertexData, typename EdgeData>
+    template<typename VertexData, typename EdgeData,
+             typename Alloc = std::allocator<EdgeData> >
     // Edge class for temporary storage. Will be finalized into the CSR+CSC form.
+    // The arrays are allocated with Alloc so they can be moved into a
+    // graph using the same allocator without a copy.
     class local_edge_buffer {
     public:
-      std::vector<EdgeData> data;
-      std::vector<lvid_type> source_arr;
-      std::vector<lvid_type> target_arr;
+      typedef std::vector<EdgeData,
+              typename Alloc::template rebind<EdgeData>::other> edata_vector_type;
+      typedef std::vector<lvid_type,
+              typename Alloc::template rebind<lvid_type>::other> lvid_vector_type;
+      edata_vector_type data;
+      lvid_vector_type source_arr;
+      lvid_vector_type target_arr;
     public:
       local_edge_buffer() {}
       void reserve_edge_space(size_t n) {
@@ -57,11 +64,28 @@ namespace graphlab {
         source_arr.insert(source_arr.end(), src_arr.begin(), src_arr.end());
         target_arr.insert(target_arr.end(), dst_arr.begin(), dst_arr.end());
       }
+      // \brief Grow the storage by n default edges, returning the index
+      // of the first new edge.
+      size_t extend(size_t n) {
+        const size_t begin = size();
+        data.resize(begin + n);
+        source_arr.resize(begin + n);
+        target_arr.resize(begin + n);
+        return begin;
+      }
+      // \brief Overwrite the edge at index i. Concurrent calls on distinct
+      // indices are safe.
+      void set_edge(size_t i, lvid_type source, lvid_type target,
+                    const EdgeData& _data) {
+        data[i] = _data;
+        source_arr[i] = source;
+        target_arr[i] = target;
+      }
       // \brief Remove all contents in the storage. 
       void clear() {
-        std::vector<EdgeData>().swap(data);
-        std::vector<lvid_type>().swap(source_arr);
-        std::vector<lvid_type>().swap(target_arr);
+        edata_vector_type().swap(data);
+        lvid_vector_type().swap(source_arr);
+        lvid_vector_type().swap(target_arr);
       }
       // \brief Return the size of the storage.
       size_t size() const {
@@ -37,6 +37,7 @@
 #include <fstream>
 
 #include <boost/bind.hpp>
+#include <boost/function.hpp>
 #include <boost/unordered_set.hpp>
 #include <boost/type_traits.hpp>
 #include <boost/typeof/typeof.hpp>
@@ -52,7 +53,9 @@
 #include <graphlab/util/generics/counting_sort.hpp>
 #include <graphlab/util/generics/vector_zip.hpp>
 #include <graphlab/util/generics/csr_storage.hpp>
+#include <graphlab/util/mmap_allocator.hpp>
 #include <graphlab/parallel/atomic.hpp>
+#include <graphlab/parallel/numa.hpp>
 
 #include <graphlab/logger/logger.hpp>
 #include <graphlab/logger/assertions.hpp>
@@ -187,8 +190,8 @@ namespace graphlab {
       edges.clear();
       _csc_storage.clear();
       _csr_storage.clear();
-      std::vector<VertexData>().swap(vertices);
-      std::vector<EdgeData>().swap(edges);
+      vertex_vector_type().swap(vertices);
+      edge_vector_type().swap(edges);
       edge_buffer.clear();
     }
 
@@ -217,42 +220,27 @@ namespace graphlab {
       // Begin of counting sort.
       counting_sort(edge_buffer.source_arr, permute, &src_counting_prefix_sum);
 
-      // Inplace permute of edge_data, edge_src, edge_target array.
+      const double sort_src_time = mytimer.current_time();
+
+      // Permute edge_src and edge_target out of place in parallel. Edge data
+      // is only permuted out of place if it is no larger than the permutation
+      // index, otherwise it is permuted inplace to bound the peak memory.
 #ifdef DEBUG_GRAPH
-      logstream(LOG_DEBUG) << "Graph2 finalize: Inplace permute by source id" << std::endl;
+      logstream(LOG_DEBUG) << "Graph2 finalize: Permute by source id" << std::endl;
 #endif
-      lvid_type swap_src; lvid_type swap_target; EdgeData  swap_data;
-      for (size_t i = 0; i < permute.size(); ++i) {
-        if (i != permute[i]) {
-          // Reserve the ith entry;
-          size_t j = i;
-          swap_data = edge_buffer.data[i];
-          swap_src = edge_buffer.source_arr[i];
-          swap_target = edge_buffer.target_arr[i];
-          // Begin swap cycle:
-          while (j != permute[j]) {
-            size_t next = permute[j];
-            if (next != i) {
-              edge_buffer.data[j] = edge_buffer.data[next];
-              edge_buffer.source_arr[j] = edge_buffer.source_arr[next];
-              edge_buffer.target_arr[j] = edge_buffer.target_arr[next];
-              permute[j] = j;
-              j = next;
-            } else {
-              // end of cycle
-              edge_buffer.data[j] = swap_data;
-              edge_buffer.source_arr[j] = swap_src;
-              edge_buffer.target_arr[j] = swap_target;
-              permute[j] = j;
-              break;
-            }
-          }
-        }
+      outofplace_shuffle(edge_buffer.source_arr, permute);
+      outofplace_shuffle(edge_buffer.target_arr, permute);
+      if (sizeof(EdgeData) <= sizeof(edge_id_type)) {
+        outofplace_shuffle(edge_buffer.data, permute);
+      } else {
+        inplace_shuffle(edge_buffer.data.begin(), edge_buffer.data.end(), permute);
       }
+      const double permute_src_time = mytimer.current_time();
 #ifdef DEBUG_GRAPH
       logstream(LOG_DEBUG) << "Graph2 finalize: Sort by dest id" << std::endl;
 #endif
       counting_sort(edge_buffer.target_arr, permute, &dest_counting_prefix_sum); 
+      const double sort_dest_time = mytimer.current_time();
       // Shuffle source array
 #ifdef DEBUG_GRAPH
       logstream(LOG_DEBUG) << "Graph2 finalize: Outofplace permute by dest id" << std::endl;
@@ -265,7 +253,7 @@ namespace graphlab {
 
       // warp into csr csc storage.
       _csr_storage.wrap(src_counting_prefix_sum, edge_buffer.target_arr);
-      std::vector<std::pair<lvid_type, edge_id_type> > csc_value = vector_zip(edge_buffer.source_arr, permute);
+      csc_type::value_vector_type csc_value = vector_zip(edge_buffer.source_arr, permute);
       //ASSERT_EQ(csc_value.size(), edge_buffer.size());
       _csc_storage.wrap(dest_counting_prefix_sum, csc_value); 
       edges.swap(edge_buffer.data);
@@ -276,10 +264,65 @@ namespace graphlab {
 #endif
 
       logstream(LOG_INFO) << "Graph finalized in " << mytimer.current_time() 
-                          << " secs" << std::endl;
+                          << " secs (sort by source: " << sort_src_time
+                          << ", permute: " << permute_src_time - sort_src_time
+                          << ", sort by dest: " << sort_dest_time - permute_src_time
+                          << ", build csr/csc: " 
+                          << mytimer.current_time() - sort_dest_time << ")"
+                          << std::endl;
       finalized = true;
     } // End of finalize
 
+    /** Callback receiving one edge at a time from an edge stream. */
+    typedef boost::function<void(lvid_type, lvid_type, const EdgeData&)>
+      edge_callback_type;
+
+    /**
+     * \brief Finalize the local_graph from an external stream of edges
+     * without buffering them in the edge_buffer.
+     *
+     * out_degree and in_degree hold the number of out/in edges of each
+     * vertex. for_each_edge(callback) must invoke callback once for every
+     * edge. The edges are placed directly into their final CSR/CSC
+     * positions, so the peak memory is the size of the finalized graph plus
+     * two cursors per vertex. Edges sharing a source keep the order in which
+     * they are streamed.
+     */
+    void finalize_streaming(const std::vector<edge_id_type>& out_degree,
+                            const std::vector<edge_id_type>& in_degree,
+                            boost::function<void(const edge_callback_type&)>
+                              for_each_edge) {
+      ASSERT_FALSE(finalized);
+      ASSERT_EQ(edge_buffer.size(), 0);
+      graphlab::timer mytimer; mytimer.start();
+
+      std::vector<edge_id_type> src_prefix, dest_prefix;
+      const size_t nedges = degree_prefix_sum(out_degree, src_prefix);
+      ASSERT_EQ(nedges, degree_prefix_sum(in_degree, dest_prefix));
+
+      csr_type::value_vector_type csr_value(nedges);
+      csc_type::value_vector_type csc_value(nedges);
+      edge_vector_type edata(nedges);
+      std::vector<edge_id_type> src_cursor(src_prefix);
+      std::vector<edge_id_type> dest_cursor(dest_prefix);
+      for_each_edge(boost::bind(&local_graph::place_edge, this, _1, _2, _3,
+                                boost::ref(src_cursor), boost::ref(dest_cursor),
+                                boost::ref(csr_value), boost::ref(csc_value),
+                                boost::ref(edata)));
+      std::vector<edge_id_type>().swap(src_cursor);
+      std::vector<edge_id_type>().swap(dest_cursor);
+
+      _csr_storage.wrap(src_prefix, csr_value);
+      _csc_storage.wrap(dest_prefix, csc_value);
+      edges.swap(edata);
+      ASSERT_EQ(_csr_storage.num_values(), _csc_storage.num_values());
+      ASSERT_EQ(_csr_storage.num_values(), edges.size());
+
+      logstream(LOG_INFO) << "Graph finalized from stream in "
+                          << mytimer.current_time() << " secs" << std::endl;
+      finalized = true;
+    } // End of finalize_streaming
+
     /** \brief Get the number of vertices */
     size_t num_vertices() const {
       return vertices.size();
@@ -355,6 +398,30 @@ namespace graphlab {
       return 0;
     } // End of add edge
     
+    /**
+     * \brief Grows the edge buffer by n edges which must then be filled in
+     * with set_edge(). Returns the position of the first new edge. 
+     * Should not be called after finalization.
+     */
+    size_t extend_edge_buffer(size_t n) {
+      if (finalized) {
+        logstream(LOG_FATAL)
+          << "Attempting add edges to a finalized local_graph." << std::endl;
+      }
+      return edge_buffer.extend(n);
+    }
+
+    /**
+     * \brief Fills in an edge reserved by extend_edge_buffer(). Concurrent
+     * calls on distinct positions are safe. Unlike add_edge() this does not
+     * grow the vertex set, so resize() must be called before finalize().
+     */
+    void set_edge(size_t pos, lvid_type source, lvid_type target, 
+                  const EdgeData& edata) {
+      ASSERT_MSG(source != target, "Attempting to add self edge!");
+      edge_buffer.set_edge(pos, source, target, edata);
+    }
+
     /**
      * \brief Add edges in block.
      */
@@ -564,6 +631,23 @@ namespace graphlab {
       return edges[eid]; 
     }
 
+    /**
+     * \internal
+     * \brief Moves the memory of the vertices [begin, end) to a NUMA
+     * node: their vertex data, their out-edges (edge data and CSR
+     * adjacency, which are stored in source order) and their in-edge
+     * CSC adjacency. Must be called after finalize.
+     */
+    void place_on_numa_node(lvid_type begin, lvid_type end, size_t node) {
+      ASSERT_TRUE(finalized);
+      numa::place(vertices, begin, end, node);
+      const edge_id_type ebegin = _csr_storage.begin(begin) - _csr_storage.begin(0);
+      const edge_id_type eend = _csr_storage.begin(end) - _csr_storage.begin(0);
+      numa::place(edges, ebegin, eend, node);
+      _csr_storage.place_on_numa_node(begin, end, node);
+      _csc_storage.place_on_numa_node(begin, end, node);
+    }
+
     /** 
      * \internal
      * \brief Returns the estimated memory footprint of the local_graph. */
@@ -603,8 +687,18 @@ namespace graphlab {
      * \internal
      * CSR/CSC storage types
      */
-    typedef csr_storage<lvid_type, edge_id_type> csr_type;
-    typedef csr_storage<std::pair<lvid_type, edge_id_type>, edge_id_type> csc_type; 
+    typedef csr_storage<lvid_type, edge_id_type,
+                        mmap_allocator<lvid_type> > csr_type;
+    typedef csr_storage<std::pair<lvid_type, edge_id_type>, edge_id_type,
+                        mmap_allocator<lvid_type> > csc_type; 
+
+    /**
+     * \internal
+     * The large arrays are allocated with mmap_allocator, so they use
+     * huge pages or file backed memory depending on mmap_alloc::get_mode().
+     */
+    typedef std::vector<VertexData, mmap_allocator<VertexData> > vertex_vector_type;
+    typedef std::vector<EdgeData, mmap_allocator<EdgeData> > edge_vector_type;
 
     typedef boost::tuple<csr_type::iterator,
                          boost::counting_iterator<edge_id_type>
@@ -697,6 +791,39 @@ namespace graphlab {
            const lvid_type vid;
         }; // end of edge_iterator
 
+    /**
+     * Fills prefix with the exclusive prefix sum of degree, truncated after
+     * the last vertex with a non-zero degree as required by
+     * csr_storage::wrap(). Returns the total degree.
+     */
+    static size_t degree_prefix_sum(const std::vector<edge_id_type>& degree,
+                                    std::vector<edge_id_type>& prefix) {
+      size_t nkeys = degree.size();
+      while (nkeys > 0 && degree[nkeys - 1] == 0) --nkeys;
+      prefix.resize(nkeys);
+      size_t total = 0;
+      for (size_t i = 0; i < nkeys; ++i) {
+        prefix[i] = total;
+        total += degree[i];
+      }
+      return total;
+    }
+
+    /** Places a single streamed edge at its final CSR/CSC position. */
+    void place_edge(lvid_type source, lvid_type target, const EdgeData& edata,
+                    std::vector<edge_id_type>& src_cursor,
+                    std::vector<edge_id_type>& dest_cursor,
+                    csr_type::value_vector_type& csr_value,
+                    csc_type::value_vector_type& csc_value,
+                    edge_vector_type& edge_value) {
+      ASSERT_LT(source, src_cursor.size());
+      ASSERT_LT(target, dest_cursor.size());
+      const edge_id_type eid = src_cursor[source]++;
+      csr_value[eid] = target;
+      edge_value[eid] = edata;
+      csc_value[dest_cursor[target]++] = std::make_pair(source, eid);
+    }
+
 
     /**************************************************************************/
     /*                                                                        */
@@ -704,18 +831,18 @@ namespace graphlab {
     /*                                                                        */
     /**************************************************************************/
     /** The vertex data is simply a vector of vertex data */
-    std::vector<VertexData> vertices;
+    vertex_vector_type vertices;
 
     /** Stores the edge data and edge relationships. */
     csr_type _csr_storage;
     csc_type _csc_storage;
-    std::vector<EdgeData> edges;
+    edge_vector_type edges;
 
     /** The edge data is a vector of edges where each edge stores its
         source, destination, and data. Used for temporary storage. The
         data is transferred into CSR+CSC representation in
         Finalize. This will be cleared after finalized.*/
-    local_edge_buffer<VertexData, EdgeData> edge_buffer;
+    local_edge_buffer<VertexData, EdgeData, mmap_allocator<EdgeData> > edge_buffer;
    
     /** Mark whether the local_graph is finalized.  Graph finalization is a
         costly procedure but it can also dramatically improve
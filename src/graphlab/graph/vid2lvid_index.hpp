@@ -0,0 +1,359 @@
+/**
+ * Copyright (c) 2009 Carnegie Mellon University.
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+#ifndef GRAPHLAB_VID2LVID_INDEX_HPP
+#define GRAPHLAB_VID2LVID_INDEX_HPP
+
+#include <vector>
+#include <string>
+#include <utility>
+#include <algorithm>
+
+#include <graphlab/graph/graph_basic_types.hpp>
+#include <graphlab/util/hopscotch_map.hpp>
+#include <graphlab/util/mmap_allocator.hpp>
+#include <graphlab/logger/logger.hpp>
+#include <graphlab/logger/assertions.hpp>
+#include <graphlab/serialization/iarchive.hpp>
+#include <graphlab/serialization/oarchive.hpp>
+#include <graphlab/macros_def.hpp>
+
+namespace graphlab {
+
+  /**
+   * \internal
+   * \brief The map from global vertex ids to local vertex ids of a
+   * distributed_graph.
+   *
+   * New entries are always inserted into a hopscotch_map. compact(),
+   * called at the end of every graph finalize, may then move all entries
+   * into a read-only compact representation, selected by the mode:
+   *
+   * \li \c hash Keep the hopscotch_map. This is the default.
+   * \li \c dense An array indexed by vid - min_vid. 4 bytes per vid in
+   *     the range between the smallest and largest local vid, and a
+   *     single load per lookup. Falls back to \c sorted if the local vids
+   *     span more than DENSE_MAX_SPAN times the number of local vertices.
+   * \li \c sorted Sorted arrays of vids and lvids with a radix table on
+   *     the high bits of the vid narrowing every binary search to a few
+   *     entries. About 12 bytes per local vertex with 64 bit vids.
+   * \li \c auto \c dense if the local vids span less than twice the
+   *     number of local vertices, \c sorted otherwise.
+   *
+   * Entries inserted after compact() go to the hopscotch_map until the
+   * next compact(). Lookups are thread safe; modifications are not.
+   *
+   * The index is serialized exactly like a hopscotch_map (size, capacity,
+   * then the pairs), so graphs saved before the index existed still load.
+   * The mode is not serialized: load() compacts with the mode of the
+   * loading index.
+   */
+  class vid2lvid_index {
+  public:
+    typedef std::pair<vertex_id_type, lvid_type> value_type;
+    typedef hopscotch_map<vertex_id_type, lvid_type,
+                          boost::hash<vertex_id_type>,
+                          std::equal_to<vertex_id_type>,
+                          mmap_allocator<value_type> > hash_map_type;
+
+    enum mode_type { HASH, DENSE, SORTED, AUTO };
+
+    /// DENSE is used only if the vids span at most this many times the
+    /// number of entries.
+    static const size_t DENSE_MAX_SPAN = 16;
+
+    /**
+     * The result of find(). Only supports dereferencing and comparison
+     * with end().
+     */
+    class const_iterator {
+    public:
+      const_iterator() : found(false) { }
+      const_iterator(vertex_id_type vid, lvid_type lvid) :
+        val(vid, lvid), found(true) { }
+      const value_type& operator*() const { return val; }
+      const value_type* operator->() const { return &val; }
+      bool operator==(const const_iterator& other) const {
+        return found == other.found && (!found || val == other.val);
+      }
+      bool operator!=(const const_iterator& other) const {
+        return !(*this == other);
+      }
+    private:
+      value_type val;
+      bool found;
+    };
+    typedef const_iterator iterator;
+
+    vid2lvid_index() : mode(HASH), compact_mode(HASH), ncompact(0),
+                       min_vid(0), max_vid(0), shift(0) { }
+
+    /// Sets the compaction mode used by the next compact().
+    void set_mode(mode_type m) { mode = m; }
+
+    /**
+     * Sets the compaction mode by name: "hash", "dense", "sorted" or
+     * "auto". Returns false if the name is not recognized.
+     */
+    bool set_mode(const std::string& name) {
+      if (name == "hash") mode = HASH;
+      else if (name == "dense") mode = DENSE;
+      else if (name == "sorted") mode = SORTED;
+      else if (name == "auto") mode = AUTO;
+      else return false;
+      return true;
+    }
+
+    /// Returns the representation currently holding the compacted entries.
+    mode_type get_compact_mode() const { return compact_mode; }
+
+    /// Returns the number of entries.
+    size_t size() const { return ncompact + map.size(); }
+
+    const_iterator end() const { return const_iterator(); }
+
+    const_iterator find(vertex_id_type vid) const {
+      const lvid_type* lvid = find_compact(vid);
+      if (lvid != NULL) return const_iterator(vid, *lvid);
+      hash_map_type::const_iterator iter = map.find(vid);
+      if (iter == map.end()) return end();
+      return const_iterator(vid, iter->second);
+    }
+
+    /// Returns 1 if vid is present and 0 otherwise.
+    size_t count(vertex_id_type vid) const {
+      return find(vid) == end() ? 0 : 1;
+    }
+
+    /// Returns the lvid of vid, inserting it if it is not present.
+    lvid_type& operator[](vertex_id_type vid) {
+      lvid_type* lvid = const_cast<lvid_type*>(find_compact(vid));
+      if (lvid != NULL) return *lvid;
+      return map[vid];
+    }
+
+    /// Inserts an entry if the vid is not already present.
+    void insert(const value_type& v) {
+      if (find_compact(v.first) == NULL) map.insert(v);
+    }
+
+    /// Makes room for n entries in the uncompacted part.
+    void rehash(size_t n) {
+      map.rehash(n);
+    }
+
+    /**
+     * Moves all entries of other into the index and clears other.
+     * Entries already present are not overwritten.
+     */
+    void merge(hash_map_type& other) {
+      if (size() == 0) {
+        map.swap(other);
+      } else {
+        map.rehash(map.size() + other.size());
+        foreach(const value_type& v, other) insert(v);
+      }
+      hash_map_type().swap(other);
+    }
+
+    void clear() {
+      hash_map_type().swap(map);
+      clear_compact();
+    }
+
+    /// Calls fn(vid, lvid) on every entry.
+    template <typename Fn>
+    void for_each(Fn fn) const {
+      if (compact_mode == DENSE) {
+        for (size_t i = 0; i < dense.size(); ++i) {
+          if (dense[i] != lvid_type(-1)) fn(vertex_id_type(min_vid + i), dense[i]);
+        }
+      } else if (compact_mode == SORTED) {
+        for (size_t i = 0; i < keys.size(); ++i) fn(keys[i], values[i]);
+      }
+      foreach(const value_type& v, map) fn(v.first, v.second);
+    }
+
+    /**
+     * Moves all entries into the representation selected by set_mode().
+     * Does nothing in HASH mode, or if nothing was inserted since the
+     * last compact() in the same mode.
+     */
+    void compact() {
+      if (mode == HASH && compact_mode == HASH) return;
+      if (map.size() == 0 && (mode == compact_mode ||
+                              (mode == AUTO && compact_mode != HASH))) {
+        return;
+      }
+      std::vector<value_type> entries;
+      entries.reserve(size());
+      for_each(entry_appender(entries));
+      clear();
+      if (entries.empty()) return;
+      std::sort(entries.begin(), entries.end());
+
+      mode_type target = mode;
+      const size_t span = entries.back().first - entries.front().first + 1;
+      if (target == AUTO) target = (span < 2 * entries.size()) ? DENSE : SORTED;
+      if (target == DENSE && span / DENSE_MAX_SPAN > entries.size()) {
+        logstream(LOG_WARNING)
+          << "vid2lvid: local vids span " << span << " ids for "
+          << entries.size() << " vertices. Using sorted instead of dense."
+          << std::endl;
+        target = SORTED;
+      }
+      if (target == HASH) {
+        map.rehash(entries.size());
+        foreach(const value_type& v, entries) map.insert(v);
+        return;
+      }
+      min_vid = entries.front().first;
+      max_vid = entries.back().first;
+      ncompact = entries.size();
+      compact_mode = target;
+      if (target == DENSE) {
+        dense.assign(span, lvid_type(-1));
+        foreach(const value_type& v, entries) dense[v.first - min_vid] = v.second;
+      } else {
+        keys.resize(entries.size());
+        values.resize(entries.size());
+        for (size_t i = 0; i < entries.size(); ++i) {
+          keys[i] = entries[i].first;
+          values[i] = entries[i].second;
+        }
+        build_radix_table();
+      }
+    }
+
+    /// Returns the memory used by the index in bytes.
+    size_t memory_bytes() const {
+      return dense.capacity() * sizeof(lvid_type) +
+        keys.capacity() * sizeof(vertex_id_type) +
+        values.capacity() * sizeof(lvid_type) +
+        radix.capacity() * sizeof(lvid_type) +
+        map.capacity() * (sizeof(value_type) + sizeof(uint32_t));
+    }
+
+    void save(oarchive& oarc) const {
+      // the capacity is only a sizing hint for a loading hopscotch_map
+      const size_t capacity = (ncompact == 0) ? map.capacity() : 2 * size();
+      oarc << size() << capacity;
+      for_each(entry_saver(oarc));
+    }
+
+    void load(iarchive& iarc) {
+      clear();
+      size_t n, capacity;
+      iarc >> n >> capacity;
+      map.rehash(n);
+      for (size_t i = 0; i < n; ++i) {
+        value_type v;
+        iarc >> v;
+        map.insert(v);
+      }
+      compact();
+    }
+
+  private:
+    typedef std::vector<lvid_type, mmap_allocator<lvid_type> > lvid_vector_type;
+    typedef std::vector<vertex_id_type, mmap_allocator<vertex_id_type> >
+      vid_vector_type;
+
+    /// The mode used by the next compact()
+    mode_type mode;
+    /// The representation of the compacted entries
+    mode_type compact_mode;
+    /// Entries inserted since the last compact()
+    hash_map_type map;
+    /// The number of compacted entries
+    size_t ncompact;
+    vertex_id_type min_vid, max_vid;
+
+    /// DENSE: lvid of min_vid + i, or -1
+    lvid_vector_type dense;
+
+    /// SORTED: sorted vids and their lvids
+    vid_vector_type keys;
+    lvid_vector_type values;
+    /// SORTED: keys with (vid - min_vid) >> shift == b are in
+    /// [radix[b], radix[b + 1])
+    lvid_vector_type radix;
+    size_t shift;
+
+    struct entry_appender {
+      std::vector<value_type>& entries;
+      entry_appender(std::vector<value_type>& entries) : entries(entries) { }
+      void operator()(vertex_id_type vid, lvid_type lvid) const {
+        entries.push_back(value_type(vid, lvid));
+      }
+    };
+
+    struct entry_saver {
+      oarchive& oarc;
+      entry_saver(oarchive& oarc) : oarc(oarc) { }
+      void operator()(vertex_id_type vid, lvid_type lvid) const {
+        oarc << value_type(vid, lvid);
+      }
+    };
+
+    void clear_compact() {
+      compact_mode = HASH;
+      ncompact = 0;
+      lvid_vector_type().swap(dense);
+      vid_vector_type().swap(keys);
+      lvid_vector_type().swap(values);
+      lvid_vector_type().swap(radix);
+    }
+
+    /// Builds a radix table with about one bucket per 8 keys.
+    void build_radix_table() {
+      const uint64_t range = uint64_t(max_vid) - uint64_t(min_vid);
+      const size_t target_buckets = std::max<size_t>(keys.size() / 8, 1);
+      shift = 0;
+      while ((range >> shift) >= target_buckets) ++shift;
+      const size_t nbuckets = size_t(range >> shift) + 1;
+      radix.assign(nbuckets + 1, 0);
+      for (size_t i = 0; i < keys.size(); ++i) {
+        ++radix[((keys[i] - min_vid) >> shift) + 1];
+      }
+      for (size_t b = 0; b < nbuckets; ++b) radix[b + 1] += radix[b];
+    }
+
+    const lvid_type* find_compact(vertex_id_type vid) const {
+      if (compact_mode == HASH || vid < min_vid || vid > max_vid) return NULL;
+      if (compact_mode == DENSE) {
+        const lvid_type& lvid = dense[vid - min_vid];
+        return lvid == lvid_type(-1) ? NULL : &lvid;
+      }
+      const size_t b = (vid - min_vid) >> shift;
+      vid_vector_type::const_iterator begin = keys.begin() + radix[b];
+      vid_vector_type::const_iterator end = keys.begin() + radix[b + 1];
+      vid_vector_type::const_iterator iter =
+        std::lower_bound(begin, end, vid);
+      if (iter == end || *iter != vid) return NULL;
+      return &values[iter - keys.begin()];
+    }
+  }; // end of class vid2lvid_index
+
+} // end of namespace graphlab
+#include <graphlab/macros_undef.hpp>
+#endif
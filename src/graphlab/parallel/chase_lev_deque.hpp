@@ -0,0 +1,154 @@
+/*  
+ * Copyright (c) 2009 Carnegie Mellon University. 
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+
+#ifndef GRAPHLAB_PARALLEL_CHASE_LEV_DEQUE_HPP
+#define GRAPHLAB_PARALLEL_CHASE_LEV_DEQUE_HPP
+#include <stdint.h>
+#include <vector>
+#include <graphlab/parallel/atomic_ops.hpp>
+
+namespace graphlab {
+
+/**
+ * A lock free work stealing deque (Chase and Lev, "Dynamic Circular
+ * Work-Stealing Deque", SPAA 2005).
+ *
+ * Only the owner thread may call push() and pop(). steal() may be called
+ * by any thread, including the owner. push() and pop() operate on the
+ * bottom of the deque, steal() takes from the top, so the owner sees the
+ * elements in LIFO order and thieves in FIFO order.
+ *
+ * The circular buffer grows when full. Old buffers are kept until the
+ * deque is destroyed since a concurrent thief may still be reading them.
+ * T must be copyable with a plain assignment.
+ */
+template <typename T>
+class chase_lev_deque {
+ public:
+  explicit chase_lev_deque(size_t initial_capacity = 1024):
+      top(0), bottom(0) {
+    size_t capacity = 2;
+    while(capacity < initial_capacity) capacity *= 2;
+    buffer* a = new buffer(capacity);
+    buffers.push_back(a);
+    array = a;
+  }
+
+  ~chase_lev_deque() {
+    for (size_t i = 0;i < buffers.size(); ++i) delete buffers[i];
+  }
+
+  /// Adds an element to the bottom. Owner only.
+  void push(const T& value) {
+    const int64_t b = bottom;
+    const int64_t t = top;
+    buffer* a = array;
+    if (b - t >= int64_t(a->capacity) - 1) {
+      a = grow(a, b, t);
+    }
+    a->put(b, value);
+    // the element must be visible before the new bottom
+    __sync_synchronize();
+    bottom = b + 1;
+  }
+
+  /// Removes an element from the bottom. Owner only.
+  bool pop(T& ret) {
+    const int64_t b = bottom - 1;
+    buffer* a = array;
+    bottom = b;
+    // the new bottom must be visible before top is read
+    __sync_synchronize();
+    const int64_t t = top;
+    if (t > b) {
+      // empty
+      bottom = b + 1;
+      return false;
+    }
+    ret = a->get(b);
+    if (t < b) return true;
+    // last element. Race against the thieves for it.
+    const bool success = atomic_compare_and_swap(top, t, t + 1);
+    bottom = b + 1;
+    return success;
+  }
+
+  /**
+   * Removes an element from the top. Thread safe. Returns false only if
+   * the deque was observed to be empty.
+   */
+  bool steal(T& ret) {
+    while(1) {
+      const int64_t t = top;
+      __sync_synchronize();
+      const int64_t b = bottom;
+      if (t >= b) return false;
+      buffer* a = array;
+      ret = a->get(t);
+      if (atomic_compare_and_swap(top, t, t + 1)) return true;
+    }
+  }
+
+  /// Approximate number of elements in the deque.
+  size_t size() const {
+    const int64_t n = bottom - top;
+    return n > 0 ? size_t(n) : 0;
+  }
+
+  bool empty() const { return size() == 0; }
+
+ private:
+  struct buffer {
+    size_t capacity;
+    T* data;
+    explicit buffer(size_t capacity):
+        capacity(capacity), data(new T[capacity]) { }
+    ~buffer() { delete [] data; }
+    T get(int64_t i) const { return data[i & (capacity - 1)]; }
+    void put(int64_t i, const T& value) { data[i & (capacity - 1)] = value; }
+  };
+
+  buffer* grow(buffer* a, int64_t b, int64_t t) {
+    buffer* newa = new buffer(a->capacity * 2);
+    for (int64_t i = t; i < b; ++i) newa->put(i, a->get(i));
+    buffers.push_back(newa);
+    __sync_synchronize();
+    array = newa;
+    return newa;
+  }
+
+  volatile int64_t top;
+  char top_padding[64 - sizeof(int64_t)];
+  volatile int64_t bottom;
+  buffer* volatile array;
+  // all buffers ever allocated. Owner only.
+  std::vector<buffer*> buffers;
+
+  // not copyable
+  chase_lev_deque(const chase_lev_deque&);
+  chase_lev_deque& operator=(const chase_lev_deque&);
+};
+
+} // namespace graphlab
+#endif
@@ -24,6 +24,7 @@
 #include <boost/bind.hpp>
 #include <graphlab/util/random.hpp>
 #include <graphlab/parallel/fiber_control.hpp>
+#include <graphlab/parallel/numa.hpp>
 #include <graphlab/logger/assertions.hpp>
 #include <graphlab/rpc/dc.hpp>
 #include <graphlab/macros_def.hpp>
@@ -42,11 +43,17 @@ fiber_control::affinity_type fiber_control::all_affinity() {
   return ret;
 }
 
+size_t fiber_control::worker_cpu(size_t workerid) const {
+  const std::vector<size_t>& cpus = numa::cpus_by_node();
+  return cpus[(affinity_base + workerid) % cpus.size()];
+}
+
 fiber_control::fiber_control(size_t nworkers, 
                              size_t affinity_base)
     :nworkers(nworkers),
     affinity_base(affinity_base),
     stop_workers(false),
+    work_stealing(false),
     flsdeleter(NULL) {
   // initialize the thread local storage keys
   if (!tls_created) {
@@ -61,13 +68,31 @@ fiber_control::fiber_control(size_t nworkers,
     schedule[i].nwaiting = 0;
     schedule[i].affinity_queue = new inplace_lf_queue2<fiber>;
     schedule[i].priority_queue = new inplace_lf_queue2<fiber>;
+    schedule[i].stealable_queue = new inplace_lf_queue2<fiber>;
+    schedule[i].stealable_priority_queue = new inplace_lf_queue2<fiber>;
     schedule[i].popped_affinity_queue = NULL;
     schedule[i].popped_priority_queue = NULL;
+    schedule[i].popped_stealable_queue = NULL;
+    schedule[i].popped_stealable_priority_queue = NULL;
+    schedule[i].idle_usec = 0;
+    schedule[i].nsteals = 0;
+    schedule[i].numa_node = numa::cpu_node(worker_cpu(i));
+  }
+  // steal from workers on the same node first. The order within a node
+  // is rotated so that not all workers go after the same victim.
+  for (size_t i = 0;i < nworkers; ++i) {
+    for (size_t pass = 0; pass < 2; ++pass) {
+      for (size_t j = 1;j < nworkers; ++j) {
+        size_t victim = (i + j) % nworkers;
+        bool same_node = schedule[victim].numa_node == schedule[i].numa_node;
+        if (same_node == (pass == 0)) schedule[i].victims.push_back(victim);
+      }
+    }
   }
   // launch the workers
   for (size_t i = 0;i < nworkers; ++i) {
     workers.launch(boost::bind(&fiber_control::worker_init, this, i), 
-                   affinity_base + i);
+                   worker_cpu(i));
   }
 }
 
@@ -80,6 +105,8 @@ fiber_control::~fiber_control() {
     schedule[i].active_lock.unlock();
     delete schedule[i].affinity_queue;
     delete schedule[i].priority_queue;
+    delete schedule[i].stealable_queue;
+    delete schedule[i].stealable_priority_queue;
   }
   workers.join();
 
@@ -116,12 +143,16 @@ fiber_control::fiber* fiber_control::get_active_fiber() {
 void fiber_control::active_queue_insert_tail(size_t workerid, fiber_control::fiber* value) {
   if (value->scheduleable) {
 //     printf("%ld: Scheduling %ld on %ld\n", get_worker_id(), value->id, workerid);
-    schedule[workerid].affinity_queue->enqueue(value);
+    const bool stealable = is_stealable(value);
+    if (stealable) schedule[workerid].stealable_queue->enqueue(value);
+    else schedule[workerid].affinity_queue->enqueue(value);
     ++schedule[workerid].nwaiting;
     if (schedule[workerid].waiting) {
       schedule[workerid].active_lock.lock();
       schedule[workerid].active_cond.signal();
       schedule[workerid].active_lock.unlock();
+    } else if (work_stealing && stealable) {
+      wake_thief(workerid);
     }
   }
 }
@@ -130,12 +161,16 @@ void fiber_control::active_queue_insert_tail(size_t workerid, fiber_control::fib
 void fiber_control::active_queue_insert_head(size_t workerid, fiber_control::fiber* value) {
   if (value->scheduleable) {
 //     printf("%ld: Scheduling %ld on %ld\n", get_worker_id(), value->id, workerid);
-    schedule[workerid].priority_queue->enqueue(value);
+    const bool stealable = is_stealable(value);
+    if (stealable) schedule[workerid].stealable_priority_queue->enqueue(value);
+    else schedule[workerid].priority_queue->enqueue(value);
     ++schedule[workerid].nwaiting;
     if (schedule[workerid].waiting) {
       schedule[workerid].active_lock.lock();
       schedule[workerid].active_cond.signal();
       schedule[workerid].active_lock.unlock();
+    } else if (work_stealing && stealable) {
+      wake_thief(workerid);
     }
   }
 }
@@ -163,19 +198,66 @@ fiber_control::fiber* fiber_control::try_pop_queue(inplace_lf_queue2<fiber>& lfq
   return ret;
 }
 
-fiber_control::fiber* fiber_control::active_queue_remove(size_t workerid) {
+fiber_control::fiber* fiber_control::active_queue_remove_locked(size_t workerid) {
   fiber_control::fiber* ret = NULL;
   thread_schedule& curts = schedule[workerid];
   ret = try_pop_queue(*curts.priority_queue, curts.popped_priority_queue);
+  if (ret == NULL) {
+    ret = try_pop_queue(*curts.stealable_priority_queue,
+                        curts.popped_stealable_priority_queue);
+  }
   if (ret == NULL) {
     ret = try_pop_queue(*curts.affinity_queue , curts.popped_affinity_queue);
   }
-  if (ret) {
-    // printf("%ld: Running %ld\n", get_worker_id(), ret->id);
+  if (ret == NULL) {
+    ret = try_pop_queue(*curts.stealable_queue, curts.popped_stealable_queue);
   }
   return ret;
 }
 
+fiber_control::fiber* fiber_control::active_queue_remove(size_t workerid) {
+  thread_schedule& curts = schedule[workerid];
+  curts.queue_lock.lock();
+  fiber_control::fiber* ret = active_queue_remove_locked(workerid);
+  curts.queue_lock.unlock();
+  return ret;
+}
+
+fiber_control::fiber* fiber_control::steal_fiber(size_t workerid) {
+  foreach(size_t victim, schedule[workerid].victims) {
+    thread_schedule& vts = schedule[victim];
+    if (vts.stealable_priority_queue->empty() &&
+        vts.popped_stealable_priority_queue == NULL &&
+        vts.stealable_queue->empty() && vts.popped_stealable_queue == NULL) {
+      continue;
+    }
+    if (!vts.queue_lock.try_lock()) continue;
+    fiber* fib = try_pop_queue(*vts.stealable_priority_queue,
+                               vts.popped_stealable_priority_queue);
+    if (fib == NULL) {
+      fib = try_pop_queue(*vts.stealable_queue, vts.popped_stealable_queue);
+    }
+    vts.queue_lock.unlock();
+    if (fib != NULL) {
+      schedule[workerid].nsteals.inc();
+      return fib;
+    }
+  }
+  return NULL;
+}
+
+void fiber_control::wake_thief(size_t workerid) {
+  if (active_workers.value >= nworkers) return;
+  foreach(size_t thief, schedule[workerid].victims) {
+    if (schedule[thief].waiting) {
+      schedule[thief].active_lock.lock();
+      schedule[thief].active_cond.signal();
+      schedule[thief].active_lock.unlock();
+      return;
+    }
+  }
+}
+
 void fiber_control::exit() {
   distributed_control* dc = distributed_control::get_instance();
   if (dc) dc->flush();
@@ -216,6 +298,15 @@ void fiber_control::worker_init(size_t workerid) {
   while(!stop_workers) {
     // get a fiber to run
     fiber* next_fib = t->parent->active_queue_remove(workerid);
+    if (next_fib == NULL && work_stealing) {
+      // stealing may need to wake the victim, so do not hold our lock
+      schedule[workerid].active_lock.unlock();
+      next_fib = steal_fiber(workerid);
+      schedule[workerid].active_lock.lock();
+      // a fiber may have been queued here without a signal while the
+      // lock was released
+      if (next_fib == NULL) next_fib = t->parent->active_queue_remove(workerid);
+    }
     if (next_fib != NULL) {
       // if there is a fiber. yield to it
       schedule[workerid].active_lock.unlock();
@@ -233,7 +324,16 @@ void fiber_control::worker_init(size_t workerid) {
       schedule[workerid].active_lock.lock();
     } else {
       // if there is no fiber. wait.
-      schedule[workerid].active_cond.wait(schedule[workerid].active_lock);
+      timer idle_timer;
+      idle_timer.start();
+      if (work_stealing) {
+        // Producers wake an idle worker when they queue on a busy one,
+        // but may miss us between the failed steal and the wait.
+        schedule[workerid].active_cond.timedwait_ms(schedule[workerid].active_lock, 10);
+      } else {
+        schedule[workerid].active_cond.wait(schedule[workerid].active_lock);
+      }
+      schedule[workerid].idle_usec.inc(uint64_t(idle_timer.current_time() * 1e6));
     }
   }
   schedule[workerid].active_lock.unlock();
@@ -272,7 +372,8 @@ size_t fiber_control::launch(boost::function<void(void)> fn,
   // allocate a stack
   fiber* fib = new fiber;
   fib->parent = this;
-  fib->stack = malloc(stacksize);
+  fib->stack = stack_pool.allocate(stacksize);
+  fib->stacksize = stacksize;
   fib->id = fiber_id_counter.inc();
   foreach(size_t b, affinity) {
     if (b < nworkers) fib->affinity_array.push_back((unsigned char)b);
@@ -404,7 +505,7 @@ void fiber_control::reschedule_fiber(size_t workerid, fiber* fib) {
   } else if (fib->terminate) {
     fib->lock.unlock();
     // previous fiber is dead. destroy it
-    free(fib->stack);
+    stack_pool.release(fib->stack, fib->stacksize);
     //VALGRIND_STACK_DEREGISTER(fib->stack);
     // delete the fiber local storage if any
     if (fib->fls && flsdeleter) flsdeleter(fib->fls);
@@ -474,7 +575,8 @@ bool fiber_control::worker_has_priority_fibers_on_queue() {
   if (t == NULL) return false;
   fiber_control* parentgroup = t->parent;
   size_t workerid = t->workerid;
-  return !parentgroup->schedule[workerid].priority_queue->empty();
+  return !parentgroup->schedule[workerid].priority_queue->empty() ||
+          !parentgroup->schedule[workerid].stealable_priority_queue->empty();
 }
 
 bool fiber_control::worker_has_fibers_on_queue() {
@@ -482,8 +584,9 @@ bool fiber_control::worker_has_fibers_on_queue() {
   if (t == NULL) return false;
   fiber_control* parentgroup = t->parent;
   size_t workerid = t->workerid;
-  return !parentgroup->schedule[workerid].priority_queue->empty() ||
-          !parentgroup->schedule[workerid].affinity_queue->empty();
+  const thread_schedule& ts = parentgroup->schedule[workerid];
+  return !ts.priority_queue->empty() || !ts.affinity_queue->empty() ||
+      !ts.stealable_priority_queue->empty() || !ts.stealable_queue->empty();
 }
 
 size_t fiber_control::get_worker_id() {
@@ -514,6 +617,25 @@ void fiber_control::schedule_tid(size_t tid, bool priority) {
 }
 
 
+std::vector<fiber_control::worker_stats> fiber_control::get_worker_stats() {
+  std::vector<worker_stats> ret(nworkers);
+  for (size_t i = 0;i < nworkers; ++i) {
+    ret[i].idle_time = schedule[i].idle_usec.value / 1e6;
+    ret[i].nsteals = schedule[i].nsteals.value;
+    ret[i].numa_node = schedule[i].numa_node;
+  }
+  return ret;
+}
+
+void fiber_control::reset_worker_stats() {
+  for (size_t i = 0;i < nworkers; ++i) {
+    schedule[i].active_lock.lock();
+    schedule[i].idle_usec = 0;
+    schedule[i].nsteals = 0;
+    schedule[i].active_lock.unlock();
+  }
+}
+
 void fiber_control::set_tls_deleter(void (*deleter)(void*)) {
   flsdeleter = deleter;
 }
@@ -33,6 +33,7 @@
 #include <graphlab/util/inplace_lf_queue2.hpp>
 #include <graphlab/parallel/pthread_tools.hpp>
 #include <graphlab/parallel/atomic.hpp>
+#include <graphlab/parallel/fiber_stack_pool.hpp>
 namespace graphlab {
 
 /**
@@ -44,11 +45,19 @@ class fiber_control {
   typedef fixed_dense_bitset<64> affinity_type;
   static affinity_type all_affinity();
 
+  /// Scheduling statistics of a single worker
+  struct worker_stats {
+    double idle_time;   ///< seconds spent with nothing to run
+    size_t nsteals;     ///< number of fibers stolen from other workers
+    size_t numa_node;   ///< NUMA node of the cpu the worker is bound to
+  };
+
   struct fiber {
     simple_spinlock lock;
     fiber_control* parent;
     boost::context::fcontext_t* context;
     void* stack;
+    size_t stacksize; // usable size of the stack. Rounded to a page
     size_t id;
     affinity_type affinity;
     std::vector<unsigned char> affinity_array;
@@ -86,6 +95,11 @@ class fiber_control {
   conditional join_cond;
 
   bool stop_workers;
+  bool work_stealing;
+
+  // The cpu worker i is bound to. Workers are laid out in NUMA node order
+  // so that consecutive workers share a socket.
+  size_t worker_cpu(size_t workerid) const;
 
   // The scheduler is a simple queue. One for each worker
   struct thread_schedule {
@@ -94,23 +108,55 @@ class fiber_control {
     conditional active_cond;
     volatile bool waiting;
     size_t nwaiting;
+    // Held by whoever is removing fibers from the queues below: the
+    // worker itself, or another worker stealing from it.
+    simple_spinlock queue_lock;
+    // Workers to steal from, same NUMA node first
+    std::vector<size_t> victims;
+    size_t numa_node;
+    // Written by the worker, read by get_worker_stats()
+    atomic<uint64_t> idle_usec;
+    atomic<size_t> nsteals;
     // a queue of fibers to evaluate before those in the thread_queue
     inplace_lf_queue2<fiber>* affinity_queue;
     fiber* popped_affinity_queue;
 
     inplace_lf_queue2<fiber>* priority_queue;
     fiber* popped_priority_queue;
+
+    // Fibers which may run on any worker are kept apart from the pinned
+    // ones above, so that thieves only ever dequeue fibers they can run.
+    inplace_lf_queue2<fiber>* stealable_queue;
+    fiber* popped_stealable_queue;
+
+    inplace_lf_queue2<fiber>* stealable_priority_queue;
+    fiber* popped_stealable_priority_queue;
+    // keep the schedules of neighboring workers on different cache lines
+    char padding[64];
   };
   std::vector<thread_schedule> schedule;
 
   thread_group workers;
 
+  fiber_stack_pool stack_pool;
+
 
   // locks must be acquired outside the call
   void active_queue_insert_head(size_t workerid, fiber* value);
   void active_queue_insert_tail(size_t workerid, fiber* value);
   void active_queue_insert_tail(fiber* value);
   fiber* active_queue_remove(size_t workerid);
+  // pops a fiber from the queues. queue_lock must be held
+  fiber* active_queue_remove_locked(size_t workerid);
+
+  /// True if the fiber may run on every worker
+  inline bool is_stealable(const fiber* fib) const {
+    return fib->affinity_array.size() == nworkers;
+  }
+  /// Takes a fiber from the stealable queues of another worker
+  fiber* steal_fiber(size_t workerid);
+  /// Wakes up an idle worker close to workerid so that it can steal
+  void wake_thief(size_t workerid);
 
   // a thread local storage for the worker to point to a fiber
   static bool tls_created;
@@ -159,6 +205,9 @@ class fiber_control {
   /** the basic launch function
    * Returns a fiber ID. IDs are not sequential.
    * \note The ID is really a pointer to a fiber_control::fiber object.
+   * \note Stacks are only committed as they are touched, so a generous
+   * stacksize only costs memory for the depth each fiber actually uses.
+   * See fiber_stack_pool.
    */
   size_t launch(boost::function<void (void)> fn, 
                 size_t stacksize = 8192, 
@@ -191,6 +240,54 @@ class fiber_control {
   inline size_t total_threads_created() {
     return fiber_id_counter.value;
   }
+  /**
+   * Returns statistics about the fiber stacks, including the peak stack
+   * usage of the terminated fibers that were sampled.
+   */
+  inline fiber_stack_pool::stack_stats get_stack_stats() {
+    return stack_pool.get_stats();
+  }
+
+  /**
+   * Sets the maximum number of bytes of released stacks kept for reuse,
+   * how much of the top of each pooled stack stays committed, and how
+   * often the usage of a released stack is measured (0 to never measure).
+   */
+  inline void set_stack_pool_parameters(size_t max_pooled_bytes,
+                                        size_t retain_bytes,
+                                        size_t usage_sample_interval = 16) {
+    stack_pool.set_max_pooled_bytes(max_pooled_bytes);
+    stack_pool.set_retain_bytes(retain_bytes);
+    stack_pool.set_usage_sample_interval(usage_sample_interval);
+  }
+
+  /**
+   * Enables or disables work stealing. If enabled, an idle worker takes
+   * queued fibers from other workers, preferring workers on the same NUMA
+   * node. Only fibers which may run on every worker are stolen. Disabled
+   * by default, since idle workers then also poll for work every 10ms.
+   */
+  inline void set_work_stealing(bool enabled) {
+    work_stealing = enabled;
+  }
+
+  /**
+   * Returns the scheduling statistics of every worker.
+   */
+  std::vector<worker_stats> get_worker_stats();
+
+  /**
+   * Returns the NUMA node of the cpu a worker is bound to.
+   */
+  inline size_t worker_numa_node(size_t workerid) const {
+    return schedule[workerid].numa_node;
+  }
+
+  /**
+   * Resets the idle time and steal counts of every worker.
+   */
+  void reset_worker_stats();
+
   /**
    * Sets the TLS deletion function. The deletion function will be called
    * on every non-NULL TLS value.
@@ -259,9 +356,10 @@ class fiber_control {
    * \param nworkers Number of worker threads to spawn. If set to 0,
    *                 the number of workers will be automatically determined
    *                 based on the number of cores the system has.
-   * \param affinity_base First worker will have CPU affinity equal to 
-   *                      affinity_base. Second will be affinity_base + 1, etc.
-   *                      Defaults to 0.
+   * \param affinity_base Workers are bound to the cpus listed by
+   *                      numa::cpus_by_node(), starting at position
+   *                      affinity_base, so that consecutive workers share a
+   *                      NUMA node. Defaults to 0.
    */
   static void instance_set_parameters(size_t nworkers,
                                       size_t affinity_base);
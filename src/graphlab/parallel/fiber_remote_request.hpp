@@ -25,6 +25,7 @@
 #define GRAPHLAB_FIBER_RPC_FUTURE_HPP
 #include <graphlab/rpc/request_future.hpp>
 #include <graphlab/rpc/request_reply_handler.hpp>
+#include <graphlab/rpc/request_continuation.hpp>
 #include <graphlab/parallel/fiber_control.hpp>
 #include <graphlab/parallel/pthread_tools.hpp>
 namespace graphlab {
@@ -96,6 +97,71 @@ struct fiber_reply_container: public dc_impl::ireply_container {
 };
 
 
+/**
+ * Combines the replies of a known number of continuation requests with
+ * operator+=, and lets the caller wait until all of them have arrived.
+ * If the caller is a fiber, it is descheduled once for all the replies
+ * rather than once per reply.
+ *
+ * \code
+ * fiber_reply_combiner<int> combiner(nrequests, 0);
+ * for (size_t i = 0;i < nrequests; ++i) {
+ *   continuation_remote_request(target[i], combiner.callback(), fn, ...);
+ * }
+ * int total = combiner.wait();
+ * \endcode
+ *
+ * The combiner must outlive all the requests, i.e. wait() must be called
+ * before it is destroyed.
+ */
+template <typename T>
+class fiber_reply_combiner {
+ private:
+  mutex lock;
+  conditional cond;
+  size_t waiting_tid;
+  size_t remaining;
+  T accum;
+
+ public:
+  fiber_reply_combiner(size_t nreplies, const T& init = T())
+      :waiting_tid(0), remaining(nreplies), accum(init) { }
+
+  /// Adds a reply. Called from the RPC handlers.
+  void receive(procid_t source, T& val) {
+    lock.lock();
+    accum += val;
+    --remaining;
+    if (remaining == 0) {
+      if (waiting_tid) fiber_control::schedule_tid(waiting_tid);
+      else cond.signal();
+    }
+    lock.unlock();
+  }
+
+  /// Returns a callback to pass to a continuation request
+  boost::function<void(procid_t, T&)> callback() {
+    return boost::bind(&fiber_reply_combiner::receive, this, _1, _2);
+  }
+
+  /// Waits for all replies and returns the combined value
+  T& wait() {
+    lock.lock();
+    if (fiber_control::in_fiber()) {
+      waiting_tid = fiber_control::get_tid();
+      while(remaining > 0) {
+        fiber_control::deschedule_self(&lock.m_mut);
+        lock.lock();
+      }
+    } else {
+      while(remaining > 0) cond.wait(lock);
+    }
+    lock.unlock();
+    return accum;
+  }
+};
+
+
 #if DOXYGEN_DOCUMENTATION
 
 
@@ -0,0 +1,219 @@
+/*  
+ * Copyright (c) 2009 Carnegie Mellon University. 
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include <graphlab/parallel/fiber_stack_pool.hpp>
+#include <graphlab/logger/assertions.hpp>
+#include <graphlab/macros_def.hpp>
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+namespace graphlab {
+
+size_t fiber_stack_pool::page_size() {
+  static size_t pagesize = sysconf(_SC_PAGESIZE);
+  return pagesize;
+}
+
+fiber_stack_pool::fiber_stack_pool(size_t max_pooled_bytes,
+                                   size_t retain_bytes,
+                                   size_t usage_sample_interval)
+    :pooled_bytes(0),
+    max_pooled_bytes(max_pooled_bytes),
+    retain_bytes(retain_bytes),
+    usage_sample_interval(usage_sample_interval),
+    num_released(0) {
+  for (size_t i = 0;i < MAX_SIZE_CLASSES; ++i) {
+    pool[i].stacksize = 0;
+    pool[i].count = 0;
+    pool[i].npooled = 0;
+    pool[i].head = NULL;
+  }
+}
+
+fiber_stack_pool::~fiber_stack_pool() {
+  clear();
+}
+
+fiber_stack_pool::size_class*
+fiber_stack_pool::find_class(size_t stacksize, bool create) {
+  size_class* unused = NULL;
+  for (size_t i = 0;i < MAX_SIZE_CLASSES; ++i) {
+    if (pool[i].count > 0) {
+      if (pool[i].stacksize == stacksize) return &pool[i];
+    } else if (unused == NULL) {
+      unused = &pool[i];
+    }
+  }
+  if (!create || unused == NULL) return NULL;
+  unused->stacksize = stacksize;
+  return unused;
+}
+
+void* fiber_stack_pool::allocate(size_t& stacksize) {
+  const size_t pagesize = page_size();
+  stacksize = (std::max<size_t>(stacksize, 1) + pagesize - 1) / pagesize * pagesize;
+  lock.lock();
+  size_class* sc = find_class(stacksize, false);
+  if (sc != NULL && sc->head != NULL) {
+    void* stack = sc->head;
+    sc->head = next_stack(stack, stacksize);
+    --sc->count;
+    --sc->npooled;
+    pooled_bytes -= stacksize;
+    --stats.num_pooled;
+    ++stats.num_reused;
+    lock.unlock();
+    return stack;
+  }
+  ++stats.num_mapped;
+  lock.unlock();
+
+  // one extra page at the bottom for the guard
+  char* base = (char*)mmap(NULL, stacksize + pagesize,
+                           PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                           -1, 0);
+  if (base == MAP_FAILED) {
+    logstream(LOG_FATAL) << "Unable to map a fiber stack of " << stacksize
+                         << " bytes" << std::endl;
+  }
+  if (mprotect(base, pagesize, PROT_NONE) != 0) {
+    logstream(LOG_WARNING) << "Unable to protect fiber stack guard page"
+                           << std::endl;
+  }
+  return base + pagesize;
+}
+
+void fiber_stack_pool::release(void* stack, size_t stacksize) {
+  // decide first whether the stack is pooled, reserving its room, so
+  // that a stack about to be unmapped is not advised
+  size_class* sc = NULL;
+  lock.lock();
+  const bool measure = usage_sample_interval > 0 &&
+      num_released++ % usage_sample_interval == 0;
+  if (pooled_bytes + stacksize <= max_pooled_bytes) {
+    sc = find_class(stacksize, true);
+    if (sc != NULL) {
+      ++sc->count;
+      pooled_bytes += stacksize;
+    }
+  }
+  lock.unlock();
+
+  const size_t usage = measure ? measure_usage(stack, stacksize) : 0;
+  if (sc != NULL) {
+    // give back the pages below the retained top of the stack. The top
+    // page holds the free list link.
+    const size_t pagesize = page_size();
+    const size_t retain =
+        std::max((retain_bytes + pagesize - 1) / pagesize * pagesize, pagesize);
+    if (stacksize > retain && (!measure || usage > retain)) {
+      madvise(stack, stacksize - retain, MADV_DONTNEED);
+    }
+  } else {
+    unmap(stack, stacksize);
+  }
+
+  lock.lock();
+  if (measure) {
+    ++stats.num_measured;
+    stats.total_usage += usage;
+    stats.peak_usage = std::max(stats.peak_usage, usage);
+  }
+  if (sc != NULL) {
+    // the reservation keeps the class from being claimed by another size
+    next_stack(stack, stacksize) = sc->head;
+    sc->head = stack;
+    ++sc->npooled;
+    ++stats.num_pooled;
+  }
+  lock.unlock();
+}
+
+size_t fiber_stack_pool::measure_usage(void* stack, size_t stacksize) {
+  const size_t pagesize = page_size();
+  const size_t npages = stacksize / pagesize;
+  // the stack grows downwards from the top. Find the lowest touched page,
+  // querying a fixed number of pages at a time
+  const size_t CHUNK = 256;
+#ifdef __APPLE__
+  char resident[CHUNK];
+#else
+  unsigned char resident[CHUNK];
+#endif
+  for (size_t first = 0;first < npages; first += CHUNK) {
+    const size_t n = std::min(CHUNK, npages - first);
+    if (mincore((char*)stack + first * pagesize, n * pagesize, resident) != 0) {
+      return 0;
+    }
+    for (size_t i = 0;i < n; ++i) {
+      if (resident[i] & 1) return (npages - first - i) * pagesize;
+    }
+  }
+  return 0;
+}
+
+void fiber_stack_pool::clear() {
+  // stacks being released concurrently keep their reservation
+  size_class stacks[MAX_SIZE_CLASSES];
+  lock.lock();
+  for (size_t i = 0;i < MAX_SIZE_CLASSES; ++i) {
+    stacks[i] = pool[i];
+    pooled_bytes -= pool[i].npooled * pool[i].stacksize;
+    pool[i].count -= pool[i].npooled;
+    pool[i].npooled = 0;
+    pool[i].head = NULL;
+  }
+  stats.num_pooled = 0;
+  lock.unlock();
+  for (size_t i = 0;i < MAX_SIZE_CLASSES; ++i) {
+    void* stack = stacks[i].head;
+    while (stack != NULL) {
+      void* next = next_stack(stack, stacks[i].stacksize);
+      unmap(stack, stacks[i].stacksize);
+      stack = next;
+    }
+  }
+}
+
+fiber_stack_pool::stack_stats fiber_stack_pool::get_stats() {
+  lock.lock();
+  stack_stats ret = stats;
+  lock.unlock();
+  return ret;
+}
+
+void fiber_stack_pool::unmap(void* stack, size_t stacksize) {
+  const size_t pagesize = page_size();
+  munmap((char*)stack - pagesize, stacksize + pagesize);
+}
+
+} // namespace graphlab
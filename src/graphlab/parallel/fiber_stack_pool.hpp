@@ -0,0 +1,140 @@
+/*  
+ * Copyright (c) 2009 Carnegie Mellon University. 
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+#ifndef GRAPHLAB_FIBER_STACK_POOL_HPP
+#define GRAPHLAB_FIBER_STACK_POOL_HPP
+
+#include <stdint.h>
+#include <cstddef>
+#include <graphlab/parallel/pthread_tools.hpp>
+namespace graphlab {
+
+/**
+ * Allocates and recycles fiber stacks.
+ *
+ * Every stack is its own anonymous mapping with an inaccessible guard
+ * page below it, so a stack overflow faults instead of silently
+ * corrupting the neighboring memory. Pages are only committed when the
+ * fiber touches them, so a large stack only costs memory for the depth
+ * actually used.
+ *
+ * Released stacks are kept in a pool (up to max_pooled_bytes) and are
+ * handed out again to the next allocation of the same size. Before a
+ * stack is pooled, everything below its top retain_bytes is returned to
+ * the operating system, so a single deep fiber does not pin memory for
+ * the lifetime of the pool. Stacks that are not pooled are unmapped
+ * right away.
+ *
+ * The pool has one free list for each of at most MAX_SIZE_CLASSES stack
+ * sizes. The lists are linked through the top word of the pooled stacks
+ * themselves, so releasing and reusing a stack never allocates, and the
+ * top page of a pooled stack is always retained. Stacks of further sizes
+ * are not pooled.
+ *
+ * Stack usage is measured on one release out of usage_sample_interval
+ * (never if 0) by finding the lowest resident page of the stack. This is
+ * a page-granular estimate of the peak depth of the fiber, and for reused
+ * stacks it is never less than the retained part.
+ */
+class fiber_stack_pool {
+ public:
+  struct stack_stats {
+    size_t num_mapped;    ///< number of stacks created with mmap
+    size_t num_reused;    ///< number of allocations served from the pool
+    size_t num_pooled;    ///< number of stacks currently in the pool
+    size_t num_measured;  ///< number of released stacks measured
+    size_t peak_usage;    ///< largest stack usage measured, in bytes
+    size_t total_usage;   ///< sum of all stack usages measured, in bytes
+    stack_stats(): num_mapped(0), num_reused(0), num_pooled(0),
+                   num_measured(0), peak_usage(0), total_usage(0) { }
+  };
+
+  enum { MAX_SIZE_CLASSES = 8 };
+
+  fiber_stack_pool(size_t max_pooled_bytes = 256 * 1024 * 1024,
+                   size_t retain_bytes = 16384,
+                   size_t usage_sample_interval = 16);
+
+  /// Unmaps all pooled stacks. Stacks still in use are not freed.
+  ~fiber_stack_pool();
+
+  /**
+   * Returns the lowest address of a stack of at least stacksize bytes.
+   * stacksize is rounded up to a whole number of pages; the rounded size
+   * must be passed to release().
+   */
+  void* allocate(size_t& stacksize);
+
+  /// Returns a stack obtained from allocate() to the pool
+  void release(void* stack, size_t stacksize);
+
+  /// Returns the number of bytes between the top of the stack and the
+  /// lowest resident page.
+  static size_t measure_usage(void* stack, size_t stacksize);
+
+  /// Unmaps all pooled stacks
+  void clear();
+
+  stack_stats get_stats();
+
+  void set_max_pooled_bytes(size_t bytes) { max_pooled_bytes = bytes; }
+  void set_retain_bytes(size_t bytes) { retain_bytes = bytes; }
+  void set_usage_sample_interval(size_t interval) {
+    usage_sample_interval = interval;
+  }
+
+  static size_t page_size();
+
+ private:
+  /// The pooled stacks of one size
+  struct size_class {
+    size_t stacksize;   ///< meaningless if count is 0
+    size_t count;       ///< pooled stacks, and stacks being released
+    size_t npooled;     ///< stacks in the list
+    void* head;         ///< first pooled stack, NULL if none
+  };
+
+  simple_spinlock lock;
+  size_class pool[MAX_SIZE_CLASSES];
+  size_t pooled_bytes;
+  size_t max_pooled_bytes;
+  size_t retain_bytes;
+  size_t usage_sample_interval;
+  size_t num_released;
+  stack_stats stats;
+
+  /// Returns the class of stacksize, claiming an unused one if create is
+  /// set. Returns NULL if there is none. The lock must be held.
+  size_class* find_class(size_t stacksize, bool create);
+
+  /// The word at the top of a pooled stack, pointing to the next one
+  static void*& next_stack(void* stack, size_t stacksize) {
+    return *(reinterpret_cast<void**>((char*)stack + stacksize) - 1);
+  }
+
+  static void unmap(void* stack, size_t stacksize);
+};
+
+} // namespace graphlab
+
+#endif
@@ -0,0 +1,117 @@
+/*  
+ * Copyright (c) 2009 Carnegie Mellon University. 
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+
+#include <dirent.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <cstdio>
+#include <algorithm>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#include <graphlab/parallel/numa.hpp>
+#include <graphlab/parallel/pthread_tools.hpp>
+#include <graphlab/logger/logger.hpp>
+
+// constants of the mbind system call. Defined here so that libnuma's
+// headers are not required.
+#define GRAPHLAB_MPOL_PREFERRED 1
+#define GRAPHLAB_MPOL_MF_MOVE (1 << 1)
+
+namespace graphlab {
+namespace numa {
+
+size_t cpu_node(size_t cpu) {
+  size_t node = 0;
+#ifdef __linux__
+  char path[64];
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%lu", (unsigned long)cpu);
+  DIR* dir = opendir(path);
+  if (dir == NULL) return 0;
+  struct dirent* entry;
+  while((entry = readdir(dir)) != NULL) {
+    unsigned long n;
+    if (sscanf(entry->d_name, "node%lu", &n) == 1) {
+      node = n;
+      break;
+    }
+  }
+  closedir(dir);
+#endif
+  return node;
+}
+
+
+static std::vector<size_t> make_cpus_by_node() {
+  const size_t ncpus = std::max<size_t>(thread::cpu_count(), 1);
+  std::vector<std::pair<size_t, size_t> > node_cpu(ncpus);
+  for (size_t i = 0; i < ncpus; ++i) {
+    node_cpu[i] = std::make_pair(cpu_node(i), i);
+  }
+  std::sort(node_cpu.begin(), node_cpu.end());
+  std::vector<size_t> ret(ncpus);
+  for (size_t i = 0; i < ncpus; ++i) ret[i] = node_cpu[i].second;
+  return ret;
+}
+
+const std::vector<size_t>& cpus_by_node() {
+  static std::vector<size_t> cpus = make_cpus_by_node();
+  return cpus;
+}
+
+size_t num_nodes() {
+  const std::vector<size_t>& cpus = cpus_by_node();
+  size_t n = 0;
+  for (size_t i = 0; i < cpus.size(); ++i) {
+    if (i == 0 || cpu_node(cpus[i]) != cpu_node(cpus[i - 1])) ++n;
+  }
+  return std::max<size_t>(n, 1);
+}
+
+bool place(const void* ptr, size_t bytes, size_t node) {
+#if defined(__linux__) && defined(__NR_mbind)
+  const uintptr_t pagesize = sysconf(_SC_PAGESIZE);
+  uintptr_t begin = reinterpret_cast<uintptr_t>(ptr);
+  uintptr_t end = begin + bytes;
+  begin = (begin + pagesize - 1) & ~(pagesize - 1);
+  end = end & ~(pagesize - 1);
+  if (end <= begin) return true;
+  unsigned long mask[16] = {0};
+  const size_t bits = 8 * sizeof(unsigned long);
+  if (node >= 16 * bits) return false;
+  mask[node / bits] = 1UL << (node % bits);
+  long ret = syscall(__NR_mbind, begin, end - begin, GRAPHLAB_MPOL_PREFERRED,
+                     mask, 16 * bits, GRAPHLAB_MPOL_MF_MOVE);
+  if (ret != 0) {
+    logstream(LOG_DEBUG) << "mbind to node " << node << " failed" << std::endl;
+    return false;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+} // namespace numa
+} // namespace graphlab
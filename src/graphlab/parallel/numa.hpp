@@ -0,0 +1,80 @@
+/*  
+ * Copyright (c) 2009 Carnegie Mellon University. 
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+
+#ifndef GRAPHLAB_NUMA_HPP
+#define GRAPHLAB_NUMA_HPP
+
+#include <vector>
+#include <cstddef>
+
+namespace graphlab {
+
+/**
+ * NUMA topology and memory placement helpers.
+ *
+ * The topology is read from /sys/devices/system/cpu on linux. On other
+ * systems (or if sysfs is not available) every cpu is reported on node 0
+ * and memory placement is a no-op, so callers do not need to special case
+ * single socket machines.
+ */
+namespace numa {
+
+/// Returns the NUMA node of a cpu, or 0 if it cannot be determined.
+size_t cpu_node(size_t cpu);
+
+/// Returns the number of NUMA nodes which have at least one cpu.
+size_t num_nodes();
+
+/**
+ * Returns all cpus ordered by NUMA node, and by cpu id within a node.
+ * Binding thread i to cpus_by_node()[i] places consecutive threads on
+ * the same socket regardless of how the cpus are numbered.
+ */
+const std::vector<size_t>& cpus_by_node();
+
+/**
+ * Migrates the pages fully contained in [ptr, ptr + bytes) to a NUMA
+ * node and makes it the preferred node of the range, so pages faulted in
+ * later are allocated there as well. Pages only partially covered by the
+ * range are left alone.
+ *
+ * \return false if the kernel refused the request (for instance if it
+ * has no NUMA support).
+ */
+bool place(const void* ptr, size_t bytes, size_t node);
+
+/**
+ * Convenience wrapper placing elements [begin, end) of a vector.
+ */
+template <typename T, typename Alloc>
+bool place(const std::vector<T, Alloc>& vec, size_t begin, size_t end,
+           size_t node) {
+  if (end > vec.size()) end = vec.size();
+  if (begin >= end) return true;
+  return place(&vec[begin], (end - begin) * sizeof(T), node);
+}
+
+} // namespace numa
+} // namespace graphlab
+#endif
@@ -23,6 +23,7 @@
 
 
 #include <graphlab/parallel/thread_pool.hpp>
+#include <graphlab/parallel/numa.hpp>
 #include <graphlab/logger/assertions.hpp>
 
 namespace graphlab {
@@ -73,11 +74,13 @@ namespace graphlab {
      Creates the thread group
   */
   void thread_pool::spawn_thread_group() {
-    size_t ncpus = thread::cpu_count();
-    // start all the threads if CPU affinity is set
+    // start all the threads if CPU affinity is set. Threads are bound in
+    // NUMA node order so that consecutive threads share a socket.
+    const std::vector<size_t>& cpus = numa::cpus_by_node();
     for (size_t i = 0;i < pool_size; ++i) {
       if (cpu_affinity) {
-        threads.launch(boost::bind(&thread_pool::wait_for_task, this), i % ncpus);
+        threads.launch(boost::bind(&thread_pool::wait_for_task, this),
+                       cpus[i % cpus.size()]);
       }
       else {
         threads.launch(boost::bind(&thread_pool::wait_for_task, this));
@@ -93,7 +93,8 @@ namespace graphlab {
       
     /* Initializes a thread pool with nthreads. 
      * If affinity is set, the nthreads will by default stripe across 
-     * the available cores on the system. 
+     * the available cores on the system, filling one NUMA node before
+     * moving to the next.
      */
     thread_pool(size_t nthreads = 2, bool affinity = false);
     
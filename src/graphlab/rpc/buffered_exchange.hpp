@@ -24,6 +24,7 @@
 #ifndef GRAPHLAB_BUFFERED_EXCHANGE_HPP
 #define GRAPHLAB_BUFFERED_EXCHANGE_HPP
 
+#include <boost/function.hpp>
 #include <graphlab/parallel/pthread_tools.hpp>
 #include <graphlab/parallel/fiber_control.hpp>
 #include <graphlab/rpc/dc.hpp>
@@ -100,6 +101,9 @@ namespace graphlab {
     // typedef boost::function<void (const T& tref)> handler_type;
     // handler_type recv_handler;
 
+    /** Called by the rpc handler after each received buffer is queued. */
+    boost::function<void()> recv_callback;
+
   public:
     /**
      * Constructs a buffered exchange object.
@@ -273,6 +277,16 @@ namespace graphlab {
 
     void clear() { }
 
+    /**
+     * Sets a function to be called on the receiving rpc thread every time
+     * a buffer arrives. The callback may drain the exchange with recv().
+     * Must not be changed while buffers are in flight, i.e. set it before
+     * any sends and reset it only after a flush().
+     */
+    void set_recv_callback(const boost::function<void()>& callback) {
+      recv_callback = callback;
+    }
+
     void barrier() { rpc.barrier(); }
   private:
     void rpc_recv(size_t len, wild_pointer w) {
@@ -299,6 +313,7 @@ namespace graphlab {
       rec.proc = src_proc;
       rec.buffer.swap(tmp);
       recv_lock.unlock();
+      if (recv_callback) recv_callback();
     } // end of rpc rcv
 
 
@@ -36,6 +36,7 @@
 #include <graphlab/rpc/object_call_issue.hpp>
 #include <graphlab/rpc/object_broadcast_issue.hpp>
 #include <graphlab/rpc/function_ret_type.hpp>
+#include <graphlab/rpc/request_continuation.hpp>
 #include <graphlab/rpc/mem_function_arg_types_def.hpp>
 #include <graphlab/util/charstream.hpp>
 #include <boost/preprocessor.hpp>
@@ -479,6 +480,15 @@ class dc_dist_object : public dc_impl::dc_dist_object_base{
     return reply(); \
   }
 
+#define CONTINUATION_REQUEST_INTERFACE_GENERATOR(Z,N,ARGS) \
+  template<typename C, typename F BOOST_PP_COMMA_IF(N) BOOST_PP_ENUM_PARAMS(N, typename T)> \
+    BOOST_PP_TUPLE_ELEM(2,0,ARGS) (procid_t target, C callback, F remote_function BOOST_PP_COMMA_IF(N) BOOST_PP_ENUM(N,GENARGS ,_) ) {  \
+    ASSERT_LT(target, dc_.senders.size()); \
+    dc_impl::ireply_container* reply = \
+        new dc_impl::continuation_reply_container<__GLRPC_FRESULT>(callback); \
+    custom_remote_request(target, reinterpret_cast<size_t>(reply), BOOST_PP_TUPLE_ELEM(2,1,ARGS), remote_function BOOST_PP_COMMA_IF(N) BOOST_PP_ENUM(N,GENI ,_) ); \
+  }
+
 
   /*
   Generates the interface functions. 3rd argument is a tuple
@@ -487,6 +497,7 @@ class dc_dist_object : public dc_impl::dc_dist_object_base{
  BOOST_PP_REPEAT(6, CUSTOM_REQUEST_INTERFACE_GENERATOR, (void custom_remote_request, dc_impl::object_request_issue) )
  BOOST_PP_REPEAT(6, REQUEST_INTERFACE_GENERATOR, (typename dc_impl::function_ret_type<__GLRPC_FRESULT>::type remote_request, (STANDARD_CALL | FLUSH_PACKET)) )
  BOOST_PP_REPEAT(6, FUTURE_REQUEST_INTERFACE_GENERATOR, (request_future<__GLRPC_FRESULT> future_remote_request, (STANDARD_CALL)) )
+ BOOST_PP_REPEAT(6, CONTINUATION_REQUEST_INTERFACE_GENERATOR, (void continuation_remote_request, (STANDARD_CALL)) )
 
 
 
@@ -495,6 +506,7 @@ class dc_dist_object : public dc_impl::dc_dist_object_base{
   #undef REQUEST_INTERFACE_GENERATOR
   #undef CUSTOM_REQUEST_INTERFACE_GENERATOR
   #undef FUTURE_REQUEST_INTERFACE_GENERATOR
+  #undef CONTINUATION_REQUEST_INTERFACE_GENERATOR
   /* Now generate the interface functions which allow me to call this
   dc_dist_object directly The internal calls are similar to the ones
   above. The only difference is that is that instead of 'obj_id', the
@@ -766,6 +778,57 @@ class dc_dist_object : public dc_impl::dc_dist_object_base{
   request_future<RetVal> future_remote_request(procid_t targetmachine, Fn fn, ...);
 
 
+/**
+ * \brief Performs a nonblocking RPC call to the target machine and passes
+ * the return value to a callback.
+ *
+ * continuation_remote_request() is like future_remote_request(), but
+ * instead of returning a future, it calls callback(source, result) on the
+ * RPC handler which receives the reply. Nothing ever waits on the request,
+ * so a fiber can issue many requests without being descheduled once per
+ * request. If fn returns void, result is a size_t.
+ *
+ * The callback must be short and must not block.
+ *
+ * Example:
+ * \code
+ * class distributed_obj_example {
+ *  graphlab::dc_dist_object<distributed_obj_example> rmi;
+ *   ... initialization and constructor ...
+ *  private:
+ *    graphlab::atomic<int> total;
+ *    int add_one(int i) {
+ *      return i + 1;
+ *    }
+ *    void add_to_total(graphlab::procid_t source, int& result) {
+ *      total.inc(result);
+ *    }
+ *  public:
+ *    void add_one_everywhere(int i) {
+ *      for (graphlab::procid_t p = 0; p < rmi.numprocs(); ++p) {
+ *        rmi.continuation_remote_request(p,
+ *               boost::bind(&distributed_obj_example::add_to_total, this, _1, _2),
+ *               &distributed_obj_example::add_one, i);
+ *      }
+ *    }
+ * }
+ * \endcode
+ *
+ * \see graphlab::continuation_remote_request
+ *      graphlab::fiber_reply_combiner
+ *
+ * \param targetmachine The ID of the machine to run the function on
+ * \param callback A boost::function<void(procid_t, RetVal&)> to call with
+ *                 the result.
+ * \param fn The function to run on the target machine. Must be a pointer to
+ *            member function in the owning object.
+ * \param ... The arguments to send to Fn. Arguments must be serializable.
+ *            and must be castable to the target types.
+ */
+  void continuation_remote_request(procid_t targetmachine, Callback callback,
+                                   Fn fn, ...);
+
+
 
 #endif
 /*****************************************************************************
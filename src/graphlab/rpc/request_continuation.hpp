@@ -0,0 +1,156 @@
+/*  
+ * Copyright (c) 2009 Carnegie Mellon University. 
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+
+#ifndef GRAPHLAB_REQUEST_CONTINUATION_HPP
+#define GRAPHLAB_REQUEST_CONTINUATION_HPP
+#include <boost/function.hpp>
+#include <graphlab/rpc/dc.hpp>
+#include <graphlab/rpc/request_reply_handler.hpp>
+#include <graphlab/rpc/function_ret_type.hpp>
+#include <graphlab/logger/assertions.hpp>
+namespace graphlab {
+
+namespace dc_impl {
+
+/**
+ * \internal
+ * \ingroup rpc
+ * A reply container which, instead of waiting for the reply, passes it to
+ * a callback on the thread which receives it and then deletes itself.
+ * wait() must never be called on it.
+ */
+template <typename T>
+struct continuation_reply_container: public ireply_container {
+  typedef typename function_ret_type<T>::type result_type;
+  boost::function<void(procid_t, result_type&)> callback;
+  blob val;
+
+  continuation_reply_container(
+      const boost::function<void(procid_t, result_type&)>& callback)
+      :callback(callback) { }
+
+  void wait() {
+    ASSERT_MSG(false, "Cannot wait on a continuation request");
+  }
+
+  void receive(procid_t source, blob b) {
+    result_type result;
+    iarchive iarc(b.c, b.len);
+    iarc >> result;
+    b.free();
+    callback(source, result);
+    delete this;
+  }
+
+  bool ready() const {
+    return false;
+  }
+
+  blob& get_blob() {
+    return val;
+  }
+};
+
+} // namespace dc_impl
+
+
+#if DOXYGEN_DOCUMENTATION
+
+/**
+ * \brief Performs a nonblocking RPC call to the target machine and passes
+ * the return value to a callback instead of returning a future.
+ *
+ * continuation_remote_request() calls the function "fn" on a target remote
+ * machine like \ref graphlab::fiber_remote_request, but returns nothing.
+ * When the reply arrives, callback(source, result) is called on the
+ * RPC handler which received it. Since nothing waits on the request, many
+ * requests can be issued without descheduling the calling fiber once
+ * per request. If fn returns void, result is a size_t.
+ *
+ * The callback runs on an RPC handler and should therefore be short and
+ * must not block. To do more work, the callback can wake a waiting fiber
+ * (see \ref graphlab::fiber_reply_combiner) or launch a new one.
+ *
+ * Example:
+ * \code
+ * void print_reply(procid_t source, int& result) {
+ *   std::cout << source << " replied " << result << "\n";
+ * }
+ *
+ * int add_one(int i) {
+ *   return i + 1;
+ * }
+ *
+ * ... ...
+ * continuation_remote_request(1, print_reply, add_one, 10);
+ * // returns immediately. print_reply will be called with 11
+ * \endcode
+ *
+ * \see graphlab::dc_dist_object::continuation_remote_request
+ *      graphlab::fiber_reply_combiner
+ *
+ * \param targetmachine The ID of the machine to run the function on
+ * \param callback A boost::function<void(procid_t, RetVal&)> to call with
+ *                 the result.
+ * \param fn The function to run on the target machine.
+ * \param ... The arguments to send to Fn. Arguments must be serializable.
+ *            and must be castable to the target types.
+ */
+  void continuation_remote_request(procid_t targetmachine, Callback callback,
+                                   Fn fn, ...);
+
+
+#endif
+
+
+#include <boost/preprocessor.hpp>
+#include <graphlab/rpc/function_arg_types_def.hpp>
+
+#define GENARGS(Z,N,_)  BOOST_PP_CAT(T, N) BOOST_PP_CAT(i, N)
+#define GENI(Z,N,_) BOOST_PP_CAT(i, N)
+
+#define REQUEST_INTERFACE_GENERATOR(Z,N,ARGS) \
+template<typename C, typename F BOOST_PP_COMMA_IF(N) BOOST_PP_ENUM_PARAMS(N, typename T)> \
+  BOOST_PP_TUPLE_ELEM(1,0,ARGS) (procid_t target, \
+                                 C callback, \
+                                 F remote_function BOOST_PP_COMMA_IF(N) \
+                                 BOOST_PP_ENUM(N,GENARGS ,_) ) {  \
+  dc_impl::ireply_container* reply = \
+      new dc_impl::continuation_reply_container<__GLRPC_FRESULT>(callback); \
+  distributed_control* dc = distributed_control::get_instance(); \
+  ASSERT_TRUE(dc != NULL); \
+  dc->custom_remote_request(target, reinterpret_cast<size_t>(reply), STANDARD_CALL, remote_function BOOST_PP_COMMA_IF(N) BOOST_PP_ENUM(N,GENI ,_) ); \
+} 
+
+BOOST_PP_REPEAT(7, REQUEST_INTERFACE_GENERATOR, (void continuation_remote_request) )
+
+#include <graphlab/rpc/function_arg_types_undef.hpp>
+
+#undef REQUEST_INTERFACE_GENERATOR
+#undef GENI
+#undef GENARGS
+
+} // namespace graphlab
+
+#endif
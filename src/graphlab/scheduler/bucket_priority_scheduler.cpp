@@ -0,0 +1,137 @@
+/*  
+ * Copyright (c) 2009 Carnegie Mellon University. 
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+
+#include <cmath>
+#include <graphlab/scheduler/bucket_priority_scheduler.hpp>
+#include <graphlab/macros_def.hpp>
+namespace graphlab {
+
+void bucket_priority_scheduler::set_options(const graphlab_options& opts) {
+  ncpus = opts.get_ncpus();
+  std::vector<std::string> keys = opts.get_scheduler_args().get_option_keys();
+  foreach(std::string opt, keys) {
+    if (opt == "delta") {
+      opts.get_scheduler_args().get_option("delta", delta);
+    } else if (opt == "nbuckets") {
+      opts.get_scheduler_args().get_option("nbuckets", nbuckets);
+    }  else {
+      logstream(LOG_FATAL) << "Unexpected Scheduler Option: " << opt << std::endl;
+    }
+  }
+  ASSERT_GT(delta, 0);
+  ASSERT_GE(nbuckets, 1);
+}
+
+// Initializes the internal datastructures
+void bucket_priority_scheduler::initialize_data_structures() {
+  nshards = ncpus;
+  shards.resize(nbuckets * nshards);
+  bucket_size.resize(nbuckets, atomic<size_t>(0));
+  vertex_is_scheduled.resize(num_vertices);
+}
+
+bucket_priority_scheduler::bucket_priority_scheduler(size_t num_vertices,
+                                                     const graphlab_options& opts):
+    base(0), nbuckets(1024), delta(1.0), num_vertices(num_vertices) { 
+  ASSERT_GE(opts.get_ncpus(), 1);
+  set_options(opts);
+  initialize_data_structures();
+}
+
+
+void bucket_priority_scheduler::set_num_vertices(const lvid_type numv) {
+  num_vertices = numv;
+  vertex_is_scheduled.resize(numv);
+}
+
+void bucket_priority_scheduler::schedule(const lvid_type vid, double priority) {
+  if (vid < num_vertices && !vertex_is_scheduled.set_bit(vid)) {
+    // clamp the bucket to the current window. If the window moves
+    // concurrently the task may land in a later bucket, which only relaxes
+    // the order further.
+    const int64_t window_start = base.value;
+    const double b = std::floor(-priority / delta);
+    int64_t bucket = window_start;
+    if (b >= double(window_start + nbuckets - 1)) {
+      bucket = window_start + nbuckets - 1;
+    } else if (b > double(window_start)) {
+      bucket = int64_t(b);
+    }
+    const size_t slot = size_t(bucket % int64_t(nbuckets) + nbuckets) % nbuckets;
+    const size_t shard = random::fast_uniform(size_t(0), nshards - 1);
+    shard_type& s = shards[slot * nshards + shard];
+    s.lock.lock();
+    s.tasks.push_back(vid);
+    s.lock.unlock();
+    bucket_size[slot].inc();
+  }
+}
+
+
+bool bucket_priority_scheduler::pop_bucket(size_t slot, size_t shard,
+                                           lvid_type& ret_vid) {
+  for (size_t i = 0; i < nshards; ++i) {
+    shard_type& s = shards[slot * nshards + (shard + i) % nshards];
+    if (s.tasks.empty()) continue;
+    bool good = false;
+    s.lock.lock();
+    while(!good && !s.tasks.empty()) {
+      ret_vid = s.tasks.back();
+      s.tasks.pop_back();
+      bucket_size[slot].dec();
+      good = ret_vid < num_vertices && vertex_is_scheduled.clear_bit(ret_vid);
+    }
+    s.lock.unlock();
+    if (good) return true;
+  }
+  return false;
+}
+
+
+/** Get the next element in the queue */
+sched_status::status_enum 
+bucket_priority_scheduler::get_next(const size_t cpuid,
+                                    lvid_type& ret_vid) {
+  const int64_t window_start = base.value;
+  const size_t shard = cpuid % nshards;
+  for (size_t i = 0; i < nbuckets; ++i) {
+    const int64_t bucket = window_start + i;
+    const size_t slot = size_t(bucket % int64_t(nbuckets) + nbuckets) % nbuckets;
+    if (bucket_size[slot].value == 0) continue;
+    // all the buckets before this one were empty: advance the window
+    if (i > 0) atomic_compare_and_swap(base.value, window_start, bucket);
+    if (pop_bucket(slot, shard, ret_vid)) return sched_status::NEW_TASK;
+  }
+  return sched_status::EMPTY;     
+} // end of get_next_task
+
+
+bool bucket_priority_scheduler::empty() {
+  for (size_t i = 0;i < nbuckets; ++i) {
+    if (bucket_size[i].value > 0) return false;
+  }
+  return true;
+}
+
+}
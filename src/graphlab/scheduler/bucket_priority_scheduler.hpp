@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2009 Carnegie Mellon University.
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+
+#ifndef GRAPHLAB_BUCKET_PRIORITY_SCHEDULER_HPP
+#define GRAPHLAB_BUCKET_PRIORITY_SCHEDULER_HPP
+
+#include <vector>
+
+#include <graphlab/graph/graph_basic_types.hpp>
+#include <graphlab/parallel/pthread_tools.hpp>
+#include <graphlab/parallel/atomic.hpp>
+#include <graphlab/parallel/atomic_ops.hpp>
+
+#include <graphlab/util/random.hpp>
+#include <graphlab/scheduler/ischeduler.hpp>
+#include <graphlab/util/dense_bitset.hpp>
+
+#include <graphlab/options/graphlab_options.hpp>
+
+#include <graphlab/macros_def.hpp>
+namespace graphlab {
+
+  /**
+   * \ingroup group_schedulers 
+   *
+   * A delta-stepping style bucketed priority scheduler, suited to
+   * priorities which are negated costs such as the tentative distance
+   * in shortest paths. A task with priority p is placed in bucket
+   * floor(-p / delta), and buckets are processed in increasing order.
+   * There is no order within a bucket.
+   *
+   * Only a window of "nbuckets" buckets is kept, starting at the lowest
+   * non-empty bucket. Tasks beyond the end of the window are placed in its
+   * last bucket and tasks before its start in its first bucket. Each
+   * bucket is split into ncpus shards so that threads scheduling into the
+   * same bucket rarely contend.
+   *
+   * Scheduling a vertex which is already scheduled does not change its
+   * priority.
+   */
+  class bucket_priority_scheduler : public ischeduler {
+  
+  private:
+    struct shard_type {
+      simple_spinlock lock;
+      std::vector<lvid_type> tasks;
+      char padding[64];
+    };
+
+    // a bitset denoting if a vertex is scheduled
+    dense_bitset vertex_is_scheduled;
+    // shards[bucket * nshards + shard]
+    std::vector<shard_type> shards;
+    // number of tasks in each bucket
+    std::vector<atomic<size_t> > bucket_size;
+    // the bucket index at the start of the window
+    atomic<int64_t> base;
+
+    // the number of CPUs
+    size_t ncpus;
+    size_t nshards;
+    size_t nbuckets;
+    double delta;
+    // the number of vertices in the graph
+    size_t num_vertices;
+  
+    void set_options(const graphlab_options& opts);
+
+    // Initializes the internal datastructures
+    void initialize_data_structures();
+
+    // Pops a task from a bucket starting at the given shard
+    bool pop_bucket(size_t bucket, size_t shard, lvid_type& ret_vid);
+
+  public:
+
+    bucket_priority_scheduler(size_t num_vertices, 
+                              const graphlab_options& opts);
+
+    void set_num_vertices(const lvid_type numv);
+
+    void schedule(const lvid_type vid, double priority = 1);
+
+    /** Get the next element in the queue */
+    sched_status::status_enum get_next(const size_t cpuid,
+                                       lvid_type& ret_vid);
+
+    bool empty();
+
+    static void print_options_help(std::ostream& out) {
+      out << "\t delta = [double, width of a bucket. Default = 1].\n"
+          << "\t nbuckets = [number of buckets in the window. Default = 1024]\n";
+    }
+
+  }; 
+
+
+} // end of namespace graphlab
+#include <graphlab/macros_undef.hpp>
+
+#endif
+
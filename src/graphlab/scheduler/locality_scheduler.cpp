@@ -0,0 +1,160 @@
+/*  
+ * Copyright (c) 2009 Carnegie Mellon University. 
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+
+#include <graphlab/scheduler/locality_scheduler.hpp>
+#include <graphlab/parallel/atomic_ops.hpp>
+#include <graphlab/macros_def.hpp>
+
+namespace graphlab {
+
+void locality_scheduler::set_options(const graphlab_options& opts) {
+  std::vector<std::string> keys = opts.get_scheduler_args().get_option_keys();
+  bool has_block_tasks = false;
+  foreach(std::string opt, keys) {
+    if (opt == "block_size") {
+      opts.get_scheduler_args().get_option("block_size", block_size);
+    } else if (opt == "block_tasks") {
+      opts.get_scheduler_args().get_option("block_tasks", block_tasks);
+      has_block_tasks = true;
+    } else {
+      logstream(LOG_FATAL) << "Unexpected Scheduler Option: " << opt << std::endl;
+    }
+  }
+  ASSERT_GE(block_size, 1);
+  if (!has_block_tasks) block_tasks = block_size;
+  ASSERT_GE(block_tasks, 1);
+}
+
+void locality_scheduler::initialize_data_structures() {
+  cpus.resize(ncpus);
+  set_num_vertices(num_vertices);
+}
+
+locality_scheduler::locality_scheduler(size_t num_vertices,
+                                       const graphlab_options& opts) :
+    ncpus(opts.get_ncpus()),
+    num_vertices(num_vertices),
+    block_size(1024), block_tasks(1024), nblocks(0) {
+      ASSERT_GE(opts.get_ncpus(), 1);
+      set_options(opts);
+      initialize_data_structures();
+    }
+
+void locality_scheduler::set_num_vertices(const lvid_type numv) {
+  num_vertices = numv;
+  vertex_is_scheduled.resize(numv);
+  nblocks = (num_vertices + block_size - 1) / block_size;
+  block_count.resize(nblocks, atomic<int64_t>(0));
+  block_claimed.resize(nblocks, atomic<int>(0));
+}
+
+void locality_scheduler::schedule(const lvid_type vid, double priority) {
+  if (vid < num_vertices && !vertex_is_scheduled.set_bit(vid)) {
+    block_count[vid / block_size].inc();
+  } 
+} // end of schedule
+
+bool locality_scheduler::take_in_range(size_t begin, size_t end,
+                                       lvid_type& ret_vid) {
+  size_t b = begin;
+  while (b < end) {
+    const size_t word = vertex_is_scheduled.containing_word(b) >> (b % 64);
+    if (word == 0) {
+      b = (b / 64 + 1) * 64;
+      continue;
+    }
+    b += __builtin_ctzl(word);
+    if (b >= end) break;
+    if (vertex_is_scheduled.clear_bit(b)) {
+      ret_vid = b;
+      return true;
+    }
+    ++b;
+  }
+  return false;
+}
+
+bool locality_scheduler::take_from_block(cpu_state& state, lvid_type& ret_vid) {
+  const size_t begin = state.block * block_size;
+  const size_t end = std::min(begin + block_size, num_vertices);
+  if (block_count[state.block].value <= 0) return false;
+  if (take_in_range(state.pos, end, ret_vid) ||
+      take_in_range(begin, state.pos, ret_vid)) {
+    block_count[state.block].dec();
+    state.pos = ret_vid + 1;
+    ++state.ntasks;
+    return true;
+  }
+  return false;
+}
+
+sched_status::status_enum 
+locality_scheduler::get_next(const size_t cpuid, lvid_type& ret_vid) {
+  cpu_state& state = cpus[cpuid];
+  sched_status::status_enum ret = sched_status::EMPTY;
+  state.lock.lock();
+  if (state.has_block) {
+    if (state.ntasks < block_tasks && take_from_block(state, ret_vid)) {
+      state.lock.unlock();
+      return sched_status::NEW_TASK;
+    }
+    release(state);
+  }
+  // home range of this cpu
+  const size_t home_begin = cpuid * nblocks / ncpus;
+  const size_t home_end = (cpuid + 1) * nblocks / ncpus;
+  const size_t home_len = home_end - home_begin;
+  // look through the home range starting after the last block visited,
+  // then steal from the other cpus starting at the next home range.
+  size_t start = state.ntasks > 0 ? state.block + 1 : home_begin;
+  if (start < home_begin || start >= home_end) start = home_begin;
+  for (size_t i = 0; i < nblocks; ++i) {
+    size_t b;
+    if (i < home_len) b = home_begin + (start - home_begin + i) % home_len;
+    else b = (home_end + i - home_len) % nblocks;
+    if (block_count[b].value > 0 && try_claim(b)) {
+      state.has_block = true;
+      state.block = b;
+      state.pos = b * block_size;
+      state.ntasks = 0;
+      if (take_from_block(state, ret_vid)) {
+        ret = sched_status::NEW_TASK;
+        break;
+      }
+      release(state);
+    }
+  }
+  state.lock.unlock();
+  return ret;
+} // end of get_next_task
+
+
+bool locality_scheduler::empty() {
+  for (size_t i = 0;i < block_count.size(); ++i) {
+    if (block_count[i].value > 0) return false;
+  }
+  return true;
+}
+
+} // namespace graphlab
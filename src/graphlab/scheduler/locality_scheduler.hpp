@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2009 Carnegie Mellon University.
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+
+#ifndef GRAPHLAB_LOCALITY_SCHEDULER_HPP
+#define GRAPHLAB_LOCALITY_SCHEDULER_HPP
+
+#include <vector>
+
+#include <graphlab/graph/graph_basic_types.hpp>
+#include <graphlab/parallel/pthread_tools.hpp>
+#include <graphlab/parallel/atomic.hpp>
+#include <graphlab/util/dense_bitset.hpp>
+#include <graphlab/scheduler/ischeduler.hpp>
+#include <graphlab/options/graphlab_options.hpp>
+
+#include <graphlab/macros_def.hpp>
+namespace graphlab {
+
+  /**
+   * \ingroup group_schedulers
+   *
+   * A scheduler which groups ready vertices by graph locality. The local
+   * vertex ids are split into contiguous blocks, and each cpu is the home
+   * of a contiguous range of blocks. Since the local graph stores vertices
+   * and edges in lvid order, consecutive updates from one block touch
+   * neighbouring vertex data, edge data and locks.
+   *
+   * A cpu claims a block with scheduled vertices and runs them in
+   * ascending lvid order, wrapping around to pick up vertices
+   * rescheduled behind it. Once the block is drained, or after
+   * "block_tasks" updates, the block is released and the cpu moves to the
+   * next block of its home range. A cpu with no work in its home range
+   * steals blocks from the other cpus.
+   *
+   * "block_tasks" bounds staleness: a scheduled vertex waits for at most
+   * one visit of every other busy block in its home range.
+   * Priorities are ignored.
+   */
+  class locality_scheduler: public ischeduler {
+  private:
+    struct cpu_state {
+      simple_spinlock lock;
+      bool has_block;
+      size_t block;
+      // next lvid to look at in the current block
+      size_t pos;
+      // updates taken from the current block in this visit
+      size_t ntasks;
+      char padding[64];
+      cpu_state(): has_block(false), block(0), pos(0), ntasks(0) { }
+      // the lock is not copied
+      cpu_state(const cpu_state& other):
+          has_block(other.has_block), block(other.block), pos(other.pos),
+          ntasks(other.ntasks) { }
+    };
+
+    size_t ncpus;
+    size_t num_vertices;
+    size_t block_size;
+    size_t block_tasks;
+    size_t nblocks;
+
+    dense_bitset vertex_is_scheduled;
+    // number of scheduled vertices in each block. May briefly drop below
+    // zero since a vertex can be popped before the count is incremented.
+    std::vector<atomic<int64_t> > block_count;
+    // 1 if a cpu is currently running the block
+    std::vector<atomic<int> > block_claimed;
+    std::vector<cpu_state> cpus;
+
+    void set_options(const graphlab_options& opts);
+    void initialize_data_structures();
+
+    bool try_claim(size_t block) {
+      return block_claimed[block].value == 0 &&
+          atomic_compare_and_swap(block_claimed[block].value, 0, 1);
+    }
+
+    void release(cpu_state& state) {
+      block_claimed[state.block].value = 0;
+      state.has_block = false;
+    }
+
+    // Finds and clears the first scheduled vertex in [begin, end)
+    bool take_in_range(size_t begin, size_t end, lvid_type& ret_vid);
+
+    // Takes the next scheduled vertex of the block claimed by the cpu
+    bool take_from_block(cpu_state& state, lvid_type& ret_vid);
+
+  public:
+    locality_scheduler(size_t num_vertices,
+                       const graphlab_options& opts); 
+
+    void set_num_vertices(const lvid_type numv);
+
+    void schedule(const lvid_type vid, double priority = 1 /* ignored */);
+
+    sched_status::status_enum get_next(const size_t cpuid,
+                                       lvid_type& ret_vid);
+
+    bool empty();
+
+    /**
+     * Print a help string describing the options that this scheduler
+     * accepts.
+     */
+    static void print_options_help(std::ostream& out) {
+      out << "\t block_size = [integer, number of consecutive vertices "
+          << "in a block. Default = 1024].\n"
+          << "\t block_tasks = [integer, maximum number of updates taken "
+          << "from a block before moving to the next one. Smaller values "
+          << "bound staleness, larger values improve locality. "
+          << "Default = block_size].\n";
+    }
+  };
+
+
+} // end of namespace graphlab
+#include <graphlab/macros_undef.hpp>
+
+#endif
+
@@ -0,0 +1,140 @@
+/*  
+ * Copyright (c) 2009 Carnegie Mellon University. 
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+
+#include <graphlab/scheduler/multiqueue_priority_scheduler.hpp>
+#include <graphlab/macros_def.hpp>
+namespace graphlab {
+
+// an empty queue has a top priority below any valid min_priority
+multiqueue_priority_scheduler::sub_queue::sub_queue() :
+    top(-std::numeric_limits<double>::infinity()) { }
+
+void multiqueue_priority_scheduler::set_options(const graphlab_options& opts) {
+  ncpus = opts.get_ncpus();
+  std::vector<std::string> keys = opts.get_scheduler_args().get_option_keys();
+  foreach(std::string opt, keys) {
+    if (opt == "multi") {
+      opts.get_scheduler_args().get_option("multi", multi);
+    } else if (opt == "min_priority") {
+      opts.get_scheduler_args().get_option("min_priority", min_priority);
+    }  else {
+      logstream(LOG_FATAL) << "Unexpected Scheduler Option: " << opt << std::endl;
+    }
+  }
+}
+
+// Initializes the internal datastructures
+void multiqueue_priority_scheduler::initialize_data_structures() {
+  size_t nqueues = std::max(multi * ncpus, size_t(2));
+  queues.resize(nqueues);
+  vertex_is_scheduled.resize(num_vertices);
+}
+
+multiqueue_priority_scheduler::
+multiqueue_priority_scheduler(size_t num_vertices,
+                              const graphlab_options& opts):
+    multi(2), 
+    min_priority(-std::numeric_limits<double>::max()),
+    num_vertices(num_vertices) { 
+  ASSERT_GE(opts.get_ncpus(), 1);
+  set_options(opts);
+  initialize_data_structures();
+}
+
+
+void multiqueue_priority_scheduler::set_num_vertices(const lvid_type numv) {
+  num_vertices = numv;
+  vertex_is_scheduled.resize(numv);
+}
+
+void multiqueue_priority_scheduler::schedule(const lvid_type vid, 
+                                             double priority) {
+  if (vid < num_vertices && !vertex_is_scheduled.set_bit(vid)) {
+    // insert into a random queue, moving on if it is locked
+    size_t idx = random::fast_uniform(size_t(0), queues.size() - 1);
+    while(!queues[idx].lock.try_lock()) {
+      idx = random::fast_uniform(size_t(0), queues.size() - 1);
+    }
+    sub_queue& q = queues[idx];
+    q.heap.push_back(entry_type(priority, vid));
+    std::push_heap(q.heap.begin(), q.heap.end());
+    q.top = q.heap.front().first;
+    q.lock.unlock();
+  }
+}
+
+
+bool multiqueue_priority_scheduler::pop_locked(size_t idx, 
+                                               lvid_type& ret_vid) {
+  sub_queue& q = queues[idx];
+  bool good = false;
+  while(!good && !q.heap.empty() && q.heap.front().first >= min_priority) {
+    std::pop_heap(q.heap.begin(), q.heap.end());
+    ret_vid = q.heap.back().second;
+    q.heap.pop_back();
+    good = ret_vid < num_vertices && vertex_is_scheduled.clear_bit(ret_vid);
+  }
+  q.top = q.heap.empty() ? -std::numeric_limits<double>::infinity() 
+                         : q.heap.front().first;
+  return good;
+}
+
+
+/** Get the next element in the queue */
+sched_status::status_enum 
+multiqueue_priority_scheduler::get_next(const size_t cpuid,
+                                        lvid_type& ret_vid) {
+  // Two choice pops. Give up after a few rounds without finding a
+  // non-empty queue and fall back to a full scan so that EMPTY is only
+  // returned when every queue is empty.
+  const size_t nqueues = queues.size();
+  for (size_t round = 0; round < nqueues; ++round) {
+    const size_t r1 = random::fast_uniform(size_t(0), nqueues - 1);
+    const size_t r2 = random::fast_uniform(size_t(0), nqueues - 1);
+    const size_t idx = (queues[r1].top >= queues[r2].top) ? r1 : r2;
+    if (queues[idx].top < min_priority) continue;
+    if (!queues[idx].lock.try_lock()) continue;
+    const bool good = pop_locked(idx, ret_vid);
+    queues[idx].lock.unlock();
+    if (good) return sched_status::NEW_TASK;
+  }
+  for (size_t i = 0; i < nqueues; ++i) {
+    const size_t idx = (cpuid + i) % nqueues;
+    queues[idx].lock.lock();
+    const bool good = pop_locked(idx, ret_vid);
+    queues[idx].lock.unlock();
+    if (good) return sched_status::NEW_TASK;
+  }
+  return sched_status::EMPTY;     
+} // end of get_next_task
+
+
+bool multiqueue_priority_scheduler::empty() {
+  for (size_t i = 0;i < queues.size(); ++i) {
+    if (queues[i].top >= min_priority) return false;
+  }
+  return true;
+}
+
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2009 Carnegie Mellon University.
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+
+#ifndef GRAPHLAB_MULTIQUEUE_PRIORITY_SCHEDULER_HPP
+#define GRAPHLAB_MULTIQUEUE_PRIORITY_SCHEDULER_HPP
+
+#include <algorithm>
+#include <vector>
+
+#include <graphlab/graph/graph_basic_types.hpp>
+#include <graphlab/parallel/pthread_tools.hpp>
+
+#include <graphlab/util/random.hpp>
+#include <graphlab/scheduler/ischeduler.hpp>
+#include <graphlab/util/dense_bitset.hpp>
+
+#include <graphlab/options/graphlab_options.hpp>
+
+#include <graphlab/macros_def.hpp>
+namespace graphlab {
+
+  /**
+   * \ingroup group_schedulers 
+   *
+   * A relaxed concurrent priority scheduler (MultiQueue). Tasks are
+   * inserted into one of multi * ncpus binary heaps chosen at random.
+   * get_next() samples two heaps, compares their cached top priorities
+   * without locking, and pops from the better one. Heaps which are locked
+   * by another thread are skipped instead of waited on, so threads
+   * rarely contend. The order in which tasks are returned only
+   * approximates the global priority order.
+   *
+   * Like the priority scheduler, scheduling a vertex which is already
+   * scheduled does not change its priority.
+   */
+  class multiqueue_priority_scheduler : public ischeduler {
+  
+  private:
+    typedef std::pair<double, lvid_type> entry_type;
+
+    struct sub_queue {
+      simple_spinlock lock;
+      // priority of the top of the heap. Read without the lock.
+      volatile double top;
+      std::vector<entry_type> heap;
+      // keep neighboring queues on different cache lines
+      char padding[64];
+      sub_queue();
+    };
+
+    // a bitset denoting if a vertex is scheduled
+    dense_bitset vertex_is_scheduled;
+    std::vector<sub_queue> queues;
+
+    // the number of CPUs
+    size_t ncpus;
+    // The queue to CPU ratio
+    size_t multi;
+    double min_priority; 
+    // the number of vertices in the graph
+    size_t num_vertices;
+  
+    void set_options(const graphlab_options& opts);
+
+    // Initializes the internal datastructures
+    void initialize_data_structures();
+
+    // Pops the top of queue idx if its priority is at least min_priority.
+    // Lock must be held.
+    bool pop_locked(size_t idx, lvid_type& ret_vid);
+
+  public:
+
+    multiqueue_priority_scheduler(size_t num_vertices, 
+                                  const graphlab_options& opts);
+
+    void set_num_vertices(const lvid_type numv);
+
+    void schedule(const lvid_type vid, double priority = 1);
+
+    /** Get the next element in the queue */
+    sched_status::status_enum get_next(const size_t cpuid,
+                                       lvid_type& ret_vid);
+
+    bool empty();
+
+    static void print_options_help(std::ostream& out) {
+      out << "\t multi = [number of queues per thread. Default = 2].\n"
+          << "min_priority = [double, minimum priority required to receive \n"
+          << "\t a message, default = -inf]\n";
+    }
+
+  }; 
+
+
+} // end of namespace graphlab
+#include <graphlab/macros_undef.hpp>
+
+#endif
+
@@ -27,6 +27,10 @@
 #include <graphlab/scheduler/ischeduler.hpp>
  #include <graphlab/scheduler/priority_scheduler.hpp>
 #include <graphlab/scheduler/queued_fifo_scheduler.hpp>
+#include <graphlab/scheduler/multiqueue_priority_scheduler.hpp>
+#include <graphlab/scheduler/bucket_priority_scheduler.hpp>
+#include <graphlab/scheduler/work_stealing_scheduler.hpp>
+#include <graphlab/scheduler/locality_scheduler.hpp>
 #include <graphlab/scheduler/scheduler_factory.hpp>
 #include <graphlab/scheduler/scheduler_list.hpp>
 #include <graphlab/scheduler/sweep_scheduler.hpp>
@@ -43,12 +43,33 @@
     "This scheduler maintains a shared FIFO queue of FIFO queues. "     \
     "Each thread maintains its own smaller in and out queues. When a "  \
     "threads out queue is too large (greater than \"queuesize\") then " \
-    "the thread puts its out queue at the end of the master queue."))   
+    "the thread puts its out queue at the end of the master queue."))   \
+  (("multiqueue", multiqueue_priority_scheduler,                        \
+    "Relaxed concurrent priority scheduler. Tasks are spread over many "\
+    "priority queues and each pop takes the better top of two randomly "\
+    "chosen queues. Scales much better than \"priority\" but only "     \
+    "approximates the priority order."))                                \
+  (("bucket", bucket_priority_scheduler,                                \
+    "Delta-stepping bucketed priority scheduler for priorities which "  \
+    "are negated costs (e.g. shortest path distances). Tasks in the "   \
+    "lowest bucket run first, in no particular order."))               \
+  (("work_stealing", work_stealing_scheduler,                           \
+    "Each fiber worker owns a lock free deque holding the tasks it "    \
+    "scheduled, and steals from the other workers when its own deque "  \
+    "is empty. Avoids the shared master queue of \"queued_fifo\"."))  \
+  (("locality", locality_scheduler,                                     \
+    "Groups scheduled vertices into blocks of consecutive local ids. "  \
+    "Each cpu drains one block at a time in id order for better cache " \
+    "reuse. Priorities are ignored."))
 
 #include <graphlab/scheduler/fifo_scheduler.hpp>
 #include <graphlab/scheduler/sweep_scheduler.hpp>
 #include <graphlab/scheduler/priority_scheduler.hpp>
 #include <graphlab/scheduler/queued_fifo_scheduler.hpp>
+#include <graphlab/scheduler/multiqueue_priority_scheduler.hpp>
+#include <graphlab/scheduler/bucket_priority_scheduler.hpp>
+#include <graphlab/scheduler/work_stealing_scheduler.hpp>
+#include <graphlab/scheduler/locality_scheduler.hpp>
 
 
 namespace graphlab {
@@ -0,0 +1,139 @@
+/*  
+ * Copyright (c) 2009 Carnegie Mellon University. 
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+
+#include <graphlab/scheduler/work_stealing_scheduler.hpp>
+#include <graphlab/parallel/fiber_control.hpp>
+#include <graphlab/macros_def.hpp>
+
+namespace graphlab {
+
+void work_stealing_scheduler::set_options(const graphlab_options& opts) {
+  // read the remaining options.
+  std::vector<std::string> keys = opts.get_scheduler_args().get_option_keys();
+  foreach(std::string opt, keys) {
+    if (opt == "lifo") {
+      opts.get_scheduler_args().get_option("lifo", lifo);
+    } else {
+      logstream(LOG_FATAL) << "Unexpected Scheduler Option: " << opt << std::endl;
+    }
+  }
+}
+
+void work_stealing_scheduler::initialize_data_structures() {
+  // one deque per fiber worker, which may be more than ncpus
+  size_t ndeques = ncpus;
+  if (fiber_control::instance_created) {
+    ndeques = std::max(ndeques, fiber_control::get_instance().num_workers());
+  }
+  deques.resize(ndeques);
+  for (size_t i = 0; i < deques.size(); ++i) deques[i] = new deque_type();
+  vertex_is_scheduled.resize(num_vertices);
+}
+
+work_stealing_scheduler::work_stealing_scheduler(size_t num_vertices,
+                                                 const graphlab_options& opts) :
+    ncpus(opts.get_ncpus()),
+    num_vertices(num_vertices),
+    lifo(false) {
+      ASSERT_GE(opts.get_ncpus(), 1);
+      set_options(opts);
+      initialize_data_structures();
+    }
+
+work_stealing_scheduler::~work_stealing_scheduler() {
+  for (size_t i = 0; i < deques.size(); ++i) delete deques[i];
+}
+
+void work_stealing_scheduler::set_num_vertices(const lvid_type numv) {
+  num_vertices = numv;
+  vertex_is_scheduled.resize(numv);
+}
+
+size_t work_stealing_scheduler::owned_deque() const {
+  if (!fiber_control::in_fiber()) return (size_t)(-1);
+  const size_t workerid = fiber_control::get_worker_id();
+  return workerid < deques.size() ? workerid : (size_t)(-1);
+}
+
+void work_stealing_scheduler::schedule(const lvid_type vid, double priority) {
+  if (vid < num_vertices && !vertex_is_scheduled.set_bit(vid)) {
+    const size_t owner = owned_deque();
+    if (owner != (size_t)(-1)) {
+      deques[owner]->push(vid);
+    } else {
+      injection_lock.lock();
+      injection_queue.push_back(vid);
+      injection_lock.unlock();
+    }
+  } 
+} // end of schedule
+
+bool work_stealing_scheduler::pop_injection_queue(lvid_type& ret_vid) {
+  if (injection_queue.empty()) return false;
+  bool good = false;
+  injection_lock.lock();
+  if (!injection_queue.empty()) {
+    ret_vid = injection_queue.front();
+    injection_queue.pop_front();
+    good = true;
+  }
+  injection_lock.unlock();
+  return good;
+}
+
+/** Get the next element in the queue */
+sched_status::status_enum 
+work_stealing_scheduler::get_next(const size_t cpuid, lvid_type& ret_vid) {
+  // my own deque
+  const size_t owner = owned_deque();
+  if (owner != (size_t)(-1)) {
+    deque_type& mine = *deques[owner];
+    while(lifo ? mine.pop(ret_vid) : mine.steal(ret_vid)) {
+      if (claim(ret_vid)) return sched_status::NEW_TASK;
+    }
+  }
+  // tasks scheduled from outside of the workers
+  while(pop_injection_queue(ret_vid)) {
+    if (claim(ret_vid)) return sched_status::NEW_TASK;
+  }
+  // steal, starting from a random victim
+  const size_t start = random::fast_uniform(size_t(0), deques.size() - 1);
+  for (size_t i = 0; i < deques.size(); ++i) {
+    const size_t victim = (start + i) % deques.size();
+    while(deques[victim]->steal(ret_vid)) {
+      if (claim(ret_vid)) return sched_status::NEW_TASK;
+    }
+  }
+  return sched_status::EMPTY;
+} // end of get_next_task
+
+
+bool work_stealing_scheduler::empty() {
+  for (size_t i = 0;i < deques.size(); ++i) {
+    if (!deques[i]->empty()) return false;
+  }
+  return injection_queue.empty();
+}
+
+} // namespace graphlab
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2009 Carnegie Mellon University.
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+
+#ifndef GRAPHLAB_WORK_STEALING_SCHEDULER_HPP
+#define GRAPHLAB_WORK_STEALING_SCHEDULER_HPP
+
+#include <deque>
+#include <vector>
+
+#include <graphlab/graph/graph_basic_types.hpp>
+#include <graphlab/parallel/pthread_tools.hpp>
+#include <graphlab/parallel/chase_lev_deque.hpp>
+#include <graphlab/util/dense_bitset.hpp>
+#include <graphlab/util/random.hpp>
+#include <graphlab/scheduler/ischeduler.hpp>
+#include <graphlab/options/graphlab_options.hpp>
+
+#include <graphlab/macros_def.hpp>
+namespace graphlab {
+
+  /**
+   * \ingroup group_schedulers
+   *
+   * A work stealing scheduler. Every fiber worker owns a lock free
+   * Chase-Lev deque; vertices scheduled from within a fiber are pushed
+   * onto the deque of the worker running it. A worker takes tasks from
+   * its own deque first, then from a shared injection queue holding the
+   * tasks scheduled from outside of fibers, and finally steals from the
+   * other workers. No lock is taken on the common path.
+   *
+   * Workers take their own tasks in FIFO order by default. Setting
+   * "lifo" makes them take the most recently scheduled task instead,
+   * which improves locality at the cost of fairness.
+   *
+   * get_next() calls from outside of a fiber never act as the owner of a
+   * deque and only steal.
+   */
+  class work_stealing_scheduler: public ischeduler {
+  public:
+    typedef chase_lev_deque<lvid_type> deque_type;
+
+  private:
+    size_t ncpus;
+    size_t num_vertices;
+    bool lifo;
+    dense_bitset vertex_is_scheduled;
+    std::vector<deque_type*> deques;
+    // tasks scheduled from outside of a fiber worker
+    std::deque<lvid_type> injection_queue;
+    simple_spinlock injection_lock;
+
+    void set_options(const graphlab_options& opts);
+    void initialize_data_structures();
+
+    // Returns the deque owned by the calling worker, or (size_t)(-1)
+    size_t owned_deque() const;
+
+    // Pops from the injection queue. Returns false if it is empty.
+    bool pop_injection_queue(lvid_type& ret_vid);
+
+    // Marks a popped vertex as no longer scheduled. Returns true
+    // if the vertex should be run.
+    bool claim(lvid_type vid) {
+      return vid < num_vertices && vertex_is_scheduled.clear_bit(vid);
+    }
+
+  public:
+    work_stealing_scheduler(size_t num_vertices,
+                            const graphlab_options& opts); 
+
+    ~work_stealing_scheduler();
+
+    void set_num_vertices(const lvid_type numv);
+
+    void schedule(const lvid_type vid, double priority = 1 /* ignored */);
+
+    /** Get the next element in the queue */
+    sched_status::status_enum get_next(const size_t cpuid,
+                                       lvid_type& ret_vid);
+
+    bool empty();
+
+    /**
+     * Print a help string describing the options that this scheduler
+     * accepts.
+     */
+    static void print_options_help(std::ostream& out) {
+      out << "\t lifo = [bool, workers run their most recently scheduled "
+          << "task first. Default = false].\n";
+    }
+  };
+
+
+} // end of namespace graphlab
+#include <graphlab/macros_undef.hpp>
+
+#endif
+
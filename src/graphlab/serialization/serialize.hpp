@@ -37,5 +37,6 @@
 #include <graphlab/serialization/unsupported_serialize.hpp>
 #include <graphlab/serialization/serialize_to_from_string.hpp>
 #include <graphlab/serialization/conditional_serialize.hpp>
+#include <graphlab/serialization/varint.hpp>
 #endif
 
@@ -0,0 +1,65 @@
+/**
+ * Copyright (c) 2009 Carnegie Mellon University.
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+/*
+   Variable length encoding of unsigned integers. Seven bits are stored
+   per byte, least significant first, and the high bit of a byte is set
+   if more bytes follow. Values below 2^7 take one byte, below 2^14 two
+   bytes and so on, up to ten bytes for a 64 bit value.
+*/
+#ifndef GRAPHLAB_SERIALIZATION_VARINT_HPP
+#define GRAPHLAB_SERIALIZATION_VARINT_HPP
+
+#include <stdint.h>
+
+namespace graphlab {
+
+  /// Writes an unsigned integer with the variable length encoding.
+  template <typename OutArcType>
+  inline void serialize_varint(OutArcType& oarc, uint64_t value) {
+    char buf[10];
+    size_t len = 0;
+    while (value >= 0x80) {
+      buf[len++] = char(value | 0x80);
+      value >>= 7;
+    }
+    buf[len++] = char(value);
+    oarc.write(buf, len);
+  }
+
+  /// Reads an unsigned integer written by serialize_varint().
+  template <typename InArcType, typename T>
+  inline void deserialize_varint(InArcType& iarc, T& value) {
+    uint64_t result = 0;
+    size_t shift = 0;
+    unsigned char c;
+    do {
+      c = (unsigned char)iarc.read_char();
+      result |= uint64_t(c & 0x7f) << shift;
+      shift += 7;
+    } while ((c & 0x80) && shift < 64);
+    value = T(result);
+  }
+
+} // namespace graphlab
+#endif
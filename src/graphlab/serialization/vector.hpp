@@ -35,9 +35,9 @@ namespace graphlab {
      * We re-dispatch vectors because based on the contained type,
      * it is actually possible to serialize them like a POD
      */
-    template <typename OutArcType, typename ValueType, bool IsPOD>
+    template <typename OutArcType, typename ValueType, typename Alloc, bool IsPOD>
     struct vector_serialize_impl {
-      static void exec(OutArcType& oarc, const ValueType& vec) {
+      static void exec(OutArcType& oarc, const std::vector<ValueType, Alloc>& vec) {
         // really this is an assert false. But the static assert
         // must depend on a template parameter 
         BOOST_STATIC_ASSERT(sizeof(OutArcType) == 0);
@@ -48,9 +48,9 @@ namespace graphlab {
      * We re-dispatch vectors because based on the contained type,
      * it is actually possible to deserialize them like iarc POD
      */
-    template <typename InArcType, typename ValueType, bool IsPOD>
+    template <typename InArcType, typename ValueType, typename Alloc, bool IsPOD>
     struct vector_deserialize_impl {
-      static void exec(InArcType& iarc, ValueType& vec) {
+      static void exec(InArcType& iarc, std::vector<ValueType, Alloc>& vec) {
         // really this is an assert false. But the static assert
         // must depend on a template parameter 
         BOOST_STATIC_ASSERT(sizeof(InArcType) == 0);
@@ -59,27 +59,27 @@ namespace graphlab {
     };
     
     /// If contained type is not a POD use the standard serializer
-    template <typename OutArcType, typename ValueType>
-    struct vector_serialize_impl<OutArcType, ValueType, false > {
-      static void exec(OutArcType& oarc, const std::vector<ValueType>& vec) {
+    template <typename OutArcType, typename ValueType, typename Alloc>
+    struct vector_serialize_impl<OutArcType, ValueType, Alloc, false > {
+      static void exec(OutArcType& oarc, const std::vector<ValueType, Alloc>& vec) {
         oarc << size_t(vec.size());
         serialize_iterator(oarc,vec.begin(), vec.end());
       }
     };
 
     /// Fast vector serialization if contained type is a POD
-    template <typename OutArcType, typename ValueType>
-    struct vector_serialize_impl<OutArcType, ValueType, true > {
-      static void exec(OutArcType& oarc, const std::vector<ValueType>& vec) {
+    template <typename OutArcType, typename ValueType, typename Alloc>
+    struct vector_serialize_impl<OutArcType, ValueType, Alloc, true > {
+      static void exec(OutArcType& oarc, const std::vector<ValueType, Alloc>& vec) {
         oarc << size_t(vec.size());
         serialize(oarc, &(vec[0]),sizeof(ValueType)*vec.size());
       }
     };
 
     /// If contained type is not a POD use the standard deserializer
-    template <typename InArcType, typename ValueType>
-    struct vector_deserialize_impl<InArcType, ValueType, false > {
-      static void exec(InArcType& iarc, std::vector<ValueType>& vec){
+    template <typename InArcType, typename ValueType, typename Alloc>
+    struct vector_deserialize_impl<InArcType, ValueType, Alloc, false > {
+      static void exec(InArcType& iarc, std::vector<ValueType, Alloc>& vec){
         size_t len;
         iarc >> len;
         vec.clear(); vec.reserve(len);
@@ -88,9 +88,9 @@ namespace graphlab {
     };
 
     /// Fast vector deserialization if contained type is a POD
-    template <typename InArcType, typename ValueType>
-    struct vector_deserialize_impl<InArcType, ValueType, true > {
-      static void exec(InArcType& iarc, std::vector<ValueType>& vec){
+    template <typename InArcType, typename ValueType, typename Alloc>
+    struct vector_deserialize_impl<InArcType, ValueType, Alloc, true > {
+      static void exec(InArcType& iarc, std::vector<ValueType, Alloc>& vec){
         size_t len;
         iarc >> len;
         vec.clear(); vec.resize(len);
@@ -102,19 +102,19 @@ namespace graphlab {
     
     /**
        Serializes a vector */
-    template <typename OutArcType, typename ValueType>
-    struct serialize_impl<OutArcType, std::vector<ValueType>, false > {
-      static void exec(OutArcType& oarc, const std::vector<ValueType>& vec) {
-        vector_serialize_impl<OutArcType, ValueType, 
+    template <typename OutArcType, typename ValueType, typename Alloc>
+    struct serialize_impl<OutArcType, std::vector<ValueType, Alloc>, false > {
+      static void exec(OutArcType& oarc, const std::vector<ValueType, Alloc>& vec) {
+        vector_serialize_impl<OutArcType, ValueType, Alloc,
           gl_is_pod_or_scaler<ValueType>::value >::exec(oarc, vec);
       }
     };
     /**
        deserializes a vector */
-    template <typename InArcType, typename ValueType>
-    struct deserialize_impl<InArcType, std::vector<ValueType>, false > {
-      static void exec(InArcType& iarc, std::vector<ValueType>& vec){
-        vector_deserialize_impl<InArcType, ValueType, 
+    template <typename InArcType, typename ValueType, typename Alloc>
+    struct deserialize_impl<InArcType, std::vector<ValueType, Alloc>, false > {
+      static void exec(InArcType& iarc, std::vector<ValueType, Alloc>& vec){
+        vector_deserialize_impl<InArcType, ValueType, Alloc,
           gl_is_pod_or_scaler<ValueType>::value >::exec(iarc, vec);
       }
     };
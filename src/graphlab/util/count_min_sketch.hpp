@@ -0,0 +1,124 @@
+/*  
+ * Copyright (c) 2009 Carnegie Mellon University. 
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+
+#ifndef GRAPHLAB_COUNT_MIN_SKETCH_HPP
+#define GRAPHLAB_COUNT_MIN_SKETCH_HPP
+#include <stdint.h>
+#include <cstring>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <graphlab/serialization/is_pod.hpp>
+#include <graphlab/util/integer_mix.hpp>
+
+namespace graphlab {
+
+  /**
+   * \ingroup util
+   * A count-min sketch estimating the number of times each key was
+   * added. estimate() never underestimates. With probability
+   * 1 - 2^-Depth it overestimates by at most 2 * total() / Width.
+   *
+   * operator+= adds the counts of another sketch, so a count_min_sketch
+   * can be used as the accumulator of an aggregator or as a gather type.
+   * Since the sketch is large, fill it with a fold rather than returning
+   * one sketch per element. For instance, to approximate a degree
+   * distribution without an exact histogram:
+   * \code
+   * typedef graphlab::count_min_sketch<> degree_sketch;
+   * void count_degree(const graph_type::vertex_type& vertex,
+   *                   degree_sketch& sketch) {
+   *   sketch.add(vertex.num_in_edges());
+   * }
+   * degree_sketch degrees = graph.fold_vertices<degree_sketch>(count_degree);
+   * uint32_t ndegree_one = degrees.estimate(1);
+   * \endcode
+   * The sketch is a POD and is serialized as 4 * Width * Depth bytes.
+   */
+  template <size_t Width = 2048, size_t Depth = 4>
+  class count_min_sketch : public IS_POD_TYPE {
+  public:
+    count_min_sketch() { clear(); }
+
+    void clear() {
+      memset(counts, 0, sizeof(counts));
+      ntotal = 0;
+    }
+
+    /// Adds count occurrences of key.
+    void add(uint64_t key, uint32_t count = 1) {
+      const uint64_t hash = integer_mix64(key + 0x9e3779b97f4a7c15ULL);
+      for (size_t d = 0; d < Depth; ++d) {
+        counts[d * Width + column(hash, d)] += count;
+      }
+      ntotal += count;
+    }
+
+    /// Returns an upper bound of the number of occurrences of key.
+    uint32_t estimate(uint64_t key) const {
+      const uint64_t hash = integer_mix64(key + 0x9e3779b97f4a7c15ULL);
+      uint32_t ret = counts[column(hash, 0)];
+      for (size_t d = 1; d < Depth; ++d) {
+        ret = std::min(ret, counts[d * Width + column(hash, d)]);
+      }
+      return ret;
+    }
+
+    /// Returns the total of all counts added.
+    uint64_t total() const { return ntotal; }
+
+    /// Adds the counts of other. Uses SSE2 if available.
+    count_min_sketch& operator+=(const count_min_sketch& other) {
+      uint32_t* a = counts;
+      const uint32_t* b = other.counts;
+      const size_t n = Width * Depth;
+      size_t i = 0;
+#ifdef __SSE2__
+      for (; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+        _mm_storeu_si128((__m128i*)(a + i), _mm_add_epi32(x, y));
+      }
+#endif
+      for (; i < n; ++i) a[i] += b[i];
+      ntotal += other.ntotal;
+      return *this;
+    }
+
+  private:
+    /// Row d of the sketch is counts[d * Width, (d + 1) * Width)
+    uint32_t counts[Depth * Width];
+    uint64_t ntotal;
+
+    /// Derives the Depth hash functions from the two halves of one hash
+    static size_t column(uint64_t hash, size_t d) {
+      const uint32_t h1 = (uint32_t)hash;
+      const uint32_t h2 = (uint32_t)(hash >> 32);
+      return (h1 + d * h2) % Width;
+    }
+  }; // end of class count_min_sketch
+
+} // namespace graphlab
+#endif
@@ -27,16 +27,61 @@
 #endif
 
 #include <vector>
+#include <algorithm>
 #include <graphlab/parallel/atomic.hpp>
 
 namespace graphlab {
+    /**
+     *  Inclusive prefix sum of counter_array in place. With OpenMP the
+     *  array is split into one block per thread: blocks are scanned in
+     *  parallel, the block totals are scanned serially and then added back
+     *  in parallel.
+     **/
+    template <typename T>
+    void parallel_prefix_sum(std::vector< atomic<T> >& counter_array) {
+#ifdef _OPENMP
+      const ssize_t n = counter_array.size();
+      const ssize_t nblocks = omp_get_max_threads();
+      if (n < 4 * nblocks || nblocks == 1) {
+#endif
+        for (size_t i = 1; i < counter_array.size(); ++i) {
+          counter_array[i].value += counter_array[i-1].value;
+        }
+#ifdef _OPENMP
+        return;
+      }
+      const ssize_t blocksize = (n + nblocks - 1) / nblocks;
+      std::vector<T> block_offset(nblocks + 1, 0);
+#pragma omp parallel for
+      for (ssize_t b = 0; b < nblocks; ++b) {
+        const ssize_t begin = b * blocksize;
+        const ssize_t end = std::min(n, begin + blocksize);
+        for (ssize_t i = begin + 1; i < end; ++i) {
+          counter_array[i].value += counter_array[i-1].value;
+        }
+        if (begin < end) block_offset[b + 1] = counter_array[end-1].value;
+      }
+      for (ssize_t b = 1; b <= nblocks; ++b) {
+        block_offset[b] += block_offset[b-1];
+      }
+#pragma omp parallel for
+      for (ssize_t b = 1; b < nblocks; ++b) {
+        const ssize_t begin = b * blocksize;
+        const ssize_t end = std::min(n, begin + blocksize);
+        for (ssize_t i = begin; i < end; ++i) {
+          counter_array[i].value += block_offset[b];
+        }
+      }
+#endif
+    }
+
     /**
      *  Count the value_vec.
      *  Generate permute_index for value_vec in ascending order and 
      *  optionally fill in the prefix array of the counts. 
      **/
-    template <typename valuetype, typename sizetype>
-    void counting_sort(const std::vector<valuetype>& value_vec,
+    template <typename valuetype, typename ValueAlloc, typename sizetype>
+    void counting_sort(const std::vector<valuetype, ValueAlloc>& value_vec,
                        std::vector<sizetype>& permute_index,
                        std::vector<sizetype>* prefix_array = NULL) {
       if(value_vec.size() == 0) return;
@@ -53,9 +98,7 @@ namespace graphlab {
         counter_array[val].inc();
       }
 
-      for (size_t i = 1; i < counter_array.size(); ++i) {
-        counter_array[i] += counter_array[i-1];
-      }
+      parallel_prefix_sum(counter_array);
 
 #ifdef _OPENMP
 #pragma omp parallel for
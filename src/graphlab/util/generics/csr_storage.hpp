@@ -26,6 +26,8 @@
 #include <vector>
 
 #include <graphlab/util/generics/counting_sort.hpp>
+#include <graphlab/parallel/numa.hpp>
+#include <graphlab/util/mmap_allocator.hpp>
 #include <graphlab/serialization/iarchive.hpp>
 #include <graphlab/serialization/oarchive.hpp>
 
@@ -35,12 +37,19 @@ namespace graphlab {
    * The key has type size_t and can be assolicated with multiple values of valuetype.
    * The core operation of is querying the list of values associated with the query key *  and returns the begin and end iterators via <code>begin(id)</code>
    * and <code>end(id)</code>.
+   * The index and the values are allocated with Alloc, rebound to each
+   * element type.
    */
-  template <typename valuetype, typename sizetype=size_t>
+  template <typename valuetype, typename sizetype=size_t,
+            typename Alloc=std::allocator<valuetype> >
   class csr_storage {
    public:
-     typedef typename std::vector<valuetype>::iterator iterator;
-     typedef typename std::vector<valuetype>::const_iterator const_iterator;
+     typedef std::vector<valuetype,
+             typename Alloc::template rebind<valuetype>::other> value_vector_type;
+     typedef std::vector<sizetype,
+             typename Alloc::template rebind<sizetype>::other> index_vector_type;
+     typedef typename value_vector_type::iterator iterator;
+     typedef typename value_vector_type::const_iterator const_iterator;
      typedef valuetype value_type;
 
    public:
@@ -65,9 +74,10 @@ namespace graphlab {
       std::vector<sizetype> permute_index;
       // Build index for id -> value 
       // Prefix of the counting array equals to the begin index for each id
-      std::vector<sizetype>& prefix = value_ptrs;
+      std::vector<sizetype> prefix;
 
       counting_sort(id_vec, permute_index, &prefix);
+      vector_adopt(value_ptrs, prefix);
 
       values.reserve(value_vec.size());
       values.resize(value_vec.size());
@@ -104,16 +114,18 @@ namespace graphlab {
      /**
       * Wrap the index vector and value vector into csr_storage.
       * Check the property of the input vector.
-      * The input vector will be cleared. 
+      * The input vector will be cleared. The vectors are swapped in if
+      * they use the same allocator as the storage, and copied otherwise.
       */
-     void wrap(std::vector<sizetype>& valueptr_vec,
-               std::vector<valuetype>& value_vec) {
+     template<typename PtrAlloc, typename ValueAlloc>
+     void wrap(std::vector<sizetype, PtrAlloc>& valueptr_vec,
+               std::vector<valuetype, ValueAlloc>& value_vec) {
        for (ssize_t i = 1; i < (ssize_t)valueptr_vec.size(); ++i) {
          ASSERT_LE(valueptr_vec[i-1], valueptr_vec[i]);
          ASSERT_LT(valueptr_vec[i], value_vec.size());
        }
-       value_ptrs.swap(valueptr_vec);
-       values.swap(value_vec);
+       vector_adopt(value_ptrs, valueptr_vec);
+       vector_adopt(values, value_vec);
      }
 
      /// Number of keys in the storage.
@@ -142,6 +154,13 @@ namespace graphlab {
        return (id+1) < num_keys() ? values.begin()+value_ptrs[id+1] : values.end();
      }
 
+     /// Moves the keys [begin_id, end_id) and their values to a NUMA node.
+     void place_on_numa_node(size_t begin_id, size_t end_id, size_t node) {
+       numa::place(value_ptrs, begin_id, end_id, node);
+       numa::place(values, begin(begin_id) - values.begin(),
+                   begin(end_id) - values.begin(), node);
+     }
+
      /// printout the csr storage
      void print(std::ostream& out) {
        for (size_t i = 0; i < num_keys(); ++i)  {
@@ -156,17 +175,17 @@ namespace graphlab {
      }
 
    public:
-     std::vector<valuetype> get_values() { return values; }
-     std::vector<sizetype> get_index() { return value_ptrs; }
+     value_vector_type get_values() { return values; }
+     index_vector_type get_index() { return value_ptrs; }
 
-     void swap(csr_storage<valuetype, sizetype>& other) {
+     void swap(csr_storage& other) {
        value_ptrs.swap(other.value_ptrs);
        values.swap(other.values);
      }
 
      void clear() {
-       std::vector<sizetype>().swap(value_ptrs);
-       std::vector<valuetype>().swap(values);
+       index_vector_type().swap(value_ptrs);
+       value_vector_type().swap(values);
      }
 
      void load(iarchive& iarc) {
@@ -184,8 +203,8 @@ namespace graphlab {
      }
 
    private:
-     std::vector<sizetype> value_ptrs;
-     std::vector<valuetype> values;
+     index_vector_type value_ptrs;
+     value_vector_type values;
   }; // end of class
 } // end of graphlab 
 #endif
@@ -173,6 +173,17 @@ namespace graphlab {
        }
      }
 
+     /// Repack only the values of the given keys in parallel
+     template<typename idtype>
+     void repack(const std::vector<idtype>& keys) {
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+       for (ssize_t i = 0; i < (ssize_t)keys.size(); ++i) {
+           values.repack(begin(keys[i]), end(keys[i]));
+       }
+     }
+
      /////////////////////////// I/O API ////////////////////////
      /// Debug print out the content of the storage;
      void print(std::ostream& out) const {
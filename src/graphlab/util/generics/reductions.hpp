@@ -0,0 +1,176 @@
+/**  
+ * Copyright (c) 2009 Carnegie Mellon University. 
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+#ifndef GRAPHLAB_REDUCTIONS_HPP
+#define GRAPHLAB_REDUCTIONS_HPP
+
+// The reductions use variadic templates, std::tuple and decltype, and
+// are only available if the compiler has C++11 support.
+#if defined(__cplusplus) && __cplusplus >= 201103L
+#include <cstddef>
+#include <limits>
+#include <tuple>
+#include <utility>
+#include <type_traits>
+#include <graphlab/serialization/is_pod.hpp>
+#include <graphlab/serialization/oarchive.hpp>
+#include <graphlab/serialization/iarchive.hpp>
+
+namespace graphlab {
+
+  /**
+   * The combine operations of the built-in reductions. Each defines the
+   * value type, the identity, a combine function which folds the value
+   * of one element into a partial result, and a merge function which
+   * joins two partial results. Both can be inlined and vectorized by
+   * the compiler. Used by reduction and by
+   * distributed_graph::reduce_vertex_data() and
+   * distributed_graph::reduce_edge_data(), which pass the value of an
+   * element to combine without converting it to value_type first.
+   */
+  template <typename T>
+  struct sum_op {
+    typedef T value_type;
+    static T identity() { return T(0); }
+    static T combine(T a, T b) { return a + b; }
+    static T merge(T a, T b) { return a + b; }
+  };
+
+  template <typename T>
+  struct min_op {
+    typedef T value_type;
+    static T identity() { return std::numeric_limits<T>::max(); }
+    static T combine(T a, T b) { return b < a ? b : a; }
+    static T merge(T a, T b) { return combine(a, b); }
+  };
+
+  template <typename T>
+  struct max_op {
+    typedef T value_type;
+    static T identity() { return std::numeric_limits<T>::lowest(); }
+    static T combine(T a, T b) { return a < b ? b : a; }
+    static T merge(T a, T b) { return combine(a, b); }
+  };
+
+  /// Counts the elements whose value is non-zero (true)
+  struct count_op : public sum_op<size_t> {
+    /// The value is compared before any conversion, so 0.5 is counted
+    template <typename T>
+    static size_t combine(size_t a, const T& b) { return a + (b != T(0)); }
+  };
+
+  /**
+   * A POD reduction which can be used as the ReductionType of any
+   * map-reduce. For instance, to find the largest vertex value:
+   * \code
+   * graphlab::reduction<graphlab::max_op<float> >
+   * vertex_value(const graph_type::vertex_type& vertex) {
+   *   return vertex.data();
+   * }
+   * float max = graph.map_reduce_vertices<
+   *    graphlab::reduction<graphlab::max_op<float> > >(vertex_value).value;
+   * \endcode
+   */
+  template <typename Op>
+  struct reduction : public IS_POD_TYPE {
+    typedef typename Op::value_type value_type;
+    value_type value;
+    reduction() : value(Op::identity()) { }
+    /// The reduction of a single element
+    template <typename ElementType>
+    reduction(const ElementType& value) :
+      value(Op::combine(Op::identity(), value)) { }
+    reduction& operator+=(const reduction& other) {
+      value = Op::merge(value, other.value);
+      return *this;
+    }
+  };
+
+  /**
+   * Several reductions summed together, as returned by
+   * distributed_graph::map_reduce_vertices_fused() and
+   * distributed_graph::map_reduce_edges_fused(). Element i is
+   * accessed with get<i>().
+   */
+  template <typename... ReductionTypes>
+  struct reduction_tuple {
+    typedef std::tuple<ReductionTypes...> tuple_type;
+    tuple_type values;
+
+    reduction_tuple() { }
+    explicit reduction_tuple(const ReductionTypes&... values) :
+      values(values...) { }
+
+    template <size_t I>
+    const typename std::tuple_element<I, tuple_type>::type& get() const {
+      return std::get<I>(values);
+    }
+
+    reduction_tuple& operator+=(const reduction_tuple& other) {
+      add<0>(other);
+      return *this;
+    }
+
+    void save(oarchive& oarc) const { save_element<0>(oarc); }
+
+    void load(iarchive& iarc) { load_element<0>(iarc); }
+
+  private:
+    static const size_t N = sizeof...(ReductionTypes);
+
+    template <size_t I>
+    typename std::enable_if<I == N>::type add(const reduction_tuple&) { }
+    template <size_t I>
+    typename std::enable_if<(I < N)>::type add(const reduction_tuple& other) {
+      std::get<I>(values) += std::get<I>(other.values);
+      add<I + 1>(other);
+    }
+
+    template <size_t I>
+    typename std::enable_if<I == N>::type save_element(oarchive&) const { }
+    template <size_t I>
+    typename std::enable_if<(I < N)>::type save_element(oarchive& oarc) const {
+      oarc << std::get<I>(values);
+      save_element<I + 1>(oarc);
+    }
+
+    template <size_t I>
+    typename std::enable_if<I == N>::type load_element(iarchive&) { }
+    template <size_t I>
+    typename std::enable_if<(I < N)>::type load_element(iarchive& iarc) {
+      iarc >> std::get<I>(values);
+      load_element<I + 1>(iarc);
+    }
+  };
+
+  /// The decayed return type of a map function called on an Arg
+  template <typename MapFunctionType, typename Arg>
+  struct map_result_type {
+    typedef typename std::decay<
+      decltype(std::declval<MapFunctionType&>()(std::declval<Arg>()))>::type
+      type;
+  };
+
+} // namespace graphlab
+#endif
+#endif
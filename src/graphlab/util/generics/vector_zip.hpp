@@ -30,14 +30,20 @@
 #include <vector>
 
 namespace graphlab {
-  template<typename v1, typename v2>
-  std::vector<std::pair<v1, v2> > 
-    vector_zip(std::vector<v1>& vec1, std::vector<v2>& vec2) {
+  /**
+   * Zips two vectors into a vector of pairs, clearing the inputs. The
+   * result uses the allocator of the first vector.
+   */
+  template<typename v1, typename a1, typename v2, typename a2>
+  std::vector<std::pair<v1, v2>,
+              typename a1::template rebind<std::pair<v1, v2> >::other>
+    vector_zip(std::vector<v1, a1>& vec1, std::vector<v2, a2>& vec2) {
 
       assert(vec1.size() == vec2.size());
       size_t length = vec1.size();
 
-      std::vector<std::pair<v1, v2> >  out;
+      std::vector<std::pair<v1, v2>,
+                  typename a1::template rebind<std::pair<v1, v2> >::other> out;
       out.reserve(length);
       out.resize(length);
 
@@ -47,8 +53,8 @@ namespace graphlab {
     for (ssize_t i = 0; i < ssize_t(length); ++i) {
       out[i] = (std::pair<v1, v2>(vec1[i], vec2[i]));
     }
-    std::vector<v1>().swap(vec1);
-    std::vector<v2>().swap(vec2);
+    std::vector<v1, a1>().swap(vec1);
+    std::vector<v2, a2>().swap(vec2);
     return out;
   }
 } // end of graphlab
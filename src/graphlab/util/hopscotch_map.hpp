@@ -50,11 +50,14 @@ namespace graphlab {
    *              available. Otherwise defaults to boost::hash<Key>
    * \tparam KeyEqual The functor used to identify object equality. Defaults to
    *                  std::equal_to<Key>
+   * \tparam Alloc The allocator of the underlying tables. Defaults to
+   *               std::allocator<std::pair<Key, Value> >
    */
   template <typename Key,
             typename Value,
             typename Hash = _HOPSCOTCH_MAP_DEFAULT_HASH,
-            typename KeyEqual = std::equal_to<Key> >
+            typename KeyEqual = std::equal_to<Key>,
+            typename Alloc = std::allocator<std::pair<Key, Value> > >
   class hopscotch_map {
 
   public:
@@ -90,7 +93,8 @@ namespace graphlab {
 
     typedef hopscotch_table<storage_type,
                             hash_redirect,
-                            key_equal_redirect> container_type;
+                            key_equal_redirect,
+                            Alloc> container_type;
 
     typedef boost::unordered_map<key_type, mapped_type, Hash> spill_type;
 
@@ -51,10 +51,12 @@ namespace graphlab {
   *              available. Otherwise defaults to boost::hash<T>
   * \tparam KeyEqual The functor used to identify object equality. Defaults to
   *                  std::equal_to<T>
+  * \tparam Alloc The allocator of the table. Defaults to std::allocator<T>
   */
 template <typename T,
          typename Hash = _HOPSCOTCH_TABLE_DEFAULT_HASH,
-         typename KeyEqual = std::equal_to<T> >
+         typename KeyEqual = std::equal_to<T>,
+         typename Alloc = std::allocator<T> >
 class hopscotch_table {
   public:
     /// The data type stored in the table
@@ -82,7 +84,9 @@ class hopscotch_table {
       element():hasdata(false), field(0) { }
     };
 
-    std::vector<element> data;
+    typedef std::vector<element,
+            typename Alloc::template rebind<element>::other> element_vector_type;
+    element_vector_type data;
 
     hasher hashfun;
     equality_function equalfun;
@@ -171,7 +175,7 @@ class hopscotch_table {
       friend class hopscotch_table;
 
       const hopscotch_table* ptr;
-      typename std::vector<element>::const_iterator iter;
+      typename element_vector_type::const_iterator iter;
 
       const_iterator():ptr(NULL) {}
 
@@ -209,7 +213,7 @@ class hopscotch_table {
 
     private:
       const_iterator(const hopscotch_table* table,
-          typename std::vector<element>::const_iterator iter):
+          typename element_vector_type::const_iterator iter):
         ptr(table), iter(iter) { }
     };
 
@@ -230,7 +234,7 @@ class hopscotch_table {
       friend class hopscotch_table;
 
       hopscotch_table* ptr;
-      typename std::vector<element>::iterator iter;
+      typename element_vector_type::iterator iter;
 
       iterator():ptr(NULL) {}
 
@@ -274,7 +278,7 @@ class hopscotch_table {
 
     private:
       iterator(hopscotch_table* table,
-          typename std::vector<element>::iterator iter):
+          typename element_vector_type::iterator iter):
         ptr(table), iter(iter) { }
     };
 
@@ -517,7 +521,7 @@ class hopscotch_table {
     /// Returns an iterator to the start of the table
     iterator begin() {
       // find the first which is not empty
-      typename std::vector<element>::iterator iter = data.begin();
+      typename element_vector_type::iterator iter = data.begin();
       while (iter != data.end() && !iter->hasdata) {
         ++iter;
       }
@@ -527,7 +531,7 @@ class hopscotch_table {
     /// Returns an iterator to the start of the table
     const_iterator begin() const {
       // find the first which is not empty
-      typename std::vector<element>::iterator iter = data.begin();
+      typename element_vector_type::iterator iter = data.begin();
       while (iter != data.end() && !iter->hasdata) {
         ++iter;
       }
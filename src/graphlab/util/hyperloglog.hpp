@@ -0,0 +1,132 @@
+/*  
+ * Copyright (c) 2009 Carnegie Mellon University. 
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+
+#ifndef GRAPHLAB_HYPERLOGLOG_HPP
+#define GRAPHLAB_HYPERLOGLOG_HPP
+#include <stdint.h>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <graphlab/serialization/is_pod.hpp>
+#include <graphlab/util/integer_mix.hpp>
+
+namespace graphlab {
+
+  /**
+   * \ingroup util
+   * A HyperLogLog sketch estimating the number of distinct values
+   * added to it, with a relative standard error of about
+   * 1.04 / sqrt(2^Precision): 1.6% with the default of 4096 one byte
+   * registers.
+   *
+   * operator+= merges two sketches into the sketch of the union of
+   * their values, so a hyperloglog can be used as the accumulator of an
+   * aggregator or as a gather type. For instance, to estimate the number
+   * of distinct vertices within two hops, gather the sketches of the
+   * neighbors:
+   * \code
+   * gather_type gather(icontext_type& context, const vertex_type& vertex,
+   *                    edge_type& edge) const {
+   *   return edge.source().data().sketch;
+   * }
+   * void apply(icontext_type& context, vertex_type& vertex,
+   *            const gather_type& total) {
+   *   vertex.data().sketch += total;
+   * }
+   * ...
+   * double nbrs = vertex.data().sketch.estimate();
+   * \endcode
+   * The sketch is a POD and is serialized as 2^Precision bytes.
+   */
+  template <size_t Precision = 12>
+  class hyperloglog : public IS_POD_TYPE {
+  public:
+    static const size_t NUM_REGISTERS = size_t(1) << Precision;
+
+    hyperloglog() { clear(); }
+
+    void clear() {
+      memset(registers, 0, sizeof(registers));
+    }
+
+    /// Adds a value. Adding the same value again has no effect.
+    void add(uint64_t value) {
+      add_hash(integer_mix64(value + 0x9e3779b97f4a7c15ULL));
+    }
+
+    /// Adds a value which is already a well mixed 64 bit hash.
+    void add_hash(uint64_t hash) {
+      const size_t idx = hash >> (64 - Precision);
+      // the sentinel bit bounds the rank by 64 - Precision + 1
+      const uint64_t rest = (hash << Precision) |
+                            (uint64_t(1) << (Precision - 1));
+      const uint8_t rank = (uint8_t)(__builtin_clzll(rest) + 1);
+      if (rank > registers[idx]) registers[idx] = rank;
+    }
+
+    /// Merges other into this sketch. Uses SSE2 if available.
+    hyperloglog& operator+=(const hyperloglog& other) {
+      size_t i = 0;
+#ifdef __SSE2__
+      for (; i + 16 <= NUM_REGISTERS; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(registers + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(other.registers + i));
+        _mm_storeu_si128((__m128i*)(registers + i), _mm_max_epu8(a, b));
+      }
+#endif
+      for (; i < NUM_REGISTERS; ++i) {
+        registers[i] = std::max(registers[i], other.registers[i]);
+      }
+      return *this;
+    }
+
+    /// Returns the estimated number of distinct values added.
+    double estimate() const {
+      const double m = (double)NUM_REGISTERS;
+      double sum = 0;
+      size_t zeros = 0;
+      for (size_t i = 0; i < NUM_REGISTERS; ++i) {
+        sum += std::ldexp(1.0, -(int)registers[i]);
+        zeros += (registers[i] == 0);
+      }
+      double alpha;
+      if (NUM_REGISTERS == 16) alpha = 0.673;
+      else if (NUM_REGISTERS == 32) alpha = 0.697;
+      else if (NUM_REGISTERS == 64) alpha = 0.709;
+      else alpha = 0.7213 / (1.0 + 1.079 / m);
+      const double raw = alpha * m * m / sum;
+      // linear counting is more accurate while many registers are empty
+      if (raw <= 2.5 * m && zeros > 0) return m * std::log(m / zeros);
+      return raw;
+    }
+
+  private:
+    uint8_t registers[NUM_REGISTERS];
+  }; // end of class hyperloglog
+
+} // namespace graphlab
+#endif
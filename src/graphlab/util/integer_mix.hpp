@@ -38,6 +38,17 @@ inline uint32_t integer_mix(uint32_t a) {
   return a;
 }
 
+// The 64 bit finalizer of MurmurHash3. Every input bit affects every
+// output bit, so the high and low bits are both usable as hashes.
+inline uint64_t integer_mix64(uint64_t a) {
+  a ^= a >> 33;
+  a *= 0xff51afd7ed558ccdULL;
+  a ^= a >> 33;
+  a *= 0xc4ceb9fe1a85ec53ULL;
+  a ^= a >> 33;
+  return a;
+}
+
 }
 #endif
 
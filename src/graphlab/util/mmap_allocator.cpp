@@ -0,0 +1,196 @@
+/**
+ * Copyright (c) 2009 Carnegie Mellon University.
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <graphlab/util/mmap_allocator.hpp>
+#include <graphlab/parallel/pthread_tools.hpp>
+#include <graphlab/logger/logger.hpp>
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+namespace graphlab {
+namespace mmap_alloc {
+
+/*
+ * Every allocation is preceded by a header recording how it was made.
+ * The header is 64 bytes so that the returned memory keeps the
+ * alignment malloc would provide.
+ */
+struct header {
+  uint64_t mode;
+  uint64_t length;   // length of the mapping
+  void* base;        // start of the mapping or of the malloc'ed block
+  char padding[64 - 2 * sizeof(uint64_t) - sizeof(void*)];
+};
+
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+static mode_type current_mode = MALLOC;
+static std::string current_dir;
+static mutex dir_lock;
+
+void set_mode(mode_type mode, const std::string& dir) {
+  dir_lock.lock();
+  current_mode = mode;
+  current_dir = dir.empty() ? std::string("/tmp") : dir;
+  dir_lock.unlock();
+}
+
+bool set_mode(const std::string& name, const std::string& dir) {
+  if (name == "malloc") set_mode(MALLOC, dir);
+  else if (name == "hugepage") set_mode(HUGEPAGE, dir);
+  else if (name == "hugetlb") set_mode(HUGETLB, dir);
+  else if (name == "file") set_mode(FILE_BACKED, dir);
+  else return false;
+  return true;
+}
+
+mode_type get_mode() {
+  return current_mode;
+}
+
+static size_t round_up(size_t val, size_t multiple) {
+  return (val + multiple - 1) / multiple * multiple;
+}
+
+/**
+ * Maps length bytes at a 2MB aligned address. An aligned range is first
+ * reserved from a larger anonymous mapping, and the real mapping is then
+ * placed over it with MAP_FIXED, so that a file mapping still starts at
+ * offset 0 and ends at the end of the file.
+ */
+static void* map_aligned(size_t length, int prot, int flags, int fd) {
+  const size_t padded = length + HUGE_PAGE_SIZE;
+  char* ptr = (char*)mmap(NULL, padded, PROT_NONE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED) return NULL;
+  char* aligned = (char*)round_up((uintptr_t)ptr, HUGE_PAGE_SIZE);
+  if (aligned > ptr) munmap(ptr, aligned - ptr);
+  char* end = ptr + padded;
+  if (end > aligned + length) munmap(aligned + length, end - aligned - length);
+  if (mmap(aligned, length, prot, flags | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    munmap(aligned, length);
+    return NULL;
+  }
+  return aligned;
+}
+
+static void* map_hugetlb(size_t length) {
+#ifdef MAP_HUGETLB
+  void* ptr = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (ptr != MAP_FAILED) return ptr;
+#endif
+  static bool warned = false;
+  if (!warned) {
+    warned = true;
+    logstream(LOG_WARNING) << "Unable to allocate from the hugetlbfs pool. "
+                           << "Falling back to transparent huge pages"
+                           << std::endl;
+  }
+  return NULL;
+}
+
+static void* map_hugepage(size_t length) {
+  void* ptr = map_aligned(length, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1);
+#ifdef MADV_HUGEPAGE
+  if (ptr != NULL) madvise(ptr, length, MADV_HUGEPAGE);
+#endif
+  return ptr;
+}
+
+static void* map_file(size_t length) {
+  dir_lock.lock();
+  std::string path = current_dir + "/graphlab_mmap_XXXXXX";
+  dir_lock.unlock();
+  std::vector<char> fname(path.begin(), path.end());
+  fname.push_back('\0');
+  int fd = mkstemp(&fname[0]);
+  if (fd < 0) {
+    logstream(LOG_ERROR) << "Unable to create backing file " << &fname[0]
+                         << std::endl;
+    return NULL;
+  }
+  // the file disappears with the mapping
+  unlink(&fname[0]);
+  void* ptr = NULL;
+  if (ftruncate(fd, length) == 0) {
+    ptr = map_aligned(length, PROT_READ | PROT_WRITE, MAP_SHARED, fd);
+  } else {
+    logstream(LOG_ERROR) << "Unable to grow backing file " << &fname[0]
+                         << " to " << length << " bytes" << std::endl;
+  }
+  close(fd);
+  return ptr;
+}
+
+void* allocate(size_t bytes) {
+  mode_type mode = current_mode;
+  const size_t total = bytes + sizeof(header);
+  if (total < HUGE_PAGE_SIZE) mode = MALLOC;
+
+  void* base = NULL;
+  size_t length = 0;
+  if (mode == HUGETLB) {
+    length = round_up(total, HUGE_PAGE_SIZE);
+    base = map_hugetlb(length);
+    if (base == NULL) mode = HUGEPAGE;
+  }
+  if (mode == HUGEPAGE) {
+    length = round_up(total, getpagesize());
+    base = map_hugepage(length);
+  } else if (mode == FILE_BACKED) {
+    length = round_up(total, getpagesize());
+    base = map_file(length);
+  } else if (mode == MALLOC) {
+    length = total;
+    base = malloc(total);
+  }
+  if (base == NULL) return NULL;
+
+  header* h = (header*)base;
+  h->mode = mode;
+  h->length = length;
+  h->base = base;
+  return h + 1;
+}
+
+void deallocate(void* ptr) {
+  if (ptr == NULL) return;
+  header* h = (header*)ptr - 1;
+  if (h->mode == MALLOC) {
+    free(h->base);
+  } else {
+    munmap(h->base, h->length);
+  }
+}
+
+} // namespace mmap_alloc
+} // namespace graphlab
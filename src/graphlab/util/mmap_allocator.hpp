@@ -0,0 +1,153 @@
+/**
+ * Copyright (c) 2009 Carnegie Mellon University.
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+#ifndef GRAPHLAB_MMAP_ALLOCATOR_HPP
+#define GRAPHLAB_MMAP_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace graphlab {
+
+  /**
+   * \internal
+   * \brief Allocation of large arrays with huge pages or file backed
+   * memory.
+   *
+   * The mode is process wide and applies to allocations made after it
+   * is set. Every allocation remembers how it was made, so memory
+   * allocated in one mode may be freed after switching to another.
+   * Allocations smaller than one huge page always use malloc.
+   */
+  namespace mmap_alloc {
+
+    enum mode_type {
+      /// Plain malloc
+      MALLOC,
+      /// Anonymous mmap aligned to 2MB with transparent huge pages
+      /// requested through madvise
+      HUGEPAGE,
+      /// Anonymous mmap from the hugetlbfs pool. Falls back to
+      /// HUGEPAGE if the pool is exhausted.
+      HUGETLB,
+      /// Shared mmap of an unlinked file, so the arrays may exceed
+      /// physical memory and are paged to the file by the OS.
+      FILE_BACKED
+    };
+
+    /**
+     * Sets the allocation mode. dir is the directory of the backing
+     * files in FILE_BACKED mode and is ignored otherwise.
+     */
+    void set_mode(mode_type mode, const std::string& dir = "");
+
+    /**
+     * Sets the mode by name: "malloc", "hugepage", "hugetlb" or "file".
+     * Returns false if the name is not recognized.
+     */
+    bool set_mode(const std::string& name, const std::string& dir = "");
+
+    /// Returns the current allocation mode.
+    mode_type get_mode();
+
+    /// Allocates bytes. Returns NULL on failure.
+    void* allocate(size_t bytes);
+
+    /// Frees memory returned by allocate().
+    void deallocate(void* ptr);
+
+  } // namespace mmap_alloc
+
+
+  /**
+   * \brief An STL allocator using mmap_alloc.
+   *
+   * All instances are interchangeable, so containers using it may be
+   * swapped with each other.
+   */
+  template <typename T>
+  class mmap_allocator {
+  public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template <typename U>
+    struct rebind { typedef mmap_allocator<U> other; };
+
+    mmap_allocator() { }
+    template <typename U>
+    mmap_allocator(const mmap_allocator<U>&) { }
+
+    pointer address(reference x) const { return &x; }
+    const_pointer address(const_reference x) const { return &x; }
+
+    pointer allocate(size_type n, const void* = 0) {
+      if (n == 0) return NULL;
+      if (n > max_size()) throw std::bad_alloc();
+      void* ptr = mmap_alloc::allocate(n * sizeof(T));
+      if (ptr == NULL) throw std::bad_alloc();
+      return static_cast<pointer>(ptr);
+    }
+
+    void deallocate(pointer p, size_type) {
+      if (p != NULL) mmap_alloc::deallocate(p);
+    }
+
+    size_type max_size() const { return size_t(-1) / sizeof(T); }
+
+    void construct(pointer p, const T& val) { new (p) T(val); }
+    void destroy(pointer p) { p->~T(); }
+
+    template <typename U>
+    bool operator==(const mmap_allocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const mmap_allocator<U>&) const { return false; }
+  }; // end of mmap_allocator
+
+
+  /**
+   * \brief Moves the contents of src into dst and empties src. This is
+   * a swap if the two vectors use the same allocator and a copy
+   * otherwise.
+   */
+  template <typename T, typename Alloc>
+  void vector_adopt(std::vector<T, Alloc>& dst, std::vector<T, Alloc>& src) {
+    dst.swap(src);
+    std::vector<T, Alloc>().swap(src);
+  }
+
+  template <typename T, typename DstAlloc, typename SrcAlloc>
+  void vector_adopt(std::vector<T, DstAlloc>& dst,
+                    std::vector<T, SrcAlloc>& src) {
+    std::vector<T, DstAlloc>(src.begin(), src.end()).swap(dst);
+    std::vector<T, SrcAlloc>().swap(src);
+  }
+
+} // namespace graphlab
+#endif
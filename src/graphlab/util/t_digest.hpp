@@ -0,0 +1,227 @@
+/*  
+ * Copyright (c) 2009 Carnegie Mellon University. 
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+
+#ifndef GRAPHLAB_T_DIGEST_HPP
+#define GRAPHLAB_T_DIGEST_HPP
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include <graphlab/serialization/is_pod.hpp>
+#include <graphlab/serialization/oarchive.hpp>
+#include <graphlab/serialization/iarchive.hpp>
+
+namespace graphlab {
+
+  /**
+   * \ingroup util
+   * A merging t-digest estimating the quantiles of the values added to
+   * it. The values are summarized by at most about compression
+   * centroids. Centroids near the tails are smaller, so extreme
+   * quantiles are estimated more accurately than the median.
+   *
+   * operator+= merges two digests into the digest of the union of their
+   * values, so a t_digest can be used as the accumulator of an
+   * aggregator or as a gather type:
+   * \code
+   * void add_degree(const graph_type::vertex_type& vertex,
+   *                 graphlab::t_digest& digest) {
+   *   digest.add(vertex.num_out_edges());
+   * }
+   * graphlab::t_digest degrees =
+   *     graph.fold_vertices<graphlab::t_digest>(add_degree);
+   * double p99 = degrees.quantile(0.99);
+   * \endcode
+   */
+  class t_digest {
+  public:
+    explicit t_digest(double compression = 100) :
+      compression(compression), ntotal(0),
+      min_value(std::numeric_limits<double>::infinity()),
+      max_value(-std::numeric_limits<double>::infinity()) { }
+
+    void clear() {
+      centroids.clear();
+      buffer.clear();
+      ntotal = 0;
+      min_value = std::numeric_limits<double>::infinity();
+      max_value = -std::numeric_limits<double>::infinity();
+    }
+
+    /// Adds value with the given weight.
+    void add(double value, double weight = 1) {
+      buffer.push_back(centroid(value, weight));
+      ntotal += weight;
+      min_value = std::min(min_value, value);
+      max_value = std::max(max_value, value);
+      if (buffer.size() > 4 * size_t(compression)) compress();
+    }
+
+    /// Merges the values of other into this digest.
+    t_digest& operator+=(const t_digest& other) {
+      if (other.ntotal == 0) return *this;
+      buffer.insert(buffer.end(), other.centroids.begin(),
+                    other.centroids.end());
+      buffer.insert(buffer.end(), other.buffer.begin(), other.buffer.end());
+      ntotal += other.ntotal;
+      min_value = std::min(min_value, other.min_value);
+      max_value = std::max(max_value, other.max_value);
+      if (buffer.size() > 4 * size_t(compression)) compress();
+      return *this;
+    }
+
+    /// Returns the total weight of the values added.
+    double total() const { return ntotal; }
+
+    double min() const { return min_value; }
+
+    double max() const { return max_value; }
+
+    /// Returns the number of centroids after merging the buffered values.
+    size_t size() const {
+      compress();
+      return centroids.size();
+    }
+
+    /**
+     * Returns an estimate of the value below which a fraction q of the
+     * weight lies. Returns NaN if the digest is empty.
+     */
+    double quantile(double q) const {
+      compress();
+      if (centroids.empty()) return std::numeric_limits<double>::quiet_NaN();
+      q = std::min(std::max(q, 0.0), 1.0);
+      const double target = q * ntotal;
+      // interpolate between the centers of adjacent centroids, using the
+      // min and max as the outer ends
+      double left_pos = 0, left_val = min_value;
+      double cum = 0;
+      for (size_t i = 0; i < centroids.size(); ++i) {
+        const double pos = cum + centroids[i].weight / 2;
+        if (target < pos) {
+          return interpolate(left_pos, left_val, pos, centroids[i].mean,
+                             target);
+        }
+        left_pos = pos;
+        left_val = centroids[i].mean;
+        cum += centroids[i].weight;
+      }
+      return interpolate(left_pos, left_val, ntotal, max_value, target);
+    }
+
+    /**
+     * Returns an estimate of the fraction of the weight below value.
+     * Returns NaN if the digest is empty.
+     */
+    double cdf(double value) const {
+      compress();
+      if (centroids.empty()) return std::numeric_limits<double>::quiet_NaN();
+      if (value < min_value) return 0;
+      if (value >= max_value) return 1;
+      double left_pos = 0, left_val = min_value;
+      double cum = 0;
+      for (size_t i = 0; i < centroids.size(); ++i) {
+        const double pos = cum + centroids[i].weight / 2;
+        if (value < centroids[i].mean) {
+          return interpolate(left_val, left_pos, centroids[i].mean, pos,
+                             value) / ntotal;
+        }
+        left_pos = pos;
+        left_val = centroids[i].mean;
+        cum += centroids[i].weight;
+      }
+      return interpolate(left_val, left_pos, max_value, ntotal, value) / ntotal;
+    }
+
+    void save(oarchive& oarc) const {
+      compress();
+      oarc << compression << ntotal << min_value << max_value << centroids;
+    }
+
+    void load(iarchive& iarc) {
+      buffer.clear();
+      iarc >> compression >> ntotal >> min_value >> max_value >> centroids;
+    }
+
+  private:
+    struct centroid : public IS_POD_TYPE {
+      double mean, weight;
+      centroid() : mean(0), weight(0) { }
+      centroid(double mean, double weight) : mean(mean), weight(weight) { }
+      bool operator<(const centroid& other) const { return mean < other.mean; }
+    };
+
+    double compression;
+    /// Sorted by mean. Only compress() modifies the centroids and buffer,
+    /// which is why they are mutable.
+    mutable std::vector<centroid> centroids;
+    /// Values and centroids not merged yet
+    mutable std::vector<centroid> buffer;
+    double ntotal;
+    double min_value, max_value;
+
+    /// The scale function k1 bounding the size of the centroids
+    double scale(double q) const {
+      return compression / (2 * M_PI) * std::asin(2 * q - 1);
+    }
+
+    double inverse_scale(double k) const {
+      if (k >= compression / 4) return 1;
+      return (std::sin(k * 2 * M_PI / compression) + 1) / 2;
+    }
+
+    static double interpolate(double x0, double y0, double x1, double y1,
+                              double x) {
+      if (x1 <= x0) return y1;
+      return y0 + (y1 - y0) * (x - x0) / (x1 - x0);
+    }
+
+    /// Merges the buffer into the centroids.
+    void compress() const {
+      if (buffer.empty()) return;
+      buffer.insert(buffer.end(), centroids.begin(), centroids.end());
+      std::sort(buffer.begin(), buffer.end());
+      centroids.clear();
+      centroid cur = buffer[0];
+      double cum = 0;
+      double qlimit = inverse_scale(scale(0) + 1) * ntotal;
+      for (size_t i = 1; i < buffer.size(); ++i) {
+        if (cum + cur.weight + buffer[i].weight <= qlimit) {
+          cur.weight += buffer[i].weight;
+          cur.mean += (buffer[i].mean - cur.mean) * buffer[i].weight /
+                      cur.weight;
+        } else {
+          centroids.push_back(cur);
+          cum += cur.weight;
+          qlimit = inverse_scale(scale(cum / ntotal) + 1) * ntotal;
+          cur = buffer[i];
+        }
+      }
+      centroids.push_back(cur);
+      buffer.clear();
+    }
+  }; // end of class t_digest
+
+} // namespace graphlab
+#endif
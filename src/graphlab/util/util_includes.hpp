@@ -33,3 +33,6 @@
 #include <graphlab/util/mpi_tools.hpp>
 #include <graphlab/util/empty.hpp>
 #include <graphlab/util/web_util.hpp>
+#include <graphlab/util/hyperloglog.hpp>
+#include <graphlab/util/count_min_sketch.hpp>
+#include <graphlab/util/t_digest.hpp>
@@ -23,11 +23,13 @@
 #include <vector>
 #include <algorithm>
 #include <iostream>
+#include <unistd.h>
 
 
 // #include <cxxtest/TestSuite.h>
 
 #include <graphlab.hpp>
+#include <graphlab/util/fs_util.hpp>
 
 typedef graphlab::distributed_graph<int,int> graph_type;
 
@@ -310,6 +312,77 @@ void test_aggregator(graphlab::distributed_control& dc,
 
 
 
+// Runs every vertex 20 times, slowly enough for snapshots to be taken
+class count_to_twenty :
+  public graphlab::ivertex_program<graph_type, int, int>,
+  public graphlab::IS_POD_TYPE {
+public:
+  edge_dir_type
+  gather_edges(icontext_type& context, const vertex_type& vertex) const {
+    return graphlab::NO_EDGES;
+  }
+  void apply(icontext_type& context, vertex_type& vertex,
+             const gather_type& total) {
+    graphlab::timer::sleep_ms(5);
+    ++vertex.data();
+    if (vertex.data() < 20) context.signal(vertex);
+  }
+  edge_dir_type
+  scatter_edges(icontext_type& context, const vertex_type& vertex) const {
+    return graphlab::NO_EDGES;
+  }
+}; // end of count to twenty
+
+size_t count_not_twenty(const graph_type::vertex_type& vtx) {
+  return vtx.data() != 20;
+}
+
+// Removes the base, delta and latest files of the snapshots at path
+void remove_snapshot_files(graphlab::distributed_control& dc,
+                           const std::string& path) {
+  dc.barrier();
+  std::vector<std::string> files;
+  graphlab::fs_util::list_files_with_prefix(".", path, files);
+  for (size_t i = 0; i < files.size(); ++i) unlink(files[i].c_str());
+  dc.barrier();
+}
+
+void test_snapshot_resume(graphlab::distributed_control& dc,
+                          graphlab::command_line_options& clopts) {
+  std::cout << "Testing asynchronous snapshots" << std::endl;
+  typedef graphlab::async_consistent_engine<count_to_twenty> engine_type;
+  const std::string path = "async_consistent_test_snapshot_";
+  graph_type graph(dc, clopts);
+  graph.load_synthetic_powerlaw(100);
+  graph.finalize();
+  graphlab::command_line_options snap_clopts = clopts;
+  snap_clopts.engine_args.set_option("factorized", false);
+  snap_clopts.engine_args.set_option("snapshot_path", path);
+  {
+    graphlab::command_line_options run_clopts = snap_clopts;
+    run_clopts.engine_args.set_option("snapshot_interval", 0.5);
+    engine_type engine(dc, graph, run_clopts);
+    engine.signal_all();
+    engine.start();
+  }
+  ASSERT_EQ(graph.map_reduce_vertices<size_t>(count_not_twenty), 0);
+  // the snapshot holds the vertex counts and the pending signals of
+  // some point of the run, so resuming must end in the same state
+  graph_type resumed_graph(dc, clopts);
+  resumed_graph.load_binary(path + "base_");
+  snap_clopts.engine_args.set_option("snapshot_resume", true);
+  engine_type engine(dc, resumed_graph, snap_clopts);
+  engine.start();
+  ASSERT_EQ(resumed_graph.map_reduce_vertices<size_t>(count_not_twenty), 0);
+  std::cout << "Resumed and finished" << std::endl;
+  remove_snapshot_files(dc, path);
+}
+
+
+
+
+
+
 int main(int argc, char** argv) {
 
   global_logger().set_log_level(LOG_INFO);
@@ -329,6 +402,7 @@ int main(int argc, char** argv) {
   test_out_neighbors(dc, clopts, graph);
   test_all_neighbors(dc, clopts, graph);
   test_aggregator(dc, clopts, graph);
+  test_snapshot_resume(dc, clopts);
   graphlab::mpi_tools::finalize();
 } // end of main
 
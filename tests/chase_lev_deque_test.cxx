@@ -0,0 +1,106 @@
+/*  
+ * Copyright (c) 2009 Carnegie Mellon University. 
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+
+#include <vector>
+#include <boost/bind.hpp>
+
+#include <cxxtest/TestSuite.h>
+
+#include <graphlab/parallel/chase_lev_deque.hpp>
+#include <graphlab/parallel/pthread_tools.hpp>
+#include <graphlab/parallel/atomic.hpp>
+
+using namespace graphlab;
+
+const size_t NUM_ELEMENTS = 1000000;
+const size_t NUM_THIEVES = 4;
+
+chase_lev_deque<size_t>* deque;
+std::vector<atomic<size_t> > seen;
+atomic<size_t> num_seen;
+
+void owner() {
+  // interleave pushes and pops so that the owner and the thieves
+  // race for the last element
+  size_t val;
+  for (size_t i = 0;i < NUM_ELEMENTS; ++i) {
+    deque->push(i);
+    if (i % 3 == 0 && deque->pop(val)) {
+      seen[val].inc();
+      num_seen.inc();
+    }
+  }
+  while(deque->pop(val)) {
+    seen[val].inc();
+    num_seen.inc();
+  }
+}
+
+void thief() {
+  size_t val;
+  while(num_seen.value < NUM_ELEMENTS) {
+    if (deque->steal(val)) {
+      seen[val].inc();
+      num_seen.inc();
+    }
+  }
+}
+
+class ChaseLevDequeTestSuite : public CxxTest::TestSuite {
+public:
+  void test_sequential() {
+    chase_lev_deque<size_t> d(4);
+    size_t val;
+    TS_ASSERT(d.empty());
+    TS_ASSERT(!d.pop(val));
+    TS_ASSERT(!d.steal(val));
+    // forces the buffer to grow a few times
+    for (size_t i = 0;i < 100; ++i) d.push(i);
+    TS_ASSERT_EQUALS(d.size(), 100);
+    TS_ASSERT(d.steal(val));
+    TS_ASSERT_EQUALS(val, 0);
+    TS_ASSERT(d.pop(val));
+    TS_ASSERT_EQUALS(val, 99);
+    for (size_t i = 1;i < 99; ++i) {
+      TS_ASSERT(d.steal(val));
+      TS_ASSERT_EQUALS(val, i);
+    }
+    TS_ASSERT(d.empty());
+  }
+
+  void test_concurrent() {
+    deque = new chase_lev_deque<size_t>(16);
+    seen.resize(NUM_ELEMENTS);
+    num_seen.value = 0;
+    thread_group group;
+    for (size_t i = 0;i < NUM_THIEVES; ++i) group.launch(thief);
+    group.launch(owner);
+    group.join();
+    TS_ASSERT_EQUALS(num_seen.value, NUM_ELEMENTS);
+    for (size_t i = 0;i < NUM_ELEMENTS; ++i) {
+      TS_ASSERT_EQUALS(seen[i].value, 1);
+    }
+    delete deque;
+  }
+};
@@ -0,0 +1,198 @@
+/*  
+ * Copyright (c) 2009 Carnegie Mellon University. 
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+
+#include <iostream>
+#include <vector>
+#include <boost/bind.hpp>
+#include <graphlab/rpc/dc.hpp>
+#include <graphlab/rpc/dc_dist_object.hpp>
+#include <graphlab/rpc/dc_init_from_mpi.hpp>
+#include <graphlab/rpc/request_continuation.hpp>
+#include <graphlab/parallel/fiber_remote_request.hpp>
+#include <graphlab/parallel/fiber_group.hpp>
+#include <graphlab/parallel/atomic.hpp>
+#include <graphlab/util/mpi_tools.hpp>
+#include <graphlab/util/timer.hpp>
+#include <graphlab/util/generics/conditional_combiner_wrapper.hpp>
+using namespace graphlab;
+
+#define NFIBERS 100
+
+int times_two(int i) {
+  return 2 * i;
+}
+
+void bool_or(bool& a, const bool& b) {
+  a = a || b;
+}
+
+/*
+ * Every process issues continuation requests to every other process
+ * and checks that each callback runs exactly once, with the value
+ * computed on the source of the reply.
+ */
+class continuation_test {
+ public:
+  dc_dist_object<continuation_test> rmi;
+  // number of times the callback ran for a reply from each process
+  std::vector<atomic<size_t> > ncalls;
+  // the value returned by each process
+  std::vector<int> replies;
+  atomic<size_t> nreplies;
+
+  continuation_test(distributed_control &dc):rmi(dc, this) {
+    dc.barrier();
+  }
+
+  int add_procid(int i) {
+    return i + (int)rmi.procid();
+  }
+
+  conditional_combiner_wrapper<bool> is_procid(int p) {
+    return conditional_combiner_wrapper<bool>(p == (int)rmi.procid());
+  }
+
+  void record_reply(procid_t source, int& val) {
+    ncalls[source].inc();
+    replies[source] = val;
+    nreplies.inc();
+  }
+
+  void reset() {
+    ncalls.clear();
+    ncalls.resize(rmi.numprocs(), atomic<size_t>(0));
+    replies.clear();
+    replies.resize(rmi.numprocs(), -1);
+    nreplies.value = 0;
+  }
+
+  // waits for a reply from every process and checks that the reply from
+  // process p ran the callback once with the value expected[p]
+  void wait_and_check(const std::vector<int>& expected) {
+    while (nreplies.value < rmi.numprocs()) timer::sleep_ms(1);
+    // make sure no duplicate replies are still in flight
+    rmi.dc().full_barrier();
+    ASSERT_EQ(nreplies.value, rmi.numprocs());
+    for (procid_t p = 0; p < rmi.numprocs(); ++p) {
+      ASSERT_EQ(ncalls[p].value, 1);
+      ASSERT_EQ(replies[p], expected[p]);
+    }
+  }
+
+  void test_member_callback() {
+    reset();
+    for (procid_t p = 0; p < rmi.numprocs(); ++p) {
+      rmi.continuation_remote_request(p,
+          boost::bind(&continuation_test::record_reply, this, _1, _2),
+          &continuation_test::add_procid, 10);
+    }
+    std::vector<int> expected(rmi.numprocs());
+    for (procid_t p = 0; p < rmi.numprocs(); ++p) expected[p] = 10 + (int)p;
+    wait_and_check(expected);
+    rmi.barrier();
+  }
+
+  void test_free_function() {
+    reset();
+    for (procid_t p = 0; p < rmi.numprocs(); ++p) {
+      continuation_remote_request(p,
+          boost::bind(&continuation_test::record_reply, this, _1, _2),
+          times_two, (int)p);
+    }
+    std::vector<int> expected(rmi.numprocs());
+    for (procid_t p = 0; p < rmi.numprocs(); ++p) expected[p] = 2 * (int)p;
+    wait_and_check(expected);
+    rmi.barrier();
+  }
+
+  // sums i + p over all processes p
+  void combine_from_fiber(int i, atomic<size_t>* nerrors) {
+    fiber_reply_combiner<int> combiner(rmi.numprocs(), 0);
+    for (procid_t p = 0; p < rmi.numprocs(); ++p) {
+      rmi.continuation_remote_request(p, combiner.callback(),
+                                      &continuation_test::add_procid, i);
+    }
+    int total = combiner.wait();
+    int n = rmi.numprocs();
+    if (total != n * i + n * (n - 1) / 2) nerrors->inc();
+  }
+
+  void test_combiner() {
+    // outside of a fiber, the combiner waits on its condition variable
+    atomic<size_t> nerrors(0);
+    combine_from_fiber(5, &nerrors);
+    ASSERT_EQ(nerrors.value, 0);
+    // inside fibers, the combiner deschedules the waiting fiber
+    fiber_group group;
+    for (size_t i = 0; i < NFIBERS; ++i) {
+      group.launch(boost::bind(&continuation_test::combine_from_fiber,
+                               this, (int)i, &nerrors));
+    }
+    group.join();
+    ASSERT_EQ(nerrors.value, 0);
+    rmi.full_barrier();
+  }
+
+  // ors "is process p" over all processes, combining the replies with a
+  // function pointer as warp::map_reduce_neighborhood does
+  bool any_is_procid(int p) {
+    conditional_combiner_wrapper<bool> init;
+    init.set_combiner(bool_or);
+    ASSERT_FALSE(init.has_value);
+    fiber_reply_combiner<conditional_combiner_wrapper<bool> >
+        combiner(rmi.numprocs(), init);
+    for (procid_t q = 0; q < rmi.numprocs(); ++q) {
+      rmi.continuation_remote_request(q, combiner.callback(),
+                                      &continuation_test::is_procid, p);
+    }
+    return combiner.wait().value;
+  }
+
+  void test_bool_combiner() {
+    ASSERT_TRUE(any_is_procid(rmi.numprocs() - 1));
+    ASSERT_FALSE(any_is_procid(rmi.numprocs()));
+    rmi.full_barrier();
+  }
+};
+
+
+int main(int argc, char ** argv) {
+  /** Initialization */
+  mpi_tools::init(argc, argv);
+  global_logger().set_log_level(LOG_INFO);
+
+  dc_init_param param;
+  if (init_param_from_mpi(param) == false) {
+    return 0;
+  }
+  distributed_control dc(param);
+  continuation_test test(dc);
+  test.test_member_callback();
+  test.test_free_function();
+  test.test_combiner();
+  test.test_bool_combiner();
+  dc.barrier();
+  if (dc.procid() == 0) std::cout << "Continuation requests OK" << std::endl;
+  mpi_tools::finalize();
+}
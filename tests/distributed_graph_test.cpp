@@ -104,6 +104,63 @@ class distributed_graph_test  {
      }
    }
 
+   /**
+    * Test that the hybrid ingress counts the in-edges of earlier
+    * finalizes when classifying high-degree vertices.
+    */
+   void test_dynamic_hybrid_ingress() {
+     const size_t threshold = 20;
+     graphlab::graphlab_options opts;
+     opts.get_graph_args().set_option("ingress", "hybrid");
+     opts.get_graph_args().set_option("threshold", threshold);
+     graphlab::distributed_graph<vertex_data, edge_data> g(*dc, opts);
+     if (!g.is_dynamic()) {
+       dc->cout() << "\n- Graph does not support dynamic. Please compile with -DUSE_DYNAMIC_GRAPH \n";
+       return;
+     }
+     // vertex 0 gets threshold in-edges in each of two finalizes. Only the
+     // second batch makes it high-degree.
+     for (size_t batch = 0; batch < 2; ++batch) {
+       for (size_t i = 1; i <= threshold; ++i) {
+         const size_t source = batch * threshold + i;
+         if (source % dc->numprocs() == dc->procid()) {
+           g.add_edge(source, 0, edge_data(source, 0));
+         }
+       }
+       g.finalize();
+     }
+     ASSERT_EQ(g.num_in_edges(0), 2 * threshold);
+     const graphlab::procid_t owner =
+         graphlab::graph_hash::hash_vertex(0) % dc->numprocs();
+     if (g.contains_vertex(0)) {
+       typedef graphlab::distributed_graph<vertex_data, edge_data> graph_type;
+       graph_type::local_vertex_type lvertex(g.l_vertex(g.local_vid(0)));
+       foreach(graph_type::local_edge_type edge, lvertex.in_edges()) {
+         const size_t source = edge.source().global_id();
+         // the first batch stays on the owner, the second one is cut
+         const graphlab::procid_t expected = source <= threshold ? owner :
+             graphlab::graph_hash::hash_vertex(source) % dc->numprocs();
+         ASSERT_EQ(expected, dc->procid());
+       }
+     }
+     dc->cout() << "\n+ Pass test: dynamic hybrid ingress. :) \n";
+   }
+
+   /**
+    * Test adding edges with the compact vid2lvid indices
+    */
+   void test_compact_vid2lvid() {
+     const char* modes[] = {"dense", "sorted", "auto"};
+     for (size_t i = 0; i < 3; ++i) {
+       graphlab::graphlab_options opts;
+       opts.get_graph_args().set_option("vid2lvid", modes[i]);
+       graphlab::distributed_graph<vertex_data, edge_data> g(*dc, opts);
+       test_add_edge_impl(g, 1000);
+       test_save_load_impl(g);
+     }
+     dc->cout() << "\n+ Pass test: compact vid2lvid index. :) \n";
+   }
+
    /**
     * Test save load
     */
@@ -505,6 +562,8 @@ int main(int argc, char** argv) {
   testsuit.test_add_vertex();
   testsuit.test_add_edge();
   testsuit.test_dynamic_add_edge();
+  testsuit.test_dynamic_hybrid_ingress();
+  testsuit.test_compact_vid2lvid();
   testsuit.test_save_load();
 
   delete(dc);
@@ -117,12 +117,51 @@ int main(int argc, char** argv) {
    //   std::cout << "Allocated Size: " << (double)allocate_size/(1024*1024) << "MB" << "\n";
    // }
 
+  // The hybrid ingress must keep every in-edge of a low-degree vertex on
+  // the machine owning it, and spread the in-edges of high-degree vertices.
+  std::string ingress = "random";
+  size_t degree_threshold = 100;
+  clopts.get_graph_args().get_option("ingress", ingress);
+  clopts.get_graph_args().get_option("threshold", degree_threshold);
+  if (ingress == "hybrid") {
+    size_t misplaced = 0;
+    size_t num_high_degree = 0;
+    size_t num_high_degree_mirrors = 0;
+    for (size_t i = 0; i < graph.num_local_vertices(); ++i) {
+      graph_type::local_vertex_type lvertex = graph.l_vertex(i);
+      if (lvertex.global_num_in_edges() <= degree_threshold) {
+        if (lvertex.num_in_edges() > 0 &&
+            (!lvertex.owned() ||
+             lvertex.num_in_edges() != lvertex.global_num_in_edges())) {
+          ++misplaced;
+        }
+      } else if (lvertex.owned()) {
+        ++num_high_degree;
+      } else if (lvertex.num_in_edges() > 0) {
+        ++num_high_degree_mirrors;
+      }
+    }
+    dc.all_reduce(misplaced);
+    dc.all_reduce(num_high_degree);
+    dc.all_reduce(num_high_degree_mirrors);
+    if (dc.procid() == 0) {
+      std::cout << "Hybrid ingress: " << num_high_degree
+                << " high-degree vertices, " << num_high_degree_mirrors
+                << " mirrors holding their in-edges" << std::endl;
+    }
+    ASSERT_EQ(misplaced, 0);
+    if (dc.numprocs() > 1 && num_high_degree > 0) {
+      ASSERT_GT(num_high_degree_mirrors, 0);
+    }
+  }
+
   if (dc.procid() == 0) {
    std::ofstream fout;
    std::vector<std::string> keys = clopts.get_graph_args().get_option_keys();
    std::string ingress_method = "random";
    std::string constraint_graph = "na";
    std::string bufsize = "50000";
+   std::string threshold = "100";
    bool usehash = false; 
    bool userecent = false; 
 
@@ -131,6 +170,8 @@ int main(int argc, char** argv) {
        clopts.get_graph_args().get_option("ingress", ingress_method);
      } else if (opt == "bufsize") {
        clopts.get_graph_args().get_option("bufsize", bufsize);
+     } else if (opt == "threshold") {
+       clopts.get_graph_args().get_option("threshold", threshold);
      } else if (opt == "usehash") {
        clopts.get_graph_args().get_option("usehash", usehash);
      } else if (opt == "userecent") {
@@ -144,6 +185,7 @@ int main(int argc, char** argv) {
    fout << "#ingress: " << ingress_method  << std::endl
      << "#constraint: " << constraint_graph << std::endl
      << "#bufsize: " << bufsize << std::endl
+     << "#threshold: " << threshold << std::endl
      << "#usehash: " << usehash << std::endl
      << "#userecent: " << userecent
      << std::endl;
@@ -0,0 +1,132 @@
+/**
+ * Copyright (c) 2009 Carnegie Mellon University.
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+/*
+ * Runs the asynchronous engine with edge consistency and the "ordered"
+ * locking scheme. Every vertex runs NUPDATES times and each update
+ * increments the data of all of its edges with an unprotected
+ * read-modify-write, so every edge must end with 2 * NUPDATES unless two
+ * neighbors ran at the same time.
+ *
+ * Run on several processes, e.g. mpiexec -n 4 ./distributed_ordered_locks_test
+ */
+#include <iostream>
+#include <string>
+#include <graphlab.hpp>
+#include <graphlab/rpc/dc_init_from_mpi.hpp>
+#include <graphlab/macros_def.hpp>
+
+#define NUPDATES 20
+
+typedef graphlab::distributed_graph<int, int> graph_type;
+
+class increment_edges :
+  public graphlab::ivertex_program<graph_type, int>,
+  public graphlab::IS_POD_TYPE {
+public:
+  edge_dir_type
+  gather_edges(icontext_type& context, const vertex_type& vertex) const {
+    return graphlab::ALL_EDGES;
+  }
+  gather_type
+  gather(icontext_type& context, const vertex_type& vertex,
+         edge_type& edge) const {
+    // widen the window in which a concurrent neighbor would lose an update
+    const int value = edge.data();
+    for (volatile size_t i = 0; i < 1000; ++i);
+    edge.data() = value + 1;
+    return 0;
+  }
+  void apply(icontext_type& context, vertex_type& vertex,
+             const gather_type& total) {
+    ++vertex.data();
+    if (vertex.data() < NUPDATES) context.signal(vertex);
+  }
+  edge_dir_type
+  scatter_edges(icontext_type& context, const vertex_type& vertex) const {
+    return graphlab::NO_EDGES;
+  }
+}; // end of increment edges
+
+size_t count_bad_vertices(const graph_type::vertex_type& vtx) {
+  return vtx.data() != NUPDATES;
+}
+
+size_t count_bad_edges(const graph_type::edge_type& edge) {
+  return edge.data() != 2 * NUPDATES;
+}
+
+int main(int argc, char** argv) {
+  ///! Initialize control plain using mpi
+  graphlab::mpi_tools::init(argc, argv);
+  graphlab::dc_init_param rpc_parameters;
+  graphlab::init_param_from_mpi(rpc_parameters);
+  graphlab::distributed_control dc(rpc_parameters);
+
+  graphlab::command_line_options clopts("distributed ordered locks test.");
+  size_t randomconnect = 300;
+  clopts.attach_option("randomconnect", randomconnect,
+                       "The size of a randomly connected network.");
+  if(!clopts.parse(argc, argv)) {
+    std::cout << "Error in parsing command line arguments." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  graph_type graph(dc, clopts);
+  if(dc.procid() == 0) {
+    for(size_t i = 0; i < randomconnect; ++i) {
+      std::vector<bool> v(randomconnect, false);
+      v[i] = true;
+      for (size_t r = 0; r < 10; ++r) {
+        size_t t = graphlab::random::rand() % randomconnect;
+        if (v[t] == false && t > i) {
+          graph.add_edge(i, t);
+          v[t] = true;
+        }
+      }
+    }
+  }
+  graph.finalize();
+
+  clopts.get_engine_args().set_option("factorized", false);
+  clopts.get_engine_args().set_option("locking", std::string("ordered"));
+  typedef graphlab::async_consistent_engine<increment_edges> engine_type;
+  engine_type engine(dc, graph, clopts);
+  engine.signal_all();
+  engine.start();
+
+  const size_t bad_vertices =
+      graph.map_reduce_vertices<size_t>(count_bad_vertices);
+  const size_t bad_edges = graph.map_reduce_edges<size_t>(count_bad_edges);
+  if (dc.procid() == 0) {
+    std::cout << engine.num_updates() << " updates, "
+              << bad_vertices << " bad vertices, "
+              << bad_edges << " bad edges" << std::endl;
+  }
+  ASSERT_EQ(bad_vertices, 0);
+  ASSERT_EQ(bad_edges, 0);
+  graphlab::mpi_tools::finalize();
+  return EXIT_SUCCESS;
+} // End of main
+
+#include <graphlab/macros_undef.hpp>
@@ -0,0 +1,123 @@
+/*  
+ * Copyright (c) 2009 Carnegie Mellon University. 
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+#include <cstring>
+#include <graphlab/parallel/fiber_stack_pool.hpp>
+#include <graphlab/logger/assertions.hpp>
+
+using namespace graphlab;
+
+class FiberStackPoolTestSuite: public CxxTest::TestSuite {
+ public:  
+  void test_round_and_reuse() {
+    fiber_stack_pool pool;
+    const size_t pagesize = fiber_stack_pool::page_size();
+    size_t stacksize = pagesize + 1;
+    void* s = pool.allocate(stacksize);
+    TS_ASSERT_EQUALS(stacksize, 2 * pagesize);
+    memset(s, 1, stacksize);
+    pool.release(s, stacksize);
+
+    size_t stacksize2 = 2 * pagesize;
+    void* s2 = pool.allocate(stacksize2);
+    TS_ASSERT_EQUALS(s, s2);
+    fiber_stack_pool::stack_stats stats = pool.get_stats();
+    TS_ASSERT_EQUALS(stats.num_mapped, 1);
+    TS_ASSERT_EQUALS(stats.num_reused, 1);
+    TS_ASSERT_EQUALS(stats.peak_usage, 2 * pagesize);
+    pool.release(s2, stacksize2);
+  }
+
+  void test_lazy_commit() {
+    fiber_stack_pool pool(256 * 1024 * 1024, 0);
+    const size_t pagesize = fiber_stack_pool::page_size();
+    size_t stacksize = 1024 * pagesize;
+    char* s = (char*)pool.allocate(stacksize);
+    TS_ASSERT_EQUALS(fiber_stack_pool::measure_usage(s, stacksize), 0);
+    // touch the top three pages only
+    memset(s + stacksize - 3 * pagesize, 1, 3 * pagesize);
+    TS_ASSERT_EQUALS(fiber_stack_pool::measure_usage(s, stacksize),
+                     3 * pagesize);
+    pool.release(s, stacksize);
+    // only the top page holding the free list link is retained
+    s = (char*)pool.allocate(stacksize);
+    TS_ASSERT_EQUALS(fiber_stack_pool::measure_usage(s, stacksize), pagesize);
+    pool.release(s, stacksize);
+  }
+
+  void test_pool_limit() {
+    const size_t pagesize = fiber_stack_pool::page_size();
+    fiber_stack_pool pool(4 * pagesize);
+    std::vector<void*> stacks;
+    size_t stacksize = 2 * pagesize;
+    for (size_t i = 0;i < 3; ++i) stacks.push_back(pool.allocate(stacksize));
+    for (size_t i = 0;i < 3; ++i) pool.release(stacks[i], stacksize);
+    TS_ASSERT_EQUALS(pool.get_stats().num_pooled, 2);
+    pool.clear();
+    TS_ASSERT_EQUALS(pool.get_stats().num_pooled, 0);
+  }
+
+  void test_size_classes() {
+    const size_t pagesize = fiber_stack_pool::page_size();
+    fiber_stack_pool pool;
+    std::vector<void*> stacks;
+    for (size_t i = 0;i <= fiber_stack_pool::MAX_SIZE_CLASSES; ++i) {
+      size_t stacksize = (i + 1) * pagesize;
+      stacks.push_back(pool.allocate(stacksize));
+    }
+    // the last size does not get a free list
+    for (size_t i = 0;i < stacks.size(); ++i) {
+      pool.release(stacks[i], (i + 1) * pagesize);
+    }
+    TS_ASSERT_EQUALS(pool.get_stats().num_pooled,
+                     (size_t)fiber_stack_pool::MAX_SIZE_CLASSES);
+    // once a size is drained, its class can be claimed by another size
+    size_t stacksize = pagesize;
+    void* s = pool.allocate(stacksize);
+    TS_ASSERT_EQUALS(s, stacks[0]);
+    stacksize = 20 * pagesize;
+    s = pool.allocate(stacksize);
+    pool.release(s, stacksize);
+    TS_ASSERT_EQUALS(pool.get_stats().num_pooled,
+                     (size_t)fiber_stack_pool::MAX_SIZE_CLASSES);
+    stacksize = 20 * pagesize;
+    TS_ASSERT_EQUALS(pool.allocate(stacksize), s);
+    pool.release(s, stacksize);
+    pool.release(stacks[0], pagesize);
+  }
+
+  void test_usage_sampling() {
+    const size_t pagesize = fiber_stack_pool::page_size();
+    fiber_stack_pool pool(256 * 1024 * 1024, 16384, 4);
+    size_t stacksize = 4 * pagesize;
+    for (size_t i = 0;i < 8; ++i) {
+      void* s = pool.allocate(stacksize);
+      pool.release(s, stacksize);
+    }
+    TS_ASSERT_EQUALS(pool.get_stats().num_measured, 2);
+    pool.set_usage_sample_interval(0);
+    void* s = pool.allocate(stacksize);
+    pool.release(s, stacksize);
+    TS_ASSERT_EQUALS(pool.get_stats().num_measured, 2);
+  }
+};
@@ -0,0 +1,123 @@
+/**
+ * Copyright (c) 2009 Carnegie Mellon University.
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+#include <vector>
+#include <boost/bind.hpp>
+#include <graphlab/parallel/fiber_control.hpp>
+#include <graphlab/parallel/atomic.hpp>
+#include <graphlab/util/timer.hpp>
+#include <cxxtest/TestSuite.h>
+
+using namespace graphlab;
+
+const size_t NWORKERS = 4;
+const size_t NFIBERS = 64;
+const size_t NYIELDS = 20;
+
+// bit w of seen_on[i] is set if fiber i ran on worker w
+std::vector<atomic<size_t> > seen_on;
+
+void busy_fiber(size_t id) {
+  for (size_t i = 0; i < NYIELDS; ++i) {
+    __sync_fetch_and_or(&seen_on[id].value,
+                        size_t(1) << fiber_control::get_worker_id());
+    timer ti; ti.start();
+    while (ti.current_time() < 0.0005);
+    fiber_control::yield();
+  }
+}
+
+// Runs on worker 0 and launches the children from there, so that they
+// are all queued on worker 0 unless their affinity says otherwise.
+void spawner(fiber_control* fc, fiber_control::affinity_type child_affinity) {
+  for (size_t i = 0; i < NFIBERS; ++i) {
+    fc->launch(boost::bind(busy_fiber, i), 8192, child_affinity);
+  }
+}
+
+size_t total_steals(fiber_control& fc) {
+  std::vector<fiber_control::worker_stats> stats = fc.get_worker_stats();
+  size_t nsteals = 0;
+  for (size_t i = 0; i < stats.size(); ++i) nsteals += stats[i].nsteals;
+  return nsteals;
+}
+
+void run_spawner(fiber_control& fc, fiber_control::affinity_type child_affinity) {
+  seen_on.clear();
+  seen_on.resize(NFIBERS, atomic<size_t>(0));
+  fc.reset_worker_stats();
+  fiber_control::affinity_type worker0;
+  worker0.set_bit(0);
+  fc.launch(boost::bind(spawner, &fc, child_affinity), 8192, worker0);
+  fc.join();
+}
+
+// fiber_control owns process-wide thread-local state, so every test
+// shares the one instance.
+fiber_control& get_fiber_control() {
+  static bool initialized = false;
+  if (!initialized) {
+    fiber_control::instance_set_parameters(NWORKERS, 0);
+    initialized = true;
+  }
+  return fiber_control::get_instance();
+}
+
+class FiberWorkStealingTestSuite: public CxxTest::TestSuite {
+ public:
+  // must run first, before any test turns stealing on
+  void test_no_stealing_by_default() {
+    fiber_control& fc = get_fiber_control();
+    run_spawner(fc, fiber_control::all_affinity());
+    TS_ASSERT_EQUALS(total_steals(fc), 0);
+    for (size_t i = 0; i < NFIBERS; ++i) {
+      TS_ASSERT_EQUALS(seen_on[i].value, 1);
+    }
+  }
+
+  void test_unpinned_fibers_migrate() {
+    fiber_control& fc = get_fiber_control();
+    fc.set_work_stealing(true);
+    run_spawner(fc, fiber_control::all_affinity());
+    fc.set_work_stealing(false);
+    TS_ASSERT_LESS_THAN(0, total_steals(fc));
+    size_t migrated = 0;
+    for (size_t i = 0; i < NFIBERS; ++i) {
+      migrated += (seen_on[i].value & ~size_t(1)) != 0;
+    }
+    TS_ASSERT_LESS_THAN(0, migrated);
+  }
+
+  void test_pinned_fibers_stay() {
+    fiber_control& fc = get_fiber_control();
+    fc.set_work_stealing(true);
+    fiber_control::affinity_type worker0;
+    worker0.set_bit(0);
+    run_spawner(fc, worker0);
+    fc.set_work_stealing(false);
+    TS_ASSERT_EQUALS(total_steals(fc), 0);
+    for (size_t i = 0; i < NFIBERS; ++i) {
+      TS_ASSERT_EQUALS(seen_on[i].value, 1);
+    }
+  }
+};
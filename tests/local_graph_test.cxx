@@ -28,6 +28,7 @@
 // includes the entire graphlab framework
 #include <graphlab/graph/local_graph.hpp>
 #include <graphlab/graph/dynamic_local_graph.hpp>
+#include <graphlab/graph/ingress/ingress_edge_spill.hpp>
 #include <graphlab/util/random.hpp>
 #include <graphlab/macros_def.hpp>
 
@@ -48,6 +49,11 @@ public:
     edge_data (int f = 0, int t = 0) : from(f), to(t) {}
   };
 
+  struct spill_record : public graphlab::IS_POD_TYPE {
+    graphlab::vertex_id_type source;
+    graphlab::vertex_id_type target;
+  };
+
   /**
    * Test add vertex and add edges
    */
@@ -131,7 +137,81 @@ public:
     std::cout << "\n+ Pass test: grid dynamic graph test. :) \n";
   }
 
+  void test_streaming_finalize() {
+    test_streaming_finalize_impl(100);
+    test_streaming_finalize_impl(10000);
+    std::cout << "\n+ Pass test: graph streaming finalize from spilled runs. :) \n";
+  }
+
 private: 
+  struct spill_collector {
+    std::vector<spill_record>& out;
+    spill_collector(std::vector<spill_record>& out) : out(out) { }
+    void operator()(const spill_record& rec) const { out.push_back(rec); }
+  };
+
+  typedef graphlab::local_graph<vertex_data, edge_data>::edge_callback_type
+    edge_callback_type;
+
+  void stream_edges(const edge_callback_type& callback,
+                    const std::vector<spill_record>& edges) {
+    foreach(const spill_record& rec, edges) {
+      callback(rec.source, rec.target, edge_data(rec.source, rec.target));
+    }
+  }
+
+  void test_streaming_finalize_impl(size_t nedges) {
+    typedef graphlab::local_graph<vertex_data, edge_data> graph_type;
+    typedef graph_type::vertex_id_type vertex_id_type;
+    srand(0);
+    const size_t nverts = 3*sqrt(nedges);
+    boost::unordered_map<vertex_id_type, std::vector<vertex_id_type> > out_edges;
+    boost::unordered_map<vertex_id_type, std::vector<vertex_id_type> > in_edges;
+    boost::unordered_set< std::pair<vertex_id_type,vertex_id_type> > all_edges;
+    std::vector<graphlab::edge_id_type> out_degree(nverts), in_degree(nverts);
+    // Keep each run small and the fan-in low so that the merge spans
+    // many runs and needs several passes.
+    const size_t max_fanin = 4;
+    graphlab::ingress_edge_spill<spill_record> 
+      spill("local_graph_test_spill", 64 * sizeof(spill_record), max_fanin);
+    while (all_edges.size() < nedges) {
+      spill_record rec;
+      rec.source = rand() % nverts;
+      rec.target = rand() % nverts;
+      if (rec.source == rec.target) continue;
+      std::pair<vertex_id_type,vertex_id_type> pair(rec.source, rec.target);
+      if (all_edges.insert(pair).second) {
+        out_edges[rec.source].push_back(rec.target);
+        in_edges[rec.target].push_back(rec.source);
+        ++out_degree[rec.source];
+        ++in_degree[rec.target];
+        spill.add(rec);
+      }
+    }
+    spill.finish();
+    ASSERT_EQ(spill.size(), nedges);
+    ASSERT_GT(spill.num_runs(), 1);
+
+    std::vector<spill_record> merged;
+    spill.merge(spill_collector(merged));
+    ASSERT_LE(spill.num_runs(), max_fanin);
+    spill.clear();
+    ASSERT_EQ(merged.size(), nedges);
+    for (size_t i = 1; i < merged.size(); ++i) {
+      ASSERT_TRUE(merged[i-1].source < merged[i].source ||
+                  (merged[i-1].source == merged[i].source &&
+                   merged[i-1].target < merged[i].target));
+    }
+
+    graph_type g;
+    g.resize(nverts);
+    g.finalize_streaming(out_degree, in_degree,
+                         boost::bind(&local_graph_test::stream_edges, this,
+                                     _1, boost::cref(merged)));
+    check_adjacency(g, in_edges, out_edges, nedges);
+    check_edge_data(g);
+  }
+
   template<typename Graph>
   void test_add_vertex_impl(Graph& g, size_t nverts) {
     g.clear();
@@ -0,0 +1,110 @@
+/*  
+ * Copyright (c) 2009 Carnegie Mellon University. 
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+#include <vector>
+#include <sstream>
+#include <graphlab/util/mmap_allocator.hpp>
+#include <graphlab/util/hopscotch_map.hpp>
+#include <graphlab/serialization/serialization_includes.hpp>
+#include <graphlab/logger/assertions.hpp>
+
+using namespace graphlab;
+
+class MmapAllocatorTestSuite: public CxxTest::TestSuite {
+ public:
+  typedef std::vector<size_t, mmap_allocator<size_t> > vector_type;
+
+  void fill_and_check(mmap_alloc::mode_type mode) {
+    mmap_alloc::set_mode(mode);
+    vector_type small(10, 1);
+    // larger than a huge page, so it is mapped in every mode but malloc
+    vector_type large;
+    for (size_t i = 0; i < 1000000; ++i) large.push_back(i);
+    mmap_alloc::set_mode(mmap_alloc::MALLOC);
+    // memory is freed correctly after the mode changed
+    large.resize(2000000, 7);
+    for (size_t i = 0; i < 1000000; ++i) TS_ASSERT_EQUALS(large[i], i);
+    TS_ASSERT_EQUALS(large[1999999], 7);
+    TS_ASSERT_EQUALS(small[9], 1);
+  }
+
+  void test_modes() {
+    fill_and_check(mmap_alloc::MALLOC);
+    fill_and_check(mmap_alloc::HUGEPAGE);
+    fill_and_check(mmap_alloc::HUGETLB);
+    fill_and_check(mmap_alloc::FILE_BACKED);
+  }
+
+  // the whole requested range must be backed, up to its last byte
+  void test_write_last_byte() {
+    mmap_alloc::mode_type modes[] = {mmap_alloc::HUGEPAGE,
+                                     mmap_alloc::HUGETLB,
+                                     mmap_alloc::FILE_BACKED};
+    size_t sizes[] = {3 * 1024 * 1024, 5 * 1024 * 1024 + 123};
+    for (size_t m = 0; m < 3; ++m) {
+      mmap_alloc::set_mode(modes[m]);
+      for (size_t s = 0; s < 2; ++s) {
+        char* ptr = (char*)mmap_alloc::allocate(sizes[s]);
+        TS_ASSERT(ptr != NULL);
+        ptr[0] = 1;
+        ptr[sizes[s] - 1] = 2;
+        TS_ASSERT_EQUALS(ptr[0], 1);
+        TS_ASSERT_EQUALS(ptr[sizes[s] - 1], 2);
+        mmap_alloc::deallocate(ptr);
+      }
+    }
+    mmap_alloc::set_mode(mmap_alloc::MALLOC);
+  }
+
+  void test_set_mode_by_name() {
+    TS_ASSERT(mmap_alloc::set_mode("file", "/tmp"));
+    TS_ASSERT_EQUALS(mmap_alloc::get_mode(), mmap_alloc::FILE_BACKED);
+    TS_ASSERT(!mmap_alloc::set_mode("bogus"));
+    TS_ASSERT(mmap_alloc::set_mode("malloc"));
+  }
+
+  void test_adopt_and_serialize() {
+    mmap_alloc::set_mode(mmap_alloc::HUGEPAGE);
+    std::vector<size_t> src(1000000, 3);
+    vector_type dst;
+    vector_adopt(dst, src);
+    TS_ASSERT(src.empty());
+    TS_ASSERT_EQUALS(dst.size(), 1000000);
+
+    std::stringstream strm;
+    oarchive oarc(strm);
+    oarc << dst;
+    strm.flush();
+    iarchive iarc(strm);
+    std::vector<size_t> loaded;
+    iarc >> loaded;
+    TS_ASSERT_EQUALS(loaded.size(), dst.size());
+    TS_ASSERT_EQUALS(loaded[999999], 3);
+
+    hopscotch_map<size_t, size_t, boost::hash<size_t>, std::equal_to<size_t>,
+                  mmap_allocator<std::pair<size_t, size_t> > > map;
+    for (size_t i = 0; i < 200000; ++i) map[i] = 2 * i;
+    for (size_t i = 0; i < 200000; ++i) TS_ASSERT_EQUALS(map[i], 2 * i);
+    mmap_alloc::set_mode(mmap_alloc::MALLOC);
+  }
+};
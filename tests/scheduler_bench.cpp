@@ -0,0 +1,119 @@
+/*  
+ * Copyright (c) 2009 Carnegie Mellon University. 
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <graphlab/scheduler/scheduler_factory.hpp>
+#include <graphlab/parallel/pthread_tools.hpp>
+#include <graphlab/parallel/atomic.hpp>
+#include <graphlab/util/random.hpp>
+#include <graphlab/util/timer.hpp>
+#include <graphlab/logger/assertions.hpp>
+
+/*
+ * Measures the throughput of the priority schedulers under a synthetic
+ * workload resembling asynchronous shortest paths: every task pops a
+ * vertex and schedules two random vertices with a priority slightly
+ * below the one it popped.
+ *
+ * Usage: scheduler_bench [nthreads] [nvertices] [ntasks]
+ */
+using namespace graphlab;
+
+size_t NUM_VERTICES = 1000000;
+size_t NUM_TASKS = 10000000;
+
+void worker(ischeduler* sched, atomic<int64_t>* budget, atomic<size_t>* pops,
+            size_t threadid) {
+  size_t local_pops = 0;
+  lvid_type vid;
+  while(1) {
+    if (sched->get_next(threadid, vid) == sched_status::NEW_TASK) {
+      ++local_pops;
+      if (budget->value > 0 && budget->dec() >= 0) {
+        const double base = -double(local_pops % 1000);
+        for (size_t i = 0; i < 2; ++i) {
+          sched->schedule(random::fast_uniform<lvid_type>(0, NUM_VERTICES - 1),
+                          base - random::fast_uniform<double>(0, 10));
+        }
+      }
+    } else if (budget->value <= 0) {
+      break;
+    }
+  }
+  pops->inc(local_pops);
+}
+
+double run(const std::string& name, size_t nthreads) {
+  graphlab_options opts;
+  opts.set_ncpus(nthreads);
+  opts.set_scheduler_type(name);
+  ischeduler* sched = scheduler_factory::new_scheduler(NUM_VERTICES, opts);
+  // seed the schedule
+  for (size_t i = 0; i < 16 * nthreads; ++i) {
+    sched->schedule(random::fast_uniform<lvid_type>(0, NUM_VERTICES - 1), 0);
+  }
+  atomic<int64_t> budget(NUM_TASKS);
+  atomic<size_t> pops(0);
+  timer ti; ti.start();
+  thread_group group;
+  for (size_t i = 0; i < nthreads; ++i) {
+    group.launch(boost::bind(worker, sched, &budget, &pops, i));
+  }
+  group.join();
+  const double runtime = ti.current_time();
+  delete sched;
+  return pops.value / runtime / 1e6;
+}
+
+int main(int argc, char** argv) {
+  size_t max_threads = thread::cpu_count();
+  if (argc > 1) max_threads = atoi(argv[1]);
+  if (argc > 2) NUM_VERTICES = atoi(argv[2]);
+  if (argc > 3) NUM_TASKS = atoi(argv[3]);
+  ASSERT_GT(max_threads, 0);
+
+  std::vector<std::string> schedulers;
+  schedulers.push_back("priority");
+  schedulers.push_back("multiqueue");
+  schedulers.push_back("bucket");
+
+  std::cout << "threads";
+  for (size_t i = 0; i < schedulers.size(); ++i) {
+    std::cout << "\t" << schedulers[i];
+  }
+  std::cout << "\t(million tasks / s)" << std::endl;
+  for (size_t nthreads = 1; nthreads <= max_threads; nthreads *= 2) {
+    std::cout << nthreads;
+    for (size_t i = 0; i < schedulers.size(); ++i) {
+      std::cout << "\t" << run(schedulers[i], nthreads);
+    }
+    std::cout << std::endl;
+    if (nthreads < max_threads && nthreads * 2 > max_threads) {
+      nthreads = max_threads / 2;
+    }
+  }
+}
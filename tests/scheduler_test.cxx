@@ -21,275 +21,275 @@
  */
 
 
-#include <fstream>
 #include <vector>
+#include <algorithm>
+#include <boost/bind.hpp>
 #include <graphlab/scheduler/scheduler_includes.hpp>
-#include <graphlab/rpc/async_consensus.hpp>
+#include <graphlab/parallel/pthread_tools.hpp>
 #include <graphlab/parallel/atomic.hpp>
+#include <graphlab/util/timer.hpp>
 #include <cxxtest/TestSuite.h>
 
 
 using namespace graphlab;
 
-distributed_control dc;
-
-struct message_type {
-  int value;
-  double pr;
-
-  explicit message_type(int value = 0, double pr = 0):value(value),pr(pr) { }
-  
-  double priority() const {
-    return pr;
-  }
-  message_type& operator+=(const message_type& other) {
-    value += other.value;
-    pr = other.value;
-    return *this;
-  }
-};
-
-
 const size_t NCPUS = 4;
-const size_t NUM_VERTICES = 101;
+const size_t NUM_VERTICES = 1001;
 std::vector<atomic<int> > correctness_counter;
 
 
+/*
+ * Schedules every vertex (twice, to exercise deduplication) and pops
+ * round-robin over the cpus on one thread. Every vertex must come out
+ * exactly once.
+ */
 template <typename SchedulerType>
-void test_scheduler_basic_functionality_single_threaded() {
-  graphlab_options opts;
+void test_scheduler_exactly_once_single_threaded(graphlab_options opts) {
   opts.set_ncpus(NCPUS);
   SchedulerType sched(NUM_VERTICES, opts);
-  const size_t target_value = 100;
-  
-  // inject a sequence of messages which will sum to 100 per vertex
-  for (size_t c = 0;c < target_value; ++c) {
-    for (size_t i = 0; i < NUM_VERTICES; ++i) {
-      sched.schedule(i, message_type(1, 1.0));
-    }
+  for (size_t r = 0; r < 2; ++r) {
+    for (size_t i = 0; i < NUM_VERTICES; ++i) sched.schedule(i, 1.0);
   }
   correctness_counter.clear();
   correctness_counter.resize(NUM_VERTICES, atomic<int>(0));
-  sched.start();
-  
-  // pull stuff out
-  bool allcpus_done = false; 
+
+  bool allcpus_done = false;
   while(!allcpus_done) {
     allcpus_done = true;
     for (size_t i = 0; i < NCPUS; ++i) {
-      vertex_id_type v; message_type m;
-      sched_status::status_enum ret = sched.get_next(i, v, m);
-      if (ret == sched_status::NEW_TASK) {
+      lvid_type v;
+      if (sched.get_next(i, v) == sched_status::NEW_TASK) {
         allcpus_done = false;
-        correctness_counter[v].inc(m.value);
+        TS_ASSERT_LESS_THAN(v, NUM_VERTICES);
+        correctness_counter[v].inc();
       }
     }
   }
-
-  // check the counters
+  TS_ASSERT(sched.empty());
   for(size_t i = 0; i < NUM_VERTICES; ++i) {
-    TS_ASSERT_EQUALS(correctness_counter[i].value, (int)target_value);
+    TS_ASSERT_EQUALS(correctness_counter[i].value, 1);
   }
 }
 
 
-
-
-
-template <typename SchedulerType>
-void test_basic_functionality_thread(SchedulerType& sched, 
-                                     async_consensus& consensus, 
-                                     size_t schedule_count,
-                                     size_t threadid) {
-  size_t c = 0;
-  vertex_id_type v; message_type m;
-  while(1) {
-    // process as many tasks as I can
-    while(1) {
-      sched_status::status_enum ret = sched.get_next(threadid, v, m);
-      if (ret == sched_status::NEW_TASK) {
-        correctness_counter[v].inc(m.value);
-      }
-      else {
-        break;
-      }
-    }
-    
-    // schedule 1 cycle. If I schedule stuff I go back to processing tasks
-    if (c < schedule_count) {
-      for (size_t i = 0; i < NUM_VERTICES; ++i) {
-        sched.schedule(i, message_type(1, 1.0));
-        consensus.cancel();
-      }
-      ++c;
-      continue;
-    }
-    
-    // nothing to schedule, nothing to run. try to quit
-    consensus.begin_done_critical_section(threadid);
-    sched_status::status_enum ret = sched.get_next(threadid, v, m);
-    if (ret == sched_status::NEW_TASK) {
-      // there is task. cancel, process it, and look back
-      consensus.cancel_critical_section(threadid);
-      correctness_counter[v].inc(m.value);
-    }
-    else {
-      // no more tasks try to finish up
-      bool ret = consensus.end_done_critical_section(threadid);
-      if (ret) break;
+/*
+ * Each thread pops vertices and reschedules a popped vertex until it has
+ * run NUM_ROUNDS times. A vertex is rescheduled only by the thread which
+ * just popped it, so it is never scheduled twice at once and must run
+ * exactly NUM_ROUNDS times.
+ */
+const int NUM_ROUNDS = 100;
+
+void test_exactly_once_thread(ischeduler* sched, atomic<size_t>* total,
+                              size_t threadid) {
+  const size_t target = NUM_VERTICES * NUM_ROUNDS;
+  timer ti; ti.start();
+  lvid_type v;
+  while(total->value < target && ti.current_time() < 60) {
+    if (sched->get_next(threadid, v) == sched_status::NEW_TASK) {
+      if (correctness_counter[v].inc() < NUM_ROUNDS) sched->schedule(v, 1.0);
+      total->inc();
     }
   }
 }
 
-
 template <typename SchedulerType>
-void test_scheduler_basic_functionality_parallel() {
-  graphlab_options opts;
+void test_scheduler_exactly_once_parallel(graphlab_options opts) {
   opts.set_ncpus(NCPUS);
   SchedulerType sched(NUM_VERTICES, opts);
-  async_consensus consensus(dc, NCPUS);
-  
-  const size_t schedule_count = 10000;
-  const size_t target_value = schedule_count * NCPUS + 1;
-
   correctness_counter.clear();
   correctness_counter.resize(NUM_VERTICES, atomic<int>(0));
+  for (size_t i = 0; i < NUM_VERTICES; ++i) sched.schedule(i, 1.0);
 
-  // inject a sequence of messages which will sum to 100 per vertex
-  for (size_t i = 0; i < NUM_VERTICES; ++i) {
-    sched.schedule(i, message_type(1, 1.0));
-  }
-  sched.start();
-  
+  atomic<size_t> total(0);
   thread_group group;
   for (size_t i = 0;i < NCPUS;++i) {
-    group.launch(boost::bind(test_basic_functionality_thread<SchedulerType>,
-                             boost::ref(sched), boost::ref(consensus), schedule_count, i));
+    group.launch(boost::bind(test_exactly_once_thread,
+                             &sched, &total, i));
   }
-
   group.join();
-  // check the counters
+  TS_ASSERT_EQUALS(total.value, NUM_VERTICES * NUM_ROUNDS);
   for(size_t i = 0; i < NUM_VERTICES; ++i) {
-    TS_ASSERT_EQUALS(correctness_counter[i].value, (int)target_value);
+    TS_ASSERT_EQUALS(correctness_counter[i].value, NUM_ROUNDS);
   }
 }
 
 
-
-
-
-
-
 /*
- * Like test_basic_functionality_thread, but only increments the 
- * correctness_counter by 1, and checks to make sure the priority is at least
- * 100.0
+ * Schedules the vertices in a scrambled order with priority -rank, as
+ * shortest paths does with distances, then pops them on one cpu.
+ * Returns the number of pops whose rank is more than "slack" away from
+ * the pop position.
  */
 template <typename SchedulerType>
-void test_scheduler_min_priority_thread(SchedulerType& sched, 
-                                        async_consensus& consensus, 
-                                        size_t schedule_count,
-                                        size_t threadid) {
-  size_t c = 0;
-  vertex_id_type v; message_type m;
-  while(1) {
-    // process as many tasks as I can
-    while(1) {
-      sched_status::status_enum ret = sched.get_next(threadid, v, m);
-      if (ret == sched_status::NEW_TASK) {
-        TS_ASSERT_LESS_THAN_EQUALS(100.0, m.priority());
-        correctness_counter[v].inc(1);
-      }
-      else {
-        break;
-      }
-    }
-    
-    // schedule 1 cycle. If I schedule stuff I go back to processing tasks
-    if (c < schedule_count) {
-      for (size_t i = 0; i < NUM_VERTICES; ++i) {
-        sched.schedule(i, message_type(1, 1.0));
-        consensus.cancel();
-      }
-      ++c;
-      continue;
-    }
-    
-    // nothing to schedule, nothing to run. try to quit
-    consensus.begin_done_critical_section(threadid);
-    sched_status::status_enum ret = sched.get_next(threadid, v, m);
-    if (ret == sched_status::NEW_TASK) {
-      TS_ASSERT_LESS_THAN_EQUALS(100.0, m.priority());
-      // there is task. cancel, process it, and look back
-      consensus.cancel_critical_section(threadid);
-      correctness_counter[v].inc(1);
-    }
-    else {
-      // no more tasks try to finish up
-      bool ret = consensus.end_done_critical_section(threadid);
-      if (ret) break;
-    }
+size_t scheduler_rank_errors(const graphlab_options& opts, size_t slack) {
+  SchedulerType sched(NUM_VERTICES, opts);
+  std::vector<size_t> rank(NUM_VERTICES);
+  for (size_t i = 0; i < NUM_VERTICES; ++i) {
+    // 997 is coprime with NUM_VERTICES, so this is a permutation
+    rank[i] = (i * 997) % NUM_VERTICES;
+  }
+  for (size_t i = 0; i < NUM_VERTICES; ++i) {
+    sched.schedule(i, -double(rank[i]));
+  }
+  size_t errors = 0;
+  size_t position = 0;
+  lvid_type v;
+  while (sched.get_next(0, v) == sched_status::NEW_TASK) {
+    const size_t r = rank[v];
+    if (std::max(r, position) - std::min(r, position) > slack) ++errors;
+    ++position;
   }
+  TS_ASSERT_EQUALS(position, NUM_VERTICES);
+  return errors;
 }
 
 
-template <typename SchedulerType>
-void test_scheduler_min_priority_parallel() {
-  graphlab_options opts;
-  opts.set_ncpus(NCPUS);
-  opts.get_scheduler_args().set_option("min_priority", 100.0);
-  
-  SchedulerType sched(NUM_VERTICES, opts);
-  async_consensus consensus(dc, NCPUS);
-  
-  const size_t schedule_count = 10000;
-  const size_t maximum_value = (size_t)((schedule_count * NCPUS + 101.0) / 100.0);
+class SchedulerTestSuite : public CxxTest::TestSuite {
+public:
+  void test_scheduler_exactly_once_single_threaded() {
+    graphlab_options opts;
+    ::test_scheduler_exactly_once_single_threaded<sweep_scheduler>(opts);
+    ::test_scheduler_exactly_once_single_threaded<fifo_scheduler>(opts);
+    ::test_scheduler_exactly_once_single_threaded<priority_scheduler>(opts);
+    ::test_scheduler_exactly_once_single_threaded<queued_fifo_scheduler>(opts);
+    ::test_scheduler_exactly_once_single_threaded<multiqueue_priority_scheduler>(opts);
+    ::test_scheduler_exactly_once_single_threaded<bucket_priority_scheduler>(opts);
+    ::test_scheduler_exactly_once_single_threaded<locality_scheduler>(opts);
+    ::test_scheduler_exactly_once_single_threaded<work_stealing_scheduler>(opts);
+  }
 
-  correctness_counter.clear();
-  correctness_counter.resize(NUM_VERTICES, atomic<int>(0));
+  void test_scheduler_exactly_once_parallel() {
+    graphlab_options opts;
+    ::test_scheduler_exactly_once_parallel<sweep_scheduler>(opts);
+    ::test_scheduler_exactly_once_parallel<fifo_scheduler>(opts);
+    ::test_scheduler_exactly_once_parallel<priority_scheduler>(opts);
+    ::test_scheduler_exactly_once_parallel<queued_fifo_scheduler>(opts);
+    ::test_scheduler_exactly_once_parallel<multiqueue_priority_scheduler>(opts);
+    ::test_scheduler_exactly_once_parallel<bucket_priority_scheduler>(opts);
+    ::test_scheduler_exactly_once_parallel<locality_scheduler>(opts);
+    ::test_scheduler_exactly_once_parallel<work_stealing_scheduler>(opts);
+  }
 
-  // inject a sequence of messages which will sum to 100 per vertex
-  for (size_t i = 0; i < NUM_VERTICES; ++i) {
-    sched.schedule(i, message_type(1, 101.0));
+  void test_priority_order() {
+    graphlab_options opts;
+    opts.set_ncpus(NCPUS);
+    // buckets are global, so the order is exact with one rank per bucket
+    TS_ASSERT_EQUALS(scheduler_rank_errors<bucket_priority_scheduler>(opts, 0), 0);
+    // the multiqueue samples 2 of multi * ncpus = 8 heaps per pop, so a
+    // vertex may come out a few dozen pops early or late
+    TS_ASSERT_LESS_THAN_EQUALS(
+        scheduler_rank_errors<multiqueue_priority_scheduler>(opts, 64),
+        NUM_VERTICES / 20);
+    // the priority scheduler only orders within a queue
+    graphlab_options single_queue;
+    single_queue.set_ncpus(1);
+    single_queue.get_scheduler_args().set_option("multi", 1);
+    TS_ASSERT_EQUALS(scheduler_rank_errors<priority_scheduler>(single_queue, 0), 0);
   }
-  sched.start();
-  
-  thread_group group;
-  for (size_t i = 0;i < NCPUS;++i) {
-    group.launch(boost::bind(test_scheduler_min_priority_thread<SchedulerType>,
-                             boost::ref(sched), boost::ref(consensus), schedule_count, i));
+
+  void test_bucket_priority_delta() {
+    // with 10 ranks per bucket the order only holds across buckets
+    graphlab_options opts;
+    opts.set_ncpus(NCPUS);
+    opts.get_scheduler_args().set_option("delta", 10.0);
+    TS_ASSERT_EQUALS(scheduler_rank_errors<bucket_priority_scheduler>(opts, 9), 0);
   }
 
-  group.join();
-  // check the counters
-  for(size_t i = 0; i < NUM_VERTICES; ++i) {
-    TS_ASSERT_LESS_THAN_EQUALS(correctness_counter[i].value, (int)maximum_value);
+  void test_multiqueue_min_priority() {
+    graphlab_options opts;
+    opts.set_ncpus(NCPUS);
+    opts.get_scheduler_args().set_option("min_priority", 0.0);
+    multiqueue_priority_scheduler sched(NUM_VERTICES, opts);
+    for (size_t i = 0; i < NUM_VERTICES; ++i) {
+      sched.schedule(i, (i % 2) ? -1.0 : 1.0);
+    }
+    size_t count = 0;
+    lvid_type v;
+    while (sched.get_next(0, v) == sched_status::NEW_TASK) {
+      TS_ASSERT_EQUALS(v % 2, 0);
+      ++count;
+    }
+    TS_ASSERT_EQUALS(count, (NUM_VERTICES + 1) / 2);
+    TS_ASSERT(sched.empty());
   }
-}
 
-class SerializeTestSuite : public CxxTest::TestSuite {
-public:
-  void test_scheduler_basic_single_threaded() {
-    test_scheduler_basic_functionality_single_threaded<sweep_scheduler<message_type> >();
-    test_scheduler_basic_functionality_single_threaded<fifo_scheduler<message_type> >();
-    test_scheduler_basic_functionality_single_threaded<priority_scheduler<message_type> >();
-    test_scheduler_basic_functionality_single_threaded<queued_fifo_scheduler<message_type> >();
+  void test_locality_block_order() {
+    // a single cpu walks the blocks, and each block, in lvid order
+    // regardless of the order in which the vertices were scheduled
+    graphlab_options opts;
+    opts.set_ncpus(1);
+    opts.get_scheduler_args().set_option("block_size", 16);
+    locality_scheduler sched(NUM_VERTICES, opts);
+    for (size_t i = NUM_VERTICES; i > 0; --i) sched.schedule(i - 1);
+    lvid_type v;
+    for (size_t i = 0; i < NUM_VERTICES; ++i) {
+      TS_ASSERT_EQUALS(sched.get_next(0, v), sched_status::NEW_TASK);
+      TS_ASSERT_EQUALS(v, i);
+    }
+    TS_ASSERT_EQUALS(sched.get_next(0, v), sched_status::EMPTY);
+    TS_ASSERT(sched.empty());
   }
-  
-  void test_scheduler_basic_parallel() {
-    test_scheduler_basic_functionality_parallel<sweep_scheduler<message_type> >();
-    test_scheduler_basic_functionality_parallel<fifo_scheduler<message_type> >();
-    test_scheduler_basic_functionality_parallel<priority_scheduler<message_type> >();
-    test_scheduler_basic_functionality_parallel<queued_fifo_scheduler<message_type> >();
+
+  void test_locality_block_tasks() {
+    // after block_tasks updates the cpu moves on to the next block
+    graphlab_options opts;
+    opts.set_ncpus(1);
+    opts.get_scheduler_args().set_option("block_size", 16);
+    opts.get_scheduler_args().set_option("block_tasks", 4);
+    locality_scheduler sched(64, opts);
+    for (size_t i = 0; i < 64; ++i) sched.schedule(i);
+    const lvid_type expected[] = {0, 1, 2, 3, 16, 17, 18, 19,
+                                  32, 33, 34, 35, 48, 49, 50, 51, 4, 5};
+    lvid_type v;
+    for (size_t i = 0; i < sizeof(expected) / sizeof(lvid_type); ++i) {
+      TS_ASSERT_EQUALS(sched.get_next(0, v), sched_status::NEW_TASK);
+      TS_ASSERT_EQUALS(v, expected[i]);
+    }
   }
-  
-    
-  void test_scheduler_min_priority() {
-    test_scheduler_min_priority_parallel<sweep_scheduler<message_type> >();
-    test_scheduler_min_priority_parallel<fifo_scheduler<message_type> >();
-    test_scheduler_min_priority_parallel<priority_scheduler<message_type> >();
-    test_scheduler_min_priority_parallel<queued_fifo_scheduler<message_type> >();
+
+  void test_locality_reschedule_in_block() {
+    // a vertex rescheduled behind the cpu is picked up after wrapping
+    // around the block, and is returned only once
+    graphlab_options opts;
+    opts.set_ncpus(1);
+    opts.get_scheduler_args().set_option("block_size", 16);
+    locality_scheduler sched(16, opts);
+    for (size_t i = 0; i < 16; ++i) sched.schedule(i);
+    lvid_type v;
+    for (size_t i = 0; i < 8; ++i) sched.get_next(0, v);
+    TS_ASSERT_EQUALS(v, 7);
+    sched.schedule(2);
+    sched.schedule(2);
+    for (size_t i = 8; i < 16; ++i) {
+      TS_ASSERT_EQUALS(sched.get_next(0, v), sched_status::NEW_TASK);
+      TS_ASSERT_EQUALS(v, i);
+    }
+    TS_ASSERT_EQUALS(sched.get_next(0, v), sched_status::NEW_TASK);
+    TS_ASSERT_EQUALS(v, 2);
+    TS_ASSERT_EQUALS(sched.get_next(0, v), sched_status::EMPTY);
   }
 
+  void test_locality_home_range() {
+    // each cpu starts in its own range of blocks and steals the rest
+    graphlab_options opts;
+    opts.set_ncpus(2);
+    opts.get_scheduler_args().set_option("block_size", 16);
+    locality_scheduler sched(64, opts);
+    for (size_t i = 0; i < 64; ++i) sched.schedule(i);
+    lvid_type v;
+    TS_ASSERT_EQUALS(sched.get_next(1, v), sched_status::NEW_TASK);
+    TS_ASSERT_EQUALS(v, 32);
+    TS_ASSERT_EQUALS(sched.get_next(0, v), sched_status::NEW_TASK);
+    TS_ASSERT_EQUALS(v, 0);
+    // cpu 1 keeps block 2 claimed, so cpu 0 drains its own range and then
+    // steals block 3
+    for (size_t i = 1; i < 32; ++i) {
+      TS_ASSERT_EQUALS(sched.get_next(0, v), sched_status::NEW_TASK);
+      TS_ASSERT_EQUALS(v, i);
+    }
+    TS_ASSERT_EQUALS(sched.get_next(0, v), sched_status::NEW_TASK);
+    TS_ASSERT_EQUALS(v, 48);
+  }
 };
 
@@ -22,6 +22,7 @@
 
 
 #include <fstream>
+#include <sstream>
 #include <vector>
 #include <map>
 #include <string>
@@ -414,5 +415,35 @@ public:
         TS_ASSERT_EQUALS(p1[i].x, p2[i].x);
     }
   }
+  void test_varint(void) {
+    std::vector<uint64_t> values;
+    for (size_t i = 0; i < 64; ++i) {
+      values.push_back(uint64_t(1) << i);
+      values.push_back((uint64_t(1) << i) - 1);
+    }
+    values.push_back(uint64_t(-1));
+    std::stringstream strm;
+    oarchive a(strm);
+    for (size_t i = 0; i < values.size(); ++i) serialize_varint(a, values[i]);
+    a << std::string("end");
+    strm.flush();
+
+    iarchive b(strm);
+    for (size_t i = 0; i < values.size(); ++i) {
+      uint64_t v;
+      deserialize_varint(b, v);
+      TS_ASSERT_EQUALS(values[i], v);
+    }
+    std::string end;
+    b >> end;
+    TS_ASSERT_EQUALS(end, "end");
+
+    // small values take a single byte
+    std::stringstream strm2;
+    oarchive c(strm2);
+    serialize_varint(c, 127);
+    strm2.flush();
+    TS_ASSERT_EQUALS(strm2.str().length(), 1);
+  }
 };
 
@@ -0,0 +1,111 @@
+/*  
+ * Copyright (c) 2009 Carnegie Mellon University. 
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include <sstream>
+#include <graphlab/util/hyperloglog.hpp>
+#include <graphlab/util/count_min_sketch.hpp>
+#include <graphlab/util/t_digest.hpp>
+#include <graphlab/serialization/serialization_includes.hpp>
+
+using namespace graphlab;
+
+class SketchTestSuite: public CxxTest::TestSuite {
+ public:
+  template <typename T>
+  T round_trip(const T& t) {
+    std::stringstream strm;
+    oarchive oarc(strm);
+    oarc << t;
+    strm.flush();
+    iarchive iarc(strm);
+    T ret;
+    iarc >> ret;
+    return ret;
+  }
+
+  void test_hyperloglog() {
+    hyperloglog<> empty;
+    TS_ASSERT_EQUALS(empty.estimate(), 0);
+    // [0, 100000) and [50000, 150000) in two sketches, each value twice
+    hyperloglog<> a, b;
+    for (size_t round = 0; round < 2; ++round) {
+      for (uint64_t i = 0; i < 100000; ++i) {
+        a.add(i);
+        b.add(i + 50000);
+      }
+    }
+    TS_ASSERT_DELTA(a.estimate(), 100000, 5000);
+    a += round_trip(b);
+    TS_ASSERT_DELTA(a.estimate(), 150000, 7500);
+    // small cardinalities use linear counting
+    hyperloglog<> small;
+    for (uint64_t i = 0; i < 100; ++i) small.add(i * 7919);
+    TS_ASSERT_DELTA(small.estimate(), 100, 5);
+  }
+
+  void test_count_min_sketch() {
+    count_min_sketch<> a, b;
+    // key i is added i times, half in each sketch
+    for (uint64_t i = 0; i < 1000; ++i) {
+      a.add(i, (uint32_t)(i / 2));
+      b.add(i, (uint32_t)(i - i / 2));
+    }
+    a += round_trip(b);
+    TS_ASSERT_EQUALS(a.total(), 999 * 1000 / 2);
+    // the error bound may be exceeded with probability 2^-4
+    size_t nexceeded = 0;
+    for (uint64_t i = 0; i < 1000; ++i) {
+      const uint32_t est = a.estimate(i);
+      TS_ASSERT_LESS_THAN_EQUALS(i, est);
+      nexceeded += (est > i + 2 * a.total() / 2048);
+    }
+    TS_ASSERT_LESS_THAN_EQUALS(nexceeded, 1000 / 16);
+  }
+
+  void test_t_digest() {
+    t_digest empty;
+    TS_ASSERT(std::isnan(empty.quantile(0.5)));
+    // the values 0 ... 99999 split over two digests in a shuffled order
+    t_digest a, b;
+    for (size_t i = 0; i < 100000; ++i) {
+      const double value = (double)((i * 7919) % 100000);
+      if (i % 2) a.add(value);
+      else b.add(value);
+    }
+    a += round_trip(b);
+    TS_ASSERT_EQUALS(a.total(), 100000);
+    TS_ASSERT_EQUALS(a.min(), 0);
+    TS_ASSERT_EQUALS(a.max(), 99999);
+    TS_ASSERT_LESS_THAN_EQUALS(a.size(), 200);
+    TS_ASSERT_DELTA(a.quantile(0.5), 50000, 500);
+    TS_ASSERT_DELTA(a.quantile(0.99), 99000, 100);
+    TS_ASSERT_DELTA(a.quantile(0.001), 100, 50);
+    TS_ASSERT_DELTA(a.cdf(25000), 0.25, 0.005);
+    TS_ASSERT_EQUALS(a.quantile(0), 0);
+    TS_ASSERT_EQUALS(a.quantile(1), 99999);
+  }
+};
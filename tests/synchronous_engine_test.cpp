@@ -23,11 +23,15 @@
 #include <vector>
 #include <algorithm>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
 
 
 // #include <cxxtest/TestSuite.h>
 
 #include <graphlab.hpp>
+#include <graphlab/util/fs_util.hpp>
 
 typedef graphlab::distributed_graph<int,int> graph_type;
 
@@ -184,6 +188,55 @@ void test_all_neighbors(graphlab::distributed_control& dc,
 
 
 
+/**
+ * Counts the in neighbors while the out neighbors keep signaling the
+ * vertex, so that messages arrive while its gather is still running.
+ */
+class count_in_neighbors_resignal : 
+  public graphlab::ivertex_program<graph_type, int>,
+  public graphlab::IS_POD_TYPE {
+public:
+  edge_dir_type 
+  gather_edges(icontext_type& context, const vertex_type& vertex) const {
+    return graphlab::IN_EDGES;
+  }
+  gather_type 
+  gather(icontext_type& context, const vertex_type& vertex, 
+         edge_type& edge) const {
+    return 1;
+  }
+  void apply(icontext_type& context, vertex_type& vertex, 
+             const gather_type& total) {
+    ASSERT_EQ( total, int(vertex.num_in_edges()) );
+  }
+  edge_dir_type 
+  scatter_edges(icontext_type& context, const vertex_type& vertex) const {
+    return graphlab::OUT_EDGES;
+  }
+  void scatter(icontext_type& context, const vertex_type& vertex, 
+               edge_type& edge) const {
+    context.signal(edge.target());
+  }
+}; // end of count_in_neighbors_resignal
+
+void test_in_neighbors_resignal(graphlab::distributed_control& dc,
+                                graphlab::command_line_options& clopts,
+                                graph_type& graph) {
+  std::cout << "Constructing a syncrhonous engine for re-signaled in neighbors"
+            << std::endl;
+  typedef graphlab::synchronous_engine<count_in_neighbors_resignal> engine_type;
+  engine_type engine(dc, graph, clopts);
+  std::cout << "Scheduling all vertices to count their neighbors" << std::endl;
+  engine.signal_all();
+  std::cout << "Running!" << std::endl;
+  engine.start();
+  std::cout << "Finished" << std::endl;
+  ASSERT_GT(engine.num_updates(), graph.num_vertices());
+}
+
+
+
+
 class basic_messages : 
   public graphlab::ivertex_program<graph_type, int, int>,
   public graphlab::IS_POD_TYPE {
@@ -316,6 +369,91 @@ void test_count_aggregators(graphlab::distributed_control& dc,
 }
 
 
+// Removes the base, delta and latest files of the snapshots at path
+void remove_snapshot_files(graphlab::distributed_control& dc,
+                           const std::string& path) {
+  dc.barrier();
+  std::vector<std::string> files;
+  graphlab::fs_util::list_files_with_prefix(".", path, files);
+  for (size_t i = 0; i < files.size(); ++i) unlink(files[i].c_str());
+  dc.barrier();
+}
+
+void test_snapshot_resume(graphlab::distributed_control& dc,
+                          graphlab::command_line_options& clopts) {
+  std::cout << "Testing incremental snapshots" << std::endl;
+  typedef graphlab::synchronous_engine<count_aggregators> engine_type;
+  const std::string path = "synchronous_engine_test_snapshot_";
+  graph_type graph(dc, clopts);
+  graph.load_synthetic_powerlaw(10000);
+  graph.finalize();
+  {
+    // stops after 7 iterations, with deltas after 2, 4 and 6, so the
+    // background writer runs several times in one engine
+    graphlab::command_line_options snap_clopts = clopts;
+    snap_clopts.engine_args.set_option("max_iterations", 7);
+    snap_clopts.engine_args.set_option("snapshot_interval", 2);
+    snap_clopts.engine_args.set_option("snapshot_path", path);
+    engine_type engine(dc, graph, snap_clopts);
+    engine.signal_all();
+    engine.start();
+  }
+  {
+    // the last delta of the run was committed
+    std::stringstream fname;
+    fname << path << "latest_" << dc.procid();
+    std::ifstream fin(fname.str().c_str());
+    size_t latest = 0;
+    fin >> latest;
+    ASSERT_EQ(latest, 6);
+  }
+  // count_aggregators::apply checks that the vertex data is restored
+  graph_type resumed_graph(dc, clopts);
+  resumed_graph.load_binary(path + "base_");
+  graphlab::command_line_options resume_clopts = clopts;
+  resume_clopts.engine_args.set_option("snapshot_resume", true);
+  resume_clopts.engine_args.set_option("snapshot_path", path);
+  engine_type engine(dc, resumed_graph, resume_clopts);
+  engine.start();
+  std::cout << "Resumed and finished at iteration " << engine.iteration()
+            << std::endl;
+  ASSERT_EQ(engine.iteration(), 10);
+  remove_snapshot_files(dc, path);
+}
+
+
+
+
+void test_profile(graphlab::distributed_control& dc,
+                  graphlab::command_line_options& clopts,
+                  graph_type& graph) {
+  std::cout << "Writing the engine profile" << std::endl;
+  graphlab::command_line_options profile_clopts = clopts;
+  const std::string fname = "synchronous_engine_test_profile.json";
+  profile_clopts.engine_args.set_option("profile_file", fname);
+  typedef graphlab::synchronous_engine<count_out_neighbors> engine_type;
+  engine_type engine(dc, graph, profile_clopts);
+  engine.signal_all();
+  engine.start();
+  if (dc.procid() == 0) {
+    std::ifstream fin(fname.c_str());
+    std::stringstream strm;
+    strm << fin.rdbuf();
+    const std::string json = strm.str();
+    // one record per machine and per iteration
+    for (size_t i = 0; i < dc.numprocs(); ++i) {
+      std::stringstream procid;
+      procid << "\"procid\": " << i << ",";
+      ASSERT_NE(json.find(procid.str()), std::string::npos);
+    }
+    ASSERT_NE(json.find("\"iteration\": 9,"), std::string::npos);
+    ASSERT_EQ(json.find("\"iteration\": 10,"), std::string::npos);
+    ASSERT_NE(json.find("\"gather\": {\"wall_time\""), std::string::npos);
+    ASSERT_NE(json.find("\"thread_barrier_wait\": ["), std::string::npos);
+    unlink(fname.c_str());
+  }
+  dc.barrier();
+}
 
 
 int main(int argc, char** argv) {
@@ -336,6 +474,29 @@ int main(int argc, char** argv) {
   test_all_neighbors(dc, clopts, graph);
   test_messages(dc, clopts, graph);
   test_count_aggregators(dc, clopts, graph);
+  test_snapshot_resume(dc, clopts);
+  test_profile(dc, clopts, graph);
+
+  // Gathers are still complete in stale-synchronous mode, but messages
+  // may arrive late so test_messages does not apply.
+  std::cout << "Stale-synchronous mode" << std::endl;
+  graphlab::command_line_options ssp_clopts = clopts;
+  ssp_clopts.engine_args.set_option("staleness", 2);
+  test_in_neighbors(dc, ssp_clopts, graph);
+  test_out_neighbors(dc, ssp_clopts, graph);
+  test_all_neighbors(dc, ssp_clopts, graph);
+  test_in_neighbors_resignal(dc, ssp_clopts, graph);
+
+  std::cout << "Creating a NUMA partitioned powerlaw graph" << std::endl;
+  graphlab::command_line_options numa_clopts = clopts;
+  numa_clopts.graph_args.set_option("numa", true);
+  graph_type numa_graph(dc, numa_clopts);
+  numa_graph.load_synthetic_powerlaw(10000);
+  numa_graph.finalize();
+  test_in_neighbors(dc, numa_clopts, numa_graph);
+  test_out_neighbors(dc, numa_clopts, numa_graph);
+  test_all_neighbors(dc, numa_clopts, numa_graph);
+  test_messages(dc, numa_clopts, numa_graph);
 
   graphlab::mpi_tools::finalize();
 } // end of main
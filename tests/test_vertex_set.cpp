@@ -62,6 +62,41 @@ int vertex_data_identity(graph_type::vertex_type vtx) {
   return vtx.data();
 }
 
+#if defined(__cplusplus) && __cplusplus >= 201103L
+graphlab::reduction<graphlab::count_op> count_div_6(graph_type::vertex_type vtx) {
+  return (vtx.id() % 6) == 0;
+}
+
+graphlab::reduction<graphlab::max_op<graphlab::vertex_id_type> >
+max_vid(graph_type::vertex_type vtx) {
+  return vtx.id();
+}
+
+int data_identity(const int& data) {
+  return data;
+}
+
+int data_times_three(const int& data) {
+  return 3 * data;
+}
+
+graphlab::reduction<graphlab::count_op> count_nonzero(graph_type::vertex_type vtx) {
+  return 3 * vtx.data();
+}
+
+double data_halved(const int& data) {
+  return 0.5 * data;
+}
+
+graphlab::reduction<graphlab::count_op> count_halved(graph_type::vertex_type vtx) {
+  return 0.5 * vtx.data();
+}
+
+size_t edge_one(const int& data) {
+  return 1;
+}
+#endif
+
 
 
 int main(int argc, char** argv) {
@@ -128,6 +163,41 @@ int main(int argc, char** argv) {
   size_t total = graph.map_reduce_vertices<size_t>(vertex_data_identity, out_deg_one);
   ASSERT_EQ(total, graph.vertex_set_size(out_deg_one)); 
 
+#if defined(__cplusplus) && __cplusplus >= 201103L
+  // test the fused and POD reductions
+  graphlab::reduction_tuple<int,
+                            graphlab::reduction<graphlab::count_op>,
+                            graphlab::reduction<graphlab::max_op<graphlab::vertex_id_type> > >
+    fused = graph.map_reduce_vertices_fused(out_deg_one, vertex_data_identity,
+                                            count_div_6, max_vid);
+  ASSERT_EQ((size_t)fused.get<0>(), total);
+  ASSERT_EQ(fused.get<1>().value,
+            graph.map_reduce_vertices<size_t>(boost::bind(is_divisible, _1, 6),
+                                              out_deg_one));
+  ASSERT_EQ(graph.reduce_vertex_data<graphlab::sum_op<size_t> >(data_identity,
+                                                                 out_deg_one),
+            total);
+  ASSERT_EQ(graph.reduce_vertex_data<graphlab::count_op>(data_identity),
+            total);
+  // count_op counts non-zero values, whatever their magnitude
+  ASSERT_EQ(graph.reduce_vertex_data<graphlab::count_op>(data_times_three),
+            total);
+  ASSERT_EQ(graph.map_reduce_vertices<graphlab::reduction<graphlab::count_op> >(
+                count_nonzero).value,
+            total);
+  // and compares them before converting them, so 0.5 is counted
+  ASSERT_EQ(graph.reduce_vertex_data<graphlab::count_op>(data_halved), total);
+  ASSERT_EQ(graph.map_reduce_vertices<graphlab::reduction<graphlab::count_op> >(
+                count_halved).value,
+            total);
+  ASSERT_EQ(graph.reduce_edge_data<graphlab::sum_op<size_t> >(edge_one),
+            graph.num_edges());
+  ASSERT_EQ(graph.map_reduce_edges_fused(graph.complete_set(),
+                                         graphlab::IN_EDGES,
+                                         count_edges).get<0>(),
+            graph.num_edges());
+#endif
+
   // test neighborhood selection 
   // extract the set of out neighbors of out_deg_one 
   graphlab::vertex_set out_nbrs = graph.neighbors(out_deg_one, graphlab::OUT_EDGES);
@@ -0,0 +1,135 @@
+/*  
+ * Copyright (c) 2009 Carnegie Mellon University. 
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+#include <sstream>
+#include <graphlab/graph/vid2lvid_index.hpp>
+#include <graphlab/util/random.hpp>
+#include <graphlab/logger/assertions.hpp>
+
+using namespace graphlab;
+
+class Vid2LvidIndexTestSuite: public CxxTest::TestSuite {
+ public:
+  // inserts n vids spaced by stride, compacts, then inserts n more
+  void check_mode(vid2lvid_index::mode_type mode, size_t stride,
+                  vid2lvid_index::mode_type expected) {
+    vid2lvid_index index;
+    index.set_mode(mode);
+    const size_t n = 10000;
+    for (size_t i = 0; i < n; ++i) index[i * stride + 5] = lvid_type(n - 1 - i);
+    index.compact();
+    TS_ASSERT_EQUALS(index.get_compact_mode(), expected);
+    TS_ASSERT_EQUALS(index.size(), n);
+    for (size_t i = n; i < 2 * n; ++i) index[i * stride + 5] = lvid_type(i);
+    TS_ASSERT_EQUALS(index.size(), 2 * n);
+    for (size_t round = 0; round < 2; ++round) {
+      for (size_t i = 0; i < 2 * n; ++i) {
+        vid2lvid_index::const_iterator iter = index.find(i * stride + 5);
+        TS_ASSERT(iter != index.end());
+        TS_ASSERT_EQUALS(iter->second, i < n ? lvid_type(n - 1 - i) : lvid_type(i));
+        if (stride > 1) TS_ASSERT(index.find(i * stride + 6) == index.end());
+      }
+      TS_ASSERT(index.find(0) == index.end());
+      TS_ASSERT(index.find(2 * n * stride + 5) == index.end());
+      // the second round looks up the recompacted index
+      index.compact();
+      TS_ASSERT_EQUALS(index.size(), 2 * n);
+    }
+  }
+
+  void test_modes() {
+    check_mode(vid2lvid_index::HASH, 3, vid2lvid_index::HASH);
+    check_mode(vid2lvid_index::DENSE, 3, vid2lvid_index::DENSE);
+    // too sparse for an array
+    check_mode(vid2lvid_index::DENSE, 1000003, vid2lvid_index::SORTED);
+    check_mode(vid2lvid_index::SORTED, 3, vid2lvid_index::SORTED);
+    check_mode(vid2lvid_index::AUTO, 1, vid2lvid_index::DENSE);
+    check_mode(vid2lvid_index::AUTO, 1000003, vid2lvid_index::SORTED);
+  }
+
+  void test_random_sorted() {
+    vid2lvid_index index;
+    index.set_mode(vid2lvid_index::SORTED);
+    std::vector<vertex_id_type> vids;
+    for (size_t i = 0; i < 50000; ++i) {
+      vertex_id_type vid = random::fast_uniform<vertex_id_type>(0, vertex_id_type(-2));
+      if (index.count(vid)) continue;
+      index[vid] = lvid_type(vids.size());
+      vids.push_back(vid);
+    }
+    index.compact();
+    for (size_t i = 0; i < vids.size(); ++i) {
+      TS_ASSERT_EQUALS(index.find(vids[i])->second, lvid_type(i));
+    }
+  }
+
+  void test_save_load() {
+    vid2lvid_index index;
+    index.set_mode(vid2lvid_index::AUTO);
+    for (size_t i = 0; i < 1000; ++i) index[2 * i] = lvid_type(i);
+    index.compact();
+    TS_ASSERT_EQUALS(index.get_compact_mode(), vid2lvid_index::DENSE);
+    std::stringstream strm;
+    oarchive oarc(strm);
+    oarc << index;
+    strm.flush();
+    // the loading index keeps its own mode
+    iarchive iarc(strm);
+    vid2lvid_index loaded;
+    loaded.set_mode(vid2lvid_index::SORTED);
+    iarc >> loaded;
+    TS_ASSERT_EQUALS(loaded.size(), 1000);
+    TS_ASSERT_EQUALS(loaded.get_compact_mode(), vid2lvid_index::SORTED);
+    for (size_t i = 0; i < 1000; ++i) {
+      TS_ASSERT_EQUALS(loaded.find(2 * i)->second, lvid_type(i));
+    }
+  }
+
+  // the serialized form is the same as that of a hopscotch_map
+  void test_hopscotch_map_format() {
+    vid2lvid_index::hash_map_type map;
+    for (size_t i = 0; i < 1000; ++i) map[3 * i] = lvid_type(i);
+    std::stringstream strm;
+    oarchive oarc(strm);
+    oarc << map;
+    strm.flush();
+    iarchive iarc(strm);
+    vid2lvid_index index;
+    index.set_mode(vid2lvid_index::AUTO);
+    iarc >> index;
+    TS_ASSERT_EQUALS(index.size(), 1000);
+    for (size_t i = 0; i < 1000; ++i) {
+      TS_ASSERT_EQUALS(index.find(3 * i)->second, lvid_type(i));
+    }
+
+    std::stringstream strm2;
+    oarchive oarc2(strm2);
+    oarc2 << index;
+    strm2.flush();
+    iarchive iarc2(strm2);
+    vid2lvid_index::hash_map_type map2;
+    iarc2 >> map2;
+    TS_ASSERT_EQUALS(map2.size(), 1000);
+    for (size_t i = 0; i < 1000; ++i) TS_ASSERT_EQUALS(map2[3 * i], lvid_type(i));
+  }
+};
@@ -34,7 +34,7 @@
 struct vdata {
   uint64_t labelid;
   vdata() :
-      labelid(0) {
+      labelid(std::numeric_limits<uint64_t>::max()) {
   }
 
   void save(graphlab::oarchive& oarc) const {
@@ -52,6 +52,12 @@ void initialize_vertex(graph_type::vertex_type& v) {
   v.data().labelid = v.id();
 }
 
+//set label id of the vertices created by a graph update
+void initialize_new_vertex(graph_type::vertex_type& v) {
+  if (v.data().labelid == std::numeric_limits<uint64_t>::max())
+    v.data().labelid = v.id();
+}
+
 //message where summation means minimum
 struct min_message {
   uint64_t value;
@@ -167,6 +173,12 @@ int main(int argc, char** argv) {
                        "If set, will save the pairs of a vertex id and "
                        "a component id to a sequence of files with prefix "
                        "saveprefix");
+  std::string delta_dir;
+  clopts.attach_option("delta", delta_dir,
+                       "If set, after the initial computation the edges in "
+                       "this location are added to the graph and the "
+                       "components are recomputed incrementally. Requires a "
+                       "dynamic graph (USE_DYNAMIC_LOCAL_GRAPH).");
   if (!clopts.parse(argc, argv)) {
     dc.cout() << "Error in parsing command line arguments." << std::endl;
     return EXIT_FAILURE;
@@ -193,6 +205,24 @@ int main(int argc, char** argv) {
   time(&start);
   engine.start();
 
+  //incremental update: components can only merge when edges are added, so
+  //only the changed vertices and their neighbors need to propagate labels
+  if (delta_dir.size() > 0) {
+    if (!graph.is_dynamic()) {
+      dc.cout() << "--delta requires a dynamic graph. Recompile with "
+                << "USE_DYNAMIC_LOCAL_GRAPH." << std::endl;
+      return EXIT_FAILURE;
+    }
+    dc.cout() << "Loading graph delta in format: "<< format << std::endl;
+    graph.load_format(delta_dir, format);
+    graph.finalize();
+    graph.transform_vertices(initialize_new_vertex, graph.changed_vertices());
+    engine.signal_changed(graphlab::ALL_EDGES);
+    engine.start();
+    dc.cout() << "Finished incremental update in " << engine.elapsed_seconds()
+              << " seconds." << std::endl;
+  }
+
   //write results
   if (saveprefix.size() > 0) {
     graph.save(saveprefix, graph_writer(),
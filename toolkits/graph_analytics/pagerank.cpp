@@ -51,6 +51,16 @@ typedef graphlab::distributed_graph<vertex_data_type, edge_data_type> graph_type
  */
 void init_vertex(graph_type::vertex_type &vertex) { vertex.data() = 1; }
 
+/*
+ * Initializes only the vertices created by a graph update. Pagerank
+ * values are never below RESET_PROB, so a zero value marks a new vertex.
+ */
+void init_new_vertex(graph_type::vertex_type &vertex)
+{
+  if (vertex.data() == 0)
+    vertex.data() = 1;
+}
+
 /*
  * The factorized page rank update function extends ivertex_program
  * specifying the:
@@ -239,6 +249,12 @@ int main(int argc, char **argv)
   clopts.attach_option("saveprefix", saveprefix,
                        "If set, will save the resultant pagerank to a "
                        "sequence of files with prefix saveprefix");
+  std::string delta_dir;
+  clopts.attach_option("delta", delta_dir,
+                       "If set, after the initial computation the edges in "
+                       "this location are added to the graph and the "
+                       "pagerank is recomputed incrementally. Requires a "
+                       "dynamic graph (USE_DYNAMIC_LOCAL_GRAPH).");
 
   if (!clopts.parse(argc, argv))
   {
@@ -298,6 +314,27 @@ int main(int argc, char **argv)
   dc.cout() << "Finished Running engine in " << runtime
             << " seconds." << std::endl;
 
+  // Incremental update ------------------------------------------------------
+  if (!delta_dir.empty())
+  {
+    if (!graph.is_dynamic())
+    {
+      dc.cout() << "--delta requires a dynamic graph. Recompile with "
+                << "USE_DYNAMIC_LOCAL_GRAPH." << std::endl;
+      return EXIT_FAILURE;
+    }
+    dc.cout() << "Loading graph delta in format: " << format << std::endl;
+    graph.load_format(delta_dir, format);
+    graph.finalize();
+    graph.transform_vertices(init_new_vertex, graph.changed_vertices());
+    // The rank of a changed vertex flows to its out neighbors, and their
+    // gather also changes when the out degree of a source changes.
+    engine.signal_changed(graphlab::OUT_EDGES);
+    engine.start();
+    dc.cout() << "Finished incremental update in " << engine.elapsed_seconds()
+              << " seconds." << std::endl;
+  }
+
   const double total_rank = graph.map_reduce_vertices<double>(map_rank);
   std::cout << "Total rank: " << total_rank << std::endl;
 
@@ -87,6 +87,9 @@ struct min_distance_type : graphlab::IS_POD_TYPE {
     dist = std::min(dist, other.dist);
     return *this;
   }
+  // Closer vertices first. Used by the priority schedulers; the "bucket"
+  // scheduler then behaves like delta-stepping.
+  double priority() const { return -double(dist); }
 };
 
 